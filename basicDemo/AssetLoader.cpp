@@ -0,0 +1,98 @@
+#include "AssetLoader.h"
+#include <algorithm>
+#include <chrono>
+
+AssetLoader * AssetLoader::mInstance = NULL;
+
+AssetLoader * AssetLoader::Instance()
+{
+	if (!mInstance)   // Only allow one instance of class to be generated.
+		mInstance = new AssetLoader();
+
+	return mInstance;
+}
+
+AssetLoader::AssetLoader()
+	: pool(nullptr), numPending(0), uploadSeconds(0.0)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+	delete pool;
+}
+
+void AssetLoader::Start(unsigned int numThreads)
+{
+	if (pool)
+		return;
+
+	// The GL thread keeps one core for itself
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency() - 1);
+
+	pool = new ThreadPool(numThreads);
+}
+
+void AssetLoader::Submit(std::function<bool()> work, std::function<void(bool)> upload)
+{
+	Start();
+	numPending++;
+
+	pool->Submit([this, work, upload]() {
+		bool succeeded = work();
+
+		std::lock_guard<std::mutex> lock(uploadMutex);
+		Upload finished = { upload, succeeded };
+		uploads.push_back(finished);
+	});
+}
+
+unsigned int AssetLoader::ProcessUploads(double budgetMilliseconds)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned int numUploads = 0;
+
+	for (;;)
+	{
+		Upload next;
+		{
+			std::lock_guard<std::mutex> lock(uploadMutex);
+			if (uploads.empty())
+				break;
+			next = uploads.front();
+			uploads.pop_front();
+		}
+
+		next.upload(next.succeeded);
+		numPending--;
+		numUploads++;
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed >= budgetMilliseconds)
+			break;
+	}
+
+	uploadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return numUploads;
+}
+
+void AssetLoader::Finish()
+{
+	while (numPending > 0)
+	{
+		if (pool)
+			pool->Wait();
+		ProcessUploads(1e9);
+	}
+}
+
+size_t AssetLoader::GetNumPending()
+{
+	return numPending;
+}
+
+double AssetLoader::GetUploadSeconds()
+{
+	return uploadSeconds;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include "ThreadPool.h"
+
+//Singleton asynchronous asset loader
+
+/**
+* Runs the CPU half of asset loads (file parsing, image decoding) on a thread pool.
+* Each finished job leaves its GPU half on a queue that the GL thread drains with ProcessUploads,
+* a few uploads per frame so the window keeps drawing while assets stream in.
+*/
+class AssetLoader
+{
+private:
+	static AssetLoader * mInstance; //Holds the instance of the class
+
+	struct Upload {
+		std::function<void(bool)> upload;
+		bool succeeded;
+	};
+
+	ThreadPool* pool;
+	std::deque<Upload> uploads;
+	std::mutex uploadMutex;
+	// Jobs submitted whose upload did not run yet, only touched by the GL thread
+	size_t numPending;
+	// Time spent in uploads, for the startup report
+	double uploadSeconds;
+
+	AssetLoader();
+
+public:
+	static AssetLoader * Instance();
+
+	~AssetLoader();
+
+	/**
+	* Sets the number of worker threads, it has to be called before the first Submit
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread but one
+	*/
+	void Start(unsigned int numThreads = 0);
+
+	/**
+	* Queues an asset load, has to be called on the GL thread
+	* @param{std::function<bool()>} CPU work run on a worker thread, returns false on failure
+	* @param{std::function<void(bool)>} GL work run by ProcessUploads with the result of the CPU work
+	*/
+	void Submit(std::function<bool()> work, std::function<void(bool)> upload);
+
+	/**
+	* Runs finished uploads on the GL thread until the time budget is spent.
+	* At least one upload runs per call, so a single large asset can not stall the queue.
+	* @param{double} Time budget in milliseconds
+	* @returns{unsigned int} Number of uploads run
+	*/
+	unsigned int ProcessUploads(double budgetMilliseconds);
+
+	/**
+	* Blocks until every submitted asset is loaded and uploaded
+	*/
+	void Finish();
+
+	/**
+	* Number of assets submitted and not uploaded yet
+	*/
+	size_t GetNumPending();
+
+	double GetUploadSeconds();
+};
@@ -0,0 +1,33 @@
+#include "Frustum.h"
+
+Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+{
+	// Gribb and Hartmann: each plane is the last row of the matrix plus or minus one of the others
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = row[3] + row[0];
+	frustum.planes[1] = row[3] - row[0];
+	frustum.planes[2] = row[3] + row[1];
+	frustum.planes[3] = row[3] - row[1];
+	frustum.planes[4] = row[3] + row[2];
+	frustum.planes[5] = row[3] - row[2];
+
+	// Normalized planes give true distances, which sphere tests need
+	for (int i = 0; i < 6; i++)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+	return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
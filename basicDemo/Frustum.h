@@ -0,0 +1,22 @@
+#pragma once
+#include <glm/glm.hpp>
+
+/**
+* View frustum as six planes pointing inwards, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+*/
+struct Frustum {
+	glm::vec4 planes[6];
+
+	/**
+	* Extracts the planes of a projection * view matrix, in world space
+	* @param{const glm::mat4 &} View projection matrix
+	*/
+	static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+	/**
+	* true if a sphere is at least partially inside the frustum
+	* @param{const glm::vec3 &} Center of the sphere
+	* @param{float} Radius of the sphere
+	*/
+	bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
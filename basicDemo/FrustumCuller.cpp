@@ -0,0 +1,152 @@
+#include "FrustumCuller.h"
+
+#if !defined(FRUSTUM_CULLER_NO_SIMD) && defined(__AVX__)
+#define FRUSTUM_CULLER_AVX 1
+#include <immintrin.h>
+#elif !defined(FRUSTUM_CULLER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FRUSTUM_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	/**
+	* Appends the lanes set in a visibility mask, without a branch per lane
+	*/
+	inline size_t AppendVisible(int mask, int numLanes, uint32_t first, uint32_t* out, size_t numVisible)
+	{
+		for (int lane = 0; lane < numLanes; lane++) {
+			out[numVisible] = first + lane;
+			numVisible += (mask >> lane) & 1;
+		}
+		return numVisible;
+	}
+}
+
+FrustumCuller::FrustumCuller()
+{
+}
+
+void FrustumCuller::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+}
+
+void FrustumCuller::Reserve(size_t numSpheres)
+{
+	centerX.reserve(numSpheres);
+	centerY.reserve(numSpheres);
+	centerZ.reserve(numSpheres);
+	radius.reserve(numSpheres);
+}
+
+void FrustumCuller::Add(const glm::vec4& sphere)
+{
+	centerX.push_back(sphere.x);
+	centerY.push_back(sphere.y);
+	centerZ.push_back(sphere.z);
+	radius.push_back(sphere.w);
+}
+
+size_t FrustumCuller::GetNumSpheres() const
+{
+	return radius.size();
+}
+
+size_t FrustumCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	size_t numSpheres = radius.size();
+	// Every index is written, the count only advances past the visible ones.
+	// Resizing down and up again would zero the whole buffer on every call
+	if (visible.size() < numSpheres + 8)
+		visible.resize(numSpheres + 8);
+	uint32_t* out = visible.data();
+	size_t numVisible = 0;
+	size_t i = 0;
+
+#if defined(FRUSTUM_CULLER_AVX)
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+	for (; i + 8 <= numSpheres; i += 8) {
+		__m256 x = _mm256_loadu_ps(&centerX[i]);
+		__m256 y = _mm256_loadu_ps(&centerY[i]);
+		__m256 z = _mm256_loadu_ps(&centerZ[i]);
+		__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&radius[i]), signMask);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+				_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+		// Most groups are entirely outside, they skip the compaction
+		int mask = _mm256_movemask_ps(inside);
+		if (mask != 0)
+			numVisible = AppendVisible(mask, 8, (uint32_t)i, out, numVisible);
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (; i + 4 <= numSpheres; i += 4) {
+		__m128 x = _mm_loadu_ps(&centerX[i]);
+		__m128 y = _mm_loadu_ps(&centerY[i]);
+		__m128 z = _mm_loadu_ps(&centerZ[i]);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&radius[i]), signMask);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+		// Most groups are entirely outside, they skip the compaction
+		int mask = _mm_movemask_ps(inside);
+		if (mask != 0)
+			numVisible = AppendVisible(mask, 4, (uint32_t)i, out, numVisible);
+	}
+#endif
+
+	// The spheres left over after the last full register
+	for (; i < numSpheres; i++) {
+		out[numVisible] = (uint32_t)i;
+		numVisible += frustum.IntersectsSphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i]) ? 1 : 0;
+	}
+
+	return numVisible;
+}
+
+size_t FrustumCuller::CullScalar(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+	for (size_t i = 0; i < radius.size(); i++)
+		if (frustum.IntersectsSphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i]))
+			visible.push_back((uint32_t)i);
+	return visible.size();
+}
+
+const char* FrustumCuller::GetSimdName()
+{
+#if defined(FRUSTUM_CULLER_AVX)
+	return "AVX";
+#elif defined(FRUSTUM_CULLER_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+/**
+* Bounding spheres of many models, kept as separate x, y, z and radius arrays so the frustum planes
+* are tested against eight spheres at a time with AVX, or four with SSE.
+* Defining FRUSTUM_CULLER_NO_SIMD compiles the scalar test only.
+*/
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	/**
+	* Removes every sphere
+	*/
+	void Clear();
+
+	/**
+	* Makes room for a number of spheres
+	* @param{size_t} Number of spheres
+	*/
+	void Reserve(size_t numSpheres);
+
+	/**
+	* Adds a sphere, its index is the number of spheres added before it
+	* @param{const glm::vec4 &} Center in xyz, radius in w
+	*/
+	void Add(const glm::vec4& sphere);
+
+	size_t GetNumSpheres() const;
+
+	/**
+	* Tests every sphere against the frustum
+	* @param{const Frustum &} Frustum with normalized planes
+	* @param{std::vector<uint32_t> &} Its first entries are set to the indices of the spheres at least partially inside, in increasing order.
+	* It is only grown, never cleared or shrunk, so a buffer kept across calls is written in place
+	* @returns{size_t} Number of visible spheres, the entries of visible past it are scratch
+	*/
+	size_t Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	/**
+	* Same test one sphere at a time with Frustum::IntersectsSphere, the reference for the SIMD path
+	*/
+	size_t CullScalar(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	/**
+	* Instruction set of Cull: AVX, SSE or scalar
+	*/
+	static const char* GetSimdName();
+
+private:
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+};
@@ -0,0 +1,99 @@
+#include "GBuffer.h"
+#include "GLState.h"
+#include <cstdio>
+
+const float GBuffer::MATERIAL_PARAMETER_RANGE = 64.0f;
+
+namespace {
+	void AllocateTexture(GLuint texture, GLint internalFormat, unsigned int width, unsigned int height, GLenum format, GLenum type)
+	{
+		GLState::BindTexture(0, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+		// Read texel by texel by the lighting pass
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+}
+
+GBuffer::GBuffer()
+	: framebuffer(0), albedoTexture(0), normalTexture(0), depthTexture(0), width(0), height(0)
+{
+	glGenFramebuffers(1, &framebuffer);
+	glGenTextures(1, &albedoTexture);
+	glGenTextures(1, &normalTexture);
+	glGenTextures(1, &depthTexture);
+}
+
+GBuffer::~GBuffer()
+{
+	GLState::DeleteTexture(albedoTexture);
+	GLState::DeleteTexture(normalTexture);
+	GLState::DeleteTexture(depthTexture);
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+bool GBuffer::Resize(unsigned int width, unsigned int height)
+{
+	// A minimized window has no pixels, the textures keep their size until it comes back
+	if ((width == this->width && height == this->height) || width == 0 || height == 0)
+		return true;
+	this->width = width;
+	this->height = height;
+
+	AllocateTexture(albedoTexture, GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE);
+	AllocateTexture(normalTexture, GL_RGBA16, width, height, GL_RGBA, GL_UNSIGNED_SHORT);
+	AllocateTexture(depthTexture, GL_DEPTH24_STENCIL8, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("G-buffer: framebuffer of %ux%u incomplete, status 0x%x\n", width, height, status);
+		return false;
+	}
+	return true;
+}
+
+void GBuffer::BeginGeometry()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	// Cleared buffer by buffer, the clear color of the window stays as it is.
+	// The lighting pass skips the pixels left at the cleared depth, their color does not matter
+	const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, zero);
+	glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+}
+
+void GBuffer::End()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GBuffer::BindTextures(GLuint albedoUnit, GLuint normalUnit, GLuint depthUnit)
+{
+	GLState::BindTexture(albedoUnit, albedoTexture);
+	GLState::BindTexture(normalUnit, normalTexture);
+	GLState::BindTexture(depthUnit, depthTexture);
+}
+
+void GBuffer::BlitDepth()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+size_t GBuffer::GetMemoryBytes() const
+{
+	return (size_t)width * height * BYTES_PER_PIXEL;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <glad/glad.h>
+
+/**
+* Framebuffer of the deferred geometry pass, twelve bytes per pixel next to the depth:
+*   albedo and material: RGBA8, albedo in rgb, the MaterialType of the surface in a (as material / 255)
+*   normal and parameters: RGBA16, octahedral world normal in rg, roughness (shininess for Blinn-Phong)
+*   in b and reflectance in a, both over MATERIAL_PARAMETER_RANGE
+*   depth: DEPTH24_STENCIL8, the format of the default framebuffer so it can be blitted back
+*/
+class GBuffer
+{
+public:
+	// Material parameters are stored in [0, 1] over this range, the one of the user interface sliders
+	static const float MATERIAL_PARAMETER_RANGE;
+	// Bytes of the color targets and the depth, per pixel
+	static const size_t BYTES_PER_PIXEL = 16;
+
+	/**
+	* Creates the framebuffer, the textures are allocated by the first Resize
+	*/
+	GBuffer();
+
+	/**
+	* Deletes the framebuffer and its textures, the GL context has to be alive
+	*/
+	~GBuffer();
+
+	/**
+	* Matches the size of the window, the textures are only allocated again when it changed and a size of zero keeps them
+	* @param{unsigned int} Width, in pixels
+	* @param{unsigned int} Height, in pixels
+	* @returns{bool} false if the framebuffer is incomplete
+	*/
+	bool Resize(unsigned int width, unsigned int height);
+
+	/**
+	* Binds the framebuffer and clears it, the draws that follow write the G-buffer
+	*/
+	void BeginGeometry();
+
+	/**
+	* Binds the default framebuffer back
+	*/
+	void End();
+
+	/**
+	* Binds the albedo, the normal and the depth textures for the lighting pass
+	* @param{GLuint} Texture unit of the albedo and material
+	* @param{GLuint} Texture unit of the normal and parameters
+	* @param{GLuint} Texture unit of the depth
+	*/
+	void BindTextures(GLuint albedoUnit, GLuint normalUnit, GLuint depthUnit);
+
+	/**
+	* Copies the depth to the default framebuffer, so forward draws after the lighting pass are hidden by the scene
+	*/
+	void BlitDepth();
+
+	size_t GetMemoryBytes() const;
+
+private:
+	GBuffer(const GBuffer&) = delete;
+	GBuffer& operator=(const GBuffer&) = delete;
+
+	GLuint framebuffer;
+	GLuint albedoTexture;
+	GLuint normalTexture;
+	GLuint depthTexture;
+	unsigned int width;
+	unsigned int height;
+};
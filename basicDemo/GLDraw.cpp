@@ -0,0 +1,265 @@
+#include "GLDraw.h"
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+DrawStats GLDraw::stats;
+
+namespace {
+	size_t GetIndexSize(GLenum type)
+	{
+		return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+	}
+
+	size_t GetNumPrimitives(GLenum mode, size_t count)
+	{
+		switch (mode) {
+		case GL_TRIANGLES:
+			return count / 3;
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			return count > 2 ? count - 2 : 0;
+		default:
+			return 0;
+		}
+	}
+
+#if defined(GL_DRAW_VALIDATION)
+	// Mismatches printed in full, the rest are only counted
+	const unsigned int MAX_REPORTS = 20;
+	unsigned int numReports = 0;
+
+	/**
+	* Size of a buffer object, through the copy target that GLState does not track
+	*/
+	GLint64 GetBufferSize(GLuint buffer)
+	{
+		GLint previous = 0;
+		// GL_COPY_READ_BUFFER_BINDING, the same enum, is missing from the loader header
+		glGetIntegerv(GL_COPY_READ_BUFFER, &previous);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		GLint64 size = 0;
+		glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+		glBindBuffer(GL_COPY_READ_BUFFER, (GLuint)previous);
+		return size;
+	}
+
+	/**
+	* Largest index of a range, read back from the element buffer
+	*/
+	GLuint GetMaxIndex(GLuint buffer, size_t first, GLsizei count, GLenum type)
+	{
+		static std::vector<unsigned char> indices;
+		indices.resize((size_t)count * GetIndexSize(type));
+
+		GLint previous = 0;
+		glGetIntegerv(GL_COPY_READ_BUFFER, &previous);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)first, (GLsizeiptr)indices.size(), indices.data());
+		glBindBuffer(GL_COPY_READ_BUFFER, (GLuint)previous);
+
+		GLuint maxIndex = 0;
+		for (GLsizei i = 0; i < count; i++) {
+			GLuint index = type == GL_UNSIGNED_BYTE ? indices[i]
+				: type == GL_UNSIGNED_SHORT ? ((const uint16_t*)indices.data())[i]
+				: ((const uint32_t*)indices.data())[i];
+			if (index > maxIndex)
+				maxIndex = index;
+		}
+		return maxIndex;
+	}
+
+	size_t GetComponentSize(GLenum type)
+	{
+		switch (type) {
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+#endif
+}
+
+void GLDraw::DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei numVertices)
+{
+#if defined(GL_DRAW_VALIDATION)
+	GLsizei numReferenced = 0;
+	if (!ValidateIndices("glDrawElements", count, type, indices, numVertices, numReferenced) ||
+		!ValidateAttributes("glDrawElements", numReferenced, 0)) {
+		stats.invalidDraws++;
+		return;
+	}
+#else
+	(void)numVertices;
+#endif
+	glDrawElements(mode, count, type, indices);
+	Count(mode, count, 1);
+}
+
+void GLDraw::DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei numInstances, GLsizei numVertices)
+{
+#if defined(GL_DRAW_VALIDATION)
+	GLsizei numReferenced = 0;
+	if (!ValidateIndices("glDrawElementsInstanced", count, type, indices, numVertices, numReferenced) ||
+		!ValidateAttributes("glDrawElementsInstanced", numReferenced, numInstances)) {
+		stats.invalidDraws++;
+		return;
+	}
+#else
+	(void)numVertices;
+#endif
+	glDrawElementsInstanced(mode, count, type, indices, numInstances);
+	Count(mode, count, numInstances);
+	stats.instances += numInstances;
+}
+
+void GLDraw::MultiDrawElements(GLenum mode, const GLsizei* counts, GLenum type, const void* const* indices, GLsizei drawCount, GLsizei numVertices)
+{
+#if defined(GL_DRAW_VALIDATION)
+	GLsizei numReferenced = 0;
+	bool valid = true;
+	for (GLsizei d = 0; d < drawCount && valid; d++)
+		valid = ValidateIndices("glMultiDrawElements", counts[d], type, indices[d], numVertices, numReferenced);
+	if (!valid || !ValidateAttributes("glMultiDrawElements", numReferenced, 0)) {
+		stats.invalidDraws++;
+		return;
+	}
+#else
+	(void)numVertices;
+#endif
+	glMultiDrawElements(mode, counts, type, indices, drawCount);
+	for (GLsizei d = 0; d < drawCount; d++) {
+		stats.vertices += counts[d];
+		stats.triangles += GetNumPrimitives(mode, counts[d]);
+	}
+	stats.ranges += drawCount;
+	stats.draws++;
+}
+
+void GLDraw::DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+#if defined(GL_DRAW_VALIDATION)
+	if (!ValidateAttributes("glDrawArrays", first + count, 0)) {
+		stats.invalidDraws++;
+		return;
+	}
+#endif
+	glDrawArrays(mode, first, count);
+	Count(mode, count, 1);
+}
+
+const DrawStats& GLDraw::GetStats()
+{
+	return stats;
+}
+
+void GLDraw::ResetStats()
+{
+	stats = DrawStats();
+}
+
+void GLDraw::Count(GLenum mode, size_t count, size_t numInstances)
+{
+	stats.draws++;
+	stats.ranges++;
+	stats.vertices += count * numInstances;
+	stats.triangles += GetNumPrimitives(mode, count) * numInstances;
+}
+
+#if defined(GL_DRAW_VALIDATION)
+bool GLDraw::ValidateIndices(const char* call, GLsizei count, GLenum type, const void* indices, GLsizei numVertices, GLsizei& numReferenced)
+{
+	GLint elementBuffer = 0;
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+	if (elementBuffer == 0) {
+		Report(call, "no element buffer bound to vertex array");
+		return false;
+	}
+
+	size_t first = (size_t)(uintptr_t)indices;
+	size_t end = first + (size_t)count * GetIndexSize(type);
+	GLint64 size = GetBufferSize((GLuint)elementBuffer);
+	if (count < 0 || first % GetIndexSize(type) != 0 || end > (size_t)size) {
+		Report(call, "indices [%zu, %zu) of element buffer %d, which holds %lld bytes", first, end, elementBuffer, (long long)size);
+		return false;
+	}
+	if (count == 0)
+		return true;
+
+	// The attributes are checked up to the vertex the indices really reach, not the count the caller expects
+	GLuint maxIndex = GetMaxIndex((GLuint)elementBuffer, first, count, type);
+	if ((numVertices > 0 && maxIndex >= (GLuint)numVertices) || maxIndex >= 0x7fffffffu) {
+		Report(call, "index %u in bytes [%zu, %zu) of element buffer %d, the mesh has %d vertices", maxIndex, first, end, elementBuffer, numVertices);
+		return false;
+	}
+	if ((GLsizei)maxIndex + 1 > numReferenced)
+		numReferenced = (GLsizei)maxIndex + 1;
+	return true;
+}
+
+bool GLDraw::ValidateAttributes(const char* call, GLsizei numVertices, GLsizei numInstances)
+{
+	static GLint maxAttributes = 0;
+	if (maxAttributes == 0)
+		glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes);
+
+	for (GLint attribute = 0; attribute < maxAttributes; attribute++) {
+
+		GLint enabled = 0;
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+		if (!enabled)
+			continue;
+
+		GLint buffer = 0, components = 0, type = 0, stride = 0, divisor = 0;
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_SIZE, &components);
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &divisor);
+		void* pointer = nullptr;
+		glGetVertexAttribPointerv(attribute, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+
+		// Elements of the attribute the draw reads
+		size_t numElements = divisor == 0 ? (size_t)numVertices : ((size_t)numInstances + divisor - 1) / divisor;
+		if (numElements == 0)
+			continue;
+		if (buffer == 0) {
+			Report(call, "attribute %d is enabled without a buffer", attribute);
+			return false;
+		}
+
+		// Packed formats hold every component in 4 bytes
+		size_t elementSize = type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV ? 4 : components * GetComponentSize(type);
+		size_t step = stride != 0 ? (size_t)stride : elementSize;
+		size_t end = (size_t)(uintptr_t)pointer + (numElements - 1) * step + elementSize;
+		GLint64 size = GetBufferSize((GLuint)buffer);
+		if (end > (size_t)size) {
+			Report(call, "attribute %d reads %zu %s up to byte %zu of buffer %d, which holds %lld bytes", attribute, numElements,
+				divisor == 0 ? "vertices" : "instances", end, buffer, (long long)size);
+			return false;
+		}
+	}
+	return true;
+}
+
+void GLDraw::Report(const char* call, const char* format, ...)
+{
+	if (numReports >= MAX_REPORTS)
+		return;
+	numReports++;
+
+	va_list arguments;
+	va_start(arguments, format);
+	printf("Draw validation: %s skipped, ", call);
+	vprintf(format, arguments);
+	printf(numReports == MAX_REPORTS ? "; further mismatches are only counted\n" : "\n");
+	va_end(arguments);
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <glad/glad.h>
+
+/**
+* Work submitted by the draws since the last reset
+*/
+struct DrawStats {
+	// API calls, a multi draw counts once
+	unsigned int draws = 0;
+	// Ranges of the multi draws, and instances of the instanced draws
+	size_t ranges = 0;
+	size_t instances = 0;
+	// Vertices the GPU runs the vertex shader for, before the post transform cache
+	size_t vertices = 0;
+	size_t triangles = 0;
+	// Draws the validation found out of their buffers, they were not issued
+	unsigned int invalidDraws = 0;
+};
+
+/**
+* Every draw of the demo goes through here, so the frame counters match what was submitted.
+* Defining GL_DRAW_VALIDATION checks each draw against the buffers bound to the vertex array before issuing it:
+* the index range has to fit the element buffer, the largest index it holds has to be below the vertex count of the mesh,
+* and the vertices up to that index and the instances have to fit the buffers of the enabled attributes.
+* A draw that does not is reported and skipped.
+* The Debug configurations define it, the checks read the indices back and stall the pipeline.
+*/
+class GLDraw
+{
+public:
+	/**
+	* glDrawElements
+	* @param{GLenum} Primitive mode
+	* @param{GLsizei} Number of indices
+	* @param{GLenum} Index type
+	* @param{const void *} Byte offset of the first index in the element buffer
+	* @param{GLsizei} Vertices of the mesh, every index has to be below it; 0 skips the check
+	*/
+	static void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei numVertices = 0);
+
+	/**
+	* glDrawElementsInstanced, same parameters as DrawElements
+	* @param{GLsizei} Number of instances, checked against the buffers of the attributes with a divisor
+	*/
+	static void DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei numInstances, GLsizei numVertices = 0);
+
+	/**
+	* glMultiDrawElements, every range is checked
+	* @param{GLenum} Primitive mode
+	* @param{const GLsizei *} Number of indices of each range
+	* @param{GLenum} Index type
+	* @param{const void * const *} Byte offset of each range in the element buffer
+	* @param{GLsizei} Number of ranges
+	* @param{GLsizei} Vertices of the mesh, every index has to be below it; 0 skips the check
+	*/
+	static void MultiDrawElements(GLenum mode, const GLsizei* counts, GLenum type, const void* const* indices, GLsizei drawCount, GLsizei numVertices = 0);
+
+	/**
+	* glDrawArrays, the vertex range is checked against the buffers of the enabled attributes
+	*/
+	static void DrawArrays(GLenum mode, GLint first, GLsizei count);
+
+	static const DrawStats& GetStats();
+
+	/**
+	* Restarts the counters, called once per frame
+	*/
+	static void ResetStats();
+
+private:
+	/**
+	* Counts a draw
+	* @param{GLenum} Primitive mode
+	* @param{size_t} Vertices of one instance
+	* @param{size_t} Number of instances
+	*/
+	static void Count(GLenum mode, size_t count, size_t numInstances);
+
+#if defined(GL_DRAW_VALIDATION)
+	/**
+	* Checks an index range against the element buffer of the bound vertex array, and its indices against the vertex count
+	* @param{GLsizei} Vertices of the mesh, 0 skips the index check
+	* @param{GLsizei &} Raised to the number of vertices the range references, the largest index plus one
+	* @returns{bool} true if the range fits
+	*/
+	static bool ValidateIndices(const char* call, GLsizei count, GLenum type, const void* indices, GLsizei numVertices, GLsizei& numReferenced);
+
+	/**
+	* Checks vertices and instances against the buffers of the enabled attributes
+	* @param{GLsizei} Vertices read, from vertex 0; 0 skips the per vertex attributes
+	* @param{GLsizei} Instances read; 0 skips the per instance attributes
+	* @returns{bool} true if every attribute fits its buffer
+	*/
+	static bool ValidateAttributes(const char* call, GLsizei numVertices, GLsizei numInstances);
+
+	static void Report(const char* call, const char* format, ...);
+#endif
+
+	static DrawStats stats;
+};
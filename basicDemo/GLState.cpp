@@ -0,0 +1,154 @@
+#include "GLState.h"
+#include <cstring>
+
+namespace {
+	// Binding of unknown value, whatever is bound next is issued
+	const GLuint UNKNOWN = ~0u;
+}
+
+GLuint GLState::program = UNKNOWN;
+GLuint GLState::vertexArray = UNKNOWN;
+GLuint GLState::activeTextureUnit = UNKNOWN;
+GLuint GLState::textures[MAX_TEXTURE_UNITS];
+GLuint GLState::arrayBuffer = UNKNOWN;
+GLuint GLState::uniformBuffer = UNKNOWN;
+GLState::UniformBinding GLState::uniformBindings[MAX_UNIFORM_BINDINGS];
+int GLState::depthTest = -1;
+GLStateCounters GLState::counters = {};
+
+void GLState::UseProgram(GLuint program)
+{
+	bool issue = GLState::program != program;
+	Count(GL_STATE_CALL_PROGRAM, issue);
+	if (!issue)
+		return;
+	GLState::program = program;
+	glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vertexArray)
+{
+	bool issue = GLState::vertexArray != vertexArray;
+	Count(GL_STATE_CALL_VERTEX_ARRAY, issue);
+	if (!issue)
+		return;
+	GLState::vertexArray = vertexArray;
+	glBindVertexArray(vertexArray);
+}
+
+void GLState::BindTexture(GLuint unit, GLuint texture, GLenum target)
+{
+	bool tracked = unit < MAX_TEXTURE_UNITS;
+	bool issue = !tracked || textures[unit] != texture;
+	Count(GL_STATE_CALL_TEXTURE, issue);
+	if (!issue)
+		return;
+
+	if (activeTextureUnit != unit) {
+		activeTextureUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	if (tracked)
+		textures[unit] = texture;
+	glBindTexture(target, texture);
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint *bound = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_UNIFORM_BUFFER ? &uniformBuffer : nullptr;
+	bool issue = bound == nullptr || *bound != buffer;
+	Count(GL_STATE_CALL_BUFFER, issue);
+	if (!issue)
+		return;
+	if (bound != nullptr)
+		*bound = buffer;
+	glBindBuffer(target, buffer);
+}
+
+void GLState::BindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	bool tracked = binding < MAX_UNIFORM_BINDINGS;
+	bool issue = !tracked || uniformBindings[binding].buffer != buffer || uniformBindings[binding].offset != offset ||
+		uniformBindings[binding].size != size;
+	Count(GL_STATE_CALL_BUFFER, issue);
+	if (!issue)
+		return;
+	if (tracked)
+		uniformBindings[binding] = { buffer, offset, size };
+	uniformBuffer = buffer;
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+}
+
+void GLState::SetCapability(GLenum capability, bool enabled)
+{
+	bool tracked = capability == GL_DEPTH_TEST;
+	bool issue = !tracked || depthTest != (int)enabled;
+	Count(GL_STATE_CALL_CAPABILITY, issue);
+	if (!issue)
+		return;
+	if (tracked)
+		depthTest = enabled;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	// A program in use stays in use after its deletion, until another one replaces it
+	if (GLState::program == program)
+		GLState::program = UNKNOWN;
+	glDeleteProgram(program);
+}
+
+void GLState::DeleteVertexArray(GLuint vertexArray)
+{
+	if (GLState::vertexArray == vertexArray)
+		GLState::vertexArray = 0;
+	glDeleteVertexArrays(1, &vertexArray);
+}
+
+void GLState::DeleteTexture(GLuint texture)
+{
+	for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		if (textures[unit] == texture)
+			textures[unit] = 0;
+	glDeleteTextures(1, &texture);
+}
+
+void GLState::DeleteBuffer(GLuint buffer)
+{
+	if (arrayBuffer == buffer)
+		arrayBuffer = 0;
+	if (uniformBuffer == buffer)
+		uniformBuffer = 0;
+	for (UniformBinding &binding : uniformBindings)
+		if (binding.buffer == buffer)
+			binding = { 0, 0, 0 };
+	glDeleteBuffers(1, &buffer);
+}
+
+void GLState::Invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	activeTextureUnit = UNKNOWN;
+	for (GLuint &texture : textures)
+		texture = UNKNOWN;
+	arrayBuffer = UNKNOWN;
+	uniformBuffer = UNKNOWN;
+	for (UniformBinding &binding : uniformBindings)
+		binding = { UNKNOWN, 0, 0 };
+	depthTest = -1;
+}
+
+const GLStateCounters& GLState::GetCounters()
+{
+	return counters;
+}
+
+void GLState::ResetCounters()
+{
+	memset(&counters, 0, sizeof(counters));
+}
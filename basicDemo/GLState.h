@@ -0,0 +1,127 @@
+#pragma once
+#include <glad/glad.h>
+
+// Kinds of state change counted by GLState
+enum GLStateCall {
+	GL_STATE_CALL_PROGRAM,
+	GL_STATE_CALL_VERTEX_ARRAY,
+	GL_STATE_CALL_TEXTURE,
+	GL_STATE_CALL_BUFFER,
+	GL_STATE_CALL_UNIFORM,
+	GL_STATE_CALL_CAPABILITY,
+	GL_STATE_CALL_COUNT
+};
+
+/**
+* Calls passed on to GL and calls skipped because they would have changed nothing, per kind
+*/
+struct GLStateCounters {
+	unsigned int issued[GL_STATE_CALL_COUNT];
+	unsigned int skipped[GL_STATE_CALL_COUNT];
+};
+
+/**
+* Shadow of the bound program, vertex array, textures, buffers and enabled capabilities of the context.
+* Binding what is already bound is skipped. Every bind of the demo goes through here, code that binds
+* behind its back (the user interface) has to call Invalidate afterwards.
+* Defining GL_STATE_COUNTERS counts the issued and skipped calls, the Debug configurations do.
+*/
+class GLState
+{
+public:
+	// Texture units tracked, units past it are always bound
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+	// Indexed uniform buffer binding points tracked
+	static const unsigned int MAX_UNIFORM_BINDINGS = 16;
+
+	static void UseProgram(GLuint program);
+
+	static void BindVertexArray(GLuint vertexArray);
+
+	/**
+	* Binds a texture to a texture unit, the active unit only changes when the bind is issued.
+	* Only the last texture of a unit is tracked, whatever its target: mixing targets on a unit costs binds, never correctness
+	* @param{GLuint} Texture unit, 0 for GL_TEXTURE0
+	* @param{GLuint} Texture
+	* @param{GLenum} Target, GL_TEXTURE_2D unless given
+	*/
+	static void BindTexture(GLuint unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+
+	/**
+	* Binds a buffer, GL_ARRAY_BUFFER and GL_UNIFORM_BUFFER are tracked.
+	* GL_ELEMENT_ARRAY_BUFFER belongs to the bound vertex array, it is always passed on
+	* @param{GLenum} Target
+	* @param{GLuint} Buffer
+	*/
+	static void BindBuffer(GLenum target, GLuint buffer);
+
+	/**
+	* Binds a range of a uniform buffer to a binding point, and the buffer to GL_UNIFORM_BUFFER like GL does
+	* @param{GLuint} Binding point
+	* @param{GLuint} Buffer
+	* @param{GLintptr} Offset in bytes
+	* @param{GLsizeiptr} Size in bytes
+	*/
+	static void BindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	/**
+	* glEnable or glDisable, only GL_DEPTH_TEST is tracked
+	* @param{GLenum} Capability
+	* @param{bool} true to enable it
+	*/
+	static void SetCapability(GLenum capability, bool enabled);
+
+	/**
+	* Deleting a bound object reverts its bindings to 0, and its name can come back from the next glGen
+	*/
+	static void DeleteProgram(GLuint program);
+	static void DeleteVertexArray(GLuint vertexArray);
+	static void DeleteTexture(GLuint texture);
+	static void DeleteBuffer(GLuint buffer);
+
+	/**
+	* Forgets every binding, the next call of each kind is issued
+	*/
+	static void Invalidate();
+
+	/**
+	* Counts of the calls since the last reset, zero unless GL_STATE_COUNTERS is defined
+	*/
+	static const GLStateCounters& GetCounters();
+
+	static void ResetCounters();
+
+	/**
+	* Counts a call, compiled out unless GL_STATE_COUNTERS is defined.
+	* Inline so the uniform setters of Shader pay nothing for it
+	* @param{GLStateCall} Kind of call
+	* @param{bool} true if it was passed on to GL
+	*/
+	static void Count(GLStateCall call, bool issued)
+	{
+#if defined(GL_STATE_COUNTERS)
+		(issued ? counters.issued : counters.skipped)[call]++;
+#else
+		(void)call;
+		(void)issued;
+#endif
+	}
+
+private:
+	struct UniformBinding {
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	static GLuint program;
+	static GLuint vertexArray;
+	static GLuint activeTextureUnit;
+	static GLuint textures[MAX_TEXTURE_UNITS];
+	static GLuint arrayBuffer;
+	static GLuint uniformBuffer;
+	static UniformBinding uniformBindings[MAX_UNIFORM_BINDINGS];
+	// Depth test, the capability the demo switches; -1 unknown, 0 disabled, 1 enabled
+	static int depthTest;
+	static GLStateCounters counters;
+};
@@ -0,0 +1,126 @@
+#include "InstanceBatcher.h"
+#include "GLDraw.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+	// Models batch together when everything but the transform matches
+	bool SameBatch(Model* a, unsigned int lodA, Model* b, unsigned int lodB)
+	{
+		return a->GetMesh() == b->GetMesh() && lodA == lodB && a->getMaterial() == b->getMaterial() &&
+			a->getTextureID() == b->getTextureID() && a->getNormalMapID() == b->getNormalMapID();
+	}
+
+	bool BatchLess(Model* a, unsigned int lodA, Model* b, unsigned int lodB)
+	{
+		uintptr_t meshA = (uintptr_t)a->GetMesh(), meshB = (uintptr_t)b->GetMesh();
+		if (meshA != meshB)
+			return meshA < meshB;
+		if (lodA != lodB)
+			return lodA < lodB;
+		if (a->getMaterial() != b->getMaterial())
+			return a->getMaterial() < b->getMaterial();
+		if (a->getTextureID() != b->getTextureID())
+			return a->getTextureID() < b->getTextureID();
+		return a->getNormalMapID() < b->getNormalMapID();
+	}
+}
+
+InstanceBatcher::InstanceBatcher()
+	: buffer(0), capacity(0)
+{
+	glGenBuffers(1, &buffer);
+}
+
+InstanceBatcher::~InstanceBatcher()
+{
+	if (buffer != 0)
+		GLState::DeleteBuffer(buffer);
+}
+
+void InstanceBatcher::Begin()
+{
+	instances.clear();
+	batches.clear();
+}
+
+void InstanceBatcher::Add(Model* model, const glm::mat4& modelMatrix, unsigned int lod)
+{
+	instances.push_back({ model, lod, modelMatrix });
+}
+
+void InstanceBatcher::Upload()
+{
+	order.resize(instances.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	// Stable, so the instances of a batch keep the order they were added in
+	std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+		return BatchLess(instances[a].model, instances[a].lod, instances[b].model, instances[b].lod);
+	});
+
+	matrices.resize(instances.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		const Instance& instance = instances[order[i]];
+		matrices[i] = instance.matrix;
+		if (batches.empty() || !SameBatch(batches.back().model, batches.back().lod, instance.model, instance.lod))
+			batches.push_back({ instance.model, instance.lod, i, 0 });
+		batches.back().numInstances++;
+	}
+
+	if (matrices.empty())
+		return;
+
+	GLState::BindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (matrices.size() > capacity)
+		capacity = matrices.size() + matrices.size() / 2;
+	// Orphans the storage of the last frame, the driver hands out a fresh one instead of waiting for the GPU
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, matrices.size() * sizeof(glm::mat4), matrices.data());
+}
+
+const std::vector<InstanceBatch>& InstanceBatcher::GetBatches()
+{
+	return batches;
+}
+
+const glm::mat4& InstanceBatcher::GetMatrix(size_t instance)
+{
+	return matrices[instance];
+}
+
+void InstanceBatcher::Draw(const InstanceBatch& batch)
+{
+	Mesh* mesh = batch.model->GetMesh();
+	size_t indexSize = mesh->GetIndexType() == GL_UNSIGNED_SHORT ? 2 : 4;
+	size_t firstIndex = 0;
+	size_t indexCount = mesh->GetNumIndices();
+	if (batch.lod > 0) {
+		const MeshLod& level = mesh->GetLods()[batch.lod];
+		firstIndex = level.firstIndex;
+		indexCount = level.indexCount;
+	}
+
+	// GL 3.3 has no base instance, the attribute starts at the batch instead
+	GLState::BindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint column = 0; column < 4; column++) {
+		GLuint attribute = INSTANCE_MATRIX_ATTRIBUTE + column;
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+			(void *)(batch.firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(attribute, 1);
+	}
+
+	GLDraw::DrawElementsInstanced(GL_TRIANGLES, (GLsizei)indexCount, mesh->GetIndexType(), (void *)(firstIndex * indexSize),
+		(GLsizei)batch.numInstances, (GLsizei)mesh->GetNumVertices());
+
+	// The same vertex array is also drawn one model at a time
+	for (GLuint column = 0; column < 4; column++)
+		glDisableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + column);
+}
+
+size_t InstanceBatcher::GetNumInstances()
+{
+	return instances.size();
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Model.h"
+
+// First of the four attribute locations of the per instance model matrix, after the vertex attributes of Mesh
+const GLuint INSTANCE_MATRIX_ATTRIBUTE = VERTEX_ATTRIBUTE_COUNT;
+
+/**
+* Models drawn together: same mesh, level of detail, material and textures
+*/
+struct InstanceBatch {
+	// First model of the batch, its mesh, material and textures stand for the whole batch
+	Model* model;
+	unsigned int lod;
+	// Range of the batch in the instance buffer
+	size_t firstInstance;
+	size_t numInstances;
+};
+
+/**
+* Groups the models of a frame that share a mesh and a material and streams their model matrices to an instance buffer,
+* so each group is drawn with a single glDrawElementsInstanced
+*/
+class InstanceBatcher
+{
+public:
+	/**
+	* Creates the instance buffer, the GL context has to be alive
+	*/
+	InstanceBatcher();
+
+	/**
+	* Deletes the instance buffer, the GL context has to be alive
+	*/
+	~InstanceBatcher();
+
+	/**
+	* Forgets the instances of the last frame
+	*/
+	void Begin();
+
+	/**
+	* Adds a model to the frame
+	* @param{Model *} Model to draw, its mesh has to be ready
+	* @param{const glm::mat4 &} Model matrix
+	* @param{unsigned int} Level of detail to draw
+	*/
+	void Add(Model* model, const glm::mat4& modelMatrix, unsigned int lod);
+
+	/**
+	* Sorts the instances into batches and copies their matrices to the instance buffer
+	*/
+	void Upload();
+
+	/**
+	* Batches of the frame, valid after Upload
+	*/
+	const std::vector<InstanceBatch>& GetBatches();
+
+	/**
+	* Model matrix of an instance, valid after Upload
+	* @param{size_t} Instance index, firstInstance of a batch for its first model
+	*/
+	const glm::mat4& GetMatrix(size_t instance);
+
+	/**
+	* Draws every instance of a batch, the program, textures, uniform blocks and the vertex array of the mesh have to be bound
+	* @param{const InstanceBatch &} Batch to draw
+	*/
+	void Draw(const InstanceBatch& batch);
+
+	/**
+	* Instances added this frame
+	*/
+	size_t GetNumInstances();
+
+private:
+	InstanceBatcher(const InstanceBatcher&) = delete;
+	InstanceBatcher& operator=(const InstanceBatcher&) = delete;
+
+	struct Instance {
+		Model* model;
+		unsigned int lod;
+		glm::mat4 matrix;
+	};
+
+	GLuint buffer;
+	// Matrices the instance buffer can hold
+	size_t capacity;
+	std::vector<Instance> instances;
+	std::vector<size_t> order;
+	std::vector<glm::mat4> matrices;
+	std::vector<InstanceBatch> batches;
+};
@@ -5,6 +5,9 @@ Light::Light() {
 	position = glm::vec3(0, 0, 0);
 }
 
+Light::~Light() {
+}
+
 void Light::SetPosition(glm::vec3 _position) {
 	position = _position;
 }
@@ -0,0 +1,303 @@
+#include "LightClusterer.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+const float LightClusterer::RANGE_THRESHOLD = 1.0f / 64.0f;
+
+namespace {
+	// Texture buffers of Upload
+	enum {
+		LIGHT_DATA,
+		CLUSTER_RANGES,
+		LIGHT_INDICES
+	};
+
+	bool SphereIntersectsBox(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+		glm::vec3 offset = center - closest;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	/**
+	* Tile of a normalized device coordinate, clamped to the grid before the conversion so huge ranges stay defined
+	*/
+	int GetTile(float ndc, float tilesPerNdc, unsigned int numTiles)
+	{
+		return (int)std::min(std::max((ndc + 1.0f) * tilesPerNdc, 0.0f), numTiles - 1.0f);
+	}
+
+	/**
+	* Streams data to a texture buffer, orphaning the storage of the last frame
+	*/
+	void UploadBuffer(GLuint buffer, const void* data, size_t size)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		// An empty buffer texture has no texels to fetch, a few bytes keep it valid
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+LightClusterer::LightClusterer(unsigned int numThreads)
+	: workers(numThreads), clustersX(CLUSTERS_X), clustersY(CLUSTERS_Y), clustersZ(CLUSTERS_Z), slotsPerCluster(MAX_LIGHTS_PER_CLUSTER), fieldOfView(0.0f), width(0),
+	height(0), nearDistance(0.0f), farDistance(0.0f), tileWidth(1), tileHeight(1)
+{
+	for (int i = 0; i < 3; i++)
+		buffers[i] = textures[i] = 0;
+}
+
+LightClusterer::~LightClusterer()
+{
+	for (int i = 0; i < 3; i++) {
+		if (textures[i] != 0)
+			GLState::DeleteTexture(textures[i]);
+		if (buffers[i] != 0)
+			GLState::DeleteBuffer(buffers[i]);
+	}
+}
+
+void LightClusterer::SetProjection(float fieldOfView, unsigned int width, unsigned int height, float nearDistance, float farDistance)
+{
+	if (fieldOfView == this->fieldOfView && width == this->width && height == this->height &&
+		nearDistance == this->nearDistance && farDistance == this->farDistance)
+		return;
+
+	this->fieldOfView = fieldOfView;
+	this->width = std::max(width, 1u);
+	this->height = std::max(height, 1u);
+	this->nearDistance = nearDistance;
+	this->farDistance = farDistance;
+	BuildClusterBounds();
+}
+
+void LightClusterer::SetClustered(bool clustered)
+{
+	clustersX = clustered ? CLUSTERS_X : 1;
+	clustersY = clustered ? CLUSTERS_Y : 1;
+	clustersZ = clustered ? CLUSTERS_Z : 1;
+	slotsPerCluster = clustered ? MAX_LIGHTS_PER_CLUSTER : MAX_LIGHTS;
+	if (width > 0)
+		BuildClusterBounds();
+}
+
+void LightClusterer::BuildClusterBounds()
+{
+	tileWidth = (width + clustersX - 1) / clustersX;
+	tileHeight = (height + clustersY - 1) / clustersY;
+
+	float tanHalfY = tanf(fieldOfView * 0.5f);
+	float tanHalfX = tanHalfY * width / height;
+	size_t numClusters = (size_t)clustersX * clustersY * clustersZ;
+	boundsMin.resize(numClusters);
+	boundsMax.resize(numClusters);
+
+	for (unsigned int z = 0; z < clustersZ; z++) {
+
+		// Logarithmic slices, each one as deep as its distance allows so clusters stay close to cubes
+		float depth0 = nearDistance * powf(farDistance / nearDistance, (float)z / clustersZ);
+		float depth1 = nearDistance * powf(farDistance / nearDistance, (float)(z + 1) / clustersZ);
+		for (unsigned int y = 0; y < clustersY; y++) {
+
+			float ndcY0 = 2.0f * y * tileHeight / height - 1.0f;
+			float ndcY1 = 2.0f * (y + 1) * tileHeight / height - 1.0f;
+			for (unsigned int x = 0; x < clustersX; x++) {
+
+				float ndcX0 = 2.0f * x * tileWidth / width - 1.0f;
+				float ndcX1 = 2.0f * (x + 1) * tileWidth / width - 1.0f;
+				// The tile widens with depth, its extremes are on the near or the far face
+				float xs[4] = { ndcX0 * depth0, ndcX0 * depth1, ndcX1 * depth0, ndcX1 * depth1 };
+				float ys[4] = { ndcY0 * depth0, ndcY0 * depth1, ndcY1 * depth0, ndcY1 * depth1 };
+				size_t cluster = x + clustersX * (y + (size_t)clustersY * z);
+				boundsMin[cluster] = glm::vec3(*std::min_element(xs, xs + 4) * tanHalfX, *std::min_element(ys, ys + 4) * tanHalfY, -depth1);
+				boundsMax[cluster] = glm::vec3(*std::max_element(xs, xs + 4) * tanHalfX, *std::max_element(ys, ys + 4) * tanHalfY, -depth0);
+			}
+		}
+	}
+}
+
+int LightClusterer::GetSlice(float depth) const
+{
+	if (depth <= nearDistance)
+		return 0;
+	int slice = (int)(logf(depth / nearDistance) / logf(farDistance / nearDistance) * clustersZ);
+	return std::min(slice, (int)clustersZ - 1);
+}
+
+void LightClusterer::Build(const glm::mat4& view, const std::vector<ClusterLight>& lights)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	stats = LightClusterStats();
+	size_t numLights = std::min(lights.size(), (size_t)MAX_LIGHTS);
+	stats.numLights = numLights;
+	this->lights.assign(lights.begin(), lights.begin() + numLights);
+
+	// Lights entirely in front of the near plane or past the far plane reach no cluster
+	viewLights.resize(numLights);
+	for (size_t i = 0; i < numLights; i++) {
+		ViewLight& light = viewLights[i];
+		light.center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		light.range = lights[i].range;
+		float depth = -light.center.z;
+		if (depth + light.range < nearDistance || depth - light.range > farDistance) {
+			light.firstSlice = 1;
+			light.lastSlice = 0;
+			continue;
+		}
+		light.firstSlice = GetSlice(depth - light.range);
+		light.lastSlice = GetSlice(depth + light.range);
+	}
+
+	size_t numClusters = (size_t)clustersX * clustersY * clustersZ;
+	slots.resize(numClusters * slotsPerCluster);
+	slotCounts.assign(numClusters, 0);
+
+	// Slices own disjoint clusters, they need no locking
+	unsigned int numJobs = std::min(workers.GetNumThreads(), clustersZ);
+	std::vector<size_t> dropped(numJobs, 0);
+	for (unsigned int job = 0; job < numJobs; job++) {
+		int firstSlice = (int)(clustersZ * job / numJobs);
+		int endSlice = (int)(clustersZ * (job + 1) / numJobs);
+		size_t* numDropped = &dropped[job];
+		workers.Submit([this, firstSlice, endSlice, numDropped]() { AssignSlices(firstSlice, endSlice, numDropped); });
+	}
+	workers.Wait();
+
+	// Compacted into one list, each cluster keeps its lights in increasing order
+	clusterRanges.resize(numClusters * 2);
+	lightIndices.clear();
+	std::vector<bool> visible(numLights, false);
+	for (size_t cluster = 0; cluster < numClusters; cluster++) {
+		uint32_t count = slotCounts[cluster];
+		clusterRanges[cluster * 2] = (uint32_t)lightIndices.size();
+		clusterRanges[cluster * 2 + 1] = count;
+		const uint16_t* clusterSlots = &slots[cluster * slotsPerCluster];
+		lightIndices.insert(lightIndices.end(), clusterSlots, clusterSlots + count);
+		for (uint32_t i = 0; i < count; i++)
+			visible[clusterSlots[i]] = true;
+		if (count > 0)
+			stats.numOccupied++;
+		stats.maxPerCluster = std::max(stats.maxPerCluster, count);
+	}
+	stats.numVisible = std::count(visible.begin(), visible.end(), true);
+	stats.numIndices = lightIndices.size();
+	for (size_t numDropped : dropped)
+		stats.numDropped += numDropped;
+	stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusterer::AssignSlices(int firstSlice, int endSlice, size_t* numDropped)
+{
+	float tanHalfY = tanf(fieldOfView * 0.5f);
+	float tanHalfX = tanHalfY * width / height;
+	// Clusters per unit of normalized device coordinates
+	float tilesPerNdcX = 0.5f * width / tileWidth;
+	float tilesPerNdcY = 0.5f * height / tileHeight;
+
+	for (int z = firstSlice; z < endSlice; z++) {
+
+		float sliceDepth0 = nearDistance * powf(farDistance / nearDistance, (float)z / clustersZ);
+		float sliceDepth1 = nearDistance * powf(farDistance / nearDistance, (float)(z + 1) / clustersZ);
+		for (size_t i = 0; i < viewLights.size(); i++) {
+
+			const ViewLight& light = viewLights[i];
+			if (z < light.firstSlice || z > light.lastSlice)
+				continue;
+
+			// Depths of the slice the sphere covers, its screen extent is widest on the nearest of them
+			float depth = -light.center.z;
+			float depth0 = std::max(sliceDepth0, depth - light.range);
+			float depth1 = std::min(sliceDepth1, depth + light.range);
+			float lowX = light.center.x - light.range, highX = light.center.x + light.range;
+			float lowY = light.center.y - light.range, highY = light.center.y + light.range;
+			float ndcX0 = lowX / ((lowX < 0.0f ? depth0 : depth1) * tanHalfX);
+			float ndcX1 = highX / ((highX > 0.0f ? depth0 : depth1) * tanHalfX);
+			float ndcY0 = lowY / ((lowY < 0.0f ? depth0 : depth1) * tanHalfY);
+			float ndcY1 = highY / ((highY > 0.0f ? depth0 : depth1) * tanHalfY);
+
+			int x0 = GetTile(ndcX0, tilesPerNdcX, clustersX), x1 = GetTile(ndcX1, tilesPerNdcX, clustersX);
+			int y0 = GetTile(ndcY0, tilesPerNdcY, clustersY), y1 = GetTile(ndcY1, tilesPerNdcY, clustersY);
+
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++) {
+					size_t cluster = x + clustersX * (y + (size_t)clustersY * z);
+					if (!SphereIntersectsBox(light.center, light.range, boundsMin[cluster], boundsMax[cluster]))
+						continue;
+					if (slotCounts[cluster] == slotsPerCluster) {
+						(*numDropped)++;
+						continue;
+					}
+					slots[cluster * slotsPerCluster + slotCounts[cluster]++] = (uint16_t)i;
+				}
+		}
+	}
+}
+
+void LightClusterer::Upload()
+{
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	if (buffers[0] == 0) {
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		for (int i = 0; i < 3; i++) {
+			UploadBuffer(buffers[i], NULL, 0);
+			GLState::BindTexture(0, textures[i], GL_TEXTURE_BUFFER);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+	}
+
+	UploadBuffer(buffers[LIGHT_DATA], lights.data(), lights.size() * sizeof(ClusterLight));
+	UploadBuffer(buffers[CLUSTER_RANGES], clusterRanges.data(), clusterRanges.size() * sizeof(uint32_t));
+	UploadBuffer(buffers[LIGHT_INDICES], lightIndices.data(), lightIndices.size() * sizeof(uint16_t));
+}
+
+void LightClusterer::Bind(GLuint firstUnit)
+{
+	for (GLuint i = 0; i < 3; i++)
+		GLState::BindTexture(firstUnit + i, textures[i], GL_TEXTURE_BUFFER);
+}
+
+glm::ivec4 LightClusterer::GetClusterCount() const
+{
+	return glm::ivec4(clustersX, clustersY, clustersZ, 0);
+}
+
+glm::vec4 LightClusterer::GetClusterScale() const
+{
+	// slice = log(depth / near) / log(far / near) * clustersZ, as GetSlice
+	float sliceScale = clustersZ / logf(farDistance / nearDistance);
+	return glm::vec4(1.0f / tileWidth, 1.0f / tileHeight, sliceScale, -logf(nearDistance) * sliceScale);
+}
+
+const std::vector<uint32_t>& LightClusterer::GetClusterRanges() const
+{
+	return clusterRanges;
+}
+
+const std::vector<uint16_t>& LightClusterer::GetLightIndices() const
+{
+	return lightIndices;
+}
+
+const LightClusterStats& LightClusterer::GetStats() const
+{
+	return stats;
+}
+
+float LightClusterer::ComputeRange(float constant, float linear, float quadratic, float brightness)
+{
+	// brightness / (constant + linear * d + quadratic * d^2) = RANGE_THRESHOLD
+	float c = constant - brightness / RANGE_THRESHOLD;
+	if (c >= 0.0f)
+		return 0.0f;
+	if (quadratic > 0.0f)
+		return (-linear + sqrtf(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+	if (linear > 0.0f)
+		return -c / linear;
+	return FLT_MAX;
+}
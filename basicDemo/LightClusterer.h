@@ -0,0 +1,190 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "ThreadPool.h"
+
+/**
+* Point light as the lighting shaders fetch it, four RGBA32F texels per light
+*/
+struct ClusterLight {
+	glm::vec3 position;
+	// Distance past which the light is dropped, see LightClusterer::ComputeRange
+	float range;
+	glm::vec3 ambient;
+	float constant;
+	glm::vec3 diffuse;
+	float linear;
+	glm::vec3 specular;
+	float quadratic;
+};
+
+/**
+* Work and results of the light assignment of one frame
+*/
+struct LightClusterStats {
+	size_t numLights = 0;
+	// Lights inside at least one cluster
+	size_t numVisible = 0;
+	// Light indices of every cluster, back to back
+	size_t numIndices = 0;
+	size_t numOccupied = 0;
+	unsigned int maxPerCluster = 0;
+	// Lights left out of clusters already full
+	size_t numDropped = 0;
+	double buildMilliseconds = 0.0;
+};
+
+/**
+* Clustered forward lighting: the view frustum is split into screen tiles and logarithmic depth slices,
+* and every cluster gets the list of the point lights whose range reaches it. A fragment only shades the
+* lights of its cluster. The lists are built on the CPU, the depth slices are split among worker threads,
+* and reach the shaders through texture buffers, GL 3.3 has neither storage buffers nor compute shaders.
+*/
+class LightClusterer
+{
+public:
+	// Clusters along x, y and depth
+	static const unsigned int CLUSTERS_X = 16;
+	static const unsigned int CLUSTERS_Y = 9;
+	static const unsigned int CLUSTERS_Z = 24;
+	// Lights kept per cluster of the grid, the rest are counted in numDropped. The single cluster keeps every light
+	static const unsigned int MAX_LIGHTS_PER_CLUSTER = 256;
+	// Light indices are 16 bit
+	static const unsigned int MAX_LIGHTS = 65535;
+	// Attenuated intensity under which a light is out of range
+	static const float RANGE_THRESHOLD;
+
+	/**
+	* Starts the worker threads, the texture buffers are created by the first Upload
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread
+	*/
+	explicit LightClusterer(unsigned int numThreads = 0);
+
+	/**
+	* Deletes the texture buffers, the GL context has to be alive if Upload ran
+	*/
+	~LightClusterer();
+
+	/**
+	* Splits the frustum of a perspective camera, the cluster bounds are only rebuilt when something changed
+	* @param{float} Vertical field of view, in radians
+	* @param{unsigned int} Viewport width, in pixels
+	* @param{unsigned int} Viewport height, in pixels
+	* @param{float} Distance of the near plane
+	* @param{float} Distance of the far plane
+	*/
+	void SetProjection(float fieldOfView, unsigned int width, unsigned int height, float nearDistance, float farDistance);
+
+	/**
+	* Switches between the cluster grid and a single cluster holding every light in view, which shades like plain forward
+	* @param{bool} true for the grid
+	*/
+	void SetClustered(bool clustered);
+
+	/**
+	* Assigns the lights to the clusters they reach
+	* @param{const glm::mat4 &} View matrix of the frame
+	* @param{const std::vector<ClusterLight> &} Lights of the frame, in world space
+	*/
+	void Build(const glm::mat4& view, const std::vector<ClusterLight>& lights);
+
+	/**
+	* Copies the lights and the cluster lists of the last Build to the texture buffers
+	*/
+	void Upload();
+
+	/**
+	* Binds the light data, the cluster ranges and the light indices to three consecutive texture units
+	* @param{GLuint} First texture unit
+	*/
+	void Bind(GLuint firstUnit);
+
+	/**
+	* Clusters along x, y and depth, w unused
+	*/
+	glm::ivec4 GetClusterCount() const;
+
+	/**
+	* Clusters per pixel in x and y; the depth slice of a view depth is log(depth) * z + w
+	*/
+	glm::vec4 GetClusterScale() const;
+
+	/**
+	* First light index and number of lights of each cluster, two values per cluster, x fastest then y then depth
+	*/
+	const std::vector<uint32_t>& GetClusterRanges() const;
+
+	const std::vector<uint16_t>& GetLightIndices() const;
+
+	const LightClusterStats& GetStats() const;
+
+	/**
+	* Distance at which the attenuation 1 / (constant + linear * d + quadratic * d^2) brings a light under RANGE_THRESHOLD
+	* @param{float} Constant attenuation
+	* @param{float} Linear attenuation
+	* @param{float} Quadratic attenuation
+	* @param{float} Brightest channel of the light colors
+	* @returns{float} Range, FLT_MAX if the light never fades out
+	*/
+	static float ComputeRange(float constant, float linear, float quadratic, float brightness);
+
+private:
+	LightClusterer(const LightClusterer&) = delete;
+	LightClusterer& operator=(const LightClusterer&) = delete;
+
+	/**
+	* Light in view space with the depth slices it overlaps
+	*/
+	struct ViewLight {
+		glm::vec3 center;
+		float range;
+		int firstSlice;
+		int lastSlice;
+	};
+
+	void BuildClusterBounds();
+
+	/**
+	* Depth slice of a view depth, clamped to the grid
+	*/
+	int GetSlice(float depth) const;
+
+	/**
+	* Fills the light lists of a range of depth slices
+	* @param{int} First slice
+	* @param{int} Slice past the last one
+	* @param{size_t *} Incremented with the lights that did not fit
+	*/
+	void AssignSlices(int firstSlice, int endSlice, size_t* numDropped);
+
+	ThreadPool workers;
+	unsigned int clustersX;
+	unsigned int clustersY;
+	unsigned int clustersZ;
+	// Lights a cluster can hold
+	unsigned int slotsPerCluster;
+	float fieldOfView;
+	unsigned int width;
+	unsigned int height;
+	float nearDistance;
+	float farDistance;
+	// Pixels covered by a cluster, the grid may reach past the right and top edges
+	unsigned int tileWidth;
+	unsigned int tileHeight;
+	// View space bounds of each cluster
+	std::vector<glm::vec3> boundsMin;
+	std::vector<glm::vec3> boundsMax;
+	std::vector<ViewLight> viewLights;
+	// slotsPerCluster slots per cluster, written by the workers
+	std::vector<uint16_t> slots;
+	std::vector<uint32_t> slotCounts;
+	std::vector<uint32_t> clusterRanges;
+	std::vector<uint16_t> lightIndices;
+	std::vector<ClusterLight> lights;
+	LightClusterStats stats;
+	// Light data, cluster ranges and light indices; buffer and texture of each
+	GLuint buffers[3];
+	GLuint textures[3];
+};
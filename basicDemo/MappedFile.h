@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+
+/**
+* Read-only memory mapping of a whole file.
+* The view stays valid until Close() is called or the object is destroyed.
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+
+	~MappedFile();
+
+	/**
+	* Maps a file in memory
+	* @param{const char*} Path to the file
+	* @returns{bool} true if the file could be mapped
+	*/
+	bool Open(const char* path);
+
+	/**
+	* Unmaps the file and releases the OS handles
+	*/
+	void Close();
+
+	const char* GetData() const;
+
+	size_t GetSize() const;
+
+	bool IsOpen() const;
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data;
+	size_t size;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
@@ -0,0 +1,1055 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "Mesh.h"
+#include "GLState.h"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+unsigned int Mesh::loaderThreads = 1;
+bool Mesh::useMeshCache = true;
+bool Mesh::optimizeMeshes = true;
+VertexLayout Mesh::defaultVertexLayout = VERTEX_LAYOUT_INTERLEAVED;
+unsigned int Mesh::interleavedStride = 0;
+bool Mesh::buildBvhs = true;
+MeshResidency Mesh::defaultResidency = MESH_RESIDENCY_DROP;
+
+#ifndef _WIN32
+// fopen_s only exists in the Microsoft runtime, the legacy parser also builds in the Linux benchmark
+static int fopen_s(FILE** file, const char* path, const char* mode) {
+	*file = fopen(path, mode);
+	return *file ? 0 : errno;
+}
+#endif
+
+namespace {
+	// Copies a blob of the mapped cache into a host array
+	template <typename T>
+	void CopyBlob(const MeshCacheBlobView& blob, vector<T>& out)
+	{
+		const T* data = static_cast<const T*>(blob.data);
+		out.assign(data, data + blob.size / sizeof(T));
+	}
+}
+
+Mesh::Mesh() {
+
+	VBO = 0;
+	VAO = 0;
+	colorBuffer = 0;
+	uvBuffer = 0;
+	normalBuffer = 0;
+	tangentBuffer = 0;
+	elementBuffer = 0;
+	numVertices = 0;
+	numIndices = 0;
+	indexType = GL_UNSIGNED_INT;
+	hasTexture = false;
+	vertexFormat = VERTEX_FORMAT_FLOAT;
+	vertexLayout = defaultVertexLayout;
+	residency = defaultResidency;
+	state = MESH_LOADING;
+	gpuBytes = 0;
+	boundsMin = glm::vec3(0.0f);
+	boundsExtent = glm::vec3(0.0f);
+
+}
+
+
+Mesh::~Mesh() {
+
+	DeleteGeometry();
+
+}
+
+unsigned int Mesh::GetVAO() {
+	return VAO;
+}
+
+unsigned int Mesh::GetVBO() {
+	return VBO;
+}
+
+GLuint Mesh::GetColorBuffer() {
+	return colorBuffer;
+}
+
+GLuint Mesh::GetUvBuffer() {
+	return uvBuffer;
+}
+
+GLuint Mesh::GetNormalBuffer() {
+	return normalBuffer;
+}
+
+GLuint Mesh::GetTangentBuffer() {
+	return tangentBuffer;
+}
+
+GLuint Mesh::GetElementBuffer() {
+	return elementBuffer;
+}
+
+int Mesh::GetNumTriangles() {
+	return numIndices / 3;
+}
+
+unsigned int Mesh::GetNumVertices() {
+	return numVertices;
+}
+
+int Mesh::GetNumIndices() {
+	return numIndices;
+}
+
+GLenum Mesh::GetIndexType() {
+	return indexType;
+}
+
+/*
+bool Mesh::LoadObj(const char * path){
+
+	fstream file;
+	vector< unsigned int > vertexIndices, uvIndices, normalIndices;
+	vector< glm::vec3 > temp_vertices;
+	vector< glm::vec2 > temp_uvs;
+	vector< glm::vec3 > temp_normals;
+	string line;
+
+	file.open(path, std::ios::in);
+
+	if (!file.is_open()) {
+		cout << "no se pudo abrir el archivo :(" << endl;
+		return false;
+	}
+
+
+	while (1) {
+
+		getline(file, line);
+		//cout << line << endl;
+
+		std::istringstream iss(line);
+		std::vector<std::string> words((std::istream_iterator<std::string>(iss)),
+			std::istream_iterator<std::string>());
+
+		for (auto x : words) {
+			//cout << "es un x: " << x << endl;
+		}
+
+		if (words.size() > 0) {
+
+			if (words[0].compare("v") == 0) {
+				//cout << "estoy asignando un vertice" << endl;
+				glm::vec3 vertex = glm::vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str()));
+				temp_vertices.push_back(vertex);
+
+			}
+			else if (words[0].compare("vt") == 0) {
+
+				glm::vec2 vertex = glm::vec2(atof(words[1].c_str()), atof(words[2].c_str()));
+				temp_uvs.push_back(vertex);
+
+			}
+			else if (words[0].compare("vn") == 0) {
+
+				glm::vec3 vertex = glm::vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str()));
+				temp_normals.push_back(vertex);
+			}
+			else if (words[0].compare("f") == 0) {
+
+				std::string delimiter = "/";
+				size_t pos = 0;
+				string face;
+
+				for (int i = 1; i < words.size(); i++) {
+
+
+					pos = words[i].find(delimiter);
+
+					face = words[i].substr(0, pos);
+					words[i].erase(0, pos + 1);
+
+					//cout << "face: " << face <<", word: "<<words[i]<<endl;
+
+					vertexIndices.push_back(atoi(face.c_str()));
+
+					pos = words[i].find(delimiter);
+
+
+					face = words[i].substr(0, pos);
+					words[i].erase(0, pos + 1);
+
+					//cout << "face: " << face << ", word: " << words[i] << endl;
+
+					uvIndices.push_back(atoi(face.c_str()));
+
+
+					//cout << "face: " << words[i] << endl;
+
+					normalIndices.push_back(atoi(words[i].c_str()));
+
+				}
+			}
+
+		}
+
+		words.clear();
+
+		if (file.eof()) {
+			break;
+		}
+	}
+
+	file.close();
+
+
+	cout << "Finalizando data" << endl;
+	cout << vertexIndices.size() << endl;
+	cout << uvIndices.size() << endl;
+	cout << normalIndices.size() << endl;
+	// For each vertex of each triangle
+	for (unsigned int i = 0; i < vertexIndices.size(); i++) {
+
+
+		unsigned int vertexIndex = vertexIndices[i];
+		out_vertices.push_back( temp_vertices[vertexIndex - 1] );
+
+
+		unsigned int uvIndex = uvIndices[i];
+		if(uvIndex > 0) if(temp_uvs.size() > 0) out_uvs.push_back(temp_uvs[uvIndex - 1]);
+	
+
+		unsigned int normalIndex = normalIndices[i];
+		out_normals.push_back(temp_normals[normalIndex - 1]);
+	}
+
+	numVertices = (unsigned int)out_vertices.size();
+	cout << "data finalizada" << endl;
+
+	if (out_uvs.size() <= 0) hasTexture = false;
+
+
+	return true;
+
+
+}
+*/
+
+
+bool Mesh::LoadObj(const char* path) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	loadTimes = MeshLoadTimes();
+	// Seconds since the previous step ended
+	std::chrono::steady_clock::time_point stepStart = start;
+	auto lap = [&stepStart]() {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - stepStart).count();
+		stepStart = now;
+		return seconds;
+	};
+
+	bool compact = vertexFormat == VERTEX_FORMAT_COMPACT;
+	unsigned int buildOptions = (compact ? (unsigned int)MESH_CACHE_COMPACT : 0u) | (optimizeMeshes ? (unsigned int)MESH_CACHE_OPTIMIZED : 0u);
+	sourcePath = path;
+
+	// The cached vertex data is uploaded straight from the mapping in BuildGeometry
+	if (useMeshCache && meshCache.Open(path, buildOptions) && !LoadCachedRanges())
+		meshCache.Close();
+
+	if (meshCache.IsOpen()) {
+
+		MeshCacheInfo info = meshCache.GetInfo();
+		numVertices = info.numVertices;
+		numIndices = info.numIndices;
+		indexType = info.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		hasTexture = (info.flags & MESH_CACHE_HAS_UVS) != 0;
+		boundsMin = glm::vec3(info.boundsMin[0], info.boundsMin[1], info.boundsMin[2]);
+		boundsExtent = glm::vec3(info.boundsExtent[0], info.boundsExtent[1], info.boundsExtent[2]);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%s: %u vertices, %u indices mapped from the mesh cache in %.2f ms\n", path, numVertices, numIndices, seconds * 1000.0);
+
+		loadTimes.otherSeconds = lap();
+		BuildBvh(path);
+		loadTimes.bvhSeconds = lap();
+
+		if (compact) {
+			QuantizationError error;
+			error.position = info.quantizationError[0];
+			float largestExtent = glm::max(boundsExtent.x, glm::max(boundsExtent.y, boundsExtent.z));
+			error.positionRelative = largestExtent > 0.0f ? error.position / largestExtent : 0.0f;
+			error.normalDegrees = info.quantizationError[1];
+			error.uv = info.quantizationError[2];
+			MeshQuantizer::PrintError(path, error);
+		}
+
+		PrepareResidency();
+		loadTimes.otherSeconds += lap();
+		loadTimes.totalSeconds = std::chrono::duration<double>(stepStart - start).count();
+		return true;
+	}
+
+	ObjData data;
+	ObjLoadStats stats;
+
+	if (!ObjLoader::Load(path, data, &stats, loaderThreads))
+		return false;
+
+	loadTimes.parseSeconds = lap();
+	ObjLoader::PrintStats(path, stats);
+
+	// Corners sharing position, uv and normal become a single indexed vertex
+	MeshIndexStats indexStats;
+	MeshBuilder::BuildIndexed(data, mesh, &indexStats);
+	loadTimes.indexSeconds = lap();
+	MeshBuilder::PrintStats(path, indexStats);
+
+	if (optimizeMeshes) {
+		MeshOptimizeStats optimizeStats;
+		MeshOptimizer::Optimize(mesh, &optimizeStats);
+		loadTimes.optimizeSeconds = lap();
+		MeshOptimizer::PrintStats(path, optimizeStats);
+	}
+
+	// Meshlets reorder the triangles, the vertices follow the new order
+	MeshletBuilder::Build(mesh.indices, mesh.positions, meshlets);
+	loadTimes.meshletSeconds = lap();
+	MeshletBuilder::PrintStats(path, meshlets);
+	// Coarser levels are appended to the index buffer and reuse the vertices
+	MeshSimplifier::BuildLods(mesh, lods);
+	loadTimes.lodSeconds = lap();
+	MeshSimplifier::PrintStats(path, lods);
+	if (optimizeMeshes) {
+		MeshOptimizer::OptimizeVertexFetch(mesh);
+		loadTimes.optimizeSeconds += lap();
+	}
+
+	// Tangents come last, once the vertex order is final, and only from the full resolution triangles
+	TangentStats tangentStats;
+	TangentGenerator::Generate(mesh, lods[0].indexCount, loaderThreads, &tangentStats);
+	loadTimes.tangentSeconds = lap();
+	TangentGenerator::PrintStats(path, tangentStats);
+
+	hasTexture = mesh.hasUvs;
+	ComputeBounds();
+	PackIndices();
+	loadTimes.otherSeconds = lap();
+	BuildBvh(path);
+	loadTimes.bvhSeconds = lap();
+
+	QuantizationError error;
+	if (compact) {
+		MeshQuantizer::Quantize(mesh, quantized, &error);
+		MeshQuantizer::PrintError(path, error);
+
+		// The compact streams are the CPU copy from now on
+		FreeFloatVertices();
+	}
+
+	if (useMeshCache) {
+
+		// Quantization errors stay zero for float meshes
+		MeshCacheInfo info = {};
+		info.numVertices = numVertices;
+		info.numIndices = numIndices;
+		info.indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		info.flags = hasTexture ? (unsigned int)MESH_CACHE_HAS_UVS : 0u;
+		info.buildOptions = buildOptions;
+
+		for (int axis = 0; axis < 3; axis++) {
+			info.boundsMin[axis] = boundsMin[axis];
+			info.boundsExtent[axis] = boundsExtent[axis];
+		}
+
+		MeshCacheBlobView blobs[MESH_CACHE_BLOB_COUNT];
+		if (compact) {
+			info.quantizationError[0] = error.position;
+			info.quantizationError[1] = error.normalDegrees;
+			info.quantizationError[2] = error.uv;
+
+			blobs[MESH_CACHE_POSITIONS] = { quantized.positions.data(), quantized.positions.size() * sizeof(uint16_t) };
+			blobs[MESH_CACHE_NORMALS] = { quantized.normals.data(), quantized.normals.size() * sizeof(int16_t) };
+			blobs[MESH_CACHE_UVS] = { quantized.uvs.data(), quantized.uvs.size() * sizeof(uint16_t) };
+			blobs[MESH_CACHE_TANGENTS] = { quantized.tangents.data(), quantized.tangents.size() * sizeof(int8_t) };
+		}
+		else {
+			blobs[MESH_CACHE_POSITIONS] = { mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3) };
+			blobs[MESH_CACHE_NORMALS] = { mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3) };
+			blobs[MESH_CACHE_UVS] = { mesh.uvs.data(), mesh.uvs.size() * sizeof(glm::vec2) };
+			blobs[MESH_CACHE_TANGENTS] = { mesh.tangents.data(), mesh.tangents.size() * sizeof(glm::vec4) };
+		}
+		blobs[MESH_CACHE_INDICES] = { packedIndices.data(), packedIndices.size() };
+		blobs[MESH_CACHE_MESHLETS] = { meshlets.data(), meshlets.size() * sizeof(Meshlet) };
+		blobs[MESH_CACHE_LODS] = { lods.data(), lods.size() * sizeof(MeshLod) };
+
+		MeshCache::Write(path, info, blobs);
+	}
+
+	PrepareResidency();
+	loadTimes.otherSeconds += lap();
+	loadTimes.totalSeconds = std::chrono::duration<double>(stepStart - start).count();
+	return true;
+}
+
+bool Mesh::LoadObjLegacy(const char* path) {
+
+	std::vector< unsigned int > vertexIndices, uvIndices, normalIndices;
+	std::vector< glm::vec3 > temp_vertices;
+	std::vector< glm::vec2 > temp_uvs;
+	std::vector< glm::vec3 > temp_normals;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	FILE * file;
+	
+	int err = fopen_s(&file, path, "r");
+	if (err != 0) {
+		printf("Impossible to open the file !\n");
+		return false;
+	}
+
+	while (1) {
+
+		char lineHeader[128];
+		// read the first word of the line
+		int res = fscanf(file, "%s", lineHeader);
+		if (res == EOF)
+			break; // EOF = End Of File. Quit the loop.
+
+		// else : parse lineHeader
+		if (strcmp(lineHeader, "v") == 0) {
+			glm::vec3 vertex;
+			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+			temp_vertices.push_back(vertex);
+		}
+		else if (strcmp(lineHeader, "vt") == 0) {
+			glm::vec2 uv;
+			fscanf(file, "%f %f\n", &uv.x, &uv.y);
+			temp_uvs.push_back(uv);
+		}
+		else if (strcmp(lineHeader, "vn") == 0) {
+			glm::vec3 normal;
+			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+			temp_normals.push_back(normal);
+		}
+		else if (strcmp(lineHeader, "f") == 0) {
+			std::string vertex1, vertex2, vertex3;
+			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+			if (matches != 9) {
+				printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+				return false;
+			}
+			vertexIndices.push_back(vertexIndex[0]);
+			vertexIndices.push_back(vertexIndex[1]);
+			vertexIndices.push_back(vertexIndex[2]);
+			uvIndices.push_back(uvIndex[0]);
+			uvIndices.push_back(uvIndex[1]);
+			uvIndices.push_back(uvIndex[2]);
+			normalIndices.push_back(normalIndex[0]);
+			normalIndices.push_back(normalIndex[1]);
+			normalIndices.push_back(normalIndex[2]);
+		}
+
+	}
+
+	ObjLoadStats stats;
+	stats.bytes = ftell(file);
+	fclose(file);
+
+	// For each vertex of each triangle
+	for (unsigned int i = 0; i < vertexIndices.size(); i++) {
+	
+		unsigned int vertexIndex = vertexIndices[i];
+		unsigned int uvIndex = uvIndices[i];
+		unsigned int normalIndex = normalIndices[i];
+		
+		mesh.positions.push_back( temp_vertices[vertexIndex - 1] );
+		mesh.uvs.push_back(temp_uvs[uvIndex - 1]);
+		mesh.normals.push_back(temp_normals[normalIndex - 1]);
+		// Every corner keeps its own vertex
+		mesh.indices.push_back(i);
+	}
+
+	mesh.hasUvs = !temp_uvs.empty();
+	hasTexture = mesh.hasUvs;
+	MeshletBuilder::Build(mesh.indices, mesh.positions, meshlets);
+	// Unindexed corners are all seams to the simplifier, the full mesh is the only level
+	lods.assign(1, MeshLod{ 0, (uint32_t)mesh.indices.size(), 0.0f, 0 });
+	// Every corner is its own vertex, so the tangents are per face like the normals of the file
+	TangentGenerator::Generate(mesh, mesh.indices.size());
+	ComputeBounds();
+	PackIndices();
+	BuildBvh(path);
+
+	if (vertexFormat == VERTEX_FORMAT_COMPACT) {
+		QuantizationError error;
+		MeshQuantizer::Quantize(mesh, quantized, &error);
+		MeshQuantizer::PrintError(path, error);
+		FreeFloatVertices();
+	}
+
+	sourcePath = path;
+	PrepareResidency();
+
+	stats.faces = vertexIndices.size() / 3;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	ObjLoader::PrintStats(path, stats);
+
+	return true;
+}
+
+
+
+void Mesh::SetLoaderThreads(unsigned int numThreads) {
+	loaderThreads = numThreads;
+}
+
+unsigned int Mesh::GetLoaderThreads() {
+	return loaderThreads;
+}
+
+void Mesh::SetUseMeshCache(bool enabled) {
+	useMeshCache = enabled;
+}
+
+void Mesh::SetOptimizeMeshes(bool enabled) {
+	optimizeMeshes = enabled;
+}
+
+void Mesh::SetBuildBvhs(bool enabled) {
+	buildBvhs = enabled;
+}
+
+void Mesh::SetVertexFormat(VertexFormat format) {
+	vertexFormat = format;
+}
+
+VertexFormat Mesh::GetVertexFormat() {
+	return vertexFormat;
+}
+
+void Mesh::SetVertexLayout(VertexLayout layout) {
+	vertexLayout = layout;
+}
+
+VertexLayout Mesh::GetVertexLayout() {
+	return vertexLayout;
+}
+
+void Mesh::SetDefaultVertexLayout(VertexLayout layout) {
+	defaultVertexLayout = layout;
+}
+
+VertexLayout Mesh::GetDefaultVertexLayout() {
+	return defaultVertexLayout;
+}
+
+void Mesh::SetResidency(MeshResidency policy) {
+	residency = policy;
+}
+
+MeshResidency Mesh::GetResidency() {
+	return residency;
+}
+
+void Mesh::SetDefaultResidency(MeshResidency policy) {
+	defaultResidency = policy;
+}
+
+MeshResidency Mesh::GetDefaultResidency() {
+	return defaultResidency;
+}
+
+const char* Mesh::GetResidencyName(MeshResidency policy) {
+	switch (policy) {
+	case MESH_RESIDENCY_KEEP:
+		return "keep";
+	case MESH_RESIDENCY_COMPRESSED:
+		return "compressed";
+	default:
+		return "drop";
+	}
+}
+
+void Mesh::SetInterleavedStride(unsigned int stride) {
+	interleavedStride = stride;
+}
+
+glm::vec3 Mesh::GetBoundsMin() {
+	return boundsMin;
+}
+
+glm::vec3 Mesh::GetBoundsExtent() {
+	return boundsExtent;
+}
+
+void Mesh::PackIndices() {
+
+	numVertices = (unsigned int)mesh.positions.size();
+	// The coarser levels follow the full resolution indices in the same buffer
+	numIndices = lods.empty() ? (unsigned int)mesh.indices.size() : lods[0].indexCount;
+
+	unsigned int indexSize = MeshBuilder::PackIndices(mesh.indices, mesh.positions.size(), packedIndices);
+	indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void Mesh::ComputeBounds() {
+
+	glm::vec3 boundsMax(0.0f);
+	boundsMin = glm::vec3(0.0f);
+	if (!mesh.positions.empty())
+		boundsMin = boundsMax = mesh.positions[0];
+	for (const glm::vec3& position : mesh.positions) {
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+	}
+	boundsExtent = boundsMax - boundsMin;
+}
+
+bool Mesh::LoadCachedRanges() {
+
+	MeshCacheInfo info = meshCache.GetInfo();
+	MeshCacheBlobView meshletBlob = meshCache.GetBlob(MESH_CACHE_MESHLETS);
+	MeshCacheBlobView lodBlob = meshCache.GetBlob(MESH_CACHE_LODS);
+	if (meshletBlob.size % sizeof(Meshlet) != 0 || lodBlob.size % sizeof(MeshLod) != 0)
+		return false;
+
+	// Meshlets are read by the culling every frame, they outlive the mapping
+	const Meshlet* cachedMeshlets = static_cast<const Meshlet*>(meshletBlob.data);
+	meshlets.assign(cachedMeshlets, cachedMeshlets + meshletBlob.size / sizeof(Meshlet));
+	const MeshLod* cachedLods = static_cast<const MeshLod*>(lodBlob.data);
+	lods.assign(cachedLods, cachedLods + lodBlob.size / sizeof(MeshLod));
+	if (lods.empty())
+		lods.assign(1, MeshLod{ 0, info.numIndices, 0.0f, 0 });
+
+	// Every range is drawn straight from the index blob
+	uint64_t blobIndices = meshCache.GetBlob(MESH_CACHE_INDICES).size / info.indexSize;
+	bool valid = true;
+	for (const Meshlet& meshlet : meshlets)
+		valid = valid && (uint64_t)meshlet.firstIndex + meshlet.indexCount <= info.numIndices;
+	for (const MeshLod& lod : lods)
+		valid = valid && (uint64_t)lod.firstIndex + lod.indexCount <= blobIndices;
+
+	if (!valid) {
+		printf("Mesh cache of %s has index ranges past its indices, rebuilding it\n", sourcePath.c_str());
+		meshlets.clear();
+		lods.clear();
+	}
+	return valid;
+}
+
+void Mesh::BuildBvh(const char* path) {
+
+	if (!buildBvhs)
+		return;
+
+	vector<glm::vec3> cachedPositions;
+	vector<unsigned int> indices(numIndices);
+
+	if (meshCache.IsOpen()) {
+
+		// Cached meshes only have the GPU layout, the positions and indices are decoded from it
+		cachedPositions.resize(numVertices);
+		MeshCacheBlobView positionBlob = meshCache.GetBlob(MESH_CACHE_POSITIONS);
+		if (vertexFormat == VERTEX_FORMAT_COMPACT) {
+			const uint16_t* quantizedPositions = static_cast<const uint16_t*>(positionBlob.data);
+			for (unsigned int v = 0; v < numVertices; v++) {
+				glm::vec3 unorm(quantizedPositions[v * 4], quantizedPositions[v * 4 + 1], quantizedPositions[v * 4 + 2]);
+				cachedPositions[v] = boundsMin + unorm / 65535.0f * boundsExtent;
+			}
+		}
+		else
+			memcpy(cachedPositions.data(), positionBlob.data, numVertices * sizeof(glm::vec3));
+
+		MeshCacheBlobView indexBlob = meshCache.GetBlob(MESH_CACHE_INDICES);
+		if (indexType == GL_UNSIGNED_SHORT) {
+			const uint16_t* shortIndices = static_cast<const uint16_t*>(indexBlob.data);
+			for (unsigned int i = 0; i < numIndices; i++)
+				indices[i] = shortIndices[i];
+		}
+		else
+			memcpy(indices.data(), indexBlob.data, numIndices * sizeof(unsigned int));
+	}
+	else
+		indices.assign(mesh.indices.begin(), mesh.indices.begin() + numIndices);
+
+	BvhBuildStats stats;
+	bvh.Build(indices, meshCache.IsOpen() ? cachedPositions : mesh.positions, loaderThreads, &stats);
+	MeshBvh::PrintStats(path, stats);
+}
+
+void Mesh::PrepareResidency() {
+
+	// The 32 bit indices only fed the builders, packedIndices has them in the GPU format
+	vector<unsigned int>().swap(mesh.indices);
+
+	bool compact = vertexFormat == VERTEX_FORMAT_COMPACT;
+
+	if (residency == MESH_RESIDENCY_DROP) {
+		// Only the triangle hierarchy keeps triangles, from compact positions and the full resolution indices
+		if (!bvh.IsEmpty()) {
+			if (meshCache.IsOpen()) {
+				MeshCacheBlobView indexBlob = meshCache.GetBlob(MESH_CACHE_INDICES);
+				indexBlob.size = (size_t)numIndices * (indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+				CopyBlob(indexBlob, packedIndices);
+				MeshCacheBlobView positionBlob = meshCache.GetBlob(MESH_CACHE_POSITIONS);
+				if (compact) {
+					CopyBlob(positionBlob, quantized.positions);
+					quantized.boundsMin = boundsMin;
+					quantized.boundsExtent = boundsExtent;
+				}
+				else
+					MeshQuantizer::QuantizePositions(static_cast<const glm::vec3*>(positionBlob.data), numVertices, quantized);
+			}
+			else if (!compact)
+				MeshQuantizer::QuantizePositions(mesh.positions.data(), mesh.positions.size(), quantized);
+		}
+		UpdateBvhGeometry();
+		return;
+	}
+
+	// Mapped meshes have no host arrays, the copy is taken before BuildGeometry closes the mapping
+	if (meshCache.IsOpen()) {
+		CopyBlob(meshCache.GetBlob(MESH_CACHE_INDICES), packedIndices);
+		if (compact) {
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_POSITIONS), quantized.positions);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_NORMALS), quantized.normals);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_UVS), quantized.uvs);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_TANGENTS), quantized.tangents);
+			quantized.boundsMin = boundsMin;
+			quantized.boundsExtent = boundsExtent;
+		}
+		else {
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_POSITIONS), mesh.positions);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_NORMALS), mesh.normals);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_UVS), mesh.uvs);
+			CopyBlob(meshCache.GetBlob(MESH_CACHE_TANGENTS), mesh.tangents);
+			mesh.hasUvs = hasTexture;
+		}
+	}
+
+	if (residency == MESH_RESIDENCY_COMPRESSED && !compact) {
+		MeshQuantizer::Quantize(mesh, quantized);
+		// The upload reads the mapping, the float copy was only the input of the quantization
+		if (meshCache.IsOpen())
+			FreeFloatVertices();
+	}
+
+	UpdateBvhGeometry();
+}
+
+void Mesh::ApplyResidency() {
+
+	// Nothing is freed, the hierarchy keeps reading what PrepareResidency pointed it at
+	if (residency == MESH_RESIDENCY_KEEP)
+		return;
+
+	// Float meshes are uploaded from float arrays, the compressed copy replaces them afterwards
+	FreeFloatVertices();
+
+	if (residency == MESH_RESIDENCY_DROP) {
+		vector<int16_t>().swap(quantized.normals);
+		vector<uint16_t>().swap(quantized.uvs);
+		vector<int8_t>().swap(quantized.tangents);
+		if (bvh.IsEmpty()) {
+			vector<uint16_t>().swap(quantized.positions);
+			vector<unsigned char>().swap(packedIndices);
+		}
+		else {
+			// The levels of detail appended after the full resolution indices were only needed by the upload
+			size_t indexBytes = std::min(packedIndices.size(), (size_t)numIndices * (indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+			vector<unsigned char>(packedIndices.begin(), packedIndices.begin() + indexBytes).swap(packedIndices);
+		}
+	}
+
+	UpdateBvhGeometry();
+}
+
+void Mesh::UpdateBvhGeometry() {
+
+	BvhGeometry geometry;
+	if (!mesh.positions.empty())
+		geometry.positions = mesh.positions.data();
+	else if (!quantized.positions.empty()) {
+		geometry.quantizedPositions = quantized.positions.data();
+		geometry.boundsMin = quantized.boundsMin;
+		geometry.boundsExtent = quantized.boundsExtent;
+	}
+
+	geometry.indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	if (numIndices > 0 && packedIndices.size() >= (size_t)numIndices * geometry.indexSize)
+		geometry.indices = packedIndices.data();
+
+	bvh.SetGeometry(geometry);
+}
+
+void Mesh::FreeFloatVertices() {
+
+	vector<glm::vec3>().swap(mesh.positions);
+	vector<glm::vec3>().swap(mesh.normals);
+	vector<glm::vec2>().swap(mesh.uvs);
+	vector<glm::vec4>().swap(mesh.tangents);
+}
+
+VertexAttributeFormat Mesh::GetAttributeFormat(VertexFormat format, int attribute) {
+
+	// Compact positions are padded to 4 shorts, normals and tangents stay raw integers and the shader applies the snorm conversion
+	static const VertexAttributeFormat floatFormats[VERTEX_ATTRIBUTE_COUNT] = {
+		{ 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float) },
+		{ 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float) },
+		{ 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float) },
+		{ 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float) }
+	};
+	static const VertexAttributeFormat compactFormats[VERTEX_ATTRIBUTE_COUNT] = {
+		{ 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(uint16_t) },
+		{ 2, GL_SHORT, GL_FALSE, 2 * sizeof(int16_t) },
+		{ 2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(uint16_t) },
+		{ 4, GL_BYTE, GL_FALSE, 4 * sizeof(int8_t) }
+	};
+
+	return format == VERTEX_FORMAT_COMPACT ? compactFormats[attribute] : floatFormats[attribute];
+}
+
+unsigned int Mesh::GetVertexStride() {
+
+	unsigned int size = 0;
+	for (int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++)
+		size += GetAttributeFormat(vertexFormat, attribute).bytes;
+
+	if (vertexLayout == VERTEX_LAYOUT_SPLIT)
+		return size;
+
+	// Padding up to the requested stride, kept a multiple of 4 bytes for the attribute alignment rules
+	unsigned int stride = interleavedStride > size ? interleavedStride : size;
+	return (stride + 3) & ~3u;
+}
+
+void Mesh::BuildGeometry(){
+
+	cout << "Buildeando Geometria" << std::endl;
+
+	// Vertex data comes either from the mapped cache or from the parsed arrays
+	MeshCacheBlobView streams[VERTEX_ATTRIBUTE_COUNT] = {
+		{ mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3) },
+		{ mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3) },
+		{ mesh.uvs.data(), mesh.uvs.size() * sizeof(glm::vec2) },
+		{ mesh.tangents.data(), mesh.tangents.size() * sizeof(glm::vec4) }
+	};
+	MeshCacheBlobView indices = { packedIndices.data(), packedIndices.size() };
+
+	if (vertexFormat == VERTEX_FORMAT_COMPACT) {
+		streams[0] = { quantized.positions.data(), quantized.positions.size() * sizeof(uint16_t) };
+		streams[1] = { quantized.normals.data(), quantized.normals.size() * sizeof(int16_t) };
+		streams[2] = { quantized.uvs.data(), quantized.uvs.size() * sizeof(uint16_t) };
+		streams[3] = { quantized.tangents.data(), quantized.tangents.size() * sizeof(int8_t) };
+	}
+
+	if (meshCache.IsOpen()) {
+		streams[0] = meshCache.GetBlob(MESH_CACHE_POSITIONS);
+		streams[1] = meshCache.GetBlob(MESH_CACHE_NORMALS);
+		streams[2] = meshCache.GetBlob(MESH_CACHE_UVS);
+		streams[3] = meshCache.GetBlob(MESH_CACHE_TANGENTS);
+		indices = meshCache.GetBlob(MESH_CACHE_INDICES);
+	}
+
+	// Creates on GPU the vertex array
+	glGenVertexArrays(1, &VAO);
+	// Binds the vertex array to set all the its properties
+	GLState::BindVertexArray(VAO);
+
+	if (vertexLayout == VERTEX_LAYOUT_INTERLEAVED) {
+
+		unsigned int stride = GetVertexStride();
+
+		// Creates on GPU a single vertex buffer object holding every attribute
+		glGenBuffers(1, &VBO);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)numVertices * stride, NULL, GL_STATIC_DRAW);
+		gpuBytes += (size_t)numVertices * stride;
+
+		// The streams are interleaved straight into the buffer memory, there is no CPU side copy
+		unsigned char* mapped = numVertices > 0
+			? (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)numVertices * stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)
+			: nullptr;
+
+		// Without a mapping the vertices are interleaved in a staging copy and uploaded from it
+		std::vector<unsigned char> staging;
+		if (numVertices > 0 && !mapped) {
+			printf("Mesh %s: the vertex buffer could not be mapped (GL error 0x%x), uploading from a staging copy\n",
+				sourcePath.c_str(), glGetError());
+			staging.resize((size_t)numVertices * stride);
+		}
+		unsigned char* vertices = mapped ? mapped : staging.data();
+
+		size_t offset = 0;
+		for (int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++) {
+
+			VertexAttributeFormat attributeFormat = GetAttributeFormat(vertexFormat, attribute);
+
+			if (vertices) {
+				const unsigned char* source = (const unsigned char*)streams[attribute].data;
+				size_t count = streams[attribute].size / attributeFormat.bytes;
+				if (count > numVertices)
+					count = numVertices;
+				for (size_t v = 0; v < count; v++)
+					memcpy(vertices + v * stride + offset, source + v * attributeFormat.bytes, attributeFormat.bytes);
+			}
+
+			// Sets the vertex attributes: position, normal, texture and tangent
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribPointer(attribute, attributeFormat.size, attributeFormat.type, attributeFormat.normalized, stride, (void *)offset);
+
+			offset += attributeFormat.bytes;
+		}
+
+		if (vertices) {
+			// Padding bytes are zeroed so the buffer content is deterministic
+			for (size_t v = 0; offset < stride && v < numVertices; v++)
+				memset(vertices + v * stride + offset, 0, stride - offset);
+			if (mapped)
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+			else
+				glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)staging.size(), staging.data());
+		}
+	}
+	else {
+
+		// Creates on GPU one vertex buffer object per attribute
+		GLuint* buffers[VERTEX_ATTRIBUTE_COUNT] = { &VBO, &normalBuffer, &uvBuffer, &tangentBuffer };
+
+		for (int attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++) {
+
+			VertexAttributeFormat attributeFormat = GetAttributeFormat(vertexFormat, attribute);
+
+			glGenBuffers(1, buffers[attribute]);
+			GLState::BindBuffer(GL_ARRAY_BUFFER, *buffers[attribute]);
+			glBufferData(GL_ARRAY_BUFFER, streams[attribute].size, streams[attribute].data, GL_STATIC_DRAW);
+			gpuBytes += streams[attribute].size;
+
+			// Sets the vertex attributes: position, normal, texture and tangent
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribPointer(attribute, attributeFormat.size, attributeFormat.type, attributeFormat.normalized, attributeFormat.bytes, (void *)0);
+		}
+	}
+
+	// Creates on GPU the index buffer, the vertex array keeps it bound
+	glGenBuffers(1, &elementBuffer);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size, indices.data, GL_STATIC_DRAW);
+	gpuBytes += indices.size;
+	
+	GLState::BindVertexArray(0);
+
+	// The GPU has its own copy now
+	meshCache.Close();
+	ApplyResidency();
+
+	state = MESH_READY;
+}
+
+bool Mesh::Reupload() {
+
+	DeleteGeometry();
+
+	if (residency == MESH_RESIDENCY_DROP || packedIndices.empty()) {
+		// Only what the triangle hierarchy reads stayed on the host, the mesh cache makes the second load cheap
+		if (!LoadObj(sourcePath.c_str())) {
+			state = MESH_FAILED;
+			return false;
+		}
+	}
+	else if (vertexFormat == VERTEX_FORMAT_FLOAT && mesh.positions.empty())
+		MeshQuantizer::Dequantize(quantized, mesh);
+
+	BuildGeometry();
+	return true;
+}
+
+void Mesh::DeleteGeometry() {
+
+	// Deletes the vertex array from the GPU
+	if (VAO != 0)
+		GLState::DeleteVertexArray(VAO);
+	// Deletes the vertex objects from the GPU
+	GLuint buffers[] = { VBO, normalBuffer, uvBuffer, tangentBuffer, elementBuffer };
+	for (GLuint buffer : buffers) {
+		if (buffer != 0)
+			GLState::DeleteBuffer(buffer);
+	}
+
+	VAO = 0;
+	VBO = 0;
+	gpuBytes = 0;
+	normalBuffer = 0;
+	uvBuffer = 0;
+	tangentBuffer = 0;
+	elementBuffer = 0;
+}
+
+bool Mesh::HasTexture() {
+	return hasTexture;
+}
+
+const vector<Meshlet>& Mesh::GetMeshlets() {
+	return meshlets;
+}
+
+const MeshBvh& Mesh::GetBvh() {
+	return bvh;
+}
+
+const vector<MeshLod>& Mesh::GetLods() {
+	return lods;
+}
+
+unsigned int Mesh::SelectLod(float pixelsPerUnit, float maxPixelError, unsigned int currentLod, float hysteresis) {
+
+	// The errors grow level after level, the first one under the limit from the coarse end is the coarsest that fits
+	unsigned int lod = 0;
+	for (size_t l = lods.size(); l-- > 1;) {
+		if (lods[l].error * pixelsPerUnit <= maxPixelError) {
+			lod = (unsigned int)l;
+			break;
+		}
+	}
+
+	// Finer levels are taken at once, coarser ones only with some margin so a model at the threshold does not pop
+	if (hysteresis > 0.0f && currentLod < lods.size()) {
+		while (lod > currentLod && lods[lod].error * pixelsPerUnit > maxPixelError * (1.0f - hysteresis))
+			lod--;
+	}
+
+	return lod;
+}
+
+MeshLoadTimes Mesh::GetLoadTimes() {
+	return loadTimes;
+}
+
+MeshMemoryStats Mesh::GetMemoryStats() {
+
+	MeshMemoryStats stats;
+	stats.hostGeometryBytes = mesh.positions.capacity() * sizeof(glm::vec3) + mesh.normals.capacity() * sizeof(glm::vec3)
+		+ mesh.uvs.capacity() * sizeof(glm::vec2) + mesh.tangents.capacity() * sizeof(glm::vec4)
+		+ mesh.indices.capacity() * sizeof(unsigned int)
+		+ quantized.positions.capacity() * sizeof(uint16_t) + quantized.normals.capacity() * sizeof(int16_t)
+		+ quantized.uvs.capacity() * sizeof(uint16_t) + quantized.tangents.capacity() * sizeof(int8_t)
+		+ packedIndices.capacity();
+	stats.hostSupportBytes = meshlets.capacity() * sizeof(Meshlet) + lods.capacity() * sizeof(MeshLod) + bvh.GetMemorySize();
+	stats.gpuBytes = gpuBytes;
+	return stats;
+}
+
+MeshState Mesh::GetState() {
+	return state;
+}
+
+void Mesh::SetState(MeshState meshState) {
+	state = meshState;
+}
+
+bool Mesh::IsReady() {
+	return state == MESH_READY;
+}
@@ -0,0 +1,417 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <stdio.h>
+#include <iostream>
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "MeshBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshQuantizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "MeshBvh.h"
+#include "TangentGenerator.h"
+
+using namespace std;
+
+// Vertex layout uploaded by BuildGeometry
+enum VertexFormat {
+	// 48 bytes per vertex, float positions, normals, uvs and tangents
+	VERTEX_FORMAT_FLOAT,
+	// 20 bytes per vertex, see QuantizedMesh
+	VERTEX_FORMAT_COMPACT
+};
+
+// How the vertex attributes are arranged in GPU buffers
+enum VertexLayout {
+	// A single buffer, the attributes of a vertex are next to each other
+	VERTEX_LAYOUT_INTERLEAVED,
+	// One buffer per attribute
+	VERTEX_LAYOUT_SPLIT
+};
+
+// Life cycle of a mesh loaded through MeshManager
+enum MeshState {
+	// Parsing on a loader thread or waiting for its GPU upload
+	MESH_LOADING,
+	// Uploaded, it can be drawn
+	MESH_READY,
+	// The file could not be loaded
+	MESH_FAILED
+};
+
+// What stays in host memory once BuildGeometry copied a mesh to the GPU
+enum MeshResidency {
+	// Vertex and packed index arrays stay, the mesh can be uploaded again at once
+	MESH_RESIDENCY_KEEP,
+	// Only meshlets, levels of detail and the triangle hierarchy stay, with the compact positions and full resolution
+	// indices the hierarchy reads, about 8 bytes per vertex and 2 or 4 per index. Uploading again loads the file
+	MESH_RESIDENCY_DROP,
+	// Compact vertices and packed indices stay, 20 bytes per vertex instead of 48 for float meshes
+	MESH_RESIDENCY_COMPRESSED
+};
+
+/**
+* Bytes held by a mesh on the host and on the GPU
+*/
+struct MeshMemoryStats {
+	// Vertex and index arrays, what the residency policy controls, including the ones the triangle hierarchy reads
+	size_t hostGeometryBytes = 0;
+	// Meshlets, levels of detail and the nodes of the triangle hierarchy, kept with every policy
+	size_t hostSupportBytes = 0;
+	// Vertex and index buffers
+	size_t gpuBytes = 0;
+};
+
+/**
+* Time spent in each step of the last LoadObj, zero for the steps that did not run
+*/
+struct MeshLoadTimes {
+	// ObjLoader, from the file to the raw streams and face indices
+	double parseSeconds = 0.0;
+	// Corners welded into indexed vertices
+	double indexSeconds = 0.0;
+	// Vertex cache, overdraw and vertex fetch passes
+	double optimizeSeconds = 0.0;
+	double meshletSeconds = 0.0;
+	double lodSeconds = 0.0;
+	double tangentSeconds = 0.0;
+	double bvhSeconds = 0.0;
+	// Bounds, index packing, quantization and the mesh cache, or the whole load when it came from the cache
+	double otherSeconds = 0.0;
+	double totalSeconds = 0.0;
+};
+
+// Position, normal, uv and tangent, in attribute location order
+const int VERTEX_ATTRIBUTE_COUNT = 4;
+
+/**
+* GPU format of one vertex attribute
+*/
+struct VertexAttributeFormat {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	// Bytes taken by the attribute in a vertex
+	unsigned int bytes;
+};
+
+/**
+* Geometry of one OBJ file on the CPU and the GPU.
+* Meshes are shared between models through MeshManager, which owns them.
+*/
+class Mesh{
+
+private:
+
+	// Indexed vertex data on the CPU
+	MeshData mesh;
+	// Compact vertex data on the CPU, replaces the float arrays of mesh in VERTEX_FORMAT_COMPACT
+	QuantizedMesh quantized;
+	VertexFormat vertexFormat;
+	VertexLayout vertexLayout;
+	MeshResidency residency;
+	MeshState state;
+	// OBJ file of the mesh, loaded again by Reupload when nothing stayed on the host
+	string sourcePath;
+	// Bounding box of the positions, also the dequantization range of compact positions
+	glm::vec3 boundsMin;
+	glm::vec3 boundsExtent;
+	// Clusters of the index buffer for culling
+	vector < Meshlet > meshlets;
+	// Levels of detail sharing the vertex buffer, the first one is the full mesh the meshlets split
+	vector < MeshLod > lods;
+	// Triangles of the full resolution level for ray queries
+	MeshBvh bvh;
+	// Indices in the GPU format, only kept until BuildGeometry
+	vector < unsigned char > packedIndices;
+	bool hasTexture;
+
+	// Index (GPU) of the geometry buffer
+	unsigned int VBO;
+	// Index (GPU) vertex array object
+	unsigned int VAO;
+
+	GLuint colorBuffer;
+	GLuint uvBuffer;
+	GLuint normalBuffer;
+	GLuint tangentBuffer;
+	GLuint elementBuffer;
+
+	// Bytes of the buffers created by BuildGeometry
+	size_t gpuBytes;
+	// Steps of the last LoadObj
+	MeshLoadTimes loadTimes;
+
+	// Number of vertices uploaded by BuildGeometry
+	unsigned int numVertices;
+	// Number of indices of the full resolution level, three per triangle
+	unsigned int numIndices;
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum indexType;
+	// Mapped binary sidecar, only open between LoadObj and BuildGeometry
+	MeshCache meshCache;
+
+	// Reads and writes the binary sidecar of each OBJ file
+	static bool useMeshCache;
+	// Reorders triangles and vertices of parsed meshes before they are cached
+	static bool optimizeMeshes;
+	// Number of threads used to parse OBJ files, 0 uses every hardware thread
+	static unsigned int loaderThreads;
+	// Layout of meshes created from now on
+	static VertexLayout defaultVertexLayout;
+	// Minimum stride of interleaved vertices, 0 packs the attributes tightly
+	static unsigned int interleavedStride;
+	// Builds the triangle hierarchy of every loaded mesh
+	static bool buildBvhs;
+	// Residency of meshes created from now on
+	static MeshResidency defaultResidency;
+
+	/**
+	* Updates the counts and converts the indices to the GPU index format
+	*/
+	void PackIndices();
+
+	/**
+	* Bounding box of the parsed positions
+	*/
+	void ComputeBounds();
+
+	/**
+	* Copies the meshlets and levels of detail of the mapped cache
+	* @returns{bool} false if a range reaches past the cached indices, the cache can not be used
+	*/
+	bool LoadCachedRanges();
+
+	/**
+	* Builds the triangle hierarchy from the parsed arrays, or from the mapped cache when the mesh came from it
+	* @param{const char *} Name shown in the report
+	*/
+	void BuildBvh(const char * path);
+
+	/**
+	* Points the triangle hierarchy at the host positions and indices, float positions when they are still there
+	*/
+	void UpdateBvhGeometry();
+
+	/**
+	* Takes the host copy the residency asks for while the parsed arrays or the cache mapping are still there,
+	* so the work runs on the loader thread and not during the upload
+	*/
+	void PrepareResidency();
+
+	/**
+	* Frees what the residency does not keep, once the GPU has its copy
+	*/
+	void ApplyResidency();
+
+	/**
+	* Frees the float position, normal, uv and tangent arrays
+	*/
+	void FreeFloatVertices();
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+public:
+
+	Mesh();
+
+	/**
+	* Deletes the GPU buffers, the GL context has to be alive
+	*/
+	~Mesh();
+
+
+	/**
+	* Loads an OBJ file, from its binary cache when it is up to date or through the memory mapped parser
+	* @param{const char *} Path to the OBJ file
+	* @returns{bool} true if the file could be parsed
+	*/
+	bool LoadObj(const char * path);
+
+	/**
+	* Loads an OBJ file with the original fscanf parser, kept as the reference for load speed comparisons
+	* @param{const char *} Path to the OBJ file
+	* @returns{bool} true if the file could be parsed
+	*/
+	bool LoadObjLegacy(const char * path);
+
+	/**
+	* Sets how many threads parse each OBJ file
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread
+	*/
+	static void SetLoaderThreads(unsigned int numThreads);
+
+	static unsigned int GetLoaderThreads();
+
+	/**
+	* Enables the binary mesh cache written next to each OBJ file
+	* @param{bool} true to read and write the cache
+	*/
+	static void SetUseMeshCache(bool enabled);
+
+	/**
+	* Enables the vertex cache, overdraw and vertex fetch optimization of parsed meshes.
+	* It runs when the mesh cache is built, loads from the cache get the optimized order for free
+	* @param{bool} true to optimize
+	*/
+	static void SetOptimizeMeshes(bool enabled);
+
+	/**
+	* Enables the triangle hierarchy used by ray queries, built by LoadObj
+	* @param{bool} true to build it
+	*/
+	static void SetBuildBvhs(bool enabled);
+
+	/**
+	* Chooses the vertex layout of this mesh, it has to be set before LoadObj
+	* @param{VertexFormat} Float or compact vertices
+	*/
+	void SetVertexFormat(VertexFormat format);
+
+	VertexFormat GetVertexFormat();
+
+	/**
+	* Lowest corner of the bounding box, the unorm16 origin of compact vertices
+	*/
+	glm::vec3 GetBoundsMin();
+
+	/**
+	* Size of the bounding box, the box covered by compact positions
+	*/
+	glm::vec3 GetBoundsExtent();
+
+	/**
+	* Chooses how BuildGeometry arranges the attributes, new meshes get the default layout
+	* @param{VertexLayout} Interleaved or split buffers
+	*/
+	void SetVertexLayout(VertexLayout layout);
+
+	VertexLayout GetVertexLayout();
+
+	static void SetDefaultVertexLayout(VertexLayout layout);
+
+	static VertexLayout GetDefaultVertexLayout();
+
+	/**
+	* Chooses what stays on the host after the upload, it has to be set before LoadObj
+	* @param{MeshResidency} Keep, drop or compressed copy
+	*/
+	void SetResidency(MeshResidency policy);
+
+	MeshResidency GetResidency();
+
+	static void SetDefaultResidency(MeshResidency policy);
+
+	static MeshResidency GetDefaultResidency();
+
+	/**
+	* Name of a residency policy as given on the command line
+	*/
+	static const char* GetResidencyName(MeshResidency policy);
+
+	/**
+	* Pads interleaved vertices, e.g. to 32 or 64 bytes, the stride never gets smaller than the vertex
+	* @param{unsigned int} Minimum stride in bytes, 0 packs the attributes tightly
+	*/
+	static void SetInterleavedStride(unsigned int stride);
+
+	/**
+	* Bytes between two vertices of the interleaved buffer, or the size of a vertex in the split layout
+	*/
+	unsigned int GetVertexStride();
+
+	/**
+	* GPU format of one attribute of a vertex format
+	* @param{VertexFormat} Float or compact vertices
+	* @param{int} Attribute location, 0 position, 1 normal, 2 uv, 3 tangent
+	*/
+	static VertexAttributeFormat GetAttributeFormat(VertexFormat format, int attribute);
+
+
+	void BuildGeometry();
+
+	/**
+	* Deletes the GPU buffers and builds them again, from the host copy or by loading the file when it was dropped
+	* @returns{bool} true if the mesh is ready again
+	*/
+	bool Reupload();
+
+	/**
+	* Deletes the vertex array and buffers from the GPU
+	*/
+	void DeleteGeometry();
+
+	unsigned int GetVAO();
+
+	unsigned int GetVBO();
+
+	GLuint GetColorBuffer();
+
+	GLuint GetUvBuffer();
+
+	GLuint GetNormalBuffer();
+
+	GLuint GetTangentBuffer();
+
+	GLuint GetElementBuffer();
+
+	int GetNumTriangles();
+
+	unsigned int GetNumVertices();
+
+	int GetNumIndices();
+
+	GLenum GetIndexType();
+
+	bool HasTexture();
+
+	/**
+	* Clusters of the index buffer, in index buffer order
+	*/
+	const vector<Meshlet>& GetMeshlets();
+
+	/**
+	* Triangle hierarchy of the full resolution level, empty if it was not built
+	*/
+	const MeshBvh& GetBvh();
+
+	/**
+	* Index ranges of the levels of detail, from full resolution to coarsest
+	*/
+	const vector<MeshLod>& GetLods();
+
+	/**
+	* Picks the coarsest level of detail whose error, projected on the screen, stays under a limit
+	* @param{float} Pixels covered by one mesh unit at the distance of the mesh
+	* @param{float} Largest error allowed, in pixels
+	* @param{unsigned int} Level drawn in the previous frame
+	* @param{float} Fraction of the limit a coarser level has to stay under before it replaces the current one, 0 switches at once
+	* @returns{unsigned int} Level to draw
+	*/
+	unsigned int SelectLod(float pixelsPerUnit, float maxPixelError, unsigned int currentLod, float hysteresis);
+
+	/**
+	* Host and GPU bytes held by this mesh
+	*/
+	MeshMemoryStats GetMemoryStats();
+
+	/**
+	* Time spent in each step of the last LoadObj
+	*/
+	MeshLoadTimes GetLoadTimes();
+
+	MeshState GetState();
+
+	void SetState(MeshState meshState);
+
+	/**
+	* true once BuildGeometry ran, only ready meshes are drawn
+	*/
+	bool IsReady();
+
+};
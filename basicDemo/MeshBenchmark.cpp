@@ -0,0 +1,622 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#ifndef MESH_BENCHMARK_HEADLESS
+#include <GLFW/glfw3.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+#include "Mesh.h"
+
+/*
+* Standalone benchmark of Mesh::LoadObj and Mesh::BuildGeometry.
+* Loads every OBJ file under assets/models and synthetic grids of 10k to 10M triangles, 50M with --max-triangles 50000000,
+* and writes the ObjLoader parse time, the time of each post processing step, cache load time, peak RSS, heap bytes allocated,
+* parsed triangles per second and upload time as JSON.
+*
+* Upload times need a GL context, they are null when no window can be created or with --no-gl.
+* Without GLFW, e.g. on a headless Linux box, it builds from the basicDemo folder with
+*   g++ -std=c++14 -O2 -DNDEBUG -DMESH_BENCHMARK_HEADLESS -Iinclude MeshBenchmark.cpp Mesh.cpp MeshBuilder.cpp MeshBvh.cpp
+*       MeshCache.cpp MeshletBuilder.cpp MeshOptimizer.cpp MeshQuantizer.cpp MeshSimplifier.cpp ObjLoader.cpp
+*       MappedFile.cpp TangentGenerator.cpp ThreadPool.cpp Frustum.cpp GLState.cpp glad.c -o meshBenchmark -ldl -pthread
+*/
+
+namespace {
+
+	// Heap counters fed by the replaced global operator new, every thread allocates through it
+	std::atomic<size_t> allocatedBytes(0);
+	std::atomic<size_t> allocationCount(0);
+	std::atomic<size_t> liveBytes(0);
+	std::atomic<size_t> peakLiveBytes(0);
+
+	// Room in front of each block for its size, keeps the alignment of operator new
+	const size_t ALLOCATION_HEADER = 16;
+
+	// Sizes of the synthetic grids, capped by --max-triangles
+	const size_t SYNTHETIC_TRIANGLES[] = { 10000, 100000, 1000000, 10000000, 50000000 };
+	// Default cap, the 50M grid takes minutes and several GB to load
+	const size_t DEFAULT_MAX_TRIANGLES = 10000000;
+
+	/**
+	* Results of one OBJ file, times of -1 were not measured
+	*/
+	struct BenchmarkResult {
+		std::string path;
+		bool synthetic = false;
+		bool loaded = false;
+		size_t fileBytes = 0;
+		size_t triangles = 0;
+		size_t vertices = 0;
+		// Steps of the fastest load of the runs, with the mesh cache disabled.
+		// parseSeconds is ObjLoader alone, loadSeconds the whole LoadObj with its post processing
+		double parseSeconds = -1.0;
+		double loadSeconds = -1.0;
+		MeshLoadTimes steps;
+		// Load from the binary sidecar written by the first cached load
+		double cacheSeconds = -1.0;
+		// BuildGeometry until glFinish returns
+		double uploadSeconds = -1.0;
+		// Peak resident set during the load, of the whole process when the peak cannot be reset
+		size_t peakResidentBytes = 0;
+		// Heap traffic of the load
+		size_t allocatedBytes = 0;
+		size_t allocations = 0;
+		size_t peakHeapBytes = 0;
+	};
+
+	/**
+	* Options of the run
+	*/
+	struct BenchmarkOptions {
+		std::string modelsDirectory = "assets/models";
+		std::string syntheticDirectory = "benchmark_objs";
+		std::string jsonPath = "mesh_benchmark.json";
+		size_t maxTriangles = DEFAULT_MAX_TRIANGLES;
+		int runs = 1;
+		bool compact = false;
+		bool regenerate = false;
+		bool useGl = true;
+	};
+
+	void* countedAllocate(size_t size)
+	{
+		unsigned char* block = (unsigned char*)malloc(size + ALLOCATION_HEADER);
+		if (!block)
+			throw std::bad_alloc();
+		*(size_t*)block = size;
+
+		allocatedBytes += size;
+		allocationCount++;
+		size_t live = liveBytes += size;
+		size_t peak = peakLiveBytes.load();
+		while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live)) {
+		}
+		return block + ALLOCATION_HEADER;
+	}
+
+	void countedFree(void* pointer)
+	{
+		if (!pointer)
+			return;
+		unsigned char* block = (unsigned char*)pointer - ALLOCATION_HEADER;
+		liveBytes -= *(size_t*)block;
+		free(block);
+	}
+}
+
+void* operator new(size_t size) { return countedAllocate(size); }
+void* operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void* pointer) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { countedFree(pointer); }
+
+/**
+ * Restarts the peak resident set measurement
+ * @returns{bool} true if the operating system allows it, otherwise the peak covers the whole process
+ * */
+bool resetPeakResident()
+{
+#if defined(__linux__)
+	// Writing 5 to clear_refs resets VmHWM, since Linux 4.0
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (!file)
+		return false;
+	bool reset = fputs("5", file) >= 0;
+	return fclose(file) == 0 && reset;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Peak resident set of the process in bytes
+ * */
+size_t peakResident()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	FILE *file = fopen("/proc/self/status", "r");
+	if (!file)
+		return 0;
+	char line[256];
+	size_t kilobytes = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (strncmp(line, "VmHWM:", 6) == 0) {
+			kilobytes = strtoull(line + 6, nullptr, 10);
+			break;
+		}
+	}
+	fclose(file);
+	return kilobytes * 1024;
+#else
+	// ru_maxrss is in bytes on macOS
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (size_t)usage.ru_maxrss;
+#endif
+}
+
+size_t fileSize(const std::string& path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+#ifdef _WIN32
+	size_t size = (size_t)_ftelli64(file);
+#else
+	size_t size = (size_t)ftello(file);
+#endif
+	fclose(file);
+	return size;
+}
+
+bool endsWithObj(const std::string& name)
+{
+	if (name.size() < 4)
+		return false;
+	std::string extension = name.substr(name.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".obj";
+}
+
+/**
+ * Collects the OBJ files of a folder and its subfolders
+ * @param{const std::string &} Folder to search
+ * @param{std::vector<std::string> &} Paths found, appended
+ * */
+void findObjFiles(const std::string& directory, std::vector<std::string>& paths)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		std::string name = entry.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = directory + "/" + name;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			findObjFiles(path, paths);
+		else if (endsWithObj(name))
+			paths.push_back(path);
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+		return;
+	while (dirent *entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = directory + "/" + name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			continue;
+		if (S_ISDIR(info.st_mode))
+			findObjFiles(path, paths);
+		else if (endsWithObj(name))
+			paths.push_back(path);
+	}
+	closedir(dir);
+#endif
+}
+
+void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+/**
+ * Writes a wavy grid with positions, uvs and normals as an OBJ file
+ * @param{const std::string &} Path of the file
+ * @param{size_t} Wanted number of triangles, the grid is square so the file gets slightly more
+ * @returns{bool} true if the file was written
+ * */
+bool writeSyntheticObj(const std::string& path, size_t numTriangles)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		printf("Could not create %s\n", path.c_str());
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t side = std::max<size_t>(1, (size_t)ceil(sqrt(numTriangles / 2.0)));
+	std::vector<char> buffer(1 << 20);
+	size_t used = 0;
+	auto flush = [&](size_t room) {
+		if (used + room > buffer.size()) {
+			fwrite(buffer.data(), 1, used, file);
+			used = 0;
+		}
+	};
+
+	fprintf(file, "# synthetic grid, %zu triangles\n", side * side * 2);
+	float step = 1.0f / side;
+	for (size_t z = 0; z <= side; z++) {
+		for (size_t x = 0; x <= side; x++) {
+			float u = x * step, v = z * step;
+			float height = 0.05f * sinf(u * 20.0f) * cosf(v * 14.0f);
+			glm::vec3 normal = glm::normalize(glm::vec3(-cosf(u * 20.0f) * cosf(v * 14.0f), 1.0f, 0.7f * sinf(u * 20.0f) * sinf(v * 14.0f)));
+			flush(160);
+			used += snprintf(buffer.data() + used, 160, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.4f %.4f %.4f\n", u, height, v, u, v, normal.x, normal.y, normal.z);
+		}
+	}
+	for (size_t z = 0; z < side; z++) {
+		for (size_t x = 0; x < side; x++) {
+			// OBJ indices start at 1, the same index serves the position, uv and normal
+			size_t a = z * (side + 1) + x + 1, b = a + side + 1;
+			flush(160);
+			used += snprintf(buffer.data() + used, 160, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+				a, a, a, b, b, b, a + 1, a + 1, a + 1, a + 1, a + 1, a + 1, b, b, b, b + 1, b + 1, b + 1);
+		}
+	}
+	fwrite(buffer.data(), 1, used, file);
+	bool written = ferror(file) == 0;
+	written = fclose(file) == 0 && written;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Wrote %s, %zu triangles in %.2f s\n", path.c_str(), side * side * 2, seconds);
+	return written;
+}
+
+/**
+ * Loads one OBJ file with the cache off, then through the cache, then uploads it
+ * @param{const std::string &} Path to the OBJ file
+ * @param{const BenchmarkOptions &} Options of the run
+ * @param{bool} true when a GL context is current
+ * @returns{BenchmarkResult} Measurements of the file
+ * */
+BenchmarkResult benchmarkFile(const std::string& path, const BenchmarkOptions& options, bool hasContext)
+{
+	BenchmarkResult result;
+	result.path = path;
+	result.fileBytes = fileSize(path);
+	VertexFormat format = options.compact ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FLOAT;
+
+	// Parse, the heap and resident set figures come from the first run
+	Mesh::SetUseMeshCache(false);
+	for (int run = 0; run < options.runs; run++) {
+
+		bool resetPeak = resetPeakResident();
+		size_t allocatedBefore = allocatedBytes, allocationsBefore = allocationCount;
+		peakLiveBytes = liveBytes.load();
+		size_t liveBefore = liveBytes;
+
+		Mesh *mesh = new Mesh();
+		mesh->SetVertexFormat(format);
+		bool loaded = mesh->LoadObj(path.c_str());
+		MeshLoadTimes steps = mesh->GetLoadTimes();
+
+		if (!loaded) {
+			delete mesh;
+			Mesh::SetUseMeshCache(true);
+			return result;
+		}
+
+		if (run == 0) {
+			result.loaded = true;
+			result.triangles = mesh->GetNumTriangles();
+			result.vertices = mesh->GetNumVertices();
+			result.allocatedBytes = allocatedBytes - allocatedBefore;
+			result.allocations = allocationCount - allocationsBefore;
+			result.peakHeapBytes = peakLiveBytes - liveBefore;
+			result.peakResidentBytes = peakResident();
+			if (!resetPeak)
+				printf("%s: peak RSS cannot be reset, it covers the whole process\n", path.c_str());
+		}
+		if (result.loadSeconds < 0.0 || steps.totalSeconds < result.loadSeconds) {
+			result.steps = steps;
+			result.parseSeconds = steps.parseSeconds;
+			result.loadSeconds = steps.totalSeconds;
+		}
+
+		// The upload goes from the parsed arrays, the same path as the first load of a model
+		if (run == 0 && hasContext) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			mesh->BuildGeometry();
+			glFinish();
+			result.uploadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		delete mesh;
+	}
+
+	// The first cached load writes the sidecar, the second one reads it
+	Mesh::SetUseMeshCache(true);
+	{
+		Mesh writer;
+		writer.SetVertexFormat(format);
+		writer.LoadObj(path.c_str());
+	}
+	for (int run = 0; run < options.runs; run++) {
+		Mesh reader;
+		reader.SetVertexFormat(format);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!reader.LoadObj(path.c_str()))
+			break;
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (result.cacheSeconds < 0.0 || seconds < result.cacheSeconds)
+			result.cacheSeconds = seconds;
+	}
+
+	return result;
+}
+
+void writeJsonString(FILE *file, const std::string& text)
+{
+	fputc('"', file);
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			fputc('\\', file);
+		fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+void writeJsonSeconds(FILE *file, const char *name, double seconds)
+{
+	if (seconds < 0.0)
+		fprintf(file, "\"%s\": null", name);
+	else
+		fprintf(file, "\"%s\": %.3f", name, seconds * 1000.0);
+}
+
+/**
+ * Writes the options and the results of the run
+ * @param{const BenchmarkOptions &} Options of the run
+ * @param{const std::vector<BenchmarkResult> &} Results, one per OBJ file
+ * @param{bool} true when upload times were measured
+ * @returns{bool} true if the file was written
+ * */
+bool writeJson(const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results, bool hasContext)
+{
+	FILE *file = fopen(options.jsonPath.c_str(), "w");
+	if (!file) {
+		printf("Could not create %s\n", options.jsonPath.c_str());
+		return false;
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(file, "  \"loader_threads\": %u,\n", Mesh::GetLoaderThreads());
+	fprintf(file, "  \"vertex_format\": \"%s\",\n", options.compact ? "compact" : "float");
+	fprintf(file, "  \"runs\": %d,\n", options.runs);
+	fprintf(file, "  \"gl_context\": %s,\n", hasContext ? "true" : "false");
+	fprintf(file, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+		fprintf(file, "    { \"path\": ");
+		writeJsonString(file, result.path);
+		fprintf(file, ", \"synthetic\": %s, \"loaded\": %s, \"file_bytes\": %zu, \"triangles\": %zu, \"vertices\": %zu, ",
+			result.synthetic ? "true" : "false", result.loaded ? "true" : "false", result.fileBytes, result.triangles, result.vertices);
+		writeJsonSeconds(file, "parse_ms", result.parseSeconds);
+		fprintf(file, ", ");
+		writeJsonSeconds(file, "load_ms", result.loadSeconds);
+		// Post processing steps of the load, zero when a step is turned off
+		if (result.loaded) {
+			fprintf(file, ", \"post_process_ms\": { ");
+			writeJsonSeconds(file, "index", result.steps.indexSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "optimize", result.steps.optimizeSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "meshlets", result.steps.meshletSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "lods", result.steps.lodSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "tangents", result.steps.tangentSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "bvh", result.steps.bvhSeconds);
+			fprintf(file, ", ");
+			writeJsonSeconds(file, "other", result.steps.otherSeconds);
+			fprintf(file, " }");
+		}
+		fprintf(file, ", ");
+		writeJsonSeconds(file, "cache_load_ms", result.cacheSeconds);
+		fprintf(file, ", ");
+		writeJsonSeconds(file, "upload_ms", result.uploadSeconds);
+		fprintf(file, ", \"triangles_per_second\": %.0f, \"peak_rss_bytes\": %zu, \"allocated_bytes\": %zu, \"allocations\": %zu, \"peak_heap_bytes\": %zu }%s\n",
+			result.parseSeconds > 0.0 ? result.triangles / result.parseSeconds : 0.0,
+			result.peakResidentBytes, result.allocatedBytes, result.allocations, result.peakHeapBytes,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	bool written = ferror(file) == 0;
+	return fclose(file) == 0 && written;
+}
+
+/**
+ * Creates a hidden window so BuildGeometry can be timed
+ * @returns{bool} true if a GL context is current
+ * */
+bool createContext()
+{
+#ifdef MESH_BENCHMARK_HEADLESS
+	return false;
+#else
+	if (!glfwInit())
+		return false;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow *window = glfwCreateWindow(64, 64, "Mesh benchmark", NULL, NULL);
+	if (!window) {
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		glfwTerminate();
+		return false;
+	}
+	return true;
+#endif
+}
+
+void printUsage()
+{
+	printf("meshBenchmark [options]\n"
+		"  --models <dir>          folder searched for OBJ files (assets/models)\n"
+		"  --synthetic-dir <dir>   folder of the generated grids (benchmark_objs)\n"
+		"  --max-triangles <n>     largest synthetic grid (10000000), 50000000 adds the 50M one, 0 skips them\n"
+		"  --regenerate            rewrites the synthetic grids even if they exist\n"
+		"  --json <file>           results file (mesh_benchmark.json)\n"
+		"  --runs <n>              loads per file, the best time is kept (1)\n"
+		"  --loader-threads <n>    threads parsing each file, 0 uses every core (1)\n"
+		"  --compact-vertices      quantized vertices\n"
+		"  --no-mesh-optimize      skips the vertex cache optimization\n"
+		"  --no-bvh                skips the triangle hierarchy\n"
+		"  --no-gl                 skips the upload timing\n");
+}
+
+int main(int argc, char const *argv[])
+{
+	BenchmarkOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--models") == 0 && i + 1 < argc) {
+			options.modelsDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--synthetic-dir") == 0 && i + 1 < argc) {
+			options.syntheticDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--max-triangles") == 0 && i + 1 < argc) {
+			options.maxTriangles = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--regenerate") == 0) {
+			options.regenerate = true;
+		}
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			options.jsonPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			options.runs = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--loader-threads") == 0 && i + 1 < argc) {
+			Mesh::SetLoaderThreads(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--compact-vertices") == 0) {
+			options.compact = true;
+		}
+		else if (strcmp(argv[i], "--no-mesh-optimize") == 0) {
+			Mesh::SetOptimizeMeshes(false);
+		}
+		else if (strcmp(argv[i], "--no-bvh") == 0) {
+			Mesh::SetBuildBvhs(false);
+		}
+		else if (strcmp(argv[i], "--no-gl") == 0) {
+			options.useGl = false;
+		}
+		else {
+			printUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : -1;
+		}
+	}
+
+	bool hasContext = options.useGl && createContext();
+	if (!hasContext)
+		printf("No GL context, upload times are not measured\n");
+
+	std::vector<std::string> paths;
+	findObjFiles(options.modelsDirectory, paths);
+	std::sort(paths.begin(), paths.end());
+	size_t numBundled = paths.size();
+
+	if (options.maxTriangles > 0)
+		makeDirectory(options.syntheticDirectory);
+	for (size_t triangles : SYNTHETIC_TRIANGLES) {
+		if (triangles > options.maxTriangles)
+			break;
+		std::string path = options.syntheticDirectory + "/grid_" + std::to_string(triangles) + ".obj";
+		if ((options.regenerate || fileSize(path) == 0) && !writeSyntheticObj(path, triangles))
+			continue;
+		paths.push_back(path);
+	}
+
+	std::vector<BenchmarkResult> results;
+	for (size_t i = 0; i < paths.size(); i++) {
+		BenchmarkResult result = benchmarkFile(paths[i], options, hasContext);
+		result.synthetic = i >= numBundled;
+		results.push_back(result);
+	}
+
+	printf("\n%-44s %12s %10s %10s %10s %10s %10s %10s %10s\n", "file", "triangles", "parse ms", "Mtris/s", "post ms", "cache ms", "upload ms",
+		"RSS MB", "alloc MB");
+	for (const BenchmarkResult& result : results) {
+		if (!result.loaded) {
+			printf("%-44s failed to load\n", result.path.c_str());
+			continue;
+		}
+		char upload[32] = "-";
+		if (result.uploadSeconds >= 0.0)
+			snprintf(upload, sizeof(upload), "%.2f", result.uploadSeconds * 1000.0);
+		printf("%-44s %12zu %10.2f %10.2f %10.2f %10.2f %10s %10.1f %10.1f\n", result.path.c_str(), result.triangles,
+			result.parseSeconds * 1000.0, result.parseSeconds > 0.0 ? result.triangles / result.parseSeconds / 1e6 : 0.0,
+			(result.loadSeconds - result.parseSeconds) * 1000.0, result.cacheSeconds * 1000.0, upload,
+			result.peakResidentBytes / (1024.0 * 1024.0), result.allocatedBytes / (1024.0 * 1024.0));
+	}
+
+	bool written = writeJson(options, results, hasContext);
+	if (written)
+		printf("Results written to %s\n", options.jsonPath.c_str());
+
+#ifndef MESH_BENCHMARK_HEADLESS
+	if (hasContext)
+		glfwTerminate();
+#endif
+	return written ? 0 : -1;
+}
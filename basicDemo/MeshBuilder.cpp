@@ -0,0 +1,129 @@
+#include "MeshBuilder.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+	inline uint32_t HashCorner(unsigned int vertexIndex, unsigned int uvIndex, unsigned int normalIndex)
+	{
+		uint32_t hash = vertexIndex * 0x9e3779b1u;
+		hash ^= uvIndex * 0x85ebca6bu + (hash << 6) + (hash >> 2);
+		hash ^= normalIndex * 0xc2b2ae35u + (hash << 6) + (hash >> 2);
+		return hash;
+	}
+}
+
+void MeshBuilder::BuildIndexed(const ObjData& obj, MeshData& mesh, MeshIndexStats* stats)
+{
+	size_t numCorners = obj.vertexIndices.size();
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	mesh.uvs.clear();
+	mesh.tangents.clear();
+	mesh.positions.reserve(numCorners);
+	mesh.normals.reserve(numCorners);
+	mesh.uvs.reserve(numCorners);
+	mesh.indices.resize(numCorners);
+	mesh.hasUvs = !obj.uvs.empty();
+
+	// Open addressing table from corner triple to vertex, kept at most half full
+	size_t tableSize = 16;
+	while (tableSize < numCorners * 2)
+		tableSize <<= 1;
+	size_t mask = tableSize - 1;
+	std::vector<unsigned int> table(tableSize, EMPTY_SLOT);
+
+	for (size_t i = 0; i < numCorners; i++)
+	{
+		unsigned int vertexIndex = obj.vertexIndices[i];
+		unsigned int uvIndex = obj.uvIndices[i];
+		unsigned int normalIndex = obj.normalIndices[i];
+
+		size_t slot = HashCorner(vertexIndex, uvIndex, normalIndex) & mask;
+		while (table[slot] != EMPTY_SLOT)
+		{
+			unsigned int corner = table[slot];
+			if (obj.vertexIndices[corner] == vertexIndex && obj.uvIndices[corner] == uvIndex && obj.normalIndices[corner] == normalIndex)
+				break;
+			slot = (slot + 1) & mask;
+		}
+
+		if (table[slot] == EMPTY_SLOT)
+		{
+			// First time this triple shows up, the slot remembers the corner that created the vertex
+			table[slot] = static_cast<unsigned int>(i);
+			mesh.indices[i] = static_cast<unsigned int>(mesh.positions.size());
+
+			mesh.positions.push_back(obj.positions[vertexIndex - 1]);
+			mesh.uvs.push_back(uvIndex > 0 ? obj.uvs[uvIndex - 1] : glm::vec2(0.0f));
+			mesh.normals.push_back(normalIndex > 0 ? obj.normals[normalIndex - 1] : glm::vec3(0.0f));
+		}
+		else
+		{
+			mesh.indices[i] = mesh.indices[table[slot]];
+		}
+	}
+
+	mesh.positions.shrink_to_fit();
+	mesh.normals.shrink_to_fit();
+	mesh.uvs.shrink_to_fit();
+
+	if (stats)
+	{
+		const size_t vertexSize = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+		stats->numCorners = numCorners;
+		stats->numVertices = mesh.positions.size();
+		stats->indexSize = mesh.positions.size() <= 0xffff ? 2 : 4;
+		stats->bytesBefore = numCorners * vertexSize;
+		stats->bytesAfter = stats->numVertices * vertexSize + numCorners * stats->indexSize;
+		stats->reusedCorners = numCorners - stats->numVertices;
+		stats->cacheHits = numCorners - SimulateVertexCache(mesh.indices, stats->numVertices, VERTEX_CACHE_SIZE);
+	}
+}
+
+unsigned int MeshBuilder::PackIndices(const std::vector<unsigned int>& indices, size_t numVertices, std::vector<unsigned char>& packed)
+{
+	if (numVertices > 0xffff)
+	{
+		packed.resize(indices.size() * sizeof(uint32_t));
+		if (!indices.empty())
+			memcpy(packed.data(), indices.data(), packed.size());
+		return sizeof(uint32_t);
+	}
+
+	packed.resize(indices.size() * sizeof(uint16_t));
+	uint16_t* shortIndices = reinterpret_cast<uint16_t*>(packed.data());
+	for (size_t i = 0; i < indices.size(); i++)
+		shortIndices[i] = static_cast<uint16_t>(indices[i]);
+	return sizeof(uint16_t);
+}
+
+size_t MeshBuilder::SimulateVertexCache(const std::vector<unsigned int>& indices, size_t numVertices, unsigned int cacheSize)
+{
+	// Time stamp of the miss that put each vertex in the FIFO, a vertex is cached while fewer than cacheSize misses happened since
+	std::vector<size_t> insertedAt(numVertices, 0);
+	size_t misses = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int vertex = indices[i];
+		if (insertedAt[vertex] == 0 || misses - insertedAt[vertex] >= cacheSize)
+		{
+			misses++;
+			insertedAt[vertex] = misses;
+		}
+	}
+
+	return misses;
+}
+
+void MeshBuilder::PrintStats(const char* name, const MeshIndexStats& stats)
+{
+	printf("%s: %zu unique vertices of %zu corners, %zu-bit indices, vertex memory %.1f KB -> %.1f KB (%.1f KB saved), %zu of %zu post-transform cache hits possible, %zu with a %u entry FIFO\n",
+		name, stats.numVertices, stats.numCorners, stats.indexSize * 8,
+		stats.bytesBefore / 1024.0, stats.bytesAfter / 1024.0, ((double)stats.bytesBefore - (double)stats.bytesAfter) / 1024.0,
+		stats.reusedCorners, stats.numCorners, stats.cacheHits, VERTEX_CACHE_SIZE);
+}
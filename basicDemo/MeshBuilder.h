@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ObjLoader.h"
+
+/**
+* Indexed triangle mesh as it is stored on the CPU, every attribute array has one entry per unique vertex
+*/
+struct MeshData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	// Tangent in xyz and bitangent sign in w, filled by TangentGenerator
+	std::vector<glm::vec4> tangents;
+	std::vector<unsigned int> indices;
+	bool hasUvs = false;
+};
+
+/**
+* What indexing saved on a mesh
+*/
+struct MeshIndexStats {
+	size_t numCorners = 0;
+	size_t numVertices = 0;
+	size_t indexSize = 0;
+	// Vertex buffer bytes of the expanded mesh
+	size_t bytesBefore = 0;
+	// Vertex and index buffer bytes of the indexed mesh
+	size_t bytesAfter = 0;
+	// Corners that reuse a vertex already emitted by a previous corner
+	size_t reusedCorners = 0;
+	// Reuses that also hit a FIFO post-transform cache of VERTEX_CACHE_SIZE entries
+	size_t cacheHits = 0;
+};
+
+/**
+* Turns parsed OBJ corners into an indexed mesh
+*/
+class MeshBuilder
+{
+public:
+	// Entries of the simulated post-transform cache
+	static const unsigned int VERTEX_CACHE_SIZE = 32;
+
+	/**
+	* Merges every corner with the same position/uv/normal triple into a single vertex
+	* @param{const ObjData &} Parsed OBJ file
+	* @param{MeshData &} Indexed mesh
+	* @param{MeshIndexStats *} Optional report of the memory saved
+	*/
+	static void BuildIndexed(const ObjData& obj, MeshData& mesh, MeshIndexStats* stats = nullptr);
+
+	/**
+	* Converts indices to the smallest GPU index format that fits the mesh
+	* @param{const std::vector<unsigned int> &} Indices of the mesh
+	* @param{size_t} Number of vertices of the mesh
+	* @param{std::vector<unsigned char> &} Indices as 16-bit or 32-bit values
+	* @returns{unsigned int} Bytes per index, 2 or 4
+	*/
+	static unsigned int PackIndices(const std::vector<unsigned int>& indices, size_t numVertices, std::vector<unsigned char>& packed);
+
+	/**
+	* Counts the vertex shader invocations of an index buffer on a FIFO post-transform cache
+	* @param{const std::vector<unsigned int> &} Indices of the mesh
+	* @param{size_t} Number of vertices of the mesh
+	* @param{unsigned int} Entries of the cache
+	* @returns{size_t} Number of cache misses
+	*/
+	static size_t SimulateVertexCache(const std::vector<unsigned int>& indices, size_t numVertices, unsigned int cacheSize);
+
+	/**
+	* Prints the memory saved by indexing
+	* @param{const char*} Name shown in the report
+	* @param{const MeshIndexStats &} Statistics of the mesh
+	*/
+	static void PrintStats(const char* name, const MeshIndexStats& stats);
+};
@@ -0,0 +1,498 @@
+#include "MeshBvh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+namespace {
+	// Cost of visiting a node relative to a triangle test
+	const float TRAVERSAL_COST = 1.0f;
+	// Smaller inputs are built on the calling thread only
+	const size_t PARALLEL_MIN_PRIMITIVES = 16384;
+	// Subtrees handed to the threads, per thread, so they even out
+	const size_t SUBTREES_PER_THREAD = 8;
+	// Past this depth nodes are split at the median, which bounds the traversal stack
+	const unsigned int MAX_SAH_DEPTH = 56;
+	const unsigned int TRAVERSAL_STACK_SIZE = 96;
+
+	struct BuildTask {
+		unsigned int node;
+		unsigned int begin;
+		unsigned int end;
+		unsigned int depth;
+	};
+
+	struct BuildInput {
+		const std::vector<glm::vec3>& primitiveMin;
+		const std::vector<glm::vec3>& primitiveMax;
+		std::vector<glm::vec3> centroids;
+		std::vector<unsigned int>& order;
+	};
+
+	struct Bin {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		unsigned int count;
+	};
+
+	float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	/**
+	* Chooses where to split a node with the binned surface area heuristic and partitions its primitives
+	* @returns{unsigned int} First primitive of the right child, begin if the node should stay a leaf
+	*/
+	unsigned int SplitNode(BuildInput& input, const BuildTask& task, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+		const glm::vec3& centroidMin, const glm::vec3& centroidMax)
+	{
+		unsigned int count = task.end - task.begin;
+		if (count <= MeshBvh::MIN_LEAF_SIZE)
+			return task.begin;
+
+		glm::vec3 centroidExtent = centroidMax - centroidMin;
+
+		int bestAxis = -1;
+		unsigned int bestBin = 0;
+		float bestCost = FLT_MAX;
+
+		if (task.depth < MAX_SAH_DEPTH)
+		{
+			// The three axes are binned in a single pass over the primitives
+			Bin bins[3][MeshBvh::SAH_BINS];
+			for (int axis = 0; axis < 3; axis++)
+				for (Bin& bin : bins[axis])
+					bin = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), 0 };
+
+			glm::vec3 scale;
+			for (int axis = 0; axis < 3; axis++)
+				scale[axis] = centroidExtent[axis] > 0.0f ? MeshBvh::SAH_BINS / centroidExtent[axis] : 0.0f;
+
+			for (unsigned int i = task.begin; i < task.end; i++)
+			{
+				unsigned int primitive = input.order[i];
+				glm::vec3 binPosition = (input.centroids[primitive] - centroidMin) * scale;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					Bin& bin = bins[axis][std::min(static_cast<unsigned int>(binPosition[axis]), MeshBvh::SAH_BINS - 1)];
+					bin.boundsMin = glm::min(bin.boundsMin, input.primitiveMin[primitive]);
+					bin.boundsMax = glm::max(bin.boundsMax, input.primitiveMax[primitive]);
+					bin.count++;
+				}
+			}
+
+			float rightCost[MeshBvh::SAH_BINS];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (centroidExtent[axis] <= 0.0f)
+					continue;
+
+				// Right side of every plane, swept from the last bin
+				glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+				unsigned int sweepCount = 0;
+				for (unsigned int b = MeshBvh::SAH_BINS - 1; b > 0; b--)
+				{
+					sweepMin = glm::min(sweepMin, bins[axis][b].boundsMin);
+					sweepMax = glm::max(sweepMax, bins[axis][b].boundsMax);
+					sweepCount += bins[axis][b].count;
+					rightCost[b - 1] = sweepCount * SurfaceArea(sweepMin, sweepMax);
+				}
+
+				sweepMin = glm::vec3(FLT_MAX);
+				sweepMax = glm::vec3(-FLT_MAX);
+				sweepCount = 0;
+				for (unsigned int b = 0; b < MeshBvh::SAH_BINS - 1; b++)
+				{
+					sweepMin = glm::min(sweepMin, bins[axis][b].boundsMin);
+					sweepMax = glm::max(sweepMax, bins[axis][b].boundsMax);
+					sweepCount += bins[axis][b].count;
+					if (sweepCount == 0 || sweepCount == count)
+						continue;
+					float cost = sweepCount * SurfaceArea(sweepMin, sweepMax) + rightCost[b];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+		}
+
+		unsigned int* first = input.order.data() + task.begin;
+		unsigned int* last = input.order.data() + task.end;
+
+		if (bestAxis >= 0)
+		{
+			float splitCost = TRAVERSAL_COST + bestCost / std::max(SurfaceArea(boundsMin, boundsMax), FLT_MIN);
+			if (count <= MeshBvh::MAX_LEAF_SIZE && splitCost >= static_cast<float>(count))
+				return task.begin;
+
+			float scale = MeshBvh::SAH_BINS / centroidExtent[bestAxis];
+			float origin = centroidMin[bestAxis];
+			unsigned int* middle = std::partition(first, last, [&](unsigned int primitive) {
+				return std::min(static_cast<unsigned int>((input.centroids[primitive][bestAxis] - origin) * scale), MeshBvh::SAH_BINS - 1) <= bestBin;
+			});
+			unsigned int mid = static_cast<unsigned int>(middle - input.order.data());
+			if (mid != task.begin && mid != task.end)
+				return mid;
+		}
+		else if (count <= MeshBvh::MAX_LEAF_SIZE)
+			return task.begin;
+
+		// Deep or degenerate nodes: halves along the longest centroid axis
+		int axis = centroidExtent.x >= centroidExtent.y && centroidExtent.x >= centroidExtent.z ? 0 : (centroidExtent.y >= centroidExtent.z ? 1 : 2);
+		unsigned int* middle = first + count / 2;
+		std::nth_element(first, middle, last, [&](unsigned int a, unsigned int b) { return input.centroids[a][axis] < input.centroids[b][axis]; });
+		return task.begin + count / 2;
+	}
+
+	/**
+	* Builds the subtree of a task into nodes, tasks smaller than deferSize are left in deferred instead
+	*/
+	void BuildSubtree(BuildInput& input, std::vector<BvhNode>& nodes, const BuildTask& root, std::vector<BuildTask>* deferred, size_t deferSize)
+	{
+		std::vector<BuildTask> stack(1, root);
+		while (!stack.empty())
+		{
+			BuildTask task = stack.back();
+			stack.pop_back();
+
+			if (deferred && task.node != root.node && task.end - task.begin <= deferSize)
+			{
+				deferred->push_back(task);
+				continue;
+			}
+
+			glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+			glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+			for (unsigned int i = task.begin; i < task.end; i++)
+			{
+				unsigned int primitive = input.order[i];
+				boundsMin = glm::min(boundsMin, input.primitiveMin[primitive]);
+				boundsMax = glm::max(boundsMax, input.primitiveMax[primitive]);
+				centroidMin = glm::min(centroidMin, input.centroids[primitive]);
+				centroidMax = glm::max(centroidMax, input.centroids[primitive]);
+			}
+
+			unsigned int mid = SplitNode(input, task, boundsMin, boundsMax, centroidMin, centroidMax);
+
+			BvhNode& node = nodes[task.node];
+			node.boundsMin = boundsMin;
+			node.boundsMax = boundsMax;
+			if (mid == task.begin)
+			{
+				node.first = task.begin;
+				node.count = task.end - task.begin;
+				continue;
+			}
+
+			unsigned int children = static_cast<unsigned int>(nodes.size());
+			node.first = children;
+			node.count = 0;
+			nodes.resize(nodes.size() + 2);
+
+			BuildTask left = { children, task.begin, mid, task.depth + 1 };
+			BuildTask right = { children + 1, mid, task.end, task.depth + 1 };
+			stack.push_back(right);
+			stack.push_back(left);
+		}
+	}
+
+	bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3* corner, float maxDistance, float& distance, float& u, float& v)
+	{
+		// Moller-Trumbore, both faces count as hits
+		glm::vec3 edge1 = corner[1] - corner[0];
+		glm::vec3 edge2 = corner[2] - corner[0];
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (determinant == 0.0f)
+			return false;
+
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 s = origin - corner[0];
+		u = glm::dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		glm::vec3 q = glm::cross(s, edge1);
+		v = glm::dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		distance = glm::dot(edge2, q) * inverseDeterminant;
+		return distance >= 0.0f && distance < maxDistance;
+	}
+}
+
+MeshBvh::MeshBvh()
+{
+}
+
+void MeshBvh::Build(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, unsigned int numThreads, BvhBuildStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t numTriangles = indices.size() / 3;
+	std::vector<glm::vec3> triangleMin(numTriangles), triangleMax(numTriangles);
+	for (size_t t = 0; t < numTriangles; t++)
+	{
+		const glm::vec3& p0 = positions[indices[t * 3]];
+		const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+		const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+		triangleMin[t] = glm::min(p0, glm::min(p1, p2));
+		triangleMax[t] = glm::max(p0, glm::max(p1, p2));
+	}
+
+	BuildNodes(triangleMin, triangleMax, numThreads, nodes, triangles, stats);
+	geometry = BvhGeometry();
+
+	if (stats)
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MeshBvh::BuildNodes(const std::vector<glm::vec3>& primitiveMin, const std::vector<glm::vec3>& primitiveMax, unsigned int numThreads,
+	std::vector<BvhNode>& nodes, std::vector<unsigned int>& order, BvhBuildStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t numPrimitives = primitiveMin.size();
+	nodes.clear();
+	order.resize(numPrimitives);
+	for (size_t i = 0; i < numPrimitives; i++)
+		order[i] = static_cast<unsigned int>(i);
+
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	if (numPrimitives < PARALLEL_MIN_PRIMITIVES)
+		numThreads = 1;
+
+	if (numPrimitives > 0)
+	{
+		BuildInput input = { primitiveMin, primitiveMax, std::vector<glm::vec3>(numPrimitives), order };
+		for (size_t i = 0; i < numPrimitives; i++)
+			input.centroids[i] = (primitiveMin[i] + primitiveMax[i]) * 0.5f;
+
+		nodes.reserve(numPrimitives * 2 / MIN_LEAF_SIZE);
+		nodes.resize(1);
+		BuildTask root = { 0, 0, static_cast<unsigned int>(numPrimitives), 0 };
+
+		if (numThreads <= 1)
+			BuildSubtree(input, nodes, root, nullptr, 0);
+		else
+		{
+			// The top levels are split here, every subtree below deferSize primitives goes to a thread with its own node list
+			std::vector<BuildTask> deferred;
+			BuildSubtree(input, nodes, root, &deferred, std::max<size_t>(numPrimitives / (numThreads * SUBTREES_PER_THREAD), 1));
+
+			std::vector<std::vector<BvhNode>> subtrees(deferred.size());
+			{
+				ThreadPool pool(numThreads);
+				for (size_t s = 0; s < deferred.size(); s++)
+				{
+					pool.Submit([&input, &deferred, &subtrees, s]() {
+						BuildTask task = deferred[s];
+						task.node = 0;
+						subtrees[s].resize(1);
+						BuildSubtree(input, subtrees[s], task, nullptr, 0);
+					});
+				}
+				pool.Wait();
+			}
+
+			// The subtree root replaces its placeholder, the other nodes are appended
+			for (size_t s = 0; s < deferred.size(); s++)
+			{
+				unsigned int base = static_cast<unsigned int>(nodes.size()) - 1;
+				for (size_t n = 0; n < subtrees[s].size(); n++)
+				{
+					BvhNode node = subtrees[s][n];
+					if (node.count == 0)
+						node.first += base;
+					if (n == 0)
+						nodes[deferred[s].node] = node;
+					else
+						nodes.push_back(node);
+				}
+			}
+		}
+	}
+
+	if (stats)
+	{
+		stats->numPrimitives = numPrimitives;
+		stats->numNodes = nodes.size();
+		stats->numLeaves = 0;
+		stats->threads = numThreads;
+		stats->sahCost = 0.0f;
+		float rootArea = nodes.empty() ? 0.0f : SurfaceArea(nodes[0].boundsMin, nodes[0].boundsMax);
+		for (const BvhNode& node : nodes)
+		{
+			float area = rootArea > 0.0f ? SurfaceArea(node.boundsMin, node.boundsMax) / rootArea : 1.0f;
+			if (node.count > 0)
+			{
+				stats->numLeaves++;
+				stats->sahCost += area * node.count;
+			}
+			else
+				stats->sahCost += area * TRAVERSAL_COST;
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+float MeshBvh::IntersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+{
+	glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+template <bool ANY_HIT>
+bool MeshBvh::Traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, MeshRayHit& hit) const
+{
+	if (nodes.empty() || !HasGeometry())
+		return false;
+
+	// Axis parallel rays get a huge finite inverse, so 0 * inverse stays 0 in the slab test
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; axis++)
+		inverseDirection[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : FLT_MAX;
+
+	if (IntersectNode(nodes[0], origin, inverseDirection, maxDistance) == FLT_MAX)
+		return false;
+
+	float closest = maxDistance;
+	bool found = false;
+	unsigned int stack[TRAVERSAL_STACK_SIZE];
+	unsigned int stackSize = 0;
+	unsigned int current = 0;
+
+	while (true)
+	{
+		const BvhNode& node = nodes[current];
+		if (node.count > 0)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; i++)
+			{
+				float distance, u, v;
+				glm::vec3 corner[3];
+				GetTriangle(triangles[i], corner);
+				if (!IntersectTriangle(origin, direction, corner, closest, distance, u, v))
+					continue;
+				if (ANY_HIT)
+					return true;
+				closest = distance;
+				found = true;
+				hit.distance = distance;
+				hit.triangle = triangles[i];
+				hit.u = u;
+				hit.v = v;
+			}
+		}
+		else
+		{
+			// Nearest child first, the other one waits on the stack
+			unsigned int nearChild = node.first, farChild = node.first + 1;
+			float nearDistance = IntersectNode(nodes[nearChild], origin, inverseDirection, closest);
+			float farDistance = IntersectNode(nodes[farChild], origin, inverseDirection, closest);
+			if (farDistance < nearDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+
+			if (nearDistance != FLT_MAX)
+			{
+				if (farDistance != FLT_MAX)
+					stack[stackSize++] = farChild;
+				current = nearChild;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		current = stack[--stackSize];
+	}
+
+	return found;
+}
+
+bool MeshBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, MeshRayHit& hit) const
+{
+	return Traverse<false>(origin, direction, maxDistance, hit);
+}
+
+bool MeshBvh::RaycastAny(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	MeshRayHit hit;
+	return Traverse<true>(origin, direction, maxDistance, hit);
+}
+
+bool MeshBvh::IsEmpty() const
+{
+	return nodes.empty();
+}
+
+glm::vec3 MeshBvh::GetBoundsMin() const
+{
+	return nodes.empty() ? glm::vec3(0.0f) : nodes[0].boundsMin;
+}
+
+glm::vec3 MeshBvh::GetBoundsMax() const
+{
+	return nodes.empty() ? glm::vec3(0.0f) : nodes[0].boundsMax;
+}
+
+size_t MeshBvh::GetMemorySize() const
+{
+	return nodes.size() * sizeof(BvhNode) + triangles.size() * sizeof(unsigned int);
+}
+
+void MeshBvh::SetGeometry(const BvhGeometry& triangleGeometry)
+{
+	geometry = triangleGeometry;
+}
+
+bool MeshBvh::HasGeometry() const
+{
+	return geometry.indices && (geometry.positions || geometry.quantizedPositions);
+}
+
+size_t MeshBvh::GetNumTriangles() const
+{
+	return triangles.size();
+}
+
+void MeshBvh::GetTriangle(unsigned int triangle, glm::vec3* corner) const
+{
+	for (int k = 0; k < 3; k++)
+	{
+		size_t index = static_cast<size_t>(triangle) * 3 + k;
+		unsigned int vertex = geometry.indexSize == 2 ? static_cast<const uint16_t*>(geometry.indices)[index]
+			: static_cast<const uint32_t*>(geometry.indices)[index];
+		if (geometry.positions)
+			corner[k] = geometry.positions[vertex];
+		else
+		{
+			const uint16_t* unorm = geometry.quantizedPositions + static_cast<size_t>(vertex) * 4;
+			corner[k] = geometry.boundsMin + glm::vec3(unorm[0], unorm[1], unorm[2]) / 65535.0f * geometry.boundsExtent;
+		}
+	}
+}
+
+void MeshBvh::PrintStats(const char* name, const BvhBuildStats& stats)
+{
+	printf("%s: BVH of %zu primitives, %zu nodes (%zu leaves), SAH cost %.1f, built in %.2f ms on %u thread(s)\n",
+		name, stats.numPrimitives, stats.numNodes, stats.numLeaves, stats.sahCost, stats.seconds * 1000.0, stats.threads);
+}
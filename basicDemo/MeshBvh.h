@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Node of a bounding volume hierarchy, 32 bytes.
+* Inner nodes have count 0 and their two children at first and first + 1,
+* leaves hold count primitives starting at first in the primitive order of the tree.
+*/
+struct BvhNode {
+	glm::vec3 boundsMin;
+	uint32_t first;
+	glm::vec3 boundsMax;
+	uint32_t count;
+};
+
+/**
+* Closest triangle hit by a ray
+*/
+struct MeshRayHit {
+	// Distance along the ray, in multiples of the ray direction
+	float distance;
+	// Triangle of the full resolution index buffer
+	unsigned int triangle;
+	// Barycentric coordinates of the hit, the weights of the second and third vertex
+	float u;
+	float v;
+};
+
+/**
+* Triangles a mesh hierarchy tests, read in place from arrays the mesh owns
+*/
+struct BvhGeometry {
+	// Float positions, null when the positions are compact
+	const glm::vec3* positions = nullptr;
+	// Compact positions, unorm16 x4 inside the bounds like QuantizedMesh
+	const uint16_t* quantizedPositions = nullptr;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsExtent = glm::vec3(0.0f);
+	// Triangle list of the full resolution level, in the GPU index format
+	const void* indices = nullptr;
+	// 2 or 4 bytes
+	unsigned int indexSize = 4;
+};
+
+/**
+* Size and build time of a hierarchy
+*/
+struct BvhBuildStats {
+	size_t numPrimitives = 0;
+	size_t numNodes = 0;
+	size_t numLeaves = 0;
+	// Expected cost of a ray, in node visits plus triangle tests, under the surface area heuristic
+	float sahCost = 0.0f;
+	unsigned int threads = 0;
+	double seconds = 0.0;
+};
+
+/**
+* Triangle bounding volume hierarchy of a mesh, built with the binned surface area heuristic.
+* It keeps no copy of the triangles, rays read them through the BvhGeometry set by the owner of the mesh.
+*/
+class MeshBvh
+{
+public:
+	// Candidate split planes per axis
+	static const unsigned int SAH_BINS = 16;
+	// Leaves never split further when they hold this many primitives or fewer
+	static const unsigned int MIN_LEAF_SIZE = 2;
+	// Leaves are split even if the heuristic disagrees when they hold more primitives
+	static const unsigned int MAX_LEAF_SIZE = 16;
+
+	MeshBvh();
+
+	/**
+	* Builds the hierarchy of a triangle list. The arrays are only read during the build,
+	* SetGeometry has to point the hierarchy at the same triangles before the first ray
+	* @param{const std::vector<unsigned int> &} Triangle list indices
+	* @param{const std::vector<glm::vec3> &} Vertex positions
+	* @param{unsigned int} Threads building subtrees, 0 uses every hardware thread
+	* @param{BvhBuildStats *} Optional build report
+	*/
+	void Build(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, unsigned int numThreads = 1, BvhBuildStats* stats = nullptr);
+
+	/**
+	* Points the hierarchy at the triangles it was built from, in any of their host formats.
+	* The arrays have to stay alive and unchanged until the next call, an empty geometry makes every ray miss
+	* @param{const BvhGeometry &} Positions and indices of the mesh
+	*/
+	void SetGeometry(const BvhGeometry& geometry);
+
+	/**
+	* Whether SetGeometry gave the hierarchy triangles to test
+	*/
+	bool HasGeometry() const;
+
+	size_t GetNumTriangles() const;
+
+	/**
+	* Mesh space corners of a triangle of the index buffer, decoded from the geometry
+	* @param{unsigned int} Triangle, below GetNumTriangles
+	* @param{glm::vec3 *} Three corners
+	*/
+	void GetTriangle(unsigned int triangle, glm::vec3* corner) const;
+
+	/**
+	* Closest triangle along a ray or a segment
+	* @param{const glm::vec3 &} Ray origin in mesh space
+	* @param{const glm::vec3 &} Ray direction in mesh space, not necessarily normalized
+	* @param{float} Largest distance, in multiples of the direction, FLT_MAX for a ray
+	* @param{MeshRayHit &} Closest hit, only written when there is one
+	* @returns{bool} true if a triangle was hit
+	*/
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, MeshRayHit& hit) const;
+
+	/**
+	* Whether any triangle crosses a ray or a segment, it stops at the first hit
+	*/
+	bool RaycastAny(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+	bool IsEmpty() const;
+
+	glm::vec3 GetBoundsMin() const;
+
+	glm::vec3 GetBoundsMax() const;
+
+	/**
+	* Bytes held by the nodes and the leaf order, the geometry belongs to the mesh
+	*/
+	size_t GetMemorySize() const;
+
+	/**
+	* Binned SAH build over primitive bounding boxes, shared by the mesh and the scene hierarchies.
+	* The top of the tree is split on the calling thread, the subtrees below are built in parallel.
+	* @param{const std::vector<glm::vec3> &} Lowest corner of every primitive
+	* @param{const std::vector<glm::vec3> &} Highest corner of every primitive
+	* @param{unsigned int} Threads building subtrees, 0 uses every hardware thread
+	* @param{std::vector<BvhNode> &} Nodes, the root first
+	* @param{std::vector<unsigned int> &} Primitive of every leaf slot
+	* @param{BvhBuildStats *} Optional build report
+	*/
+	static void BuildNodes(const std::vector<glm::vec3>& primitiveMin, const std::vector<glm::vec3>& primitiveMax, unsigned int numThreads,
+		std::vector<BvhNode>& nodes, std::vector<unsigned int>& order, BvhBuildStats* stats = nullptr);
+
+	/**
+	* Slab test of a ray against a node
+	* @param{const BvhNode &} Node to test
+	* @param{const glm::vec3 &} Ray origin
+	* @param{const glm::vec3 &} Inverse of the ray direction
+	* @param{float} Largest distance
+	* @returns{float} Entry distance, FLT_MAX if the ray misses the box
+	*/
+	static float IntersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+
+	/**
+	* Prints the size and build time of a hierarchy
+	* @param{const char*} Name shown in the report
+	* @param{const BvhBuildStats &} Statistics of the build
+	*/
+	static void PrintStats(const char* name, const BvhBuildStats& stats);
+
+private:
+	std::vector<BvhNode> nodes;
+	// Triangle of the index buffer behind every leaf slot
+	std::vector<unsigned int> triangles;
+	BvhGeometry geometry;
+
+	template <bool ANY_HIT>
+	bool Traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, MeshRayHit& hit) const;
+};
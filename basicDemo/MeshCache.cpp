@@ -0,0 +1,295 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "MeshCache.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+	const char MESH_CACHE_MAGIC[8] = { 'B', 'D', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+	// Bytes per vertex of the position, normal, uv and tangent blobs: floats, and the compact layout of MeshQuantizer
+	const uint64_t FLOAT_VERTEX_BYTES[] = { 3 * sizeof(float), 3 * sizeof(float), 2 * sizeof(float), 4 * sizeof(float) };
+	const uint64_t COMPACT_VERTEX_BYTES[] = { 4 * sizeof(uint16_t), 2 * sizeof(int16_t), 2 * sizeof(uint16_t), 4 * sizeof(int8_t) };
+	const MeshCacheBlob VERTEX_BLOBS[] = { MESH_CACHE_POSITIONS, MESH_CACHE_NORMALS, MESH_CACHE_UVS, MESH_CACHE_TANGENTS };
+
+	/**
+	* Replaces a file with another one of the same folder, the target is never left half written
+	*/
+	bool MoveFileOver(const char* from, const char* to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(from, to) == 0;
+#endif
+	}
+
+	int CurrentProcessId()
+	{
+#ifdef _WIN32
+		return _getpid();
+#else
+		return (int)getpid();
+#endif
+	}
+
+	inline uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + MESH_CACHE_ALIGNMENT - 1) & ~static_cast<uint64_t>(MESH_CACHE_ALIGNMENT - 1);
+	}
+}
+
+MeshCache::MeshCache()
+	: header(nullptr)
+{
+}
+
+MeshCache::~MeshCache()
+{
+	Close();
+}
+
+bool MeshCache::Open(const char* sourcePath, unsigned int buildOptions)
+{
+	Close();
+
+	std::string cachePath = GetCachePath(sourcePath, (buildOptions & MESH_CACHE_COMPACT) != 0);
+	if (!file.Open(cachePath.c_str()))
+		return false;
+
+	int64_t touchedModificationTime = 0;
+	bool valid = Validate(sourcePath, buildOptions, touchedModificationTime);
+
+	// A touched but unchanged source keeps its cache, and its new time goes to the header so later loads do not hash it again
+	if (valid && touchedModificationTime != 0)
+	{
+		file.Close();
+		if (!WriteModificationTime(cachePath, touchedModificationTime))
+			printf("Unable to update the mesh cache %s, the source will be hashed again next time\n", cachePath.c_str());
+		valid = file.Open(cachePath.c_str()) && Validate(sourcePath, buildOptions, touchedModificationTime);
+	}
+
+	if (!valid)
+	{
+		printf("Mesh cache %s is stale, rebuilding it\n", cachePath.c_str());
+		file.Close();
+		return false;
+	}
+
+	header = reinterpret_cast<const MeshCacheHeader*>(file.GetData());
+	return true;
+}
+
+bool MeshCache::Validate(const char* sourcePath, unsigned int buildOptions, int64_t& touchedModificationTime) const
+{
+	touchedModificationTime = 0;
+
+	const MeshCacheHeader* candidate = reinterpret_cast<const MeshCacheHeader*>(file.GetData());
+	bool valid = file.GetSize() >= sizeof(MeshCacheHeader)
+		&& memcmp(candidate->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+		&& candidate->version == MESH_CACHE_VERSION
+		&& candidate->fileSize == file.GetSize()
+		&& candidate->buildOptions == buildOptions
+		&& candidate->numBlobs == MESH_CACHE_BLOB_COUNT
+		&& (candidate->indexSize == 2 || candidate->indexSize == 4);
+	if (!valid)
+		return false;
+
+	for (uint32_t i = 0; valid && i < MESH_CACHE_BLOB_COUNT; i++)
+		valid = candidate->blobOffsets[i] <= candidate->fileSize && candidate->blobSizes[i] <= candidate->fileSize - candidate->blobOffsets[i];
+
+	// The blobs are read with the counts of the header, a blob of another size comes from a broken or foreign file
+	const uint64_t* vertexBytes = (buildOptions & MESH_CACHE_COMPACT) != 0 ? COMPACT_VERTEX_BYTES : FLOAT_VERTEX_BYTES;
+	for (int i = 0; valid && i < 4; i++)
+		valid = candidate->blobSizes[VERTEX_BLOBS[i]] == (uint64_t)candidate->numVertices * vertexBytes[i];
+	// The index blob also holds the coarser levels after the full resolution one
+	uint64_t indexBytes = candidate->blobSizes[MESH_CACHE_INDICES];
+	valid = valid && indexBytes % candidate->indexSize == 0 && indexBytes >= (uint64_t)candidate->numIndices * candidate->indexSize;
+	if (!valid)
+		return false;
+
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	if (!DescribeSource(sourcePath, sourceSize, sourceModificationTime, nullptr) || sourceSize != candidate->sourceSize)
+		return false;
+
+	if (sourceModificationTime != candidate->sourceModificationTime)
+	{
+		uint64_t sourceHash;
+		if (!DescribeSource(sourcePath, sourceSize, sourceModificationTime, &sourceHash) || sourceHash != candidate->sourceHash)
+			return false;
+		touchedModificationTime = sourceModificationTime;
+	}
+
+	return true;
+}
+
+void MeshCache::Close()
+{
+	file.Close();
+	header = nullptr;
+}
+
+bool MeshCache::IsOpen() const
+{
+	return header != nullptr;
+}
+
+MeshCacheInfo MeshCache::GetInfo() const
+{
+	MeshCacheInfo info = {};
+	if (header)
+	{
+		info.numVertices = header->numVertices;
+		info.numIndices = header->numIndices;
+		info.indexSize = header->indexSize;
+		info.flags = header->flags;
+		info.buildOptions = header->buildOptions;
+		memcpy(info.boundsMin, header->boundsMin, sizeof(info.boundsMin));
+		memcpy(info.boundsExtent, header->boundsExtent, sizeof(info.boundsExtent));
+		memcpy(info.quantizationError, header->quantizationError, sizeof(info.quantizationError));
+	}
+	return info;
+}
+
+MeshCacheBlobView MeshCache::GetBlob(MeshCacheBlob blob) const
+{
+	MeshCacheBlobView view = { nullptr, 0 };
+	if (header)
+	{
+		view.data = file.GetData() + header->blobOffsets[blob];
+		view.size = static_cast<size_t>(header->blobSizes[blob]);
+	}
+	return view;
+}
+
+bool MeshCache::Write(const char* sourcePath, const MeshCacheInfo& info, const MeshCacheBlobView* blobs)
+{
+	MeshCacheHeader fileHeader;
+	memset(&fileHeader, 0, sizeof(fileHeader));
+	memcpy(fileHeader.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	fileHeader.version = MESH_CACHE_VERSION;
+	fileHeader.flags = info.flags;
+	fileHeader.buildOptions = info.buildOptions;
+	fileHeader.numVertices = info.numVertices;
+	fileHeader.numIndices = info.numIndices;
+	fileHeader.indexSize = info.indexSize;
+	fileHeader.numBlobs = MESH_CACHE_BLOB_COUNT;
+	memcpy(fileHeader.boundsMin, info.boundsMin, sizeof(fileHeader.boundsMin));
+	memcpy(fileHeader.boundsExtent, info.boundsExtent, sizeof(fileHeader.boundsExtent));
+	memcpy(fileHeader.quantizationError, info.quantizationError, sizeof(fileHeader.quantizationError));
+	strncpy(fileHeader.sourcePath, sourcePath, sizeof(fileHeader.sourcePath) - 1);
+
+	if (!DescribeSource(sourcePath, fileHeader.sourceSize, fileHeader.sourceModificationTime, &fileHeader.sourceHash))
+		return false;
+
+	uint64_t offset = AlignOffset(sizeof(MeshCacheHeader));
+	for (uint32_t i = 0; i < MESH_CACHE_BLOB_COUNT; i++)
+	{
+		fileHeader.blobOffsets[i] = offset;
+		fileHeader.blobSizes[i] = blobs[i].size;
+		offset = AlignOffset(offset + blobs[i].size);
+	}
+	fileHeader.fileSize = offset;
+
+	// Written under a name of its own and renamed once complete: a crash or another process loading the same file
+	// never sees a partial cache under the final name
+	std::string cachePath = GetCachePath(sourcePath, (info.buildOptions & MESH_CACHE_COMPACT) != 0);
+	std::string temporaryPath = cachePath + "." + std::to_string(CurrentProcessId()) + ".tmp";
+	FILE* output = fopen(temporaryPath.c_str(), "wb");
+	if (!output)
+	{
+		printf("Unable to write the mesh cache %s\n", cachePath.c_str());
+		return false;
+	}
+
+	// Blobs are padded with zeros up to the next aligned offset
+	static const char padding[MESH_CACHE_ALIGNMENT] = {};
+	bool written = fwrite(&fileHeader, sizeof(fileHeader), 1, output) == 1;
+	uint64_t position = sizeof(fileHeader);
+	for (uint32_t i = 0; written && i < MESH_CACHE_BLOB_COUNT; i++)
+	{
+		written = fwrite(padding, 1, static_cast<size_t>(fileHeader.blobOffsets[i] - position), output) == fileHeader.blobOffsets[i] - position;
+		if (written && blobs[i].size > 0)
+			written = fwrite(blobs[i].data, 1, blobs[i].size, output) == blobs[i].size;
+		position = fileHeader.blobOffsets[i] + blobs[i].size;
+	}
+	if (written)
+		written = fwrite(padding, 1, static_cast<size_t>(fileHeader.fileSize - position), output) == fileHeader.fileSize - position;
+
+	written = fclose(output) == 0 && written;
+
+	// The previous cache stays in place when the new one could not be completed or moved over it, e.g. while it is mapped
+	if (!written || !MoveFileOver(temporaryPath.c_str(), cachePath.c_str()))
+	{
+		printf("Unable to write the mesh cache %s\n", cachePath.c_str());
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshCache::WriteModificationTime(const std::string& cachePath, int64_t modificationTime)
+{
+	FILE* output = fopen(cachePath.c_str(), "r+b");
+	if (!output)
+		return false;
+
+	bool written = fseek(output, (long)offsetof(MeshCacheHeader, sourceModificationTime), SEEK_SET) == 0
+		&& fwrite(&modificationTime, sizeof(modificationTime), 1, output) == 1;
+	return fclose(output) == 0 && written;
+}
+
+std::string MeshCache::GetCachePath(const char* sourcePath, bool compact)
+{
+	return std::string(sourcePath) + (compact ? ".compact.meshcache" : ".meshcache");
+}
+
+uint64_t MeshCache::Hash(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool MeshCache::DescribeSource(const char* sourcePath, uint64_t& size, int64_t& modificationTime, uint64_t* hash)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(sourcePath, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(sourcePath, &info) != 0)
+		return false;
+#endif
+
+	size = static_cast<uint64_t>(info.st_size);
+	modificationTime = static_cast<int64_t>(info.st_mtime);
+
+	if (hash)
+	{
+		MappedFile source;
+		if (!source.Open(sourcePath))
+			return false;
+		*hash = Hash(source.GetData(), source.GetSize());
+	}
+
+	return true;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+
+// Attribute blobs stored in a mesh cache, in file order
+enum MeshCacheBlob {
+	MESH_CACHE_POSITIONS,
+	MESH_CACHE_NORMALS,
+	MESH_CACHE_UVS,
+	MESH_CACHE_INDICES,
+	MESH_CACHE_MESHLETS,
+	MESH_CACHE_LODS,
+	MESH_CACHE_TANGENTS,
+	MESH_CACHE_BLOB_COUNT
+};
+
+// Bit flags describing the cached mesh
+enum MeshCacheFlags {
+	MESH_CACHE_HAS_UVS = 1 << 0
+};
+
+// Bit flags of the loader options the blobs were built with, a cache built with other options is a miss
+enum MeshCacheBuildOptions {
+	// Blobs hold the quantized layout of MeshQuantizer instead of floats
+	MESH_CACHE_COMPACT = 1 << 0,
+	// Triangles and vertices were reordered by MeshOptimizer
+	MESH_CACHE_OPTIMIZED = 1 << 1
+};
+
+const uint32_t MESH_CACHE_VERSION = 9;
+const uint32_t MESH_CACHE_MAX_BLOBS = 16;
+// Every blob starts at a multiple of this so it can be handed to the GPU as is
+const uint32_t MESH_CACHE_ALIGNMENT = 64;
+
+/**
+* Fixed size header at the start of every cache file
+*/
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t buildOptions;
+	uint64_t fileSize;
+	int64_t sourceModificationTime;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t indexSize;
+	uint32_t numBlobs;
+	uint64_t blobOffsets[MESH_CACHE_MAX_BLOBS];
+	uint64_t blobSizes[MESH_CACHE_MAX_BLOBS];
+	float boundsMin[3];
+	float boundsExtent[3];
+	// Worst position, normal (degrees) and uv error of compact blobs
+	float quantizationError[3];
+	char sourcePath[256];
+};
+
+/**
+* Counts and layout of a cached mesh
+*/
+struct MeshCacheInfo {
+	unsigned int numVertices;
+	// Indices of the full resolution level, the index blob also holds the coarser levels
+	unsigned int numIndices;
+	// Bytes per index, 2 or 4
+	unsigned int indexSize;
+	// MeshCacheFlags of the mesh
+	unsigned int flags;
+	// MeshCacheBuildOptions of the blobs
+	unsigned int buildOptions;
+	// Bounding box of the positions, also the dequantization range of compact positions
+	float boundsMin[3];
+	float boundsExtent[3];
+	// Worst position, normal (degrees) and uv error of compact blobs
+	float quantizationError[3];
+};
+
+/**
+* Pointer and size of one attribute blob
+*/
+struct MeshCacheBlobView {
+	const void* data;
+	size_t size;
+};
+
+/**
+* Binary sidecar of an OBJ file holding the vertex data exactly as it is uploaded to the GPU.
+* The sidecar is trusted when the source size and modification time match, or when its content hash still matches,
+* and when it was built with the same options. Blob sizes are checked against the vertex and index counts of the header.
+*/
+class MeshCache
+{
+public:
+	MeshCache();
+
+	~MeshCache();
+
+	/**
+	* Maps the cache of a source file if it exists and is up to date
+	* @param{const char*} Path to the source OBJ file
+	* @param{unsigned int} MeshCacheBuildOptions the mesh is loaded with, MESH_CACHE_COMPACT picks the sidecar
+	* @returns{bool} true if the cache can be used
+	*/
+	bool Open(const char* sourcePath, unsigned int buildOptions);
+
+	/**
+	* Releases the mapping, blob pointers are invalid afterwards
+	*/
+	void Close();
+
+	bool IsOpen() const;
+
+	MeshCacheInfo GetInfo() const;
+
+	/**
+	* Gets a blob from the mapped cache
+	* @param{MeshCacheBlob} Blob to get
+	* @returns{MeshCacheBlobView} Pointer into the mapping and blob size in bytes
+	*/
+	MeshCacheBlobView GetBlob(MeshCacheBlob blob) const;
+
+	/**
+	* Writes the cache of a source file, compact meshes go to their own sidecar.
+	* The file is written next to it under a temporary name and renamed over it once complete
+	* @param{const char*} Path to the source OBJ file
+	* @param{const MeshCacheInfo &} Counts and layout of the mesh
+	* @param{const MeshCacheBlobView *} MESH_CACHE_BLOB_COUNT blobs to store
+	* @returns{bool} true if the cache was written
+	*/
+	static bool Write(const char* sourcePath, const MeshCacheInfo& info, const MeshCacheBlobView* blobs);
+
+	/**
+	* Path of the sidecar of a source file
+	* @param{const char*} Path to the source OBJ file
+	* @param{bool} true for the sidecar holding the compact vertex layout
+	*/
+	static std::string GetCachePath(const char* sourcePath, bool compact = false);
+
+	/**
+	* 64-bit FNV-1a hash of a block of memory
+	*/
+	static uint64_t Hash(const void* data, size_t size);
+
+private:
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	/**
+	* Size, modification time and content hash of a source file
+	*/
+	static bool DescribeSource(const char* sourcePath, uint64_t& size, int64_t& modificationTime, uint64_t* hash);
+
+	/**
+	* Checks the mapped file against its source and the options of the load
+	* @param{const char*} Path to the source OBJ file
+	* @param{unsigned int} MeshCacheBuildOptions of the load
+	* @param{int64_t &} Set to the modification time of the source when it differs from the header but its hash matches, 0 otherwise
+	* @returns{bool} true if the cache can be used
+	*/
+	bool Validate(const char* sourcePath, unsigned int buildOptions, int64_t& touchedModificationTime) const;
+
+	/**
+	* Rewrites the source modification time of a cache file in place
+	*/
+	static bool WriteModificationTime(const std::string& cachePath, int64_t modificationTime);
+
+	MappedFile file;
+	const MeshCacheHeader* header;
+};
@@ -0,0 +1,200 @@
+#include "MeshManager.h"
+#include "AssetLoader.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <climits>
+#endif
+
+MeshManager * MeshManager::mInstance = NULL;
+
+MeshManager * MeshManager::Instance()
+{
+	if (!mInstance)   // Only allow one instance of class to be generated.
+		mInstance = new MeshManager();
+
+	return mInstance;
+}
+
+MeshManager::MeshManager()
+	: numShared(0), numLoaded(0)
+{
+}
+
+MeshManager::~MeshManager()
+{
+	for (auto& entry : meshes)
+		delete entry.second.mesh;
+}
+
+Mesh* MeshManager::Acquire(const char* path, VertexFormat format)
+{
+	string key = GetKey(path, format);
+
+	Mesh* mesh = Share(key, path);
+	if (mesh)
+		return mesh;
+
+	mesh = new Mesh();
+	mesh->SetVertexFormat(format);
+	mesh->SetResidency(GetResidency(path));
+	if (!mesh->LoadObj(path))
+	{
+		delete mesh;
+		return nullptr;
+	}
+	mesh->BuildGeometry();
+
+	Entry entry = { mesh, 1 };
+	meshes[key] = entry;
+	keys[mesh] = key;
+	numLoaded++;
+
+	return mesh;
+}
+
+Mesh* MeshManager::AcquireAsync(const char* path, VertexFormat format)
+{
+	string key = GetKey(path, format);
+
+	Mesh* mesh = Share(key, path);
+	if (mesh)
+		return mesh;
+
+	mesh = new Mesh();
+	mesh->SetVertexFormat(format);
+	mesh->SetResidency(GetResidency(path));
+
+	// One reference for the caller and one for the pending load
+	Entry entry = { mesh, 2 };
+	meshes[key] = entry;
+	keys[mesh] = key;
+	numLoaded++;
+
+	string file = path;
+	AssetLoader::Instance()->Submit(
+		[mesh, file]() { return mesh->LoadObj(file.c_str()); },
+		[this, mesh](bool loaded) {
+			if (loaded)
+				mesh->BuildGeometry();
+			else
+				mesh->SetState(MESH_FAILED);
+			Release(mesh);
+		});
+
+	return mesh;
+}
+
+Mesh* MeshManager::Share(const string& key, const char* path)
+{
+	auto found = meshes.find(key);
+	if (found == meshes.end())
+		return nullptr;
+
+	found->second.references++;
+	numShared++;
+	printf("%s: shared mesh reused, %u references\n", path, found->second.references);
+	return found->second.mesh;
+}
+
+string MeshManager::GetKey(const char* path, VertexFormat format)
+{
+	return GetCanonicalPath(path) + (format == VERTEX_FORMAT_COMPACT ? "|compact" : "|float")
+		+ (Mesh::GetDefaultVertexLayout() == VERTEX_LAYOUT_SPLIT ? "|split" : "|interleaved");
+}
+
+void MeshManager::Release(Mesh* mesh)
+{
+	if (!mesh)
+		return;
+
+	auto key = keys.find(mesh);
+	if (key == keys.end())
+	{
+		printf("MeshManager: release of a mesh it does not own\n");
+		return;
+	}
+
+	auto found = meshes.find(key->second);
+	if (--found->second.references == 0)
+	{
+		delete mesh;
+		meshes.erase(found);
+		keys.erase(key);
+	}
+}
+
+MeshResidency MeshManager::GetResidency(const char* path)
+{
+	auto found = residencies.find(GetCanonicalPath(path));
+	return found != residencies.end() ? found->second : Mesh::GetDefaultResidency();
+}
+
+void MeshManager::SetResidency(const char* path, MeshResidency policy)
+{
+	residencies[GetCanonicalPath(path)] = policy;
+}
+
+unsigned int MeshManager::ReuploadAll()
+{
+	unsigned int numFailed = 0;
+	for (auto& entry : meshes)
+	{
+		// Meshes still loading get their first upload from AssetLoader
+		if (entry.second.mesh->IsReady() && !entry.second.mesh->Reupload())
+			numFailed++;
+	}
+	return numFailed;
+}
+
+void MeshManager::PrintMemoryStats()
+{
+	const double MEGABYTE = 1024.0 * 1024.0;
+	MeshMemoryStats total;
+
+	for (auto& entry : meshes)
+	{
+		Mesh* mesh = entry.second.mesh;
+		MeshMemoryStats stats = mesh->GetMemoryStats();
+		printf("%s: %s, host %.2f MB geometry + %.2f MB clusters and hierarchy, GPU %.2f MB, %u references\n",
+			entry.first.c_str(), Mesh::GetResidencyName(mesh->GetResidency()),
+			stats.hostGeometryBytes / MEGABYTE, stats.hostSupportBytes / MEGABYTE, stats.gpuBytes / MEGABYTE, entry.second.references);
+
+		total.hostGeometryBytes += stats.hostGeometryBytes;
+		total.hostSupportBytes += stats.hostSupportBytes;
+		total.gpuBytes += stats.gpuBytes;
+	}
+
+	printf("Mesh memory: host %.2f MB geometry + %.2f MB clusters and hierarchy, GPU %.2f MB\n",
+		total.hostGeometryBytes / MEGABYTE, total.hostSupportBytes / MEGABYTE, total.gpuBytes / MEGABYTE);
+}
+
+size_t MeshManager::GetNumMeshes()
+{
+	return meshes.size();
+}
+
+void MeshManager::PrintStats()
+{
+	printf("Meshes: %u loaded, %u loads avoided by sharing, %zu alive\n", numLoaded, numShared, meshes.size());
+}
+
+string MeshManager::GetCanonicalPath(const char* path)
+{
+	string canonical;
+
+#ifdef _WIN32
+	char buffer[_MAX_PATH];
+	canonical = _fullpath(buffer, path, _MAX_PATH) ? buffer : path;
+	// Windows paths are case insensitive
+	std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](unsigned char c) { return (char)tolower(c); });
+#else
+	char buffer[PATH_MAX];
+	canonical = realpath(path, buffer) ? buffer : path;
+#endif
+
+	std::replace(canonical.begin(), canonical.end(), '\\', '/');
+	return canonical;
+}
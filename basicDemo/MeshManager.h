@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include "Mesh.h"
+
+using std::string;
+
+//Singleton mesh asset manager
+
+/**
+* Loads every OBJ file once and shares its mesh between models.
+* Meshes are keyed by canonical path, vertex format and layout, and counted by reference:
+* the last Release of a mesh deletes its GPU buffers.
+*/
+class MeshManager
+{
+private:
+	static MeshManager * mInstance; //Holds the instance of the class
+
+	struct Entry {
+		Mesh* mesh;
+		unsigned int references;
+	};
+
+	std::unordered_map<string, Entry> meshes;
+	// Reverse lookup used by Release
+	std::unordered_map<Mesh*, string> keys;
+	// Residency of single assets by canonical path, the others get Mesh::GetDefaultResidency
+	std::unordered_map<string, MeshResidency> residencies;
+
+	// Acquire calls served by a mesh that was already loaded
+	unsigned int numShared;
+	unsigned int numLoaded;
+
+	MeshManager();
+
+	/**
+	* Key of a mesh in the table
+	*/
+	static string GetKey(const char* path, VertexFormat format);
+
+	/**
+	* Adds a reference to a mesh already in the table
+	* @returns{Mesh *} The mesh, nullptr if there is none for the key
+	*/
+	Mesh* Share(const string& key, const char* path);
+
+	/**
+	* Residency policy of an OBJ file
+	*/
+	MeshResidency GetResidency(const char* path);
+
+public:
+	static MeshManager * Instance();
+
+	~MeshManager();
+
+	/**
+	* Gets the mesh of an OBJ file, loading it and uploading it to the GPU the first time
+	* @param{const char *} Path to the OBJ file
+	* @param{VertexFormat} Vertex layout of the mesh
+	* @returns{Mesh *} Shared mesh, nullptr if the file could not be loaded
+	*/
+	Mesh* Acquire(const char* path, VertexFormat format = VERTEX_FORMAT_FLOAT);
+
+	/**
+	* Like Acquire, but the file is parsed by AssetLoader and uploaded later by AssetLoader::ProcessUploads.
+	* The mesh is returned at once in MESH_LOADING state, the loader holds its own reference until the upload ran.
+	* @param{const char *} Path to the OBJ file
+	* @param{VertexFormat} Vertex layout of the mesh
+	* @returns{Mesh *} Shared mesh, MESH_FAILED if the file could not be loaded
+	*/
+	Mesh* AcquireAsync(const char* path, VertexFormat format = VERTEX_FORMAT_FLOAT);
+
+	/**
+	* Drops one reference to a mesh returned by Acquire, the last one deletes it
+	* @param{Mesh *} Mesh to release, nullptr is ignored
+	*/
+	void Release(Mesh* mesh);
+
+	/**
+	* Sets what stays on the host after the upload of one asset, whatever its vertex format.
+	* It applies to meshes loaded from now on, meshes already alive keep their policy
+	* @param{const char *} Path to the OBJ file
+	* @param{MeshResidency} Keep, drop or compressed copy
+	*/
+	void SetResidency(const char* path, MeshResidency policy);
+
+	/**
+	* Uploads every ready mesh again, e.g. after the GL context was recreated
+	* @returns{unsigned int} Number of meshes that could not be uploaded
+	*/
+	unsigned int ReuploadAll();
+
+	/**
+	* Prints the host and GPU bytes of each mesh and the totals
+	*/
+	void PrintMemoryStats();
+
+	/**
+	* Number of meshes currently alive
+	*/
+	size_t GetNumMeshes();
+
+	/**
+	* Prints how many meshes were loaded and how many loads were avoided by sharing
+	*/
+	void PrintStats();
+
+	/**
+	* Absolute path with unified separators, so different spellings of a file share its mesh
+	* @param{const char *} Path to normalize
+	*/
+	static string GetCanonicalPath(const char* path);
+};
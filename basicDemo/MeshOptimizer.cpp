@@ -0,0 +1,304 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+	// Forsyth's scoring constants, tuned for a 32 entry LRU cache
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	// Triangles between two cluster cuts are never fewer than this
+	const size_t MIN_CLUSTER_TRIANGLES = 32;
+	// Past this size a cluster is also cut where the strip only partially restarts
+	const size_t MAX_CLUSTER_TRIANGLES = 256;
+
+	float VertexScore(int cachePosition, unsigned int remainingTriangles)
+	{
+		// No triangle left to draw with this vertex
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The three vertices of the last triangle get a fixed score so the next one does not just reuse them
+			if (cachePosition < 3)
+				score = LAST_TRIANGLE_SCORE;
+			else
+				score = powf(1.0f - (cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+
+		// Vertices with few triangles left are finished first so they leave the cache for good
+		score += VALENCE_BOOST_SCALE * powf(float(remainingTriangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	double AverageCacheMissRatio(const std::vector<unsigned int>& indices, size_t numVertices)
+	{
+		size_t numTriangles = indices.size() / 3;
+		return numTriangles > 0 ? double(MeshBuilder::SimulateVertexCache(indices, numVertices, MeshBuilder::VERTEX_CACHE_SIZE)) / numTriangles : 0.0;
+	}
+
+	double AverageTransformToVertexRatio(const std::vector<unsigned int>& indices, size_t numVertices)
+	{
+		return numVertices > 0 ? double(MeshBuilder::SimulateVertexCache(indices, numVertices, MeshBuilder::VERTEX_CACHE_SIZE)) / numVertices : 0.0;
+	}
+}
+
+void MeshOptimizer::Optimize(MeshData& mesh, MeshOptimizeStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t numVertices = mesh.positions.size();
+
+	if (stats)
+	{
+		stats->numTriangles = mesh.indices.size() / 3;
+		stats->numVertices = numVertices;
+		stats->acmrBefore = AverageCacheMissRatio(mesh.indices, numVertices);
+		stats->atvrBefore = AverageTransformToVertexRatio(mesh.indices, numVertices);
+	}
+
+	OptimizeVertexCache(mesh.indices, numVertices);
+	size_t numClusters = OptimizeOverdraw(mesh.indices, mesh.positions);
+	OptimizeVertexFetch(mesh);
+
+	if (stats)
+	{
+		stats->numClusters = numClusters;
+		// The fetch pass drops unused vertices, the ratios after it are taken over the remaining ones
+		stats->acmrAfter = AverageCacheMissRatio(mesh.indices, mesh.positions.size());
+		stats->atvrAfter = AverageTransformToVertexRatio(mesh.indices, mesh.positions.size());
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles of every vertex as a compact adjacency list
+	std::vector<unsigned int> remaining(numVertices, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<unsigned int> adjacencyOffset(numVertices + 1, 0);
+	for (size_t v = 0; v < numVertices; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+	std::vector<unsigned int> adjacency(numTriangles * 3);
+	std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < numTriangles; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	for (size_t v = 0; v < numVertices; v++)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(numTriangles);
+	std::vector<bool> emitted(numTriangles, false);
+	for (size_t t = 0; t < numTriangles; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> result;
+	result.reserve(numTriangles * 3);
+
+	// The cache holds three extra entries while the new triangle pushes older vertices out
+	std::vector<unsigned int> cache, nextCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+	long long bestTriangle = -1;
+
+	for (size_t emittedCount = 0; emittedCount < numTriangles; emittedCount++)
+	{
+		// Nothing useful in the cache: continue with the first triangle that is still pending
+		if (bestTriangle < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = static_cast<long long>(scanCursor);
+		}
+
+		unsigned int triangle[3] = { indices[bestTriangle * 3], indices[bestTriangle * 3 + 1], indices[bestTriangle * 3 + 2] };
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		// Moves the triangle vertices to the front of the LRU cache
+		nextCache.assign(triangle, triangle + 3);
+		for (unsigned int vertex : cache)
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+				nextCache.push_back(vertex);
+
+		for (int k = 0; k < 3; k++)
+			remaining[triangle[k]]--;
+
+		for (size_t i = 0; i < nextCache.size(); i++)
+		{
+			unsigned int vertex = nextCache[i];
+			cachePosition[vertex] = i < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+		}
+
+		// Rescores the vertices that moved and the triangles around them, picking the best one for the next step
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < nextCache.size(); i++)
+		{
+			unsigned int vertex = nextCache[i];
+			float newScore = VertexScore(cachePosition[vertex], remaining[vertex]);
+			float delta = newScore - vertexScore[vertex];
+			vertexScore[vertex] = newScore;
+
+			for (unsigned int a = adjacencyOffset[vertex]; a < adjacencyOffset[vertex + 1]; a++)
+			{
+				unsigned int t = adjacency[a];
+				if (emitted[t])
+					continue;
+				triangleScore[t] += delta;
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (nextCache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE))
+			nextCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(nextCache);
+	}
+
+	indices.swap(result);
+}
+
+size_t MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return 0;
+
+	// Cuts the buffer where the cache optimizer jumped to a new region, there every vertex of the triangle misses.
+	// Long clusters are also cut where two vertices miss so the sort has enough pieces to work with
+	std::vector<size_t> clusterStart;
+	std::vector<size_t> insertedAt(positions.size(), 0);
+	size_t misses = 0;
+	for (size_t t = 0; t < numTriangles; t++)
+	{
+		int triangleMisses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int vertex = indices[t * 3 + k];
+			if (insertedAt[vertex] == 0 || misses - insertedAt[vertex] >= MeshBuilder::VERTEX_CACHE_SIZE)
+			{
+				misses++;
+				insertedAt[vertex] = misses;
+				triangleMisses++;
+			}
+		}
+
+		if (clusterStart.empty())
+			clusterStart.push_back(t);
+		else if (triangleMisses == 3 && t - clusterStart.back() >= MIN_CLUSTER_TRIANGLES)
+			clusterStart.push_back(t);
+		else if (triangleMisses >= 2 && t - clusterStart.back() >= MAX_CLUSTER_TRIANGLES)
+			clusterStart.push_back(t);
+	}
+	clusterStart.push_back(numTriangles);
+	size_t numClusters = clusterStart.size() - 1;
+
+	// Area weighted centroid of the mesh and of every cluster, plus the average cluster normal
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroid(numClusters, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormal(numClusters, glm::vec3(0.0f));
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		float clusterArea = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			const glm::vec3& a = positions[indices[t * 3]];
+			const glm::vec3& b = positions[indices[t * 3 + 1]];
+			const glm::vec3& d = positions[indices[t * 3 + 2]];
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal) * 0.5f;
+			glm::vec3 center = (a + b + d) / 3.0f;
+
+			clusterCentroid[c] += center * area;
+			clusterNormal[c] += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroid[c];
+		meshArea += clusterArea;
+		clusterCentroid[c] = clusterArea > 0.0f ? clusterCentroid[c] / clusterArea : positions[indices[clusterStart[c] * 3]];
+		float normalLength = glm::length(clusterNormal[c]);
+		clusterNormal[c] = normalLength > 0.0f ? clusterNormal[c] / normalLength : glm::vec3(0.0f);
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters facing away from the mesh center usually occlude the rest, so they go first
+	std::vector<float> sortKey(numClusters);
+	std::vector<size_t> order(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c]);
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t c : order)
+		result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+	indices.swap(result);
+
+	return numClusters;
+}
+
+void MeshOptimizer::OptimizeVertexFetch(MeshData& mesh)
+{
+	const unsigned int UNUSED = 0xffffffffu;
+	size_t numVertices = mesh.positions.size();
+
+	std::vector<unsigned int> remap(numVertices, UNUSED);
+	unsigned int nextVertex = 0;
+	for (unsigned int& index : mesh.indices)
+	{
+		if (remap[index] == UNUSED)
+			remap[index] = nextVertex++;
+		index = remap[index];
+	}
+
+	// Vertices no triangle uses are dropped
+	std::vector<glm::vec3> positions(nextVertex), normals(nextVertex);
+	std::vector<glm::vec2> uvs(nextVertex);
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		if (remap[v] == UNUSED)
+			continue;
+		positions[remap[v]] = mesh.positions[v];
+		normals[remap[v]] = mesh.normals[v];
+		uvs[remap[v]] = mesh.uvs[v];
+	}
+
+	mesh.positions.swap(positions);
+	mesh.normals.swap(normals);
+	mesh.uvs.swap(uvs);
+}
+
+void MeshOptimizer::PrintStats(const char* name, const MeshOptimizeStats& stats)
+{
+	printf("%s: %zu triangles in %zu clusters optimized in %.2f ms, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		name, stats.numTriangles, stats.numClusters, stats.seconds * 1000.0,
+		stats.acmrBefore, stats.acmrAfter, stats.atvrBefore, stats.atvrAfter);
+}
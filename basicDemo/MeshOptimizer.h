@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBuilder.h"
+
+/**
+* Post-transform cache efficiency of an index buffer before and after optimization
+*/
+struct MeshOptimizeStats {
+	size_t numTriangles = 0;
+	size_t numVertices = 0;
+	size_t numClusters = 0;
+	// Average cache miss ratio, transformed vertices per triangle
+	double acmrBefore = 0.0;
+	double acmrAfter = 0.0;
+	// Average transform to vertex ratio, 1.0 means every vertex is transformed once
+	double atvrBefore = 0.0;
+	double atvrAfter = 0.0;
+	double seconds = 0.0;
+};
+
+/**
+* Reorders indexed meshes for the GPU: triangles for the post-transform cache,
+* triangle clusters for early depth rejection and vertices for fetch locality.
+* It only changes the order of triangles and vertices, never the rendered geometry.
+*/
+class MeshOptimizer
+{
+public:
+	/**
+	* Runs every optimization stage on a mesh
+	* @param{MeshData &} Mesh to reorder
+	* @param{MeshOptimizeStats *} Optional ACMR/ATVR report
+	*/
+	static void Optimize(MeshData& mesh, MeshOptimizeStats* stats = nullptr);
+
+	/**
+	* Reorders triangles to maximize post-transform cache hits (Forsyth's linear-speed algorithm)
+	* @param{std::vector<unsigned int> &} Indices to reorder
+	* @param{size_t} Number of vertices of the mesh
+	*/
+	static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices);
+
+	/**
+	* Splits a cache optimized index buffer in clusters and sorts them so outward facing clusters are drawn first
+	* @param{std::vector<unsigned int> &} Indices to reorder
+	* @param{const std::vector<glm::vec3> &} Vertex positions
+	* @returns{size_t} Number of clusters
+	*/
+	static size_t OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+
+	/**
+	* Reorders the vertices of a mesh in the order the index buffer first uses them
+	* @param{MeshData &} Mesh to reorder
+	*/
+	static void OptimizeVertexFetch(MeshData& mesh);
+
+	/**
+	* Prints the cache efficiency before and after optimization
+	* @param{const char*} Name shown in the report
+	* @param{const MeshOptimizeStats &} Statistics of the mesh
+	*/
+	static void PrintStats(const char* name, const MeshOptimizeStats& stats);
+};
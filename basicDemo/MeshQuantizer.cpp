@@ -0,0 +1,166 @@
+#include "MeshQuantizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/packing.hpp>
+
+namespace {
+	inline float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline int16_t ToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	inline float FromSnorm16(int16_t value)
+	{
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	inline int8_t ToSnorm8(float value)
+	{
+		return static_cast<int8_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 127.0f));
+	}
+}
+
+void MeshQuantizer::QuantizePositions(const glm::vec3* positions, size_t numVertices, QuantizedMesh& quantized)
+{
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	if (numVertices > 0)
+	{
+		boundsMin = boundsMax = positions[0];
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			boundsMin = glm::min(boundsMin, positions[v]);
+			boundsMax = glm::max(boundsMax, positions[v]);
+		}
+	}
+	quantized.boundsMin = boundsMin;
+	quantized.boundsExtent = boundsMax - boundsMin;
+
+	// Flat axes quantize to 0, the decode multiplies by a zero extent
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+		scale[axis] = quantized.boundsExtent[axis] > 0.0f ? 65535.0f / quantized.boundsExtent[axis] : 0.0f;
+
+	quantized.positions.resize(numVertices * 4);
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float q = std::round((positions[v][axis] - boundsMin[axis]) * scale[axis]);
+			quantized.positions[v * 4 + axis] = static_cast<uint16_t>(glm::clamp(q, 0.0f, 65535.0f));
+		}
+		quantized.positions[v * 4 + 3] = 0;
+	}
+}
+
+void MeshQuantizer::Quantize(const MeshData& mesh, QuantizedMesh& quantized, QuantizationError* error)
+{
+	size_t numVertices = mesh.positions.size();
+
+	QuantizePositions(mesh.positions.data(), numVertices, quantized);
+	quantized.normals.resize(numVertices * 2);
+	quantized.uvs.resize(numVertices * 2);
+	quantized.tangents.assign(numVertices * 4, 0);
+
+	QuantizationError worst;
+
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		const glm::vec3& position = mesh.positions[v];
+		glm::vec3 decodedPosition;
+		for (int axis = 0; axis < 3; axis++)
+			decodedPosition[axis] = quantized.boundsMin[axis] + (quantized.positions[v * 4 + axis] / 65535.0f) * quantized.boundsExtent[axis];
+		worst.position = std::max(worst.position, glm::length(decodedPosition - position));
+
+		const glm::vec3& normal = mesh.normals[v];
+		glm::vec2 encoded = OctahedralEncode(normal);
+		quantized.normals[v * 2] = ToSnorm16(encoded.x);
+		quantized.normals[v * 2 + 1] = ToSnorm16(encoded.y);
+		float normalLength = glm::length(normal);
+		if (normalLength > 0.0f)
+		{
+			glm::vec3 decodedNormal = OctahedralDecode(glm::vec2(FromSnorm16(quantized.normals[v * 2]), FromSnorm16(quantized.normals[v * 2 + 1])));
+			float cosine = glm::clamp(glm::dot(decodedNormal, normal / normalLength), -1.0f, 1.0f);
+			worst.normalDegrees = std::max(worst.normalDegrees, glm::degrees(std::acos(cosine)));
+		}
+
+		const glm::vec2& uv = mesh.uvs[v];
+		quantized.uvs[v * 2] = glm::packHalf1x16(uv.x);
+		quantized.uvs[v * 2 + 1] = glm::packHalf1x16(uv.y);
+		glm::vec2 decodedUv(glm::unpackHalf1x16(quantized.uvs[v * 2]), glm::unpackHalf1x16(quantized.uvs[v * 2 + 1]));
+		worst.uv = std::max(worst.uv, std::max(std::abs(decodedUv.x - uv.x), std::abs(decodedUv.y - uv.y)));
+
+		// Tangents only steer the normal map, 8 bits keep them within half a degree
+		if (v < mesh.tangents.size())
+		{
+			for (int axis = 0; axis < 4; axis++)
+				quantized.tangents[v * 4 + axis] = ToSnorm8(mesh.tangents[v][axis]);
+		}
+	}
+
+	float largestExtent = std::max(quantized.boundsExtent.x, std::max(quantized.boundsExtent.y, quantized.boundsExtent.z));
+	worst.positionRelative = largestExtent > 0.0f ? worst.position / largestExtent : 0.0f;
+
+	if (error)
+		*error = worst;
+}
+
+void MeshQuantizer::Dequantize(const QuantizedMesh& quantized, MeshData& mesh)
+{
+	size_t numVertices = quantized.positions.size() / 4;
+	mesh.positions.resize(numVertices);
+	mesh.normals.resize(numVertices);
+	mesh.uvs.resize(numVertices);
+	mesh.tangents.resize(quantized.tangents.size() / 4);
+
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		glm::vec3 unorm(quantized.positions[v * 4], quantized.positions[v * 4 + 1], quantized.positions[v * 4 + 2]);
+		mesh.positions[v] = quantized.boundsMin + unorm / 65535.0f * quantized.boundsExtent;
+		mesh.normals[v] = OctahedralDecode(glm::vec2(FromSnorm16(quantized.normals[v * 2]), FromSnorm16(quantized.normals[v * 2 + 1])));
+		mesh.uvs[v] = glm::vec2(glm::unpackHalf1x16(quantized.uvs[v * 2]), glm::unpackHalf1x16(quantized.uvs[v * 2 + 1]));
+	}
+
+	for (size_t v = 0; v < mesh.tangents.size(); v++)
+	{
+		for (int axis = 0; axis < 4; axis++)
+			mesh.tangents[v][axis] = std::max(quantized.tangents[v * 4 + axis] / 127.0f, -1.0f);
+	}
+}
+
+glm::vec2 MeshQuantizer::OctahedralEncode(const glm::vec3& normal)
+{
+	float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (sum <= 0.0f)
+		return glm::vec2(0.0f);
+
+	glm::vec3 n = normal / sum;
+	if (n.z >= 0.0f)
+		return glm::vec2(n.x, n.y);
+
+	// The lower hemisphere is folded over the diagonals
+	return glm::vec2((1.0f - std::abs(n.y)) * SignNotZero(n.x), (1.0f - std::abs(n.x)) * SignNotZero(n.y));
+}
+
+glm::vec3 MeshQuantizer::OctahedralDecode(const glm::vec2& encoded)
+{
+	glm::vec3 n(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	if (n.z < 0.0f)
+	{
+		float x = n.x;
+		n.x = (1.0f - std::abs(n.y)) * SignNotZero(x);
+		n.y = (1.0f - std::abs(x)) * SignNotZero(n.y);
+	}
+	return glm::normalize(n);
+}
+
+void MeshQuantizer::PrintError(const char* name, const QuantizationError& error)
+{
+	printf("%s: compact vertices, worst error position %.6f (%.5f%% of the bounds), normal %.4f deg, uv %.6f\n",
+		name, error.position, error.positionRelative * 100.0f, error.normalDegrees, error.uv);
+}
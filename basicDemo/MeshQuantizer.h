@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBuilder.h"
+
+/**
+* Compact vertex streams, 20 bytes per vertex instead of 48:
+* positions as unorm16 x4 relative to the mesh bounds (the fourth value is padding),
+* normals octahedral encoded in snorm16 x2, uvs as half floats
+* and tangents as snorm8 x4 with the bitangent sign in the fourth value
+*/
+struct QuantizedMesh {
+	std::vector<uint16_t> positions;
+	std::vector<int16_t> normals;
+	std::vector<uint16_t> uvs;
+	std::vector<int8_t> tangents;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsExtent = glm::vec3(0.0f);
+};
+
+/**
+* Worst-case error introduced by the quantization of a mesh
+*/
+struct QuantizationError {
+	// World units
+	float position = 0.0f;
+	// Fraction of the largest bounds extent
+	float positionRelative = 0.0f;
+	float normalDegrees = 0.0f;
+	float uv = 0.0f;
+};
+
+/**
+* Converts float meshes to the compact vertex layout
+*/
+class MeshQuantizer
+{
+public:
+	/**
+	* Quantizes the attributes of a mesh and measures the error against the float data
+	* @param{const MeshData &} Float mesh
+	* @param{QuantizedMesh &} Compact streams
+	* @param{QuantizationError *} Optional worst-case error
+	*/
+	static void Quantize(const MeshData& mesh, QuantizedMesh& quantized, QuantizationError* error = nullptr);
+
+	/**
+	* Quantizes positions alone, the other streams of quantized are left alone
+	* @param{const glm::vec3 *} Float positions
+	* @param{size_t} Number of positions
+	* @param{QuantizedMesh &} Positions and bounds of the compact streams
+	*/
+	static void QuantizePositions(const glm::vec3* positions, size_t numVertices, QuantizedMesh& quantized);
+
+	/**
+	* Decodes compact streams back to float arrays, the indices of the mesh are left alone
+	* @param{const QuantizedMesh &} Compact streams
+	* @param{MeshData &} Float positions, normals, uvs and tangents
+	*/
+	static void Dequantize(const QuantizedMesh& quantized, MeshData& mesh);
+
+	/**
+	* Octahedral encoding of a unit vector in [-1, 1]^2
+	*/
+	static glm::vec2 OctahedralEncode(const glm::vec3& normal);
+
+	/**
+	* Inverse of OctahedralEncode, matches octahedralDecode in the lightning shaders
+	*/
+	static glm::vec3 OctahedralDecode(const glm::vec2& encoded);
+
+	/**
+	* Prints the worst-case quantization error of a mesh
+	* @param{const char*} Name shown in the report
+	* @param{const QuantizationError &} Error of the mesh
+	*/
+	static void PrintError(const char* name, const QuantizationError& error);
+};
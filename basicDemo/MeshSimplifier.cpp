@@ -0,0 +1,536 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+	// Each level aims for this fraction of the triangles of the previous one
+	const float LOD_REDUCTION = 0.5f;
+	// A level that removes less than this fraction of the previous triangles ends the chain
+	const float LOD_MIN_REDUCTION = 0.2f;
+	// Largest error of a single level, relative to the size of the mesh
+	const float LOD_MAX_ERROR = 0.05f;
+	// Weight of the planes holding borders and seams in place, relative to the face planes
+	const float BORDER_WEIGHT = 10.0f;
+
+	const unsigned int NONE = 0xffffffffu;
+
+	enum VertexKind {
+		// Inside a closed fan, collapses anywhere
+		KIND_MANIFOLD,
+		// On an open edge of the surface
+		KIND_BORDER,
+		// Position split in two vertices with different uvs or normals
+		KIND_SEAM,
+		// Corners, seams meeting borders and non-manifold fans never move
+		KIND_LOCKED
+	};
+
+	// Kinds each kind of vertex may collapse onto
+	const bool CAN_COLLAPSE[4][4] = {
+		{ true, true, true, true },
+		{ false, true, false, false },
+		{ false, false, true, false },
+		{ false, false, false, false }
+	};
+
+	struct PositionHash {
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	// Position and uv of a vertex, what the levels of detail keep apart
+	struct WeldKey {
+		glm::vec3 position;
+		glm::vec2 uv;
+
+		bool operator==(const WeldKey& other) const
+		{
+			return position == other.position && uv == other.uv;
+		}
+	};
+
+	struct WeldHash {
+		size_t operator()(const WeldKey& key) const
+		{
+			uint32_t bits[2];
+			memcpy(bits, &key.uv, sizeof(bits));
+			return PositionHash()(key.position) ^ (bits[0] * 2654435761u) ^ (bits[1] * 40503u);
+		}
+	};
+
+	/**
+	* Sum of squared distances to a set of planes, weighted by area
+	*/
+	struct Quadric {
+		float a00, a11, a22, a10, a20, a21;
+		float b0, b1, b2;
+		float c;
+		float w;
+	};
+
+	Quadric QuadricFromPlane(const glm::vec3& n, float d, float w)
+	{
+		Quadric q;
+		q.a00 = w * n.x * n.x;
+		q.a11 = w * n.y * n.y;
+		q.a22 = w * n.z * n.z;
+		q.a10 = w * n.y * n.x;
+		q.a20 = w * n.z * n.x;
+		q.a21 = w * n.z * n.y;
+		q.b0 = w * n.x * d;
+		q.b1 = w * n.y * d;
+		q.b2 = w * n.z * d;
+		q.c = w * d * d;
+		q.w = w;
+		return q;
+	}
+
+	void QuadricAdd(Quadric& q, const Quadric& r)
+	{
+		q.a00 += r.a00;
+		q.a11 += r.a11;
+		q.a22 += r.a22;
+		q.a10 += r.a10;
+		q.a20 += r.a20;
+		q.a21 += r.a21;
+		q.b0 += r.b0;
+		q.b1 += r.b1;
+		q.b2 += r.b2;
+		q.c += r.c;
+		q.w += r.w;
+	}
+
+	// Average squared distance of a point to the planes
+	float QuadricError(const Quadric& q, const glm::vec3& p)
+	{
+		float r = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+			+ 2.0f * (q.a10 * p.x * p.y + q.a20 * p.x * p.z + q.a21 * p.y * p.z)
+			+ 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return q.w > 0.0f ? std::abs(r) / q.w : 0.0f;
+	}
+
+	/**
+	* Triangles around every vertex
+	*/
+	struct Adjacency {
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+
+		void Build(const std::vector<unsigned int>& indices, size_t numVertices)
+		{
+			offsets.assign(numVertices + 1, 0);
+			for (unsigned int index : indices)
+				offsets[index + 1]++;
+			for (size_t v = 0; v < numVertices; v++)
+				offsets[v + 1] += offsets[v];
+
+			triangles.resize(indices.size());
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+				triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+		}
+
+		// true if a triangle has the directed edge a -> b
+		bool HasEdge(const std::vector<unsigned int>& indices, unsigned int a, unsigned int b) const
+		{
+			for (unsigned int i = offsets[a]; i < offsets[a + 1]; i++)
+			{
+				const unsigned int* triangle = &indices[triangles[i] * 3];
+				for (int k = 0; k < 3; k++)
+					if (triangle[k] == a && triangle[(k + 1) % 3] == b)
+						return true;
+			}
+			return false;
+		}
+	};
+
+	// Largest side of the bounding box, the unit of the simplification errors
+	float MeasureExtent(const std::vector<glm::vec3>& positions, glm::vec3& boundsMin)
+	{
+		boundsMin = positions[0];
+		glm::vec3 boundsMax = positions[0];
+		for (const glm::vec3& p : positions)
+		{
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		glm::vec3 size = boundsMax - boundsMin;
+		return std::max(size.x, std::max(size.y, size.z));
+	}
+
+	// Positions moved into the unit cube, so errors are relative to the size of the mesh
+	void NormalizePositions(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& points)
+	{
+		glm::vec3 boundsMin;
+		float extent = MeasureExtent(positions, boundsMin);
+		float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+
+		points.resize(positions.size());
+		for (size_t v = 0; v < positions.size(); v++)
+			points[v] = (positions[v] - boundsMin) * scale;
+	}
+
+	// true if moving v0 to v1 turns the triangle a, b, v0 over
+	bool FlipsTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& v0, const glm::vec3& v1)
+	{
+		glm::vec3 edge = b - a;
+		return glm::dot(glm::cross(edge, v0 - a), glm::cross(edge, v1 - a)) <= 0.0f;
+	}
+}
+
+float MeshSimplifier::Simplify(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+	size_t targetIndexCount, float targetError, std::vector<unsigned int>& destination)
+{
+	destination = indices;
+	size_t numVertices = positions.size();
+	if (destination.size() <= targetIndexCount || numVertices == 0)
+		return 0.0f;
+
+	std::vector<glm::vec3> points;
+	NormalizePositions(positions, points);
+
+	// Vertices sharing a position are its wedges: remap points at the first one, wedge links them in a cycle.
+	// Vertices no triangle uses stay on their own, they would lock the wedges they join
+	std::vector<unsigned char> used(numVertices, 0);
+	for (unsigned int index : destination)
+		used[index] = 1;
+
+	std::vector<unsigned int> remap(numVertices), wedge(numVertices);
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> firstVertex;
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		if (!used[v])
+		{
+			remap[v] = wedge[v] = static_cast<unsigned int>(v);
+			continue;
+		}
+		unsigned int r = firstVertex.emplace(positions[v], static_cast<unsigned int>(v)).first->second;
+		remap[v] = r;
+		if (r == v)
+			wedge[v] = r;
+		else
+		{
+			wedge[v] = wedge[r];
+			wedge[r] = static_cast<unsigned int>(v);
+		}
+	}
+
+	Adjacency adjacency;
+	adjacency.Build(destination, numVertices);
+
+	// Open edges have no twin going the other way, openOut follows them forward and openIn backward
+	std::vector<unsigned int> openOut(numVertices, NONE), openIn(numVertices, NONE);
+	std::vector<unsigned char> openOutCount(numVertices, 0), openInCount(numVertices, 0);
+	for (size_t i = 0; i < destination.size(); i++)
+	{
+		unsigned int a = destination[i];
+		unsigned int b = destination[i - i % 3 + (i + 1) % 3];
+		if (adjacency.HasEdge(destination, b, a))
+			continue;
+		openOut[a] = b;
+		openIn[b] = a;
+		openOutCount[a] = static_cast<unsigned char>(std::min(openOutCount[a] + 1, 2));
+		openInCount[b] = static_cast<unsigned char>(std::min(openInCount[b] + 1, 2));
+	}
+
+	std::vector<unsigned char> kind(numVertices, KIND_LOCKED);
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		if (remap[v] != v)
+			continue;
+
+		unsigned int w = wedge[v];
+		VertexKind vertexKind = KIND_LOCKED;
+		if (w == v)
+		{
+			if (openOutCount[v] == 0 && openInCount[v] == 0)
+				vertexKind = KIND_MANIFOLD;
+			else if (openOutCount[v] == 1 && openInCount[v] == 1)
+				vertexKind = KIND_BORDER;
+		}
+		else if (wedge[w] == v)
+		{
+			// Both sides of a seam run along the same positions in opposite directions
+			if (openOutCount[v] == 1 && openInCount[v] == 1 && openOutCount[w] == 1 && openInCount[w] == 1
+				&& remap[openOut[v]] == remap[openIn[w]] && remap[openOut[w]] == remap[openIn[v]])
+				vertexKind = KIND_SEAM;
+		}
+
+		unsigned int u = static_cast<unsigned int>(v);
+		do
+		{
+			kind[u] = static_cast<unsigned char>(vertexKind);
+			u = wedge[u];
+		} while (u != v);
+	}
+
+	// Face planes of every position, plus planes standing on the open edges to keep borders and seams in shape
+	std::vector<Quadric> quadrics(numVertices, QuadricFromPlane(glm::vec3(0.0f), 0.0f, 0.0f));
+	for (size_t t = 0; t < destination.size() / 3; t++)
+	{
+		const unsigned int* triangle = &destination[t * 3];
+		glm::vec3 normal = glm::cross(points[triangle[1]] - points[triangle[0]], points[triangle[2]] - points[triangle[0]]);
+		float area = glm::length(normal);
+		if (area <= 0.0f)
+			continue;
+		normal /= area;
+
+		Quadric face = QuadricFromPlane(normal, -glm::dot(normal, points[triangle[0]]), area * 0.5f);
+		for (int k = 0; k < 3; k++)
+			QuadricAdd(quadrics[remap[triangle[k]]], face);
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = triangle[k], b = triangle[(k + 1) % 3];
+			if (adjacency.HasEdge(destination, b, a))
+				continue;
+
+			glm::vec3 edge = points[b] - points[a];
+			float length = glm::length(edge);
+			glm::vec3 side = glm::cross(edge, normal);
+			float sideLength = glm::length(side);
+			if (sideLength <= 0.0f)
+				continue;
+			side /= sideLength;
+
+			Quadric border = QuadricFromPlane(side, -glm::dot(side, points[a]), length * length * BORDER_WEIGHT);
+			QuadricAdd(quadrics[remap[a]], border);
+			QuadricAdd(quadrics[remap[b]], border);
+		}
+	}
+
+	struct Collapse {
+		unsigned int v0;
+		unsigned int v1;
+		float error;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> collapseRemap(numVertices);
+	std::vector<unsigned char> locked(numVertices);
+
+	// Borders and seams only slide along their own open edges
+	auto canCollapse = [&](unsigned int v0, unsigned int v1) {
+		if (!CAN_COLLAPSE[kind[v0]][kind[v1]])
+			return false;
+		if (kind[v0] == KIND_BORDER || kind[v0] == KIND_SEAM)
+			return openOut[v0] == v1 || openIn[v0] == v1;
+		return true;
+	};
+
+	auto hasFlips = [&](unsigned int v0, unsigned int v1) {
+		unsigned int r1 = remap[v1];
+		for (unsigned int i = adjacency.offsets[v0]; i < adjacency.offsets[v0 + 1]; i++)
+		{
+			const unsigned int* triangle = &destination[adjacency.triangles[i] * 3];
+			int k = triangle[0] == v0 ? 0 : triangle[1] == v0 ? 1 : 2;
+			unsigned int a = triangle[(k + 1) % 3], b = triangle[(k + 2) % 3];
+			// Triangles on the collapsed edge disappear
+			if (remap[a] == r1 || remap[b] == r1)
+				continue;
+			if (FlipsTriangle(points[collapseRemap[a]], points[collapseRemap[b]], points[v0], points[v1]))
+				return true;
+		}
+		return false;
+	};
+
+	float limit = targetError * targetError;
+	float resultError = 0.0f;
+
+	while (destination.size() > targetIndexCount)
+	{
+		collapses.clear();
+		for (size_t i = 0; i < destination.size(); i++)
+		{
+			unsigned int i0 = destination[i];
+			unsigned int i1 = destination[i - i % 3 + (i + 1) % 3];
+			if (remap[i0] == remap[i1])
+				continue;
+			// Interior edges show up once per direction, one is enough
+			if (i0 > i1 && adjacency.HasEdge(destination, i1, i0))
+				continue;
+
+			Collapse collapse = { NONE, NONE, FLT_MAX };
+			if (canCollapse(i0, i1))
+				collapse = { i0, i1, QuadricError(quadrics[remap[i0]], points[i1]) };
+			if (canCollapse(i1, i0))
+			{
+				float error = QuadricError(quadrics[remap[i1]], points[i0]);
+				if (error < collapse.error)
+					collapse = { i1, i0, error };
+			}
+			if (collapse.v0 != NONE)
+				collapses.push_back(collapse);
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// A collapse removes about two triangles, the pass stops well before the cheap ones run out
+		size_t triangleGoal = (destination.size() - targetIndexCount) / 3;
+		size_t edgeGoal = triangleGoal / 2;
+		float passLimit = edgeGoal < collapses.size() ? collapses[edgeGoal].error * 1.5f : FLT_MAX;
+		passLimit = std::min(passLimit, limit);
+
+		for (size_t v = 0; v < numVertices; v++)
+			collapseRemap[v] = static_cast<unsigned int>(v);
+		std::fill(locked.begin(), locked.end(), 0);
+
+		size_t triangleCollapses = 0;
+		size_t numCollapses = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > passLimit || triangleCollapses >= triangleGoal)
+				break;
+
+			unsigned int i0 = collapse.v0, i1 = collapse.v1;
+			unsigned int r0 = remap[i0], r1 = remap[i1];
+			// One collapse per neighbourhood and pass, the quadrics of the others are stale
+			if (locked[r0] || locked[r1])
+				continue;
+
+			bool seam = kind[i0] == KIND_SEAM;
+			if (hasFlips(i0, i1) || (seam && hasFlips(wedge[i0], wedge[i1])))
+				continue;
+
+			collapseRemap[i0] = i1;
+			// The other side of the seam follows
+			if (seam)
+				collapseRemap[wedge[i0]] = wedge[i1];
+
+			QuadricAdd(quadrics[r1], quadrics[r0]);
+			locked[r0] = 1;
+			locked[r1] = 1;
+			triangleCollapses += kind[i0] == KIND_BORDER ? 1 : 2;
+			resultError = std::max(resultError, collapse.error);
+			numCollapses++;
+		}
+
+		if (numCollapses == 0)
+			break;
+
+		// Open edge loops skip the vertices that went away
+		for (std::vector<unsigned int>* loop : { &openOut, &openIn })
+		{
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				unsigned int next = (*loop)[v];
+				if (next == NONE)
+					continue;
+				unsigned int target = collapseRemap[next];
+				(*loop)[v] = target == v ? (*loop)[next] : target;
+			}
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < destination.size() / 3; t++)
+		{
+			unsigned int a = collapseRemap[destination[t * 3]];
+			unsigned int b = collapseRemap[destination[t * 3 + 1]];
+			unsigned int c = collapseRemap[destination[t * 3 + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+				continue;
+			destination[write++] = a;
+			destination[write++] = b;
+			destination[write++] = c;
+		}
+		destination.resize(write);
+
+		adjacency.Build(destination, numVertices);
+	}
+
+	return std::sqrt(resultError);
+}
+
+void MeshSimplifier::BuildLods(MeshData& mesh, std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	MeshLod full = { 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f, 0 };
+	lods.push_back(full);
+	if (mesh.positions.empty())
+		return;
+
+	glm::vec3 boundsMin;
+	float extent = MeasureExtent(mesh.positions, boundsMin);
+	size_t numVertices = mesh.positions.size();
+
+	// Flat shaded meshes split every corner by its face normal, which would leave no edge to collapse.
+	// The simplifier sees vertices welded by position and uv, so only uv seams stay apart,
+	// weldNext links the vertices of a welded one in a cycle
+	std::vector<unsigned int> weldRemap(numVertices), weldNext(numVertices);
+	std::unordered_map<WeldKey, unsigned int, WeldHash> firstVertex;
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		WeldKey key = { mesh.positions[v], mesh.hasUvs ? mesh.uvs[v] : glm::vec2(0.0f) };
+		unsigned int r = firstVertex.emplace(key, static_cast<unsigned int>(v)).first->second;
+		weldRemap[v] = r;
+		if (r == v)
+			weldNext[v] = r;
+		else
+		{
+			weldNext[v] = weldNext[r];
+			weldNext[r] = static_cast<unsigned int>(v);
+		}
+	}
+
+	// Each level is simplified from the previous one, so the errors add up
+	std::vector<unsigned int> previous(mesh.indices.size()), simplified, level;
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+		previous[i] = weldRemap[mesh.indices[i]];
+	float error = 0.0f;
+	while (lods.size() < MAX_LODS)
+	{
+		size_t target = static_cast<size_t>(previous.size() / 3 * LOD_REDUCTION) * 3;
+		error += Simplify(previous, mesh.positions, target, LOD_MAX_ERROR, simplified);
+		if (simplified.empty() || simplified.size() > previous.size() * (1.0f - LOD_MIN_REDUCTION))
+			break;
+
+		// Every corner goes back to the vertex of its welded one whose normal is closest to the face,
+		// so hard edges and flat faces keep their shading
+		level.resize(simplified.size());
+		for (size_t t = 0; t < simplified.size() / 3; t++)
+		{
+			const unsigned int* triangle = &simplified[t * 3];
+			glm::vec3 face = glm::cross(mesh.positions[triangle[1]] - mesh.positions[triangle[0]],
+				mesh.positions[triangle[2]] - mesh.positions[triangle[0]]);
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int best = triangle[k], v = triangle[k];
+				float bestDot = -FLT_MAX;
+				do
+				{
+					float d = glm::dot(mesh.normals[v], face);
+					if (d > bestDot)
+					{
+						bestDot = d;
+						best = v;
+					}
+					v = weldNext[v];
+				} while (v != triangle[k]);
+				level[t * 3 + k] = best;
+			}
+		}
+
+		MeshOptimizer::OptimizeVertexCache(level, numVertices);
+
+		MeshLod lod = { static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(level.size()), error * extent, 0 };
+		lods.push_back(lod);
+		mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+		previous.swap(simplified);
+	}
+}
+
+void MeshSimplifier::PrintStats(const char* name, const std::vector<MeshLod>& lods)
+{
+	printf("%s: %zu levels of detail,", name, lods.size());
+	for (size_t l = 0; l < lods.size(); l++)
+		printf("%s %u triangles (error %.4f)", l > 0 ? " /" : "", lods[l].indexCount / 3, lods[l].error);
+	printf("\n");
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBuilder.h"
+
+/**
+* One level of detail, a range of the shared index buffer.
+* The layout is stored as is in the mesh cache.
+*/
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// Largest distance, in mesh units, between this level and the full resolution surface
+	float error;
+	uint32_t padding;
+};
+
+/**
+* Simplifies indexed meshes with quadric error metric edge collapses.
+* Vertices only move onto existing vertices, so every level of detail reuses the vertex buffer of the mesh.
+* Open borders and uv/normal seams only collapse along themselves, which keeps both sides of a seam welded.
+*/
+class MeshSimplifier
+{
+public:
+	// Levels of detail of a mesh, the full resolution one included
+	static const unsigned int MAX_LODS = 4;
+
+	/**
+	* Collapses edges until the index count reaches the target or the next collapse would exceed the error limit
+	* @param{const std::vector<unsigned int> &} Triangle list indices to simplify
+	* @param{const std::vector<glm::vec3> &} Vertex positions
+	* @param{size_t} Index count to reach
+	* @param{float} Largest error allowed, relative to the size of the mesh
+	* @param{std::vector<unsigned int> &} Simplified indices
+	* @returns{float} Error of the result, relative to the size of the mesh
+	*/
+	static float Simplify(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		size_t targetIndexCount, float targetError, std::vector<unsigned int>& destination);
+
+	/**
+	* Builds a chain of levels of detail, each one about half the triangles of the previous one.
+	* The simplified indices are appended to the mesh indices, the first level is the original index buffer.
+	* Vertices split only by their normal are welded while simplifying, so flat shaded meshes reduce too,
+	* uv seams stay. The chain stops early once a level no longer removes enough triangles.
+	* @param{MeshData &} Mesh whose index buffer is extended
+	* @param{std::vector<MeshLod> &} Index range and error of every level
+	*/
+	static void BuildLods(MeshData& mesh, std::vector<MeshLod>& lods);
+
+	/**
+	* Prints the triangle count and error of every level
+	* @param{const char*} Name shown in the report
+	* @param{const std::vector<MeshLod> &} Levels of the mesh
+	*/
+	static void PrintStats(const char* name, const std::vector<MeshLod>& lods);
+};
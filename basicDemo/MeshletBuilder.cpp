@@ -0,0 +1,294 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+double MeshletCullStats::GetRejectedFraction() const
+{
+	return numMeshlets > 0 ? (double)(frustumCulled + coneCulled) / (double)numMeshlets : 0.0;
+}
+
+namespace {
+	// Weight of the normal spread against the distance when growing a meshlet, higher values make tighter cones
+	const float CONE_WEIGHT = 0.25f;
+	// Positions shared by more triangles are fan hubs, walking them would flood the candidate list
+	const unsigned int MAX_VALENCE = 128;
+
+	struct PositionHash {
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+}
+
+void MeshletBuilder::Build(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, std::vector<Meshlet>& meshlets)
+{
+	meshlets.clear();
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles touching each position, seams split vertices but the surface is still connected through the positions
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> positionIds;
+	std::vector<unsigned int> vertexPosition(positions.size());
+	for (size_t v = 0; v < positions.size(); v++)
+		vertexPosition[v] = positionIds.emplace(positions[v], static_cast<unsigned int>(positionIds.size())).first->second;
+
+	std::vector<unsigned int> adjacencyOffsets(positionIds.size() + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		adjacencyOffsets[vertexPosition[indices[i]] + 1]++;
+	for (size_t p = 0; p < positionIds.size(); p++)
+		adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+	std::vector<unsigned int> adjacency(numTriangles * 3);
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		adjacency[fill[vertexPosition[indices[i]]]++] = static_cast<unsigned int>(i / 3);
+
+	std::vector<glm::vec3> centroids(numTriangles), normals(numTriangles);
+	float averageArea = 0.0f;
+	for (size_t t = 0; t < numTriangles; t++)
+	{
+		const glm::vec3& p0 = positions[indices[t * 3]];
+		const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+		const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+		centroids[t] = (p0 + p1 + p2) / 3.0f;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		averageArea += length * 0.5f;
+	}
+	averageArea /= numTriangles;
+	// Radius a full meshlet of average triangles would have, it scales the distance term
+	float expectedRadius = std::max(std::sqrt(averageArea * MAX_TRIANGLES / 3.14159265f), 1e-6f);
+
+	std::vector<bool> emitted(numTriangles, false);
+	// Meshlet whose candidate list already holds each triangle
+	std::vector<unsigned int> queuedBy(numTriangles, 0xffffffffu);
+	// Meshlet that last used each vertex
+	std::vector<unsigned int> usedBy(positions.size(), 0xffffffffu);
+	std::vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+	std::vector<unsigned int> candidates;
+
+	size_t seed = 0;
+	unsigned int meshletId = 0;
+
+	for (;;)
+	{
+		// The next meshlet starts at the first triangle left in the cache optimized order
+		while (seed < numTriangles && emitted[seed])
+			seed++;
+		if (seed == numTriangles)
+			break;
+
+		Meshlet current = {};
+		current.firstIndex = static_cast<uint32_t>(reordered.size());
+		glm::vec3 centroidSum(0.0f), normalSum(0.0f);
+		candidates.clear();
+
+		size_t next = seed;
+		for (;;)
+		{
+			// Emits the triangle and queues its neighbours
+			emitted[next] = true;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int vertex = indices[next * 3 + corner];
+				if (usedBy[vertex] != meshletId)
+				{
+					usedBy[vertex] = meshletId;
+					current.vertexCount++;
+				}
+				reordered.push_back(vertex);
+
+				unsigned int position = vertexPosition[vertex];
+				if (adjacencyOffsets[position + 1] - adjacencyOffsets[position] > MAX_VALENCE)
+					continue;
+				for (unsigned int a = adjacencyOffsets[position]; a < adjacencyOffsets[position + 1]; a++)
+				{
+					unsigned int triangle = adjacency[a];
+					if (!emitted[triangle] && queuedBy[triangle] != meshletId)
+					{
+						queuedBy[triangle] = meshletId;
+						candidates.push_back(triangle);
+					}
+				}
+			}
+			current.indexCount += 3;
+			centroidSum += centroids[next];
+			normalSum += normals[next];
+
+			if (current.indexCount / 3 == MAX_TRIANGLES)
+				break;
+
+			glm::vec3 center = centroidSum / (float)(current.indexCount / 3);
+			float axisLength = glm::length(normalSum);
+			glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f);
+
+			// Fewest new vertices first, then the closest triangle facing like the rest of the meshlet
+			size_t best = numTriangles;
+			unsigned int bestNew = 4;
+			float bestScore = 0.0f;
+			size_t kept = 0;
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				unsigned int triangle = candidates[c];
+				if (emitted[triangle])
+					continue;
+				candidates[kept++] = triangle;
+
+				unsigned int newVertices = 0;
+				for (int corner = 0; corner < 3; corner++)
+					newVertices += usedBy[indices[triangle * 3 + corner]] != meshletId;
+				if (current.vertexCount + newVertices > MAX_VERTICES || newVertices > bestNew)
+					continue;
+
+				float spread = glm::dot(normals[triangle], axis);
+				float cone = std::max(1.0f - spread * CONE_WEIGHT, 1e-3f);
+				float score = (1.0f + glm::length(centroids[triangle] - center) / expectedRadius * (1.0f - CONE_WEIGHT)) * cone;
+
+				if (newVertices < bestNew || score < bestScore)
+				{
+					best = triangle;
+					bestNew = newVertices;
+					bestScore = score;
+				}
+			}
+			candidates.resize(kept);
+
+			// Full or disconnected from everything left
+			if (best == numTriangles)
+				break;
+			next = best;
+		}
+
+		meshlets.push_back(current);
+		meshletId++;
+	}
+
+	indices.swap(reordered);
+
+	for (Meshlet& meshlet : meshlets)
+		ComputeBounds(meshlet, indices, positions);
+}
+
+void MeshletBuilder::ComputeBounds(Meshlet& meshlet, const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions)
+{
+	size_t begin = meshlet.firstIndex;
+	size_t end = begin + meshlet.indexCount;
+
+	// Sphere around the center of the bounding box, tight enough for clusters this small
+	glm::vec3 boxMin = positions[indices[begin]];
+	glm::vec3 boxMax = boxMin;
+	for (size_t i = begin; i < end; i++)
+	{
+		boxMin = glm::min(boxMin, positions[indices[i]]);
+		boxMax = glm::max(boxMax, positions[indices[i]]);
+	}
+	meshlet.center = (boxMin + boxMax) * 0.5f;
+
+	float radiusSquared = 0.0f;
+	for (size_t i = begin; i < end; i++)
+	{
+		glm::vec3 offset = positions[indices[i]] - meshlet.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	meshlet.radius = std::sqrt(radiusSquared);
+
+	// Cone of the face normals, the vertex normals are smoothed and would not tell which side is visible
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.indexCount / 3);
+	glm::vec3 axis(0.0f);
+	for (size_t i = begin; i < end; i += 3)
+	{
+		const glm::vec3& p0 = positions[indices[i]];
+		glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+			continue;
+		normals.push_back(normal / length);
+		axis += normal / length;
+	}
+
+	float axisLength = glm::length(axis);
+	meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 2.0f;
+
+	if (axisLength <= 0.0f)
+		return;
+
+	float minDot = 1.0f;
+	for (const glm::vec3& normal : normals)
+		minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+
+	// Normals spreading over a hemisphere or more can always have a visible triangle
+	if (minDot > 0.0f)
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void MeshletBuilder::Cull(const std::vector<Meshlet>& meshlets, const glm::mat4& model, const Frustum& frustum, const glm::vec3& cameraPosition,
+	bool coneCulling, std::vector<MeshletRange>& visible, MeshletCullStats& stats)
+{
+	glm::mat3 linear(model);
+	float scale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+
+	size_t firstRange = visible.size();
+
+	for (const Meshlet& meshlet : meshlets)
+	{
+		glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center, 1.0f));
+		float radius = meshlet.radius * scale;
+
+		if (!frustum.IntersectsSphere(center, radius))
+		{
+			stats.frustumCulled++;
+			continue;
+		}
+
+		// Every triangle faces away when the view direction lies inside the cone widened by the sphere
+		if (coneCulling && meshlet.coneCutoff <= 1.0f)
+		{
+			glm::vec3 axis = glm::normalize(linear * meshlet.coneAxis);
+			glm::vec3 view = center - cameraPosition;
+			if (glm::dot(view, axis) >= meshlet.coneCutoff * glm::length(view) + radius)
+			{
+				stats.coneCulled++;
+				continue;
+			}
+		}
+
+		if (visible.size() > firstRange && visible.back().firstIndex + visible.back().indexCount == meshlet.firstIndex)
+		{
+			visible.back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			MeshletRange range = { meshlet.firstIndex, meshlet.indexCount };
+			visible.push_back(range);
+		}
+	}
+
+	stats.numMeshlets += meshlets.size();
+	stats.numDraws += visible.size() - firstRange;
+}
+
+void MeshletBuilder::PrintStats(const char* name, const std::vector<Meshlet>& meshlets)
+{
+	size_t numVertices = 0, numTriangles = 0, numConeCullable = 0;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		numVertices += meshlet.vertexCount;
+		numTriangles += meshlet.indexCount / 3;
+		if (meshlet.coneCutoff <= 1.0f)
+			numConeCullable++;
+	}
+
+	double count = meshlets.empty() ? 1.0 : (double)meshlets.size();
+	printf("%s: %zu meshlets, %.1f vertices and %.1f triangles on average, %zu can be backface culled\n",
+		name, meshlets.size(), numVertices / count, numTriangles / count, numConeCullable);
+}
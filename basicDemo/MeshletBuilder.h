@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+/**
+* Contiguous run of triangles of the index buffer with its culling bounds.
+* The layout is stored as is in the mesh cache.
+*/
+struct Meshlet {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	uint32_t padding;
+	glm::vec3 center;
+	float radius;
+	// Average facing of the triangles
+	glm::vec3 coneAxis;
+	// Sine of the spread of the triangle normals around the axis, above 1 when the cluster can not be backface culled
+	float coneCutoff;
+};
+
+/**
+* Index range to draw after culling, adjacent visible meshlets are merged
+*/
+struct MeshletRange {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
+
+/**
+* Clusters tested and rejected, accumulated over a frame
+*/
+struct MeshletCullStats {
+	size_t numMeshlets = 0;
+	size_t frustumCulled = 0;
+	size_t coneCulled = 0;
+	size_t numDraws = 0;
+
+	double GetRejectedFraction() const;
+};
+
+/**
+* Splits indexed meshes in small clusters that can be culled on their own
+*/
+class MeshletBuilder
+{
+public:
+	static const unsigned int MAX_VERTICES = 64;
+	static const unsigned int MAX_TRIANGLES = 124;
+
+	/**
+	* Groups triangles in meshlets of at most MAX_VERTICES unique vertices and MAX_TRIANGLES triangles.
+	* Each meshlet grows from a seed through neighbouring triangles, preferring the ones that add no vertex,
+	* sit close to it and face the same way, so the bounding sphere and the normal cone stay tight.
+	* The index buffer is reordered so every meshlet is a contiguous range.
+	* @param{std::vector<unsigned int> &} Triangle list indices, reordered meshlet by meshlet
+	* @param{const std::vector<glm::vec3> &} Vertex positions
+	* @param{std::vector<Meshlet> &} Meshlets with their bounds
+	*/
+	static void Build(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, std::vector<Meshlet>& meshlets);
+
+	/**
+	* Culls the meshlets of a model against the view frustum and, optionally, with their normal cones
+	* @param{const std::vector<Meshlet> &} Meshlets of the mesh
+	* @param{const glm::mat4 &} Model matrix
+	* @param{const Frustum &} World space frustum
+	* @param{const glm::vec3 &} World space camera position
+	* @param{bool} true to reject clusters facing away from the camera
+	* @param{std::vector<MeshletRange> &} Index ranges left to draw
+	* @param{MeshletCullStats &} Counters to accumulate into
+	*/
+	static void Cull(const std::vector<Meshlet>& meshlets, const glm::mat4& model, const Frustum& frustum, const glm::vec3& cameraPosition,
+		bool coneCulling, std::vector<MeshletRange>& visible, MeshletCullStats& stats);
+
+	/**
+	* Prints the cluster counts of a mesh
+	* @param{const char*} Name shown in the report
+	* @param{const std::vector<Meshlet> &} Meshlets of the mesh
+	*/
+	static void PrintStats(const char* name, const std::vector<Meshlet>& meshlets);
+
+private:
+	/**
+	* Bounding sphere and normal cone of the triangles of a meshlet
+	*/
+	static void ComputeBounds(Meshlet& meshlet, const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+};
@@ -8,6 +8,8 @@
 #include <sstream>
 #include <iostream>
 #include <iterator>
+#include "Mesh.h"
+#include "MeshManager.h"
 
 using namespace std;
 
@@ -18,51 +20,116 @@ enum MaterialType {
 };
 
 
+/**
+* Instance of a shared mesh in the scene: mesh handle, transform and material
+*/
 class Model{
 
 private:
 
-	vector < glm::vec3 > out_vertices;
-	vector < glm::vec2 > out_uvs;
-	vector < glm::vec3 > out_normals;
+	// Shared geometry, owned by MeshManager
+	Mesh* mesh;
+	VertexFormat vertexFormat;
 	glm::vec3 position;
 	MaterialType material;
 	unsigned int textureID;
-	bool hasTexture;
-
-	// Index (GPU) of the geometry buffer
-	unsigned int VBO;
-	// Index (GPU) vertex array object
-	unsigned int VAO;
-
-	GLuint colorBuffer;
-	GLuint uvBuffer;
-	GLuint normalBuffer;
+	// Tangent space normal map, 0 if the material has none
+	unsigned int normalMapID;
+	// Level of detail drawn in the last frame
+	unsigned int lod;
+	// World space bounds, computed once the mesh is ready and again after the model moves
+	bool boundsValid;
+	glm::vec3 worldBoundsMin;
+	glm::vec3 worldBoundsMax;
+	glm::vec4 boundingSphere;
+
+	/**
+	* Places the bounds of the mesh at the position of the model, they stay invalid while the mesh loads
+	*/
+	void UpdateBounds();
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
 
 public:
 
 	Model();
 
+	/**
+	* Releases the mesh, the GL context has to be alive if this was its last model
+	*/
 	~Model();
 
 
+	/**
+	* Gets the mesh of an OBJ file from MeshManager, it is only loaded and uploaded by the first model using it
+	* @param{const char *} Path to the OBJ file
+	* @returns{bool} true if the file could be loaded
+	*/
 	bool LoadObj(const char * path);
 
+	/**
+	* Starts loading the mesh of an OBJ file on the loader threads, the model is drawn once the mesh is ready
+	* @param{const char *} Path to the OBJ file
+	*/
+	void LoadObjAsync(const char * path);
 
-	void BuildGeometry();
+	/**
+	* true when the mesh is uploaded and can be drawn
+	*/
+	bool IsReady();
 
-	unsigned int GetVAO();
+	/**
+	* Chooses the vertex layout of the mesh, it has to be set before LoadObj
+	* @param{VertexFormat} Float or compact vertices
+	*/
+	void SetVertexFormat(VertexFormat format);
+
+	VertexFormat GetVertexFormat();
 
-	unsigned int GetVBO();
+	Mesh* GetMesh();
 
-	GLuint GetColorBuffer();
+	/**
+	* Host and GPU bytes of the mesh, shared with every model using the same mesh
+	*/
+	MeshMemoryStats GetMemoryStats();
 
-	GLuint GetUvBuffer();
+	glm::vec3 GetBoundsMin();
 
-	GLuint GetNormalBuffer();
+	glm::vec3 GetBoundsExtent();
+
+	/**
+	* World space bounding box, empty at the position of the model while the mesh loads
+	*/
+	glm::vec3 GetWorldBoundsMin();
+
+	glm::vec3 GetWorldBoundsMax();
+
+	/**
+	* World space sphere around the bounding box, center in xyz and radius in w
+	*/
+	glm::vec4 GetBoundingSphere();
+
+	unsigned int GetVAO();
 
 	int GetNumTriangles();
 
+	int GetNumIndices();
+
+	GLenum GetIndexType();
+
+	/**
+	* Picks the level of detail of this instance from the error of each level projected on the screen
+	* @param{const glm::vec3 &} World space camera position
+	* @param{float} Pixels covered by one world unit at a distance of one unit, the viewport height over 2 tan(fov / 2)
+	* @param{float} Largest error allowed, in pixels
+	* @param{float} Hysteresis margin, see Mesh::SelectLod
+	* @returns{unsigned int} Level to draw, it is also kept for the next frame
+	*/
+	unsigned int SelectLod(const glm::vec3& cameraPosition, float projectionScale, float maxPixelError, float hysteresis);
+
+	unsigned int GetLod();
+
 	glm::vec3 getPosition();
 
 	void setPosition(glm::vec3 pos);
@@ -74,4 +141,7 @@ public:
 	void setTextureID(unsigned int _textureID);
 	unsigned int getTextureID();
 
-};
\ No newline at end of file
+	void setNormalMapID(unsigned int _normalMapID);
+	unsigned int getNormalMapID();
+
+};
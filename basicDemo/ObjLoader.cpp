@@ -0,0 +1,589 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+namespace {
+
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* SkipBlanks(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p))
+			p++;
+		return p;
+	}
+
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		if (p >= end)
+			return end;
+		const char* newLine = static_cast<const char*>(memchr(p, '\n', end - p));
+		return newLine ? newLine + 1 : end;
+	}
+
+#if !defined(__cpp_lib_to_chars)
+	// Powers of ten a double holds exactly
+	const double EXACT_POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	/**
+	* Reads a plain decimal number in place, without copying the token.
+	* A mantissa of up to 2^53 scaled by an exact power of ten gives the correctly rounded double, and that double
+	* rounds to the same float as the text unless it lies exactly halfway between two floats.
+	* Returns false for those, and for anything else it does not handle, so the caller can fall back to strtof
+	*/
+	inline bool ScanFloat(const char*& cursor, const char* end, float& value)
+	{
+		const char* p = cursor;
+		bool negative = p < end && *p == '-';
+		if (negative)
+			p++;
+
+		uint64_t mantissa = 0;
+		int numDigits = 0, numSignificant = 0, exponent = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++, numDigits++) {
+			if (numSignificant == 19)
+				return false;
+			mantissa = mantissa * 10 + (*p - '0');
+			numSignificant += mantissa != 0;
+		}
+		if (p < end && *p == '.') {
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++, numDigits++) {
+				if (numSignificant == 19)
+					return false;
+				mantissa = mantissa * 10 + (*p - '0');
+				numSignificant += mantissa != 0;
+				exponent--;
+			}
+		}
+		if (numDigits == 0)
+			return false;
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char* q = p + 1;
+			bool negativeExponent = q < end && *q == '-';
+			if (q < end && (*q == '-' || *q == '+'))
+				q++;
+			if (q >= end || *q < '0' || *q > '9')
+				return false;
+			int explicitExponent = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; q++)
+				if (explicitExponent < 10000)
+					explicitExponent = explicitExponent * 10 + (*q - '0');
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			p = q;
+		}
+
+		if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
+			return false;
+
+		double scaled = exponent < 0 ? double(mantissa) / EXACT_POWERS_OF_TEN[-exponent] : double(mantissa) * EXACT_POWERS_OF_TEN[exponent];
+		if (scaled != 0.0 && (scaled < FLT_MIN || scaled > FLT_MAX))
+			return false;
+
+		// A double exactly halfway between two floats, the text can be on either side of it
+		uint64_t bits;
+		memcpy(&bits, &scaled, sizeof(bits));
+		if ((bits & ((1ull << 29) - 1)) == (1ull << 28))
+			return false;
+
+		value = float(negative ? -scaled : scaled);
+		cursor = p;
+		return true;
+	}
+#endif
+
+	/**
+	* Reads a float and advances the cursor, leaves the value untouched if there is no number
+	*/
+	inline const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		p = SkipBlanks(p, end);
+		// from_chars does not accept an explicit plus sign
+		if (p < end && *p == '+')
+			p++;
+
+#if defined(__cpp_lib_to_chars)
+		std::from_chars_result result = std::from_chars(p, end, value);
+		return result.ptr;
+#else
+		// Toolchains without floating point from_chars, like the v141 one of the project
+		if (ScanFloat(p, end, value))
+			return p;
+
+		// Anything the scanner does not handle: copy the token and fall back to strtof
+		char token[64];
+		size_t length = 0;
+		while (p + length < end && length < sizeof(token) - 1 && !IsBlank(p[length]) && p[length] != '\n')
+		{
+			token[length] = p[length];
+			length++;
+		}
+		token[length] = '\0';
+		char* tokenEnd;
+		float parsed = strtof(token, &tokenEnd);
+		if (tokenEnd != token)
+			value = parsed;
+		return p + (tokenEnd - token);
+#endif
+	}
+
+	/**
+	* Reads a signed face index, 0 if there is none
+	*/
+	inline const char* ParseIndex(const char* p, const char* end, long long& value)
+	{
+		bool negative = false;
+		if (p < end && *p == '-')
+		{
+			negative = true;
+			p++;
+		}
+
+		long long result = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			result = result * 10 + (*p - '0');
+			p++;
+		}
+
+		value = negative ? -result : result;
+		return p;
+	}
+
+	// Marks an index that is relative to the start of its chunk until the chunks are merged
+	const unsigned int CHUNK_RELATIVE_INDEX = 0x80000000u;
+	// Relative indices can point to chunks before their own, so they are stored with a bias
+	const long long CHUNK_RELATIVE_BIAS = 0x40000000;
+
+	// Smallest piece of file worth handing to its own thread
+	const size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+	/**
+	* Turns a file index into a 1-based index, 0 if there is none.
+	* Negative indices refer to the attributes read so far, which inside a chunk are only known
+	* relative to the chunk start, so they are tagged and fixed up once every chunk is parsed.
+	*/
+	inline unsigned int ResolveIndex(long long index, size_t chunkCount)
+	{
+		if (index < 0)
+		{
+			index += static_cast<long long>(chunkCount) + CHUNK_RELATIVE_BIAS;
+			return index >= 0 ? (CHUNK_RELATIVE_INDEX | static_cast<unsigned int>(index)) : 0;
+		}
+		return static_cast<unsigned int>(index);
+	}
+
+	/**
+	* Rebases tagged indices on the number of attributes read before their chunk
+	*/
+	inline unsigned int FixupIndex(unsigned int index, size_t base)
+	{
+		if (index & CHUNK_RELATIVE_INDEX)
+		{
+			long long absolute = static_cast<long long>(base) + (index & ~CHUNK_RELATIVE_INDEX) - CHUNK_RELATIVE_BIAS + 1;
+			return absolute > 0 ? static_cast<unsigned int>(absolute) : 0;
+		}
+		return index;
+	}
+
+	template <typename T>
+	void CopyRange(const std::vector<T>& source, std::vector<T>& destination, size_t offset)
+	{
+		if (!source.empty())
+			memcpy(&destination[offset], source.data(), source.size() * sizeof(T));
+	}
+
+	void CopyIndices(const std::vector<unsigned int>& source, std::vector<unsigned int>& destination, size_t offset, size_t base)
+	{
+		for (size_t i = 0; i < source.size(); i++)
+			destination[offset + i] = FixupIndex(source[i], base);
+	}
+
+	/**
+	* Workers shared by every parse. Models loading side by side on the asset loader threads
+	* queue their chunks here instead of each starting a thread per chunk
+	*/
+	ThreadPool& ChunkPool()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	/**
+	* Runs job(0) to job(count - 1), the first one on the calling thread and the others on the chunk pool.
+	* Only waits for its own jobs, other parses can be using the pool at the same time
+	*/
+	void RunChunks(size_t count, const std::function<void(size_t)>& job)
+	{
+		std::mutex mutex;
+		std::condition_variable chunksDone;
+		size_t numPending = count - 1;
+
+		for (size_t i = 1; i < count; i++)
+		{
+			ChunkPool().Submit([&, i]() {
+				job(i);
+				// Notified under the lock, the caller can not return and destroy it before
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--numPending == 0)
+					chunksDone.notify_one();
+			});
+		}
+		job(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		chunksDone.wait(lock, [&numPending]() { return numPending == 0; });
+	}
+}
+
+double ObjLoadStats::GetMegabytesPerSecond() const
+{
+	return seconds > 0.0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+double ObjLoadStats::GetFacesPerSecond() const
+{
+	return seconds > 0.0 ? faces / seconds : 0.0;
+}
+
+bool ObjLoader::Load(const char* path, ObjData& data, ObjLoadStats* stats, unsigned int numThreads)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		printf("Impossible to open the file %s !\n", path);
+		return false;
+	}
+
+	const char* begin = file.GetData();
+	const char* end = begin + file.GetSize();
+
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	if (!Parse(begin, end, data, numThreads))
+	{
+		printf("File %s has faces pointing outside of its vertex data\n", path);
+		return false;
+	}
+
+	if (stats)
+	{
+		stats->bytes = file.GetSize();
+		stats->faces = data.vertexIndices.size() / 3;
+		stats->threads = numThreads;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return true;
+}
+
+void ObjLoader::Reserve(const char* begin, const char* end, ObjData& data)
+{
+	size_t numPositions = 0, numUvs = 0, numNormals = 0, numCorners = 0;
+
+	for (const char* p = begin; p < end; )
+	{
+		p = SkipBlanks(p, end);
+		if (end - p > 1)
+		{
+			if (p[0] == 'v')
+			{
+				if (p[1] == ' ' || p[1] == '\t')
+					numPositions++;
+				else if (p[1] == 't')
+					numUvs++;
+				else if (p[1] == 'n')
+					numNormals++;
+			}
+			else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				// Every corner after the second one adds a triangle to the fan
+				const char* lineEnd = SkipLine(p, end);
+				size_t corners = 0;
+				for (const char* q = p + 1; q < lineEnd; )
+				{
+					q = SkipBlanks(q, lineEnd);
+					if (q >= lineEnd || *q == '\n')
+						break;
+					corners++;
+					while (q < lineEnd && !IsBlank(*q) && *q != '\n')
+						q++;
+				}
+				if (corners >= 3)
+					numCorners += (corners - 2) * 3;
+				p = lineEnd;
+				continue;
+			}
+		}
+		p = SkipLine(p, end);
+	}
+
+	data.positions.reserve(data.positions.size() + numPositions);
+	data.uvs.reserve(data.uvs.size() + numUvs);
+	data.normals.reserve(data.normals.size() + numNormals);
+	data.vertexIndices.reserve(data.vertexIndices.size() + numCorners);
+	data.uvIndices.reserve(data.uvIndices.size() + numCorners);
+	data.normalIndices.reserve(data.normalIndices.size() + numCorners);
+}
+
+bool ObjLoader::Parse(const char* begin, const char* end, ObjData& data, unsigned int numThreads)
+{
+	std::vector<const char*> bounds = Split(begin, end, std::max(1u, numThreads));
+	size_t numChunks = bounds.size() - 1;
+
+	if (numChunks == 1 && data.positions.empty() && data.uvs.empty() && data.normals.empty())
+	{
+		Reserve(begin, end, data);
+		ParseChunk(begin, end, data);
+		Merge(std::vector<ObjData>(), data);
+		return Validate(data);
+	}
+
+	// Every job counts and parses its own chunk
+	std::vector<ObjData> chunks(numChunks);
+	RunChunks(numChunks, [&bounds, &chunks](size_t i) {
+		Reserve(bounds[i], bounds[i + 1], chunks[i]);
+		ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+	});
+
+	Merge(chunks, data);
+
+	return Validate(data);
+}
+
+std::vector<const char*> ObjLoader::Split(const char* begin, const char* end, unsigned int numThreads)
+{
+	size_t size = end - begin;
+	size_t numChunks = std::min<size_t>(numThreads, std::max<size_t>(1, size / MIN_CHUNK_BYTES));
+	size_t chunkSize = size / numChunks;
+
+	std::vector<const char*> bounds;
+	bounds.push_back(begin);
+	for (size_t i = 1; i < numChunks; i++)
+	{
+		// Moves every cut to the start of the next line
+		const char* cut = SkipLine(std::max(begin + i * chunkSize, bounds.back()), end);
+		if (cut > bounds.back() && cut < end)
+			bounds.push_back(cut);
+	}
+	bounds.push_back(end);
+
+	return bounds;
+}
+
+void ObjLoader::Merge(const std::vector<ObjData>& chunks, ObjData& data)
+{
+	// A single chunk parsed straight into data only needs its relative indices resolved
+	if (chunks.empty())
+	{
+		for (size_t i = 0; i < data.vertexIndices.size(); i++)
+		{
+			data.vertexIndices[i] = FixupIndex(data.vertexIndices[i], 0);
+			data.uvIndices[i] = FixupIndex(data.uvIndices[i], 0);
+			data.normalIndices[i] = FixupIndex(data.normalIndices[i], 0);
+		}
+		return;
+	}
+
+	// Offsets of every chunk in the final arrays
+	std::vector<size_t> positionBase(chunks.size() + 1), uvBase(chunks.size() + 1), normalBase(chunks.size() + 1), cornerBase(chunks.size() + 1);
+	positionBase[0] = data.positions.size();
+	uvBase[0] = data.uvs.size();
+	normalBase[0] = data.normals.size();
+	cornerBase[0] = data.vertexIndices.size();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+		uvBase[i + 1] = uvBase[i] + chunks[i].uvs.size();
+		normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+		cornerBase[i + 1] = cornerBase[i] + chunks[i].vertexIndices.size();
+	}
+
+	data.positions.resize(positionBase.back());
+	data.uvs.resize(uvBase.back());
+	data.normals.resize(normalBase.back());
+	data.vertexIndices.resize(cornerBase.back());
+	data.uvIndices.resize(cornerBase.back());
+	data.normalIndices.resize(cornerBase.back());
+
+	RunChunks(chunks.size(), [&](size_t i) {
+		const ObjData& chunk = chunks[i];
+		CopyRange(chunk.positions, data.positions, positionBase[i]);
+		CopyRange(chunk.uvs, data.uvs, uvBase[i]);
+		CopyRange(chunk.normals, data.normals, normalBase[i]);
+		CopyIndices(chunk.vertexIndices, data.vertexIndices, cornerBase[i], positionBase[i]);
+		CopyIndices(chunk.uvIndices, data.uvIndices, cornerBase[i], uvBase[i]);
+		CopyIndices(chunk.normalIndices, data.normalIndices, cornerBase[i], normalBase[i]);
+	});
+}
+
+bool ObjLoader::CompareSerialParallel(const char* path, unsigned int numThreads)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		printf("Impossible to open the file %s !\n", path);
+		return false;
+	}
+
+	return CompareSerialParallel(path, file.GetData(), file.GetData() + file.GetSize(), numThreads);
+}
+
+bool ObjLoader::CompareSerialParallel(const char* name, const char* begin, const char* end, unsigned int numThreads)
+{
+	ObjData serial, parallel;
+	bool serialOk = Parse(begin, end, serial, 1);
+	bool parallelOk = Parse(begin, end, parallel, numThreads);
+
+	bool equal = serialOk == parallelOk
+		&& serial.positions.size() == parallel.positions.size()
+		&& serial.uvs.size() == parallel.uvs.size()
+		&& serial.normals.size() == parallel.normals.size()
+		&& serial.vertexIndices == parallel.vertexIndices
+		&& serial.uvIndices == parallel.uvIndices
+		&& serial.normalIndices == parallel.normalIndices
+		&& (serial.positions.empty() || memcmp(serial.positions.data(), parallel.positions.data(), serial.positions.size() * sizeof(glm::vec3)) == 0)
+		&& (serial.uvs.empty() || memcmp(serial.uvs.data(), parallel.uvs.data(), serial.uvs.size() * sizeof(glm::vec2)) == 0)
+		&& (serial.normals.empty() || memcmp(serial.normals.data(), parallel.normals.data(), serial.normals.size() * sizeof(glm::vec3)) == 0);
+
+	printf("%s: serial and %u thread parse %s\n", name, numThreads, equal ? "match" : "DIFFER");
+
+	return equal;
+}
+
+void ObjLoader::ParseChunk(const char* begin, const char* end, ObjData& data)
+{
+	for (const char* p = begin; p < end; )
+	{
+		p = SkipBlanks(p, end);
+		if (end - p < 2)
+			break;
+
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			glm::vec3 vertex(0.0f);
+			p = ParseFloat(p + 1, end, vertex.x);
+			p = ParseFloat(p, end, vertex.y);
+			p = ParseFloat(p, end, vertex.z);
+			data.positions.push_back(vertex);
+		}
+		else if (p[0] == 'v' && p[1] == 't')
+		{
+			glm::vec2 uv(0.0f);
+			p = ParseFloat(p + 2, end, uv.x);
+			p = ParseFloat(p, end, uv.y);
+			data.uvs.push_back(uv);
+		}
+		else if (p[0] == 'v' && p[1] == 'n')
+		{
+			glm::vec3 normal(0.0f);
+			p = ParseFloat(p + 2, end, normal.x);
+			p = ParseFloat(p, end, normal.y);
+			p = ParseFloat(p, end, normal.z);
+			data.normals.push_back(normal);
+		}
+		else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			unsigned int first[3] = { 0, 0, 0 };
+			unsigned int previous[3] = { 0, 0, 0 };
+			int corners = 0;
+
+			p++;
+			while (true)
+			{
+				p = SkipBlanks(p, end);
+				if (p >= end || *p == '\n' || *p == '#')
+					break;
+
+				// v, v/vt, v//vn or v/vt/vn
+				long long vertexIndex = 0, uvIndex = 0, normalIndex = 0;
+				p = ParseIndex(p, end, vertexIndex);
+				if (p < end && *p == '/')
+				{
+					p = ParseIndex(p + 1, end, uvIndex);
+					if (p < end && *p == '/')
+						p = ParseIndex(p + 1, end, normalIndex);
+				}
+				// Skips anything the scanner does not understand in this corner
+				while (p < end && !IsBlank(*p) && *p != '\n')
+					p++;
+
+				unsigned int corner[3] = {
+					ResolveIndex(vertexIndex, data.positions.size()),
+					ResolveIndex(uvIndex, data.uvs.size()),
+					ResolveIndex(normalIndex, data.normals.size())
+				};
+
+				if (corners >= 2)
+				{
+					data.vertexIndices.push_back(first[0]);
+					data.vertexIndices.push_back(previous[0]);
+					data.vertexIndices.push_back(corner[0]);
+					data.uvIndices.push_back(first[1]);
+					data.uvIndices.push_back(previous[1]);
+					data.uvIndices.push_back(corner[1]);
+					data.normalIndices.push_back(first[2]);
+					data.normalIndices.push_back(previous[2]);
+					data.normalIndices.push_back(corner[2]);
+				}
+
+				if (corners == 0)
+					memcpy(first, corner, sizeof(corner));
+				memcpy(previous, corner, sizeof(corner));
+				corners++;
+			}
+		}
+
+		p = SkipLine(p, end);
+	}
+}
+
+bool ObjLoader::Validate(const ObjData& data)
+{
+	size_t numPositions = data.positions.size();
+	size_t numUvs = data.uvs.size();
+	size_t numNormals = data.normals.size();
+
+	for (size_t i = 0; i < data.vertexIndices.size(); i++)
+	{
+		if (data.vertexIndices[i] == 0 || data.vertexIndices[i] > numPositions)
+			return false;
+		if (data.uvIndices[i] > numUvs || data.normalIndices[i] > numNormals)
+			return false;
+	}
+
+	return true;
+}
+
+void ObjLoader::PrintStats(const char* name, const ObjLoadStats& stats)
+{
+	printf("%s: %.2f MB, %zu faces in %.2f ms on %u thread(s) (%.1f MB/s, %.0f faces/s)\n",
+		name, stats.bytes / (1024.0 * 1024.0), stats.faces, stats.seconds * 1000.0, stats.threads,
+		stats.GetMegabytesPerSecond(), stats.GetFacesPerSecond());
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Raw content of an OBJ file.
+* Face corner indices are 1-based like in the file and 0 marks a missing attribute,
+* polygons are already triangulated as fans.
+*/
+struct ObjData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+
+	std::vector<unsigned int> vertexIndices;
+	std::vector<unsigned int> uvIndices;
+	std::vector<unsigned int> normalIndices;
+};
+
+/**
+* Timing of a single OBJ load
+*/
+struct ObjLoadStats {
+	size_t bytes = 0;
+	size_t faces = 0;
+	unsigned int threads = 1;
+	double seconds = 0.0;
+
+	double GetMegabytesPerSecond() const;
+	double GetFacesPerSecond() const;
+};
+
+/**
+* OBJ reader working in place over a memory mapped file.
+* A counting pre-pass sizes every array before the tokenizer runs so the parse itself never reallocates.
+* Large files can be split on line boundaries and parsed on a thread pool shared by every load, the result is identical to the serial parse.
+*/
+class ObjLoader
+{
+public:
+	/**
+	* Maps and parses an OBJ file
+	* @param{const char*} Path to the OBJ file
+	* @param{ObjData &} Parsed streams and face indices
+	* @param{ObjLoadStats *} Optional parse statistics
+	* @param{unsigned int} Number of parsing threads, 0 uses every hardware thread
+	* @returns{bool} true if the file could be read and every index is valid
+	*/
+	static bool Load(const char* path, ObjData& data, ObjLoadStats* stats = nullptr, unsigned int numThreads = 1);
+
+	/**
+	* Parses OBJ text that is already in memory
+	* @param{const char*} First character of the text
+	* @param{const char*} One past the last character of the text
+	* @param{ObjData &} Parsed streams and face indices
+	* @param{unsigned int} Maximum number of parsing threads
+	* @returns{bool} true if every face index is valid
+	*/
+	static bool Parse(const char* begin, const char* end, ObjData& data, unsigned int numThreads = 1);
+
+	/**
+	* Parses a file serially and in parallel and checks that both results are bit for bit identical
+	* @param{const char*} Path to the OBJ file
+	* @param{unsigned int} Number of threads of the parallel parse
+	* @returns{bool} true if both parses match
+	*/
+	static bool CompareSerialParallel(const char* path, unsigned int numThreads);
+
+	/**
+	* Parses OBJ text serially and in parallel and checks that both results are bit for bit identical
+	* @param{const char*} Name shown in the report
+	* @param{const char*} First character of the text
+	* @param{const char*} One past the last character of the text
+	* @param{unsigned int} Number of threads of the parallel parse
+	* @returns{bool} true if both parses match
+	*/
+	static bool CompareSerialParallel(const char* name, const char* begin, const char* end, unsigned int numThreads);
+
+	/**
+	* Prints the parse throughput of a load
+	* @param{const char*} Name shown in the report
+	* @param{ObjLoadStats &} Statistics of the load
+	*/
+	static void PrintStats(const char* name, const ObjLoadStats& stats);
+
+private:
+	/**
+	* Counts the records of each kind and reserves the arrays for them
+	*/
+	static void Reserve(const char* begin, const char* end, ObjData& data);
+
+	/**
+	* Parses a range of whole lines, negative indices stay relative to the range start
+	*/
+	static void ParseChunk(const char* begin, const char* end, ObjData& data);
+
+	/**
+	* Cuts the text in up to numThreads ranges of whole lines
+	*/
+	static std::vector<const char*> Split(const char* begin, const char* end, unsigned int numThreads);
+
+	/**
+	* Appends the chunks to data in order and rebases their relative indices
+	*/
+	static void Merge(const std::vector<ObjData>& chunks, ObjData& data);
+
+	/**
+	* Checks that every face index points to an existing attribute
+	*/
+	static bool Validate(const ObjData& data);
+};
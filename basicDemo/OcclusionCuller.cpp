@@ -0,0 +1,327 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if !defined(OCCLUSION_CULLER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define OCCLUSION_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Triangles with less area, in square pixels, cover no pixel center worth testing
+	const float MIN_AREA = 1e-6f;
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+OcclusionCuller::OcclusionCuller(unsigned int numThreads)
+	: workers(numThreads), viewProjection(1.0f)
+{
+	tilesX = (WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+	bins.resize(tilesX * tilesY);
+
+	// Down to a single texel, odd sizes round up so the last row and column are kept
+	glm::ivec2 size(WIDTH, HEIGHT);
+	while (true) {
+		levelSizes.push_back(size);
+		levels.push_back(std::vector<float>((size_t)size.x * size.y, 1.0f));
+		if (size.x == 1 && size.y == 1)
+			break;
+		size = glm::ivec2((size.x + 1) / 2, (size.y + 1) / 2);
+	}
+}
+
+void OcclusionCuller::Begin(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	stats = OcclusionStats();
+	triangles.clear();
+	for (std::vector<unsigned int>& bin : bins)
+		bin.clear();
+	std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(const MeshBvh& mesh, const glm::mat4& model)
+{
+	glm::mat4 modelViewProjection = viewProjection * model;
+	stats.numOccluders++;
+
+	size_t numTriangles = mesh.HasGeometry() ? mesh.GetNumTriangles() : 0;
+	for (size_t t = 0; t < numTriangles; t++) {
+
+		stats.numTriangles++;
+		glm::vec3 corner[3];
+		mesh.GetTriangle((unsigned int)t, corner);
+		glm::vec4 clip[3];
+		bool crossesNear = false;
+		for (int k = 0; k < 3; k++) {
+			clip[k] = modelViewProjection * glm::vec4(corner[k], 1.0f);
+			crossesNear |= clip[k].w <= 0.0f || clip[k].z < -clip[k].w;
+		}
+		// Clipping is skipped, a dropped occluder triangle only hides less
+		if (crossesNear)
+			continue;
+
+		// Entirely outside one of the other planes
+		bool outside = false;
+		for (int axis = 0; axis < 3 && !outside; axis++) {
+			bool allAbove = true, allBelow = true;
+			for (int k = 0; k < 3; k++) {
+				allAbove &= clip[k][axis] > clip[k].w;
+				allBelow &= clip[k][axis] < -clip[k].w;
+			}
+			outside = allAbove || (allBelow && axis < 2);
+		}
+		if (outside)
+			continue;
+
+		// Window coordinates, rows from the bottom like the GL viewport
+		glm::vec3 screen[3];
+		for (int k = 0; k < 3; k++) {
+			glm::vec3 ndc = glm::vec3(clip[k]) / clip[k].w;
+			screen[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+		}
+
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (std::fabs(area) < MIN_AREA)
+			continue;
+		// Both windings are rasterized, occluders do not need to be closed
+		if (area < 0.0f) {
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		ScreenTriangle triangle;
+		for (int e = 0; e < 3; e++) {
+			const glm::vec3& from = screen[e];
+			const glm::vec3& to = screen[(e + 1) % 3];
+			triangle.edgeA[e] = from.y - to.y;
+			triangle.edgeB[e] = to.x - from.x;
+			triangle.edgeC[e] = -(triangle.edgeA[e] * from.x + triangle.edgeB[e] * from.y);
+		}
+		float depthX = ((screen[1].z - screen[0].z) * (screen[2].y - screen[0].y) - (screen[2].z - screen[0].z) * (screen[1].y - screen[0].y)) / area;
+		float depthY = ((screen[2].z - screen[0].z) * (screen[1].x - screen[0].x) - (screen[1].z - screen[0].z) * (screen[2].x - screen[0].x)) / area;
+		triangle.depthA = depthX;
+		triangle.depthB = depthY;
+		triangle.depthC = screen[0].z - depthX * screen[0].x - depthY * screen[0].y;
+
+		float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+		float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+		float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+		float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+		triangle.minX = std::max(0, (int)std::floor(minX));
+		triangle.maxX = std::min(WIDTH - 1, (int)std::ceil(maxX));
+		triangle.minY = std::max(0, (int)std::floor(minY));
+		triangle.maxY = std::min(HEIGHT - 1, (int)std::ceil(maxY));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		unsigned int index = (unsigned int)triangles.size();
+		triangles.push_back(triangle);
+		for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; tileY++)
+			for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; tileX++)
+				bins[tileY * tilesX + tileX].push_back(index);
+		stats.numRasterized++;
+	}
+}
+
+void OcclusionCuller::Rasterize()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Tiles write disjoint pixels, they need no locking
+	for (int tile = 0; tile < (int)bins.size(); tile++)
+		if (!bins[tile].empty())
+			workers.Submit([this, tile]() { RasterizeTile(tile); });
+	workers.Wait();
+	stats.rasterMilliseconds = MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	BuildPyramid();
+	stats.pyramidMilliseconds = MillisecondsSince(start);
+}
+
+void OcclusionCuller::RasterizeTile(int tile)
+{
+	int tileMinX = (tile % tilesX) * TILE_SIZE;
+	int tileMinY = (tile / tilesX) * TILE_SIZE;
+	int tileMaxX = std::min(tileMinX + TILE_SIZE, WIDTH) - 1;
+	int tileMaxY = std::min(tileMinY + TILE_SIZE, HEIGHT) - 1;
+	float* depth = levels[0].data();
+
+	for (unsigned int index : bins[tile]) {
+
+		const ScreenTriangle& triangle = triangles[index];
+		int minY = std::max(triangle.minY, tileMinY);
+		int maxY = std::min(triangle.maxY, tileMaxY);
+		int maxX = std::min(triangle.maxX, tileMaxX);
+#if defined(OCCLUSION_CULLER_SSE)
+		// Rows are walked four pixels at a time from a multiple of four, tiles are too
+		int minX = std::max(triangle.minX, tileMinX) & ~3;
+
+		__m128 edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; e++) {
+			edgeA[e] = _mm_set1_ps(triangle.edgeA[e]);
+			edgeB[e] = _mm_set1_ps(triangle.edgeB[e]);
+			edgeC[e] = _mm_set1_ps(triangle.edgeC[e]);
+		}
+		__m128 depthA = _mm_set1_ps(triangle.depthA);
+		__m128 depthB = _mm_set1_ps(triangle.depthB);
+		__m128 depthC = _mm_set1_ps(triangle.depthC);
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (int y = minY; y <= maxY; y++) {
+			__m128 pixelY = _mm_set1_ps(y + 0.5f);
+			// Edge and depth values at the start of the row, x is added per block
+			__m128 rowEdge[3];
+			for (int e = 0; e < 3; e++)
+				rowEdge[e] = _mm_add_ps(_mm_mul_ps(edgeB[e], pixelY), edgeC[e]);
+			__m128 rowDepth = _mm_add_ps(_mm_mul_ps(depthB, pixelY), depthC);
+			float* row = depth + y * WIDTH;
+
+			for (int x = minX; x <= maxX; x += 4) {
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], pixelX), rowEdge[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], pixelX), rowEdge[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], pixelX), rowEdge[2]), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthA, pixelX), rowDepth);
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 closest = _mm_min_ps(current, pixelDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+			}
+		}
+#else
+		int minX = std::max(triangle.minX, tileMinX);
+		for (int y = minY; y <= maxY; y++) {
+			float pixelY = y + 0.5f;
+			// Same order of operations as the SSE path, both give the same buffer
+			float rowEdge[3];
+			for (int e = 0; e < 3; e++)
+				rowEdge[e] = triangle.edgeB[e] * pixelY + triangle.edgeC[e];
+			float rowDepth = triangle.depthB * pixelY + triangle.depthC;
+			float* row = depth + y * WIDTH;
+
+			for (int x = minX; x <= maxX; x++) {
+				float pixelX = x + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; e++)
+					inside &= triangle.edgeA[e] * pixelX + rowEdge[e] >= 0.0f;
+				if (inside)
+					row[x] = std::min(row[x], triangle.depthA * pixelX + rowDepth);
+			}
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+	for (size_t l = 1; l < levels.size(); l++) {
+		const std::vector<float>& source = levels[l - 1];
+		glm::ivec2 sourceSize = levelSizes[l - 1];
+		glm::ivec2 size = levelSizes[l];
+		std::vector<float>& level = levels[l];
+
+		for (int y = 0; y < size.y; y++) {
+			int y0 = 2 * y, y1 = std::min(2 * y + 1, sourceSize.y - 1);
+			for (int x = 0; x < size.x; x++) {
+				int x0 = 2 * x, x1 = std::min(2 * x + 1, sourceSize.x - 1);
+				level[y * size.x + x] = std::max(std::max(source[y0 * sourceSize.x + x0], source[y0 * sourceSize.x + x1]),
+					std::max(source[y1 * sourceSize.x + x0], source[y1 * sourceSize.x + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	stats.numTested++;
+
+	float minX = (float)WIDTH, maxX = 0.0f, minY = (float)HEIGHT, maxY = 0.0f, nearestDepth = 1.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 point((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+		// A box reaching the camera covers everything in front of it
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return true;
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		float x = (ndc.x * 0.5f + 0.5f) * WIDTH;
+		float y = (ndc.y * 0.5f + 0.5f) * HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, (int)std::floor(minX));
+	int x1 = std::min(WIDTH - 1, (int)std::floor(maxX));
+	int y0 = std::max(0, (int)std::floor(minY));
+	int y1 = std::min(HEIGHT - 1, (int)std::floor(maxY));
+	// Off the buffer, the frustum test already decided
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	// Coarsest level where the box still spans two or three texels per axis
+	int size = std::max(x1 - x0, y1 - y0) + 1;
+	int level = 0;
+	while ((size >> level) > 2 && level + 1 < (int)levels.size())
+		level++;
+
+	const std::vector<float>& depth = levels[level];
+	int width = levelSizes[level].x;
+	float farthestDepth = 0.0f;
+	for (int y = y0 >> level; y <= y1 >> level; y++)
+		for (int x = x0 >> level; x <= x1 >> level; x++)
+			farthestDepth = std::max(farthestDepth, depth[y * width + x]);
+
+	if (nearestDepth > farthestDepth) {
+		stats.numOccluded++;
+		return false;
+	}
+	return true;
+}
+
+const std::vector<float>& OcclusionCuller::GetDepth(int level)
+{
+	return levels[level];
+}
+
+int OcclusionCuller::GetLevelWidth(int level)
+{
+	return levelSizes[level].x;
+}
+
+int OcclusionCuller::GetLevelHeight(int level)
+{
+	return levelSizes[level].y;
+}
+
+int OcclusionCuller::GetNumLevels()
+{
+	return (int)levels.size();
+}
+
+const OcclusionStats& OcclusionCuller::GetStats()
+{
+	return stats;
+}
+
+const char* OcclusionCuller::GetSimdName()
+{
+#if defined(OCCLUSION_CULLER_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
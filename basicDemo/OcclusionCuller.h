@@ -0,0 +1,124 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBvh.h"
+#include "ThreadPool.h"
+
+/**
+* Work and results of the occlusion culling of one frame
+*/
+struct OcclusionStats {
+	size_t numOccluders = 0;
+	// Occluder triangles submitted, and the ones left after the near plane and frustum rejection
+	size_t numTriangles = 0;
+	size_t numRasterized = 0;
+	// Bounding boxes tested against the pyramid, and the ones found hidden
+	size_t numTested = 0;
+	size_t numOccluded = 0;
+	double rasterMilliseconds = 0.0;
+	double pyramidMilliseconds = 0.0;
+};
+
+/**
+* Software occlusion culling: a few occluder meshes are rasterized on the CPU into a small depth buffer,
+* a pyramid keeps the farthest depth of every 2x2 block, and bounding boxes whose nearest depth is behind
+* the farthest depth of the pixels they cover are hidden.
+* The buffer is split in tiles rasterized in parallel, four pixels at a time with SSE.
+* Defining OCCLUSION_CULLER_NO_SIMD compiles the scalar rasterizer only.
+*/
+class OcclusionCuller
+{
+public:
+	// Resolution of the depth buffer, the whole viewport is squeezed into it
+	static const int WIDTH = 256;
+	static const int HEIGHT = 192;
+	// Side of the square tiles the triangles are binned into, a multiple of 4
+	static const int TILE_SIZE = 32;
+
+	/**
+	* Starts the rasterizer threads
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread
+	*/
+	explicit OcclusionCuller(unsigned int numThreads = 0);
+
+	/**
+	* Clears the depth buffer and the statistics
+	* @param{const glm::mat4 &} Projection times view of the frame
+	*/
+	void Begin(const glm::mat4& viewProjection);
+
+	/**
+	* Transforms and bins the triangles of an occluder
+	* @param{const MeshBvh &} Hierarchy of the mesh, its geometry gives the triangles in mesh space
+	* @param{const glm::mat4 &} Model matrix
+	*/
+	void AddOccluder(const MeshBvh& mesh, const glm::mat4& model);
+
+	/**
+	* Rasterizes the binned triangles and builds the depth pyramid
+	*/
+	void Rasterize();
+
+	/**
+	* Tests a world space box against the pyramid
+	* @param{const glm::vec3 &} Lowest corner
+	* @param{const glm::vec3 &} Highest corner
+	* @returns{bool} false if the occluders hide the whole box
+	*/
+	bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	/**
+	* Depth of a level of the pyramid, window depth in [0, 1] with rows from the bottom
+	* @param{int} Level, 0 is the full resolution buffer
+	*/
+	const std::vector<float>& GetDepth(int level);
+
+	int GetLevelWidth(int level);
+
+	int GetLevelHeight(int level);
+
+	int GetNumLevels();
+
+	const OcclusionStats& GetStats();
+
+	/**
+	* Instruction set of the rasterizer: SSE or scalar
+	*/
+	static const char* GetSimdName();
+
+private:
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	/**
+	* Triangle ready for rasterization: edge functions a * x + b * y + c, positive inside,
+	* and the depth plane, all in pixel units
+	*/
+	struct ScreenTriangle {
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA, depthB, depthC;
+		int minX, minY, maxX, maxY;
+	};
+
+	/**
+	* Rasterizes the triangles binned into a tile
+	* @param{int} Tile index, row major
+	*/
+	void RasterizeTile(int tile);
+
+	void BuildPyramid();
+
+	ThreadPool workers;
+	glm::mat4 viewProjection;
+	int tilesX;
+	int tilesY;
+	std::vector<ScreenTriangle> triangles;
+	// Triangles overlapping each tile
+	std::vector<std::vector<unsigned int>> bins;
+	// Farthest depth per texel, the first level is the rasterized buffer
+	std::vector<std::vector<float>> levels;
+	std::vector<glm::ivec2> levelSizes;
+	OcclusionStats stats;
+};
@@ -0,0 +1,89 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+	const int RADIX_BITS = 8;
+	const int NUM_BUCKETS = 1 << RADIX_BITS;
+	const int NUM_PASSES = 64 / RADIX_BITS;
+
+	inline uint64_t Field(unsigned int value, int bits, int shift)
+	{
+		return ((uint64_t)value & ((1ull << bits) - 1)) << shift;
+	}
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int program, unsigned int material, unsigned int texture, unsigned int mesh, float depth)
+{
+	const int depthShift = 0;
+	const int meshShift = depthShift + DEPTH_BITS;
+	const int textureShift = meshShift + MESH_BITS;
+	const int materialShift = textureShift + TEXTURE_BITS;
+	const int programShift = materialShift + MATERIAL_BITS;
+
+	unsigned int depthBits = (unsigned int)(std::min(std::max(depth, 0.0f), 1.0f) * ((1u << DEPTH_BITS) - 1));
+	return Field(program, PROGRAM_BITS, programShift) | Field(material, MATERIAL_BITS, materialShift) |
+		Field(texture, TEXTURE_BITS, textureShift) | Field(mesh, MESH_BITS, meshShift) | Field(depthBits, DEPTH_BITS, depthShift);
+}
+
+void RenderQueue::Clear()
+{
+	items.clear();
+	entries.clear();
+}
+
+void RenderQueue::Submit(uint64_t key, const RenderItem& item)
+{
+	entries.push_back({ key, (uint32_t)items.size() });
+	items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t numEntries = entries.size();
+	scratch.resize(numEntries);
+
+	// Every histogram in one read of the keys
+	size_t counts[NUM_PASSES][NUM_BUCKETS];
+	memset(counts, 0, sizeof(counts));
+	for (const SortEntry& entry : entries)
+		for (int pass = 0; pass < NUM_PASSES; pass++)
+			counts[pass][(entry.key >> (pass * RADIX_BITS)) & (NUM_BUCKETS - 1)]++;
+
+	for (int pass = 0; pass < NUM_PASSES; pass++) {
+
+		int shift = pass * RADIX_BITS;
+		// A byte shared by every key leaves the order as it is, most of the key is like that in a small scene
+		if (numEntries == 0 || counts[pass][(entries[0].key >> shift) & (NUM_BUCKETS - 1)] == numEntries)
+			continue;
+
+		size_t offsets[NUM_BUCKETS];
+		size_t offset = 0;
+		for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+			offsets[bucket] = offset;
+			offset += counts[pass][bucket];
+		}
+		for (const SortEntry& entry : entries)
+			scratch[offsets[(entry.key >> shift) & (NUM_BUCKETS - 1)]++] = entry;
+		entries.swap(scratch);
+	}
+
+	sortMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t RenderQueue::GetNumItems()
+{
+	return entries.size();
+}
+
+const RenderItem& RenderQueue::GetItem(size_t index)
+{
+	return items[entries[index].item];
+}
+
+double RenderQueue::GetSortMilliseconds()
+{
+	return sortMilliseconds;
+}
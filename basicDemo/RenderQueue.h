@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Model.h"
+#include "InstanceBatcher.h"
+
+/**
+* One draw of the frame: a model alone, or an instance batch drawn through its first model
+*/
+struct RenderItem {
+	Model* model;
+	unsigned int lod;
+	// Offset of the ObjectBlock of the draw in the frame uniform buffer
+	size_t objectBlock;
+	// Batch drawn with one instanced call, nullptr draws the model alone
+	const InstanceBatch* batch;
+};
+
+/**
+* Draws of a frame ordered by a 64 bit key, the most expensive state to change in the highest bits:
+* program (4 bits), material (12 bits), texture (12 bits), mesh (12 bits) and depth (24 bits).
+* Ids wider than their field alias with others, which only costs a bind, the executor compares the real state.
+* The keys are sorted with an 8 bit LSD radix sort, passes where every key has the same byte are skipped.
+*/
+class RenderQueue
+{
+public:
+	static const int PROGRAM_BITS = 4;
+	static const int MATERIAL_BITS = 12;
+	static const int TEXTURE_BITS = 12;
+	static const int MESH_BITS = 12;
+	static const int DEPTH_BITS = 24;
+
+	/**
+	* Packs the state of a draw into a sort key
+	* @param{unsigned int} Program
+	* @param{unsigned int} Material, any id telling apart the state the program shares between models
+	* @param{unsigned int} Texture
+	* @param{unsigned int} Mesh, its vertex array
+	* @param{float} Distance to the camera over the view distance, clamped to [0, 1]; draws sharing state go front to back
+	* @returns{uint64_t} Key, draws sort in increasing order
+	*/
+	static uint64_t MakeKey(unsigned int program, unsigned int material, unsigned int texture, unsigned int mesh, float depth);
+
+	/**
+	* Forgets the draws of the last frame
+	*/
+	void Clear();
+
+	/**
+	* Adds a draw to the frame
+	* @param{uint64_t} Key from MakeKey
+	* @param{const RenderItem &} Draw
+	*/
+	void Submit(uint64_t key, const RenderItem& item);
+
+	/**
+	* Sorts the draws by key, draws with equal keys keep their submission order
+	*/
+	void Sort();
+
+	size_t GetNumItems();
+
+	/**
+	* Draw in sorted order, valid after Sort
+	* @param{size_t} Position in the sorted queue
+	*/
+	const RenderItem& GetItem(size_t index);
+
+	/**
+	* Time spent in the last Sort
+	*/
+	double GetSortMilliseconds();
+
+private:
+	struct SortEntry {
+		uint64_t key;
+		uint32_t item;
+	};
+
+	std::vector<RenderItem> items;
+	std::vector<SortEntry> entries;
+	// Second buffer of the radix passes
+	std::vector<SortEntry> scratch;
+	double sortMilliseconds = 0.0;
+};
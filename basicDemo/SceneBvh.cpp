@@ -0,0 +1,111 @@
+#include "SceneBvh.h"
+#include <cfloat>
+
+void SceneBvh::Build(const std::vector<BvhInstance>& sceneInstances)
+{
+	instances = sceneInstances;
+
+	std::vector<unsigned int> built;
+	std::vector<glm::vec3> boundsMin, boundsMax;
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		if (!instances[i].bvh || instances[i].bvh->IsEmpty())
+			continue;
+		built.push_back(static_cast<unsigned int>(i));
+		boundsMin.push_back(instances[i].bvh->GetBoundsMin() + instances[i].position);
+		boundsMax.push_back(instances[i].bvh->GetBoundsMax() + instances[i].position);
+	}
+
+	MeshBvh::BuildNodes(boundsMin, boundsMax, 1, nodes, order);
+
+	// Leaf slots point at the instance list given by the caller
+	for (unsigned int& slot : order)
+		slot = built[slot];
+}
+
+bool SceneBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, SceneRayHit& hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; axis++)
+		inverseDirection[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : FLT_MAX;
+
+	float closest = maxDistance;
+	bool found = false;
+	std::vector<unsigned int> stack(1, 0u);
+	while (!stack.empty())
+	{
+		const BvhNode& node = nodes[stack.back()];
+		stack.pop_back();
+		if (MeshBvh::IntersectNode(node, origin, inverseDirection, closest) == FLT_MAX)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+			continue;
+		}
+
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			const BvhInstance& instance = instances[order[i]];
+			MeshRayHit meshHit;
+			// The ray goes to mesh space, distances stay the same under a translation
+			if (!instance.bvh->Raycast(origin - instance.position, direction, closest, meshHit))
+				continue;
+			closest = meshHit.distance;
+			found = true;
+			hit.instance = order[i];
+			hit.distance = meshHit.distance;
+			hit.triangle = meshHit.triangle;
+			hit.u = meshHit.u;
+			hit.v = meshHit.v;
+		}
+	}
+
+	return found;
+}
+
+bool SceneBvh::IntersectsSegment(const glm::vec3& from, const glm::vec3& to) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 direction = to - from;
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; axis++)
+		inverseDirection[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : FLT_MAX;
+
+	std::vector<unsigned int> stack(1, 0u);
+	while (!stack.empty())
+	{
+		const BvhNode& node = nodes[stack.back()];
+		stack.pop_back();
+		if (MeshBvh::IntersectNode(node, from, inverseDirection, 1.0f) == FLT_MAX)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+			continue;
+		}
+
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			const BvhInstance& instance = instances[order[i]];
+			if (instance.bvh->RaycastAny(from - instance.position, direction, 1.0f))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+size_t SceneBvh::GetNumInstances() const
+{
+	return instances.size();
+}
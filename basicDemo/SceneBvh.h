@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBvh.h"
+
+/**
+* Mesh hierarchy placed in the scene, models are only translated
+*/
+struct BvhInstance {
+	const MeshBvh* bvh;
+	glm::vec3 position;
+};
+
+/**
+* Closest triangle hit among the instances of a scene
+*/
+struct SceneRayHit {
+	// Index of the instance in the list given to Build
+	unsigned int instance;
+	// Distance along the ray, in multiples of the ray direction
+	float distance;
+	// Triangle of the full resolution index buffer of the instance mesh
+	unsigned int triangle;
+	// Barycentric coordinates of the hit, the weights of the second and third vertex
+	float u;
+	float v;
+};
+
+/**
+* Top level hierarchy over the instances of a scene, each leaf hands the ray to the hierarchy of its mesh
+*/
+class SceneBvh
+{
+public:
+	/**
+	* Builds the hierarchy over the world space bounds of the instances, empty meshes are skipped
+	* @param{const std::vector<BvhInstance> &} Instances of the scene
+	*/
+	void Build(const std::vector<BvhInstance>& sceneInstances);
+
+	/**
+	* Closest triangle along a ray or a segment
+	* @param{const glm::vec3 &} World space origin
+	* @param{const glm::vec3 &} World space direction, not necessarily normalized
+	* @param{float} Largest distance, in multiples of the direction, FLT_MAX for a ray
+	* @param{SceneRayHit &} Closest hit, only written when there is one
+	* @returns{bool} true if a triangle was hit
+	*/
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, SceneRayHit& hit) const;
+
+	/**
+	* Whether the segment between two points crosses any triangle, e.g. to keep the camera out of the models
+	*/
+	bool IntersectsSegment(const glm::vec3& from, const glm::vec3& to) const;
+
+	size_t GetNumInstances() const;
+
+private:
+	std::vector<BvhNode> nodes;
+	std::vector<BvhInstance> instances;
+	// Instance behind every leaf slot
+	std::vector<unsigned int> order;
+};
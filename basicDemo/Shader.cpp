@@ -1,8 +1,96 @@
 #include "Shader.h"
+#include "GLState.h"
 #include <glad/glad.h>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+
+unsigned int Shader::lookupCount = 0;
+
+ShaderUniform::ShaderUniform(int uniformLocation, UniformValue *lastValue)
+	: location(uniformLocation), lastValue(lastValue)
+{
+}
+
+bool ShaderUniform::isValid() const
+{
+	return location >= 0;
+}
+
+int ShaderUniform::getLocation() const
+{
+	return location;
+}
+
+bool ShaderUniform::changed(const void *value, size_t size) const
+{
+	if (lastValue == nullptr)
+		return true;
+	bool same = lastValue->known && memcmp(lastValue->bytes, value, size) == 0;
+	GLState::Count(GL_STATE_CALL_UNIFORM, !same);
+	if (same)
+		return false;
+	lastValue->known = true;
+	memcpy(lastValue->bytes, value, size);
+	return true;
+}
+
+void ShaderUniform::set(bool value) const
+{
+	int integer = (int)value;
+	if (changed(&integer, sizeof(integer)))
+		glUniform1i(location, integer);
+}
+
+void ShaderUniform::set(int value) const
+{
+	if (changed(&value, sizeof(value)))
+		glUniform1i(location, value);
+}
+
+void ShaderUniform::set(float value) const
+{
+	if (changed(&value, sizeof(value)))
+		glUniform1f(location, value);
+}
+
+void ShaderUniform::set(const glm::vec2 &value) const
+{
+	if (changed(&value, sizeof(value)))
+		glUniform2fv(location, 1, &value[0]);
+}
+
+void ShaderUniform::set(const glm::vec3 &value) const
+{
+	if (changed(&value, sizeof(value)))
+		glUniform3fv(location, 1, &value[0]);
+}
+
+void ShaderUniform::set(const glm::vec4 &value) const
+{
+	if (changed(&value, sizeof(value)))
+		glUniform4fv(location, 1, &value[0]);
+}
+
+void ShaderUniform::set(const glm::mat2 &mat) const
+{
+	if (changed(&mat, sizeof(mat)))
+		glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void ShaderUniform::set(const glm::mat3 &mat) const
+{
+	if (changed(&mat, sizeof(mat)))
+		glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void ShaderUniform::set(const glm::mat4 &mat) const
+{
+	if (changed(&mat, sizeof(mat)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath)
 {
@@ -52,72 +140,163 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath, const char *geo
 
 Shader::~Shader()
 {
-	glDeleteProgram(ID);
+	GLState::DeleteProgram(ID);
 }
 
 void Shader::use()
 {
-	glUseProgram(ID);
+	GLState::UseProgram(ID);
 }
 
 void Shader::setBool(const std::string &name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	uniform(name).set(value);
 }
 
 void Shader::setInt(const std::string &name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	uniform(name).set(value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	uniform(name).set(value);
 }
 
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
 {
-	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	uniform(name).set(value);
 }
 
 void Shader::setVec2(const std::string &name, float x, float y) const
 {
-	glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+	uniform(name).set(glm::vec2(x, y));
 }
 
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	uniform(name).set(value);
 }
 
 void Shader::setVec3(const std::string &name, float x, float y, float z) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+	uniform(name).set(glm::vec3(x, y, z));
 }
 
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
 {
-	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	uniform(name).set(value);
 }
 
 void Shader::setVec4(const std::string &name, float x, float y, float z, float w)
 {
-	glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+	uniform(name).set(glm::vec4(x, y, z, w));
 }
 
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
 {
-	glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	uniform(name).set(mat);
 }
 
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
 {
-	glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	uniform(name).set(mat);
 }
 
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	uniform(name).set(mat);
+}
+
+ShaderUniform Shader::uniform(const std::string &name) const
+{
+	const UniformInfo *info = findUniform(name);
+	if (info == nullptr)
+		return ShaderUniform();
+	return ShaderUniform(info->location, &values[info->value]);
+}
+
+int Shader::bindUniformBlock(const std::string &name, unsigned int binding)
+{
+	GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+	if (index == GL_INVALID_INDEX)
+		return -1;
+
+	glUniformBlockBinding(ID, index, binding);
+	GLint size = 0;
+	glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	return size;
+}
+
+const std::vector<UniformInfo> &Shader::getUniforms() const
+{
+	return uniforms;
+}
+
+unsigned int Shader::getLookupCount()
+{
+	return lookupCount;
+}
+
+void Shader::resetLookupCount()
+{
+	lookupCount = 0;
+}
+
+const UniformInfo *Shader::findUniform(const std::string &name) const
+{
+	lookupCount++;
+	auto found = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+		[](const UniformInfo &info, const std::string &key) { return info.name < key; });
+	return found != uniforms.end() && found->name == name ? &*found : nullptr;
+}
+
+void Shader::reflectUniforms()
+{
+	uniforms.clear();
+	unsigned int numValues = 0;
+
+	int numUniforms = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+
+	for (int i = 0; i < numUniforms; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+		std::string name(buffer.data(), length);
+
+		// Uniform block members have no location, they are set through their buffer
+		if (glGetUniformLocation(ID, name.c_str()) < 0)
+			continue;
+
+		// Arrays of basic types are reported once as name[0], every element gets its own entry
+		std::string base = name;
+		if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+			base.resize(base.size() - 3);
+		else
+			size = 1;
+
+		for (GLint element = 0; element < size; element++)
+		{
+			std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : name;
+			UniformInfo info = { elementName, glGetUniformLocation(ID, elementName.c_str()), type, numValues };
+			if (info.location < 0)
+				continue;
+			uniforms.push_back(info);
+			numValues++;
+			// The first element also answers to the bare array name, like glGetUniformLocation
+			if (element == 0 && size > 1)
+				uniforms.push_back({ base, info.location, type, info.value });
+		}
+	}
+
+	std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo &a, const UniformInfo &b) { return a.name < b.name; });
+	// Nothing is known of a freshly linked program, the first write of each uniform is issued
+	values.assign(numValues, UniformValue());
 }
 
 bool Shader::compileShaderCode(const char *path, shaderType type, unsigned int &shaderID)
@@ -202,17 +381,19 @@ bool Shader::linkProgram(unsigned int vertexShaderID, unsigned int fragmentShade
 	int succes;
 	char log[1024];
 	// Get compilation status
-	glGetShaderiv(ID, GL_LINK_STATUS, &succes);
+	glGetProgramiv(ID, GL_LINK_STATUS, &succes);
 	// Compilation error
 	if (!succes)
 	{
 		// Gets the error message
-		glGetShaderInfoLog(ID, 1024, NULL, log);
+		glGetProgramInfoLog(ID, 1024, NULL, log);
 		std::cout << "ERROR::PROGRAM_LINKING_ERROR\n"
 				  << log << "\n -- --------------------------------------------------- -- " << std::endl;
 		return false;
 	}
 
+	reflectUniforms();
+
 	// Delete all the shaders because they are no longer neccesary
 	glDeleteShader(vertexShaderID);
 	glDeleteShader(fragmentShaderID);
@@ -236,17 +417,19 @@ bool Shader::linkProgram(unsigned int vertexShaderID, unsigned int fragmentShade
 	int succes;
 	char log[1024];
 	// Get compilation status
-	glGetShaderiv(ID, GL_LINK_STATUS, &succes);
+	glGetProgramiv(ID, GL_LINK_STATUS, &succes);
 	// Compilation error
 	if (!succes)
 	{
 		// Gets the error message
-		glGetShaderInfoLog(ID, 1024, NULL, log);
+		glGetProgramInfoLog(ID, 1024, NULL, log);
 		std::cout << "ERROR::PROGRAM_LINKING_ERROR\n"
 				  << log << "\n -- --------------------------------------------------- -- " << std::endl;
 		return false;
 	}
 
+	reflectUniforms();
+
 	// Delete all the shaders because they are no longer neccesary
 	glDeleteShader(vertexShaderID);
 	glDeleteShader(fragmentShaderID);
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 // Types of shader supported by the shader class
@@ -10,6 +11,68 @@ enum shaderType {
 	PROGRAM
 };
 
+/**
+* Active uniform of a linked program, found by reflection.
+* Arrays get one entry per element, e.g. pointLights[1].position
+*/
+struct UniformInfo {
+	std::string name;
+	int location;
+	// GL type, e.g. GL_FLOAT_VEC3
+	unsigned int type;
+	// Slot of the last value written, shared by the names of the same location
+	unsigned int value;
+};
+
+/**
+* Last value written to a uniform of a program, up to a mat4
+*/
+struct UniformValue {
+	bool known;
+	unsigned char bytes[64];
+};
+
+/**
+* Pre-resolved uniform location, setting a value needs no name lookup.
+* Like the set* methods of Shader it writes to the program in use, which has to be the one it was resolved from:
+* the handle remembers the last value written and skips writing it again. An invalid handle is ignored by GL
+*/
+class ShaderUniform
+{
+public:
+	ShaderUniform(int uniformLocation = -1, UniformValue *lastValue = nullptr);
+
+	/**
+	* true if the uniform is active in the program it was resolved from
+	*/
+	bool isValid() const;
+
+	int getLocation() const;
+
+	void set(bool value) const;
+	void set(int value) const;
+	void set(float value) const;
+	void set(const glm::vec2 &value) const;
+	void set(const glm::vec3 &value) const;
+	void set(const glm::vec4 &value) const;
+	void set(const glm::mat2 &mat) const;
+	void set(const glm::mat3 &mat) const;
+	void set(const glm::mat4 &mat) const;
+
+private:
+	int location;
+	// Owned by the Shader, nullptr for a handle that is not valid
+	UniformValue *lastValue;
+
+	/**
+	* Records a value about to be written
+	* @param{const void *} value
+	* @param{size_t} bytes of the value
+	* @returns{bool} false if the uniform already holds it and the write can be skipped
+	*/
+	bool changed(const void *value, size_t size) const;
+};
+
 class Shader
 {
 public:
@@ -128,10 +191,60 @@ public:
 	*/
 	void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
+	/**
+	* Resolves a uniform once, the handle then sets it with no lookup
+	* @param{std::string &} uniform name, array elements as in GLSL e.g. pointLights[0].position
+	* @returns{ShaderUniform} handle, invalid if the uniform is not active in this program
+	*/
+	ShaderUniform uniform(const std::string &name) const;
+
+	/**
+	* Connects a uniform block of the program to a binding point
+	* @param{std::string &} block name
+	* @param{unsigned int} binding point its buffer is bound to
+	* @returns{int} bytes the block needs, -1 if the program has no active block with that name
+	*/
+	int bindUniformBlock(const std::string &name, unsigned int binding);
+
+	/**
+	* Active uniforms of the program, sorted by name
+	*/
+	const std::vector<UniformInfo> &getUniforms() const;
+
+	/**
+	* Name lookups done by uniform and the set* methods since the last reset, handles do none
+	*/
+	static unsigned int getLookupCount();
+
+	/**
+	* Restarts the lookup count, called once per frame
+	*/
+	static void resetLookupCount();
+
 	unsigned int ID;
 private:
 	// Program shader ID in GPU
 	
+	// Flat table of the active uniforms, filled after linking
+	std::vector<UniformInfo> uniforms;
+	// Last value of each uniform location, sized once after linking so the handles can point into it.
+	// Handles resolved from a const Shader write to it too
+	mutable std::vector<UniformValue> values;
+
+	// Name lookups of every shader since the last reset
+	static unsigned int lookupCount;
+
+	/**
+	* Uniform from the reflected table
+	* @param{std::string &} uniform name
+	* @returns{const UniformInfo *} nullptr if the uniform is not active
+	*/
+	const UniformInfo *findUniform(const std::string &name) const;
+
+	/**
+	* Fills the uniform table of the linked program with glGetActiveUniform
+	*/
+	void reflectUniforms();
 
 	/**
 	* Loads a shader code and compiles it
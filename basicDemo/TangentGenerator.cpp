@@ -0,0 +1,433 @@
+#include "TangentGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#if !defined(TANGENT_GENERATOR_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TANGENT_GENERATOR_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Below this many triangles the threads cost more than they save
+	const size_t PARALLEL_MIN_TRIANGLES = 16384;
+	// Corners whose contributions are computed before they are summed into their vertices
+	const size_t CORNER_BATCH = 1024;
+
+	/**
+	* Unit tangent of a triangle, oriented by its uv winding
+	*/
+	struct FaceTangent {
+		glm::vec3 tangent;
+		// +1 or -1 with the sign of the uv area, 0 for degenerate triangles
+		float orientation;
+	};
+
+	/**
+	* Tangent of one triangle from the position and uv deltas of its edges, as in MikkTSpace
+	*/
+	FaceTangent ComputeFaceTangent(const MeshData& mesh, const unsigned int* corners)
+	{
+		const glm::vec3& p0 = mesh.positions[corners[0]];
+		const glm::vec2& uv0 = mesh.uvs[corners[0]];
+		glm::vec3 d1 = mesh.positions[corners[1]] - p0;
+		glm::vec3 d2 = mesh.positions[corners[2]] - p0;
+		glm::vec2 t21 = mesh.uvs[corners[1]] - uv0;
+		glm::vec2 t31 = mesh.uvs[corners[2]] - uv0;
+
+		float signedArea = t21.x * t31.y - t21.y * t31.x;
+		float sign = signedArea < 0.0f ? -1.0f : 1.0f;
+		glm::vec3 tangent = (d1 * t31.y - d2 * t21.y) * sign;
+		float lengthSquared = glm::dot(tangent, tangent);
+
+		if (std::abs(signedArea) <= FLT_MIN || lengthSquared <= FLT_MIN)
+			return { glm::vec3(0.0f), 0.0f };
+		return { tangent * (1.0f / std::sqrt(lengthSquared)), sign };
+	}
+
+	size_t ComputeFaceTangentsScalar(const MeshData& mesh, size_t begin, size_t end, std::vector<FaceTangent>& faces)
+	{
+		size_t degenerate = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			faces[t] = ComputeFaceTangent(mesh, &mesh.indices[t * 3]);
+			degenerate += faces[t].orientation == 0.0f ? 1 : 0;
+		}
+		return degenerate;
+	}
+
+#ifdef TANGENT_GENERATOR_SSE
+	/**
+	* Same as ComputeFaceTangentsScalar, four triangles per iteration in structure of arrays form
+	*/
+	size_t ComputeFaceTangentsSimd(const MeshData& mesh, size_t begin, size_t end, std::vector<FaceTangent>& faces)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 smallest = _mm_set1_ps(FLT_MIN);
+
+		size_t degenerate = 0;
+		size_t t = begin;
+		for (; t + 4 <= end; t += 4)
+		{
+			// Gathers the corners of four triangles, one triangle per lane
+			float p[3][3][4], uv[3][2][4];
+			for (int lane = 0; lane < 4; lane++)
+			{
+				const unsigned int* corners = &mesh.indices[(t + lane) * 3];
+				for (int c = 0; c < 3; c++)
+				{
+					const glm::vec3& position = mesh.positions[corners[c]];
+					const glm::vec2& texcoord = mesh.uvs[corners[c]];
+					p[c][0][lane] = position.x;
+					p[c][1][lane] = position.y;
+					p[c][2][lane] = position.z;
+					uv[c][0][lane] = texcoord.x;
+					uv[c][1][lane] = texcoord.y;
+				}
+			}
+
+			__m128 d1[3], d2[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 p0 = _mm_loadu_ps(p[0][axis]);
+				d1[axis] = _mm_sub_ps(_mm_loadu_ps(p[1][axis]), p0);
+				d2[axis] = _mm_sub_ps(_mm_loadu_ps(p[2][axis]), p0);
+			}
+			__m128 uv0x = _mm_loadu_ps(uv[0][0]);
+			__m128 uv0y = _mm_loadu_ps(uv[0][1]);
+			__m128 t21x = _mm_sub_ps(_mm_loadu_ps(uv[1][0]), uv0x);
+			__m128 t21y = _mm_sub_ps(_mm_loadu_ps(uv[1][1]), uv0y);
+			__m128 t31x = _mm_sub_ps(_mm_loadu_ps(uv[2][0]), uv0x);
+			__m128 t31y = _mm_sub_ps(_mm_loadu_ps(uv[2][1]), uv0y);
+
+			__m128 signedArea = _mm_sub_ps(_mm_mul_ps(t21x, t31y), _mm_mul_ps(t21y, t31x));
+			// -1 where the area is negative, +1 elsewhere
+			__m128 sign = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(signedArea, _mm_setzero_ps()), signMask), one);
+
+			__m128 tangent[3];
+			__m128 lengthSquared = _mm_setzero_ps();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				tangent[axis] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(d1[axis], t31y), _mm_mul_ps(d2[axis], t21y)), sign);
+				lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(tangent[axis], tangent[axis]));
+			}
+
+			__m128 valid = _mm_and_ps(_mm_cmpgt_ps(_mm_andnot_ps(signMask, signedArea), smallest), _mm_cmpgt_ps(lengthSquared, smallest));
+			__m128 inverseLength = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(lengthSquared)), valid);
+
+			float out[4][4];
+			for (int axis = 0; axis < 3; axis++)
+				_mm_storeu_ps(out[axis], _mm_mul_ps(tangent[axis], inverseLength));
+			_mm_storeu_ps(out[3], _mm_and_ps(sign, valid));
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				faces[t + lane] = { glm::vec3(out[0][lane], out[1][lane], out[2][lane]), out[3][lane] };
+				degenerate += out[3][lane] == 0.0f ? 1 : 0;
+			}
+		}
+
+		return degenerate + ComputeFaceTangentsScalar(mesh, t, end, faces);
+	}
+#endif
+
+	/**
+	* Removes the component of a vector along a unit normal
+	*/
+	inline glm::vec3 ProjectOnPlane(const glm::vec3& vector, const glm::vec3& normal)
+	{
+		return vector - normal * glm::dot(normal, vector);
+	}
+
+	inline glm::vec3 NormalizeOrZero(const glm::vec3& vector)
+	{
+		float lengthSquared = glm::dot(vector, vector);
+		return lengthSquared > FLT_MIN ? vector * (1.0f / std::sqrt(lengthSquared)) : glm::vec3(0.0f);
+	}
+
+	/**
+	* Polynomial arc cosine, within 7e-5 radians of std::acos and several times faster.
+	* The angles only weight the corners, the error is far below what the normal map can show.
+	*/
+	inline float FastAcos(float x)
+	{
+		float a = std::abs(x);
+		float result = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - a * 0.0187293f)));
+		return x < 0.0f ? 3.14159265f - result : result;
+	}
+
+	/**
+	* Any unit vector perpendicular to a normal
+	*/
+	glm::vec3 Perpendicular(const glm::vec3& normal)
+	{
+		glm::vec3 tangent = std::abs(normal.x) > std::abs(normal.z) ? glm::vec3(-normal.y, normal.x, 0.0f) : glm::vec3(0.0f, -normal.z, normal.y);
+		tangent = NormalizeOrZero(tangent);
+		return tangent == glm::vec3(0.0f) ? glm::vec3(1.0f, 0.0f, 0.0f) : tangent;
+	}
+
+	/**
+	* Tangent of a triangle flattened on the plane of a corner normal, weighted by the angle of the corner as in MikkTSpace
+	* @returns{glm::vec4} Weighted tangent in xyz, angle times the uv orientation of the triangle in w
+	*/
+	glm::vec4 CornerContribution(const MeshData& mesh, const std::vector<FaceTangent>& faces, unsigned int corner)
+	{
+		unsigned int triangle = corner / 3;
+		const FaceTangent& face = faces[triangle];
+		if (face.orientation == 0.0f)
+			return glm::vec4(0.0f);
+
+		const unsigned int* indices = &mesh.indices[triangle * 3];
+		unsigned int k = corner - triangle * 3;
+		const glm::vec3& position = mesh.positions[indices[k]];
+		glm::vec3 normal = NormalizeOrZero(mesh.normals[indices[k]]);
+		glm::vec3 edge1 = NormalizeOrZero(ProjectOnPlane(mesh.positions[indices[(k + 1) % 3]] - position, normal));
+		glm::vec3 edge2 = NormalizeOrZero(ProjectOnPlane(mesh.positions[indices[(k + 2) % 3]] - position, normal));
+		float angle = FastAcos(glm::clamp(glm::dot(edge1, edge2), -1.0f, 1.0f));
+
+		return glm::vec4(NormalizeOrZero(ProjectOnPlane(face.tangent, normal)) * angle, face.orientation * angle);
+	}
+
+	void ComputeCornersScalar(const MeshData& mesh, const std::vector<FaceTangent>& faces, const unsigned int* corners, size_t count, glm::vec4* weighted)
+	{
+		for (size_t c = 0; c < count; c++)
+			weighted[c] = CornerContribution(mesh, faces, corners[c]);
+	}
+
+#ifdef TANGENT_GENERATOR_SSE
+	inline __m128 Dot(const __m128* a, const __m128* b)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+	}
+
+	inline void ProjectOnPlane(__m128* vector, const __m128* normal)
+	{
+		__m128 distance = Dot(normal, vector);
+		for (int axis = 0; axis < 3; axis++)
+			vector[axis] = _mm_sub_ps(vector[axis], _mm_mul_ps(normal[axis], distance));
+	}
+
+	inline void NormalizeOrZero(__m128* vector)
+	{
+		__m128 lengthSquared = Dot(vector, vector);
+		__m128 valid = _mm_cmpgt_ps(lengthSquared, _mm_set1_ps(FLT_MIN));
+		__m128 inverseLength = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)), valid);
+		for (int axis = 0; axis < 3; axis++)
+			vector[axis] = _mm_mul_ps(vector[axis], inverseLength);
+	}
+
+	inline __m128 FastAcos(__m128 x)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 a = _mm_andnot_ps(signMask, x);
+		__m128 polynomial = _mm_sub_ps(_mm_set1_ps(0.0742610f), _mm_mul_ps(a, _mm_set1_ps(0.0187293f)));
+		polynomial = _mm_add_ps(_mm_set1_ps(-0.2121144f), _mm_mul_ps(a, polynomial));
+		polynomial = _mm_add_ps(_mm_set1_ps(1.5707288f), _mm_mul_ps(a, polynomial));
+		__m128 result = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), polynomial);
+		__m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(3.14159265f), result)), _mm_andnot_ps(negative, result));
+	}
+
+	/**
+	* Same as ComputeCornersScalar, four corners per iteration in structure of arrays form
+	*/
+	void ComputeCornersSimd(const MeshData& mesh, const std::vector<FaceTangent>& faces, const unsigned int* corners, size_t count, glm::vec4* weighted)
+	{
+		size_t c = 0;
+		for (; c + 4 <= count; c += 4)
+		{
+			// Gathers the corner position, its two neighbours, the corner normal and the face tangent, one corner per lane
+			const glm::vec3* sources[4][5];
+			float orientation[4];
+			for (int lane = 0; lane < 4; lane++)
+			{
+				unsigned int corner = corners[c + lane];
+				unsigned int triangle = corner / 3;
+				const unsigned int* indices = &mesh.indices[triangle * 3];
+				unsigned int k = corner - triangle * 3;
+				sources[lane][0] = &mesh.positions[indices[k]];
+				sources[lane][1] = &mesh.positions[indices[(k + 1) % 3]];
+				sources[lane][2] = &mesh.positions[indices[(k + 2) % 3]];
+				sources[lane][3] = &mesh.normals[indices[k]];
+				sources[lane][4] = &faces[triangle].tangent;
+				orientation[lane] = faces[triangle].orientation;
+			}
+
+			__m128 gathered[5][3];
+			for (int source = 0; source < 5; source++)
+				for (int axis = 0; axis < 3; axis++)
+					gathered[source][axis] = _mm_set_ps((*sources[3][source])[axis], (*sources[2][source])[axis], (*sources[1][source])[axis], (*sources[0][source])[axis]);
+
+			__m128 edge1[3], edge2[3], normal[3], tangent[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				edge1[axis] = _mm_sub_ps(gathered[1][axis], gathered[0][axis]);
+				edge2[axis] = _mm_sub_ps(gathered[2][axis], gathered[0][axis]);
+				normal[axis] = gathered[3][axis];
+				tangent[axis] = gathered[4][axis];
+			}
+
+			NormalizeOrZero(normal);
+			ProjectOnPlane(edge1, normal);
+			ProjectOnPlane(edge2, normal);
+			NormalizeOrZero(edge1);
+			NormalizeOrZero(edge2);
+			__m128 cosine = _mm_min_ps(_mm_max_ps(Dot(edge1, edge2), _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+			__m128 angle = FastAcos(cosine);
+
+			// Degenerate faces have a zero tangent and orientation, their corners add nothing
+			ProjectOnPlane(tangent, normal);
+			NormalizeOrZero(tangent);
+
+			float out[4][4];
+			for (int axis = 0; axis < 3; axis++)
+				_mm_storeu_ps(out[axis], _mm_mul_ps(tangent[axis], angle));
+			_mm_storeu_ps(out[3], _mm_mul_ps(_mm_loadu_ps(orientation), angle));
+
+			for (int lane = 0; lane < 4; lane++)
+				weighted[c + lane] = glm::vec4(out[0][lane], out[1][lane], out[2][lane], out[3][lane]);
+		}
+
+		ComputeCornersScalar(mesh, faces, corners + c, count - c, weighted + c);
+	}
+#endif
+
+	/**
+	* Splits [0, count) in one range per thread and runs a job on each of them
+	*/
+	template <typename Job>
+	void ParallelFor(size_t count, unsigned int numThreads, Job job)
+	{
+		if (numThreads <= 1)
+		{
+			job(0, count, 0);
+			return;
+		}
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < numThreads; i++)
+			workers.push_back(std::thread(job, count * i / numThreads, count * (i + 1) / numThreads, i));
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+}
+
+void TangentGenerator::Generate(MeshData& mesh, size_t numIndices, unsigned int numThreads, TangentStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t numVertices = mesh.positions.size();
+	size_t numTriangles = std::min(numIndices, mesh.indices.size()) / 3;
+
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	if (numTriangles < PARALLEL_MIN_TRIANGLES)
+		numThreads = 1;
+
+	// Triangle pass, every thread writes its own range of faces
+	std::vector<FaceTangent> faces(numTriangles);
+	std::vector<size_t> degenerate(numThreads, 0);
+	if (mesh.hasUvs)
+	{
+		ParallelFor(numTriangles, numThreads, [&](size_t begin, size_t end, unsigned int thread) {
+#ifdef TANGENT_GENERATOR_SSE
+			degenerate[thread] = ComputeFaceTangentsSimd(mesh, begin, end, faces);
+#else
+			degenerate[thread] = ComputeFaceTangentsScalar(mesh, begin, end, faces);
+#endif
+		});
+	}
+	else
+	{
+		std::fill(faces.begin(), faces.end(), FaceTangent{ glm::vec3(0.0f), 0.0f });
+		degenerate[0] = numTriangles;
+	}
+
+	// Corners grouped by vertex, so each vertex gathers its own sum and no two threads write the same vertex
+	std::vector<unsigned int> firstCorner(numVertices + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		firstCorner[mesh.indices[i] + 1]++;
+	for (size_t v = 0; v < numVertices; v++)
+		firstCorner[v + 1] += firstCorner[v];
+	std::vector<unsigned int> corners(numTriangles * 3);
+	std::vector<unsigned int> fill(firstCorner.begin(), firstCorner.end() - 1);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		corners[fill[mesh.indices[i]]++] = static_cast<unsigned int>(i);
+	std::vector<unsigned int>().swap(fill);
+
+	mesh.tangents.resize(numVertices);
+	std::vector<size_t> fallback(numThreads, 0), mixedSign(numThreads, 0);
+
+	// Each thread owns a range of vertices and the contiguous range of corners they gather
+	ParallelFor(numVertices, numThreads, [&](size_t begin, size_t end, unsigned int thread) {
+		glm::vec4 weighted[CORNER_BATCH];
+		glm::vec3 sum(0.0f);
+		float positiveWeight = 0.0f, negativeWeight = 0.0f;
+
+		size_t v = begin;
+		auto finishVertex = [&]() {
+			glm::vec3 tangent = NormalizeOrZero(sum);
+			if (tangent == glm::vec3(0.0f))
+			{
+				tangent = Perpendicular(NormalizeOrZero(mesh.normals[v]));
+				fallback[thread]++;
+			}
+			if (positiveWeight > 0.0f && negativeWeight > 0.0f)
+				mixedSign[thread]++;
+
+			mesh.tangents[v] = glm::vec4(tangent, negativeWeight > positiveWeight ? -1.0f : 1.0f);
+			sum = glm::vec3(0.0f);
+			positiveWeight = negativeWeight = 0.0f;
+			v++;
+		};
+
+		for (size_t batch = firstCorner[begin]; batch < firstCorner[end]; batch += CORNER_BATCH)
+		{
+			size_t count = std::min(CORNER_BATCH, firstCorner[end] - batch);
+#ifdef TANGENT_GENERATOR_SSE
+			ComputeCornersSimd(mesh, faces, &corners[batch], count, weighted);
+#else
+			ComputeCornersScalar(mesh, faces, &corners[batch], count, weighted);
+#endif
+			for (size_t c = 0; c < count; c++)
+			{
+				while (batch + c >= firstCorner[v + 1])
+					finishVertex();
+				sum += glm::vec3(weighted[c]);
+				positiveWeight += std::max(weighted[c].w, 0.0f);
+				negativeWeight += std::max(-weighted[c].w, 0.0f);
+			}
+		}
+		while (v < end)
+			finishVertex();
+	});
+
+	if (stats)
+	{
+		*stats = TangentStats();
+		stats->numTriangles = numTriangles;
+		stats->numVertices = numVertices;
+		for (unsigned int i = 0; i < numThreads; i++)
+		{
+			stats->degenerateTriangles += degenerate[i];
+			stats->fallbackVertices += fallback[i];
+			stats->mixedSignVertices += mixedSign[i];
+		}
+		stats->threads = numThreads;
+#ifdef TANGENT_GENERATOR_SSE
+		stats->simd = true;
+#endif
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void TangentGenerator::PrintStats(const char* name, const TangentStats& stats)
+{
+	printf("%s: tangents of %zu vertices from %zu triangles in %.2f ms on %u thread(s)%s, %zu degenerate triangles, %zu fallback and %zu mirrored vertices\n",
+		name, stats.numVertices, stats.numTriangles, stats.seconds * 1000.0, stats.threads, stats.simd ? " with SSE" : "",
+		stats.degenerateTriangles, stats.fallbackVertices, stats.mixedSignVertices);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshBuilder.h"
+
+/**
+* What the tangent generation did on a mesh
+*/
+struct TangentStats {
+	size_t numTriangles = 0;
+	size_t numVertices = 0;
+	// Triangles with a zero area in position or uv space, they add nothing to their vertices
+	size_t degenerateTriangles = 0;
+	// Vertices whose triangles gave no usable direction, they get an arbitrary tangent of their normal
+	size_t fallbackVertices = 0;
+	// Vertices shared by triangles with opposite uv winding, e.g. on mirrored uv islands
+	size_t mixedSignVertices = 0;
+	unsigned int threads = 0;
+	// true when the triangle and corner passes ran four at a time with SSE
+	bool simd = false;
+	double seconds = 0.0;
+};
+
+/**
+* Per vertex tangent frames for normal mapping, following the MikkTSpace conventions:
+* face tangents oriented by the uv winding, projected on the plane of the vertex normal and weighted by the corner angle,
+* with the bitangent rebuilt in the shader as sign * cross(normal, tangent).
+* Unlike the reference implementation vertices are never split, a vertex on a mirror seam takes the majority sign.
+* Defining TANGENT_GENERATOR_NO_SIMD compiles the scalar triangle pass only.
+*/
+class TangentGenerator
+{
+public:
+	/**
+	* Fills mesh.tangents, the triangle pass and the per vertex accumulation both run on the given threads
+	* @param{MeshData &} Indexed mesh with normals and uvs
+	* @param{size_t} Indices of the triangles that contribute, the coarser levels of detail after them are ignored
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread
+	* @param{TangentStats *} Optional report
+	*/
+	static void Generate(MeshData& mesh, size_t numIndices, unsigned int numThreads = 1, TangentStats* stats = nullptr);
+
+	/**
+	* Prints what the generation did on a mesh
+	* @param{const char*} Name shown in the report
+	* @param{const TangentStats &} Statistics of the mesh
+	*/
+	static void PrintStats(const char* name, const TangentStats& stats);
+};
@@ -0,0 +1,71 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+	: numPending(0), stopping(false)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+		numPending++;
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobsDone.wait(lock, [this]() { return numPending == 0; });
+}
+
+unsigned int ThreadPool::GetNumThreads() const
+{
+	return static_cast<unsigned int>(workers.size());
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			// The queue is drained before the workers stop
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			numPending--;
+			if (numPending == 0)
+				jobsDone.notify_all();
+		}
+	}
+}
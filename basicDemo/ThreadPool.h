@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Fixed set of worker threads running jobs in submission order
+*/
+class ThreadPool
+{
+public:
+	/**
+	* Starts the workers
+	* @param{unsigned int} Number of threads, 0 uses every hardware thread
+	*/
+	explicit ThreadPool(unsigned int numThreads = 0);
+
+	/**
+	* Runs the queued jobs and joins the workers
+	*/
+	~ThreadPool();
+
+	/**
+	* Queues a job for the next free worker
+	* @param{std::function<void()>} Job to run
+	*/
+	void Submit(std::function<void()> job);
+
+	/**
+	* Blocks until every submitted job has finished
+	*/
+	void Wait();
+
+	unsigned int GetNumThreads() const;
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobsDone;
+	// Jobs queued or running
+	size_t numPending;
+	bool stopping;
+};
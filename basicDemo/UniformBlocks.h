@@ -0,0 +1,83 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// Binding points of the uniform blocks shared by the lighting shaders
+enum UniformBlockBinding {
+	// View, projection and camera position, FrameBlock
+	UNIFORM_BLOCK_FRAME = 0,
+	// Directional and spot lights with the cluster grid of the point lights, LightBlock
+	UNIFORM_BLOCK_LIGHTS = 1,
+	// Transform and vertex decoding of the model drawn, ObjectBlock
+	UNIFORM_BLOCK_OBJECT = 2
+};
+
+/*
+* std140 mirrors of the blocks declared in the lighting shaders.
+* A vec3 takes the room of a vec4, scalars after it would fill the fourth float so they are kept apart,
+* and structs are padded to a multiple of 16 bytes
+*/
+
+struct FrameBlock {
+	glm::mat4 view;
+	glm::mat4 proj;
+	// xyz used
+	glm::vec4 viewPos;
+};
+
+struct LightColorStd140 {
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+struct AttenuationStd140 {
+	float constant;
+	float linear;
+	float quadratic;
+	float padding;
+};
+
+struct DirectionalLightStd140 {
+	glm::vec4 direction;
+	LightColorStd140 color;
+};
+
+struct SpotLightStd140 {
+	glm::vec4 position;
+	glm::vec4 direction;
+	LightColorStd140 color;
+	float cutOff;
+	float outerCutOff;
+	float padding[2];
+	AttenuationStd140 attenuation;
+};
+
+struct LightBlock {
+	DirectionalLightStd140 dirLight;
+	SpotLightStd140 spotLight;
+	// GLSL bools take 4 bytes in std140
+	int isActiveDirLight;
+	int isActiveSpotLight;
+	int padding[2];
+	// Point lights come from texture buffers, see LightClusterer: GetClusterCount and GetClusterScale
+	glm::ivec4 clusterCount;
+	glm::vec4 clusterScale;
+};
+
+struct ObjectBlock {
+	glm::mat4 model;
+	int vertexQuantized;
+	int normalMapping;
+	// The model matrix comes from the instance buffer, see InstanceBatcher
+	int instanced;
+	int padding;
+	// xyz used, compact vertices are decoded inside these bounds
+	glm::vec4 boundsMin;
+	glm::vec4 boundsExtent;
+};
+
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock does not match the std140 layout");
+static_assert(sizeof(DirectionalLightStd140) == 64, "DirectionalLightProperties does not match the std140 layout");
+static_assert(sizeof(SpotLightStd140) == 112, "SpotLightProperties does not match the std140 layout");
+static_assert(sizeof(LightBlock) == 224, "LightBlock does not match the std140 layout");
+static_assert(sizeof(ObjectBlock) == 112, "ObjectBlock does not match the std140 layout");
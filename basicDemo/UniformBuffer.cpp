@@ -0,0 +1,129 @@
+#include "UniformBuffer.h"
+#include "GLState.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	// Longest wait for a slice before giving up on the fence, in nanoseconds
+	const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+	inline size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+UniformBuffer::UniformBuffer(unsigned int numFrames, size_t initialSliceSize)
+	: buffer(0), numFrames(numFrames > 0 ? numFrames : 1), frame(0), sliceSize(0), alignment(256), uploadedBytes(0), numWaits(0)
+{
+	GLint offsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	if (offsetAlignment > 0)
+		alignment = (size_t)offsetAlignment;
+
+	fences.assign(this->numFrames, (GLsync)0);
+	glGenBuffers(1, &buffer);
+	Allocate(AlignUp(initialSliceSize > 0 ? initialSliceSize : 1, alignment));
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	for (GLsync fence : fences)
+		if (fence)
+			glDeleteSync(fence);
+	if (buffer != 0)
+		GLState::DeleteBuffer(buffer);
+}
+
+void UniformBuffer::BeginFrame()
+{
+	frame = (frame + 1) % numFrames;
+	staging.clear();
+}
+
+size_t UniformBuffer::Push(const void* data, size_t size)
+{
+	size_t offset = AlignUp(staging.size(), alignment);
+	staging.resize(offset + size);
+	memcpy(staging.data() + offset, data, size);
+	return offset;
+}
+
+void UniformBuffer::Upload()
+{
+	uploadedBytes = staging.size();
+	if (staging.empty())
+		return;
+
+	if (staging.size() > sliceSize)
+		Grow(staging.size());
+
+	// The slice was last read numFrames frames ago, usually the GPU is long done with it
+	GLsync& fence = fences[frame];
+	if (fence) {
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			numWaits++;
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	GLState::BindBuffer(GL_UNIFORM_BUFFER, buffer);
+	void* slice = glMapBufferRange(GL_UNIFORM_BUFFER, (GLintptr)(frame * sliceSize), (GLsizeiptr)staging.size(),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (slice) {
+		memcpy(slice, staging.data(), staging.size());
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	else
+		glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)(frame * sliceSize), (GLsizeiptr)staging.size(), staging.data());
+}
+
+void UniformBuffer::Bind(unsigned int binding, size_t offset, size_t size)
+{
+	GLState::BindUniformBufferRange(binding, buffer, (GLintptr)(frame * sliceSize + offset), (GLsizeiptr)size);
+}
+
+void UniformBuffer::EndFrame()
+{
+	if (fences[frame])
+		glDeleteSync(fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+size_t UniformBuffer::GetUploadedBytes()
+{
+	return uploadedBytes;
+}
+
+unsigned int UniformBuffer::GetNumWaits()
+{
+	return numWaits;
+}
+
+void UniformBuffer::Grow(size_t bytes)
+{
+	// Room for some growth, so a scene that keeps adding models does not reallocate every frame
+	size_t newSize = AlignUp(bytes + bytes / 2, alignment);
+	if (newSize <= sliceSize)
+		return;
+
+	printf("Uniform buffer: slices grow from %zu to %zu bytes\n", sliceSize, newSize);
+	Allocate(newSize);
+}
+
+void UniformBuffer::Allocate(size_t newSliceSize)
+{
+	sliceSize = newSliceSize;
+
+	// Orphaning the old storage makes every pending fence meaningless
+	for (GLsync& fence : fences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+
+	GLState::BindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)(sliceSize * numFrames), NULL, GL_STREAM_DRAW);
+}
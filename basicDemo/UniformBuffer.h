@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+/**
+* Uniform buffer rewritten every frame, with one slice per frame in flight.
+* The blocks of a frame are staged on the CPU, copied into the slice of the frame with a single map,
+* and bound by range to the binding points every program reads them from.
+* A fence per slice stops the CPU from overwriting a slice the GPU still reads.
+*/
+class UniformBuffer
+{
+public:
+	/**
+	* Creates the buffer, the GL context has to be alive
+	* @param{unsigned int} Number of frames in flight, each one gets its own slice
+	* @param{size_t} Initial bytes per slice, the slices grow when a frame needs more
+	*/
+	explicit UniformBuffer(unsigned int numFrames = 3, size_t initialSliceSize = 16384);
+
+	/**
+	* Deletes the buffer and the fences, the GL context has to be alive
+	*/
+	~UniformBuffer();
+
+	/**
+	* Moves to the next slice and clears the staged blocks
+	*/
+	void BeginFrame();
+
+	/**
+	* Stages a block, aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so it can be bound on its own
+	* @param{const void *} Block data in std140 layout
+	* @param{size_t} Bytes of the block
+	* @returns{size_t} Offset of the block in the frame, for Bind
+	*/
+	size_t Push(const void* data, size_t size);
+
+	/**
+	* Copies the staged blocks to the slice of the frame, waiting first if the GPU still reads it
+	*/
+	void Upload();
+
+	/**
+	* Binds a block uploaded this frame to a binding point
+	* @param{unsigned int} Binding point, see UniformBlockBinding
+	* @param{size_t} Offset returned by Push
+	* @param{size_t} Bytes of the block
+	*/
+	void Bind(unsigned int binding, size_t offset, size_t size);
+
+	/**
+	* Fences the slice once the draws reading it were submitted
+	*/
+	void EndFrame();
+
+	/**
+	* Bytes copied by the last Upload
+	*/
+	size_t GetUploadedBytes();
+
+	/**
+	* Times Upload had to wait for the GPU to release a slice
+	*/
+	unsigned int GetNumWaits();
+
+private:
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	/**
+	* Reallocates the buffer with bigger slices, the old storage is orphaned
+	* @param{size_t} Bytes needed by one frame
+	*/
+	void Grow(size_t bytes);
+
+	/**
+	* Creates the storage of every slice
+	* @param{size_t} Bytes per slice, a multiple of the offset alignment
+	*/
+	void Allocate(size_t newSliceSize);
+
+	GLuint buffer;
+	unsigned int numFrames;
+	// Slice written by the current frame
+	unsigned int frame;
+	size_t sliceSize;
+	size_t alignment;
+	std::vector<unsigned char> staging;
+	// Fence of each slice, 0 once it was waited on
+	std::vector<GLsync> fences;
+	size_t uploadedBytes;
+	unsigned int numWaits;
+};
@@ -0,0 +1,246 @@
+#version 330 core
+
+#define PI 3.14159265
+
+// MaterialType in Model.h
+#define BLINN_PHONG 0
+#define OREN_NAYAR 1
+
+// Lighting pass of the deferred path: every covered pixel of the G-buffer is shaded once,
+// with the BRDF of its material and the point lights of its cluster
+out vec4 fragColor;
+
+struct LightColor {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct Attenuation{
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct PointLightProperties {
+   vec3 position;
+   // Distance past which the light is left out of the clusters
+   float range;
+    LightColor color;
+    Attenuation attenuation;
+};
+
+struct DirectionalLightProperties {
+   vec3 direction;
+   LightColor color;
+};
+
+struct SpotLightProperties{
+    vec3 position;
+    vec3 direction;
+    LightColor color;
+    float cutOff;
+    float outerCutOff;
+    Attenuation attenuation;
+};
+
+// Per frame data, FrameBlock in UniformBlocks.h
+layout (std140) uniform FrameBlock {
+    mat4 view;
+    mat4 proj;
+    vec3 viewPos;
+};
+
+// Directional and spot lights with the cluster grid of the point lights, LightBlock in UniformBlocks.h
+layout (std140) uniform LightBlock {
+    DirectionalLightProperties dirLight;
+    SpotLightProperties spotLight;
+    //IS ACTIVE
+    bool isActiveDirLight;
+    bool isActiveSpotLight;
+    // Clusters along x, y and depth, w unused
+    ivec4 clusterCount;
+    // Clusters per pixel in x and y, the depth slice is log(view depth) * z + w
+    vec4 clusterScale;
+};
+
+// G-buffer, see GBuffer.h
+uniform sampler2D albedoMaterial;
+uniform sampler2D normalParameters;
+uniform sampler2D depth;
+// Range of the stored parameters, GBuffer::MATERIAL_PARAMETER_RANGE
+uniform float parameterRange = 64;
+// Window coordinates back to world space
+uniform mat4 inverseViewProjection;
+uniform float intensity = 1;
+
+// Point lights of the frame, see LightClusterer: four texels per light, position and range,
+// ambient and constant attenuation, diffuse and linear attenuation, specular and quadratic attenuation
+uniform samplerBuffer pointLightData;
+// First light index and number of lights of every cluster
+uniform usamplerBuffer clusterRanges;
+// Light indices of the clusters, back to back
+uniform usamplerBuffer clusterLightIndices;
+
+// Surface of the pixel, decoded once from the G-buffer
+vec3 surfacePos;
+vec3 normal;
+vec3 viewDir;
+int material;
+// Shininess for Blinn-Phong
+float roughness;
+float reflectance;
+
+PointLightProperties fetchPointLight(int light)
+{
+    vec4 positionRange = texelFetch(pointLightData, light * 4);
+    vec4 ambient = texelFetch(pointLightData, light * 4 + 1);
+    vec4 diffuse = texelFetch(pointLightData, light * 4 + 2);
+    vec4 specular = texelFetch(pointLightData, light * 4 + 3);
+    return PointLightProperties(positionRange.xyz, positionRange.w, LightColor(ambient.xyz, diffuse.xyz, specular.xyz),
+        Attenuation(ambient.w, diffuse.w, specular.w));
+}
+
+// Cluster of the pixel: screen tile and logarithmic slice of its view depth
+int fragmentCluster()
+{
+    float viewDepth = -(view * vec4(surfacePos, 1.0)).z;
+    ivec3 cluster = ivec3(gl_FragCoord.xy * clusterScale.xy, log(viewDepth) * clusterScale.z + clusterScale.w);
+    cluster = clamp(cluster, ivec3(0), clusterCount.xyz - 1);
+    return cluster.x + clusterCount.x * (cluster.y + clusterCount.y * cluster.z);
+}
+
+// Brings the attenuation smoothly to zero at the range of the light, the clusters leave out everything past it
+float rangeWindow(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Inverse of MeshQuantizer::OctahedralEncode
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+
+// Response of the surface to one light, the same terms as the forward shader of the material.
+// The attenuation scales everything, the spot falloff everything but the ambient
+vec3 calcLightContribution(vec3 lightDir, LightColor color, float attenuation, float falloff)
+{
+    float NdotL = max(dot(normal, lightDir), 0.0);
+
+    if (material == BLINN_PHONG) {
+        vec3 lightContribution = color.ambient * attenuation;
+        if (NdotL > 0.0) {
+            vec3 halfwayDir = normalize(lightDir + viewDir);
+            float spec = pow(max(dot(normal, halfwayDir), 0.0), roughness);
+            lightContribution += (color.diffuse * NdotL + color.specular * spec) * attenuation * falloff;
+        }
+        return lightContribution;
+    }
+
+    if (NdotL <= 0.0)
+        return vec3(0.0);
+
+    if (material == OREN_NAYAR) {
+        float sigma2 = roughness * roughness;
+        float A = 1.0 - (0.5 * sigma2 / (sigma2 + 0.57));
+        float B = 0.45 * sigma2 / (sigma2 + 0.09);
+
+        vec3 angle1 = normalize(viewDir - normal * viewDir * normal);
+        vec3 angle2 = normalize(lightDir - normal * lightDir * normal);
+        float cosIntern = max(0.0, dot(angle1, angle2));
+
+        float alpha = max(acos(dot(normal, lightDir)), acos(dot(normal, viewDir)));
+        float beta = min(acos(dot(normal, lightDir)), acos(dot(normal, viewDir)));
+
+        return intensity * color.diffuse * NdotL * attenuation * falloff * (A + cosIntern * B * sin(alpha) * tan(beta));
+    }
+
+    // Cook-Torrance
+    float k = .2;
+    vec3 H = normalize(lightDir + viewDir);
+    float NdotH = clamp(dot(normal, H), 0.0, 1.0);
+    float NdotV = clamp(dot(normal, viewDir), 0.0, 1.0);
+    float VdotH = clamp(dot(lightDir, H), 0.0, 1.0);
+
+    // Fresnel reflectance
+    float F = pow(1.0 - VdotH, 5.0);
+    F *= (1.0 - reflectance);
+    F += reflectance;
+
+    // Microfacet distribution by Beckmann
+    float m_squared = roughness * roughness;
+    float r1 = 1.0 / (4.0 * m_squared * pow(NdotH, 4.0));
+    float r2 = (NdotH * NdotH - 1.0) / (m_squared * NdotH * NdotH);
+    float D = r1 * exp(r2);
+
+    // Geometric shadowing
+    float two_NdotH = 2.0 * NdotH;
+    float g1 = (two_NdotH * NdotV) / VdotH;
+    float g2 = (two_NdotH * NdotL) / VdotH;
+    float G = min(1.0, min(g1, g2));
+
+    float Rs = (F * D * G) / (PI * NdotL * NdotV);
+    return (color.diffuse + color.specular * (k + Rs * (1.0 - k))) * NdotL * attenuation * falloff;
+}
+
+float calcAttenuation(Attenuation attenuation, float distance)
+{
+    return 1.0 / (attenuation.constant + attenuation.linear * distance + attenuation.quadratic * (distance * distance));
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float windowDepth = texelFetch(depth, pixel, 0).r;
+    // Nothing was drawn here, the clear color of the window stays
+    if (windowDepth == 1.0)
+        discard;
+
+    vec2 windowPos = gl_FragCoord.xy / vec2(textureSize(depth, 0));
+    vec4 worldPos = inverseViewProjection * vec4(vec3(windowPos, windowDepth) * 2.0 - 1.0, 1.0);
+    surfacePos = worldPos.xyz / worldPos.w;
+    viewDir = normalize(viewPos - surfacePos);
+
+    vec4 albedo = texelFetch(albedoMaterial, pixel, 0);
+    vec4 parameters = texelFetch(normalParameters, pixel, 0);
+    material = int(albedo.a * 255.0 + 0.5);
+    normal = octahedralDecode(parameters.xy * 2.0 - 1.0);
+    roughness = parameters.z * parameterRange;
+    reflectance = parameters.w * parameterRange;
+
+    vec3 lightContribution = vec3(0.0);
+
+    if (isActiveDirLight)
+        lightContribution += calcLightContribution(normalize(-dirLight.direction), dirLight.color, 1.0, 1.0);
+
+    // Only the point lights whose range reaches the cluster of the pixel
+    uvec2 clusterRange = texelFetch(clusterRanges, fragmentCluster()).xy;
+    for (uint i = 0u; i < clusterRange.y; i++) {
+        PointLightProperties pointLight = fetchPointLight(int(texelFetch(clusterLightIndices, int(clusterRange.x + i)).r));
+        float distance = length(pointLight.position - surfacePos);
+        float attenuation = calcAttenuation(pointLight.attenuation, distance) * rangeWindow(distance, pointLight.range);
+        lightContribution += calcLightContribution(normalize(pointLight.position - surfacePos), pointLight.color, attenuation, 1.0);
+    }
+
+    if (isActiveSpotLight) {
+        float distance = length(spotLight.position - surfacePos);
+        vec3 lightDir = normalize(spotLight.position - surfacePos);
+        float theta = dot(lightDir, normalize(-spotLight.direction));
+        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+        float falloff = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+        lightContribution += calcLightContribution(lightDir, spotLight.color, calcAttenuation(spotLight.attenuation, distance), falloff);
+    }
+
+    fragColor = vec4(albedo.rgb * lightContribution, 1.0);
+}
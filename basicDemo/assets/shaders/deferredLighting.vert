@@ -0,0 +1,9 @@
+#version 330 core
+// Fullscreen quad from the vertex index, no vertex buffer. The lighting pass reads the G-buffer with gl_FragCoord
+
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
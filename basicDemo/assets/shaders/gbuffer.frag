@@ -0,0 +1,78 @@
+#version 330 core
+
+// MaterialType in Model.h
+#define COOK_TORRANCE 2
+
+// Geometry pass of the deferred path, the layout is described in GBuffer.h
+// Albedo in rgb, material in a
+layout (location = 0) out vec4 albedoMaterial;
+// Octahedral normal in rg, roughness and reflectance in b and a
+layout (location = 1) out vec4 normalParameters;
+
+
+in Data{
+    vec3 vertexPos;
+    vec3 normal;
+    vec2 uv;
+    vec4 tangent;
+}dataIn;
+
+// Per model data, ObjectBlock in UniformBlocks.h
+layout (std140) uniform ObjectBlock {
+    mat4 model;
+    // Compact vertices: positions are unorm16 inside the mesh bounds, normals are octahedral snorm16, tangents snorm8
+    bool vertexQuantized;
+    // Tangent space normal map, with the tangents of TangentGenerator
+    bool normalMapping;
+    // The model matrix comes from the instanceModel attribute, model is unused
+    bool instanced;
+    vec3 boundsMin;
+    vec3 boundsExtent;
+};
+
+uniform sampler2D ourTexture;
+// Tangent space normal map, with the tangents of TangentGenerator
+uniform sampler2D normalMap;
+
+uniform int material;
+// Shininess for Blinn-Phong
+uniform float roughness;
+uniform float reflectance;
+// Range of the stored parameters, GBuffer::MATERIAL_PARAMETER_RANGE
+uniform float parameterRange = 64;
+
+// Normal of the fragment, perturbed by the normal map with the MikkTSpace convention:
+// the interpolated frame is used unnormalized and the bitangent is rebuilt from the tangent sign
+vec3 shadingNormal()
+{
+    if (!normalMapping)
+        return normalize(dataIn.normal);
+
+    vec3 bitangent = dataIn.tangent.w * cross(dataIn.normal, dataIn.tangent.xyz);
+    vec3 mapped = texture(normalMap, dataIn.uv).xyz * 2.0 - 1.0;
+    return normalize(mapped.x * dataIn.tangent.xyz + mapped.y * bitangent + mapped.z * dataIn.normal);
+}
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Same mapping as MeshQuantizer::OctahedralEncode, in [-1, 1]
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return e;
+}
+
+void main()
+{
+    // The forward Cook-Torrance shader leaves the texture out, so does its albedo
+    vec3 albedo = material == COOK_TORRANCE ? vec3(1.0) : texture(ourTexture, dataIn.uv).rgb;
+    albedoMaterial = vec4(albedo, float(material) / 255.0);
+    normalParameters = vec4(octahedralEncode(shadingNormal()) * 0.5 + 0.5,
+        clamp(vec2(roughness, reflectance) / parameterRange, 0.0, 1.0));
+}
@@ -1,5 +1,4 @@
 #version 330 core
-#define NUM_POINTLIGHT 2
 #define NUM_SPOTLIGHT 1
 #define NUM_DIRLIGHT 1
 
@@ -20,6 +19,8 @@ struct Attenuation{
 
 struct PointLightProperties {
    vec3 position;
+   // Distance past which the light is left out of the clusters
+   float range;
     LightColor color;
     Attenuation attenuation;
 };
@@ -44,31 +45,105 @@ in Data{
     vec3 vertexPos;
     vec3 normal;
     vec2 uv;
+    vec4 tangent;
 }dataIn;
 
-uniform vec3 viewPos;
+// Per frame data, FrameBlock in UniformBlocks.h
+layout (std140) uniform FrameBlock {
+    mat4 view;
+    mat4 proj;
+    vec3 viewPos;
+};
+
+// Per model data, ObjectBlock in UniformBlocks.h
+layout (std140) uniform ObjectBlock {
+    mat4 model;
+    // Compact vertices: positions are unorm16 inside the mesh bounds, normals are octahedral snorm16, tangents snorm8
+    bool vertexQuantized;
+    // Tangent space normal map, with the tangents of TangentGenerator
+    bool normalMapping;
+    // The model matrix comes from the instanceModel attribute, model is unused
+    bool instanced;
+    vec3 boundsMin;
+    vec3 boundsExtent;
+};
+
 uniform float shininess;
 uniform sampler2D ourTexture;
 
-//IS ACTIVE
-uniform bool isActiveDirLight;
-uniform bool isActiveSpotLight;
-uniform bool isActivePointLight1;
-uniform bool isActivePointLight2;
+// Directional and spot lights with the cluster grid of the point lights, LightBlock in UniformBlocks.h
+layout (std140) uniform LightBlock {
+    DirectionalLightProperties dirLight;
+    SpotLightProperties spotLight;
+    //IS ACTIVE
+    bool isActiveDirLight;
+    bool isActiveSpotLight;
+    // Clusters along x, y and depth, w unused
+    ivec4 clusterCount;
+    // Clusters per pixel in x and y, the depth slice is log(view depth) * z + w
+    vec4 clusterScale;
+};
+
+// Tangent space normal map, with the tangents of TangentGenerator
+uniform sampler2D normalMap;
 
-uniform PointLightProperties pointLights[NUM_POINTLIGHT];
-uniform DirectionalLightProperties dirLight;
-uniform SpotLightProperties spotLight;
+// Normal of the fragment, perturbed by the normal map with the MikkTSpace convention:
+// the interpolated frame is used unnormalized and the bitangent is rebuilt from the tangent sign
+vec3 shadingNormal()
+{
+    if (!normalMapping)
+        return normalize(dataIn.normal);
+
+    vec3 bitangent = dataIn.tangent.w * cross(dataIn.normal, dataIn.tangent.xyz);
+    vec3 mapped = texture(normalMap, dataIn.uv).xyz * 2.0 - 1.0;
+    return normalize(mapped.x * dataIn.tangent.xyz + mapped.y * bitangent + mapped.z * dataIn.normal);
+}
+
+// Point lights of the frame, see LightClusterer: four texels per light, position and range,
+// ambient and constant attenuation, diffuse and linear attenuation, specular and quadratic attenuation
+uniform samplerBuffer pointLightData;
+// First light index and number of lights of every cluster
+uniform usamplerBuffer clusterRanges;
+// Light indices of the clusters, back to back
+uniform usamplerBuffer clusterLightIndices;
+
+PointLightProperties fetchPointLight(int light)
+{
+    vec4 positionRange = texelFetch(pointLightData, light * 4);
+    vec4 ambient = texelFetch(pointLightData, light * 4 + 1);
+    vec4 diffuse = texelFetch(pointLightData, light * 4 + 2);
+    vec4 specular = texelFetch(pointLightData, light * 4 + 3);
+    return PointLightProperties(positionRange.xyz, positionRange.w, LightColor(ambient.xyz, diffuse.xyz, specular.xyz),
+        Attenuation(ambient.w, diffuse.w, specular.w));
+}
+
+// Cluster of the fragment: screen tile and logarithmic slice of its view depth
+int fragmentCluster()
+{
+    float viewDepth = -(view * vec4(dataIn.vertexPos, 1.0)).z;
+    ivec3 cluster = ivec3(gl_FragCoord.xy * clusterScale.xy, log(viewDepth) * clusterScale.z + clusterScale.w);
+    cluster = clamp(cluster, ivec3(0), clusterCount.xyz - 1);
+    return cluster.x + clusterCount.x * (cluster.y + clusterCount.y * cluster.z);
+}
+
+// Brings the attenuation smoothly to zero at the range of the light, the clusters leave out everything past it
+float rangeWindow(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
 
 vec3 calcPointLightContribution(PointLightProperties pointLight){
 
-    vec3 normal=normalize(dataIn.normal);
+    vec3 normal=shadingNormal();
    // Distance from the vertex to the light
    float distance = length(pointLight.position-dataIn.vertexPos);
    // Attenuation
    float attenuation = 1.0f / (pointLight.attenuation.constant +
   	pointLight.attenuation.linear*distance +
   	pointLight.attenuation.quadratic*(distance*distance));
+   attenuation *= rangeWindow(distance, pointLight.range);
 
    vec3 ambient=pointLight.color.ambient * attenuation;
    vec3 lightContribution=ambient;
@@ -94,7 +169,7 @@ vec3 calcPointLightContribution(PointLightProperties pointLight){
 
 vec3 calcDirLightContribution(){
 
-    vec3 normal=normalize(dataIn.normal);
+    vec3 normal=shadingNormal();
     vec3 ambient=dirLight.color.ambient;
    
     vec3 lightContribution=ambient;
@@ -125,7 +200,7 @@ vec3 calcDirLightContribution(){
 
 vec3 calcSpotLightContribution(){
 
-    vec3 normal=normalize(dataIn.normal);
+    vec3 normal=shadingNormal();
    // Distance from the vertex to the light
    float distance=length(spotLight.position-dataIn.vertexPos);
    // Attenuation
@@ -166,9 +241,10 @@ void main() {
     
     vec3 lightContribution = vec3(0,0,0);
     
-    if(isActivePointLight1) lightContribution+=calcPointLightContribution( pointLights[0] );
-
-    if(isActivePointLight2) lightContribution+=calcPointLightContribution( pointLights[1] );
+    // Only the point lights whose range reaches the cluster of the fragment
+    uvec2 clusterRange = texelFetch(clusterRanges, fragmentCluster()).xy;
+    for (uint i = 0u; i < clusterRange.y; i++)
+        lightContribution += calcPointLightContribution(fetchPointLight(int(texelFetch(clusterLightIndices, int(clusterRange.x + i)).r)));
     
     if(isActiveDirLight) lightContribution+=calcDirLightContribution();
 
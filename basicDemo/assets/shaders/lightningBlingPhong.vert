@@ -5,29 +5,76 @@ layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexNormal;
 // Attribute 2 of the vertex
 layout (location = 2) in vec2 vertexUV;
+// Attribute 3 of the vertex, tangent and bitangent sign
+layout (location = 3) in vec4 vertexTangent;
+// Attributes 4 to 7, model matrix of the instance, see InstanceBatcher
+layout (location = 4) in mat4 instanceModel;
 
 out Data{
     vec3 vertexPos;
     vec3 normal;
     vec2 uv;
+    vec4 tangent;
 }dataOut;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+// Per frame data, FrameBlock in UniformBlocks.h
+layout (std140) uniform FrameBlock {
+    mat4 view;
+    mat4 proj;
+    vec3 viewPos;
+};
 
+// Per model data, ObjectBlock in UniformBlocks.h
+layout (std140) uniform ObjectBlock {
+    mat4 model;
+    // Compact vertices: positions are unorm16 inside the mesh bounds, normals are octahedral snorm16, tangents snorm8
+    bool vertexQuantized;
+    // Tangent space normal map, with the tangents of TangentGenerator
+    bool normalMapping;
+    // The model matrix comes from the instanceModel attribute, model is unused
+    bool instanced;
+    vec3 boundsMin;
+    vec3 boundsExtent;
+};
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Inverse of MeshQuantizer::OctahedralEncode
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
 
 void main()
 {
 
-    mat4 modelView = view * model;
+    mat4 world = instanced ? instanceModel : model;
+    mat4 modelView = view * world;
     mat4 MVP = proj * modelView;
-    mat3 normalMatrix = mat3(model);
+    mat3 normalMatrix = mat3(world);
+
+    vec3 position = vertexPosition;
+    vec3 normal = vertexNormal;
+    vec4 tangent = vertexTangent;
+    if (vertexQuantized) {
+        position = boundsMin + vertexPosition * boundsExtent;
+        // Normals arrive as raw integers, the snorm conversion is done here so it does not depend on the GL version
+        normal = octahedralDecode(max(vertexNormal.xy / 32767.0, vec2(-1.0)));
+        tangent = vertexTangent / 127.0;
+    }
     // World space vertex
-    dataOut.vertexPos = vec3(model*vec4(vertexPosition,1.f));
+    dataOut.vertexPos = vec3(world*vec4(position,1.f));
    // World space normal
-    dataOut.normal  = normalMatrix * vertexNormal;
+    dataOut.normal  = normalMatrix * normal;
     dataOut.uv = vertexUV;
+    // World space tangent, the sign rebuilds the bitangent in the fragment shader
+    dataOut.tangent = vec4(normalMatrix * tangent.xyz, tangent.w);
 
-    gl_Position = MVP * vec4(vertexPosition, 1.0f);
+    gl_Position = MVP * vec4(position, 1.0f);
 }
\ No newline at end of file
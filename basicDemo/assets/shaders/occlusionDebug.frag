@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec2 texCoord;
+// Software rasterized occlusion depth, window depth in the red channel
+uniform sampler2D depthBuffer;
+out vec4 color;
+
+void main()
+{
+    // Window depth crowds next to 1, the power spreads the occluders over the gray range
+    float depth = pow(texture(depthBuffer, texCoord).r, 64.0f);
+    color = vec4(vec3(depth), 1);
+}
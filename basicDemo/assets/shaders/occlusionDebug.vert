@@ -0,0 +1,10 @@
+#version 330 core
+// Fullscreen quad from the vertex index, no vertex buffer
+out vec2 texCoord;
+
+
+void main()
+{
+    texCoord = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(texCoord * 2.0f - 1.0f, 0.0f, 1.0f);
+}
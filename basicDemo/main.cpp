@@ -3,6 +3,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
 #include <iostream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <cfloat>
 #include <stb_image.h>
 
 
@@ -11,6 +17,20 @@
 #include "Shader.h"
 #include "Model.h"
 #include "Light.h"
+#include "AssetLoader.h"
+#include "Frustum.h"
+#include "SceneBvh.h"
+#include "ThreadPool.h"
+#include "UniformBlocks.h"
+#include "UniformBuffer.h"
+#include "InstanceBatcher.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "GLDraw.h"
+#include "LightClusterer.h"
+#include "GBuffer.h"
 
 const int NUM_POINTLIGHT = 2;
 
@@ -53,14 +73,44 @@ struct Data {
 	glm::vec3 normal;
 };
 
-vector<Model *> modelsBlinnPhong;
-vector<Model *> modelsOrenNayar;
-vector<Model *> modelsCookTorrance;
+// Every model of the scene, its material picks the program it is drawn with
+vector<Model *> sceneModels;
+
+// OBJ files shipped with the demo, used by the loader check and the benchmarks
+const char *bundledModels[] = {
+	"./assets/models/cat.obj",
+	"./assets/models/cottage/cottage.obj",
+	"./assets/models/lowPolyTree/lowPolyTree.obj",
+	"./assets/models/cube.obj",
+	"./assets/models/plane.obj"
+};
 
 Light *lightSources[2];
 PointLightProperties pointLights[2];
 DirectionalLightProperties directionalLight;
 SpotLightProperties spotLight;
+// Point lights shaded this frame: the two of the user interface when they are active, then benchmarkLights
+vector<ClusterLight> frameLights;
+// Stress scene: point lights scattered over the scene, --point-lights
+int numBenchmarkLights = 0;
+vector<ClusterLight> benchmarkLights;
+// Fragments shade the point lights of their cluster only, off puts every light in view in a single cluster
+bool clusteredLighting = true;
+LightClusterer *lightClusterer;
+// First of the three texture units holding the lights and their clusters, after the diffuse texture and the normal map
+const GLuint LIGHT_CLUSTER_TEXTURE_UNIT = 2;
+// Models write a G-buffer and one fullscreen pass shades every pixel, instead of shading every fragment drawn
+bool deferredShading = false;
+GBuffer *gBuffer;
+// The lighting pass reads the albedo and the normal on units 0 and 1, the light clusters as usual and the depth after them
+const GLuint GBUFFER_DEPTH_TEXTURE_UNIT = LIGHT_CLUSTER_TEXTURE_UNIT + 3;
+// GL_TIME_ELAPSED queries around the scene passes, a query is read when its slot comes around again so the frame never waits on it
+const unsigned int SCENE_TIMER_QUERIES = 4;
+GLuint sceneTimerQueries[SCENE_TIMER_QUERIES];
+unsigned int sceneTimerFrames = 0;
+// GPU time of the scene passes summed since the last report, and the frames it covers
+double sceneGpuMilliseconds = 0.0;
+unsigned int sceneGpuFrames = 0;
 float shininess = 32;
 float roughness = .3;
 float intensity = 1;
@@ -86,10 +136,131 @@ Shader *shaderOrenNayar;
 Shader *shaderCookTorrance;
 // Shader for lights
 Shader *shaderLights;
+// Geometry and lighting passes of the deferred path
+Shader *shaderGBuffer;
+Shader *shaderDeferredLighting;
+
+// Uniforms of a lighting shader, resolved once after it is linked so the frame does no name lookups.
+// Camera, lights and per model data come from the uniform blocks of UniformBlocks.h
+struct LightingUniforms {
+	// Material parameters, a shader only has the ones of its BRDF
+	ShaderUniform shininess, roughness, intensity, reflectance;
+	ShaderUniform normalMap;
+	// Texture buffers of LightClusterer
+	ShaderUniform pointLightData, clusterRanges, clusterLightIndices;
+};
+LightingUniforms uniformsBlinnPhong;
+LightingUniforms uniformsOrenNayar;
+LightingUniforms uniformsCookTorrance;
+LightingUniforms uniformsGBuffer;
+LightingUniforms uniformsDeferredLighting;
+// MaterialType written to the G-buffer
+ShaderUniform gBufferMaterial;
+ShaderUniform deferredInverseViewProjection;
+ShaderUniform lightsMVP;
+ShaderUniform lightsColorIn;
+// Uniform name lookups of the last frame, handles do none
+unsigned int uniformLookups = 0;
+// Frame, light and per model blocks shared by every lighting shader, written once per frame
+UniformBuffer *sceneUniforms;
+// Bytes written to the uniform buffer by the last frame
+size_t uniformBytes = 0;
+
+// Models sharing a mesh and a material are drawn with one instanced call
+bool instancing = true;
+InstanceBatcher *instanceBatcher;
+// Draws of the frame sorted by program, material, texture, mesh and depth
+RenderQueue renderQueue;
+// State changes of the current frame, the sorted queue keeps them to one per distinct value
+unsigned int programBinds = 0;
+unsigned int textureBinds = 0;
+unsigned int vaoBinds = 0;
+// Copies of lowPolyTree in the stress scene, --trees
+int numTrees = 0;
 
 // Index (GPU) of the texture
 unsigned int houseTextureID;
 unsigned int planeTextureID;
+unsigned int planeNormalMapID;
+unsigned int treeTextureID = 0;
+
+// Scene models use the 20 byte quantized vertex layout
+bool compactVertices = false;
+// Models with a normal map perturb their normals with it
+bool normalMaps = true;
+
+// Loads every asset on the GL thread before the first frame, like before the asset loader existed
+bool syncLoading = false;
+// Milliseconds per frame the GL thread spends uploading loaded assets
+double uploadBudget = 4.0;
+// Start of the program, for the startup timing
+std::chrono::steady_clock::time_point startupTime;
+
+// Draws dense meshes meshlet by meshlet, skipping the clusters outside the frustum
+bool clusterCulling = true;
+// Also skips the clusters whose triangles all face away from the camera
+bool coneCulling = true;
+// World space frustum of the current frame
+Frustum viewFrustum;
+// Meshlets tested and rejected in the current frame
+MeshletCullStats clusterStats;
+// Bounding spheres of the loaded models, tested against the frustum before the draw lists are built
+FrustumCuller modelCuller;
+// Model of each sphere of modelCuller
+vector<Model *> cullCandidates;
+// Scratch output of modelCuller, only its first entries are the visible models
+vector<uint32_t> visibleModels;
+// Models inside the frustum, in the current frame
+vector<Model *> drawModels;
+// Models outside the frustum and time spent testing them, in the current frame
+size_t modelsCulled = 0;
+double cullMilliseconds = 0.0;
+// The cottages are rasterized on the CPU, the models of the draw lists hidden behind them are removed
+bool occlusionCulling = true;
+OcclusionCuller *occlusionCuller;
+vector<Model *> occluderModels;
+// Shows the software depth buffer in a corner of the window
+bool occlusionDebug = false;
+Shader *shaderOcclusionDebug;
+unsigned int occlusionDepthTextureID;
+// Vertex array of the fullscreen passes
+unsigned int fullscreenVAO;
+
+// How drawModel picks the level of detail of each model
+enum LodPolicy {
+	// Always the full resolution mesh
+	LOD_POLICY_OFF,
+	// Coarsest level whose error projected on the screen stays under lodPixelError
+	LOD_POLICY_SCREEN_ERROR,
+	// Same, but a model only moves to a coarser level once its error is well under the limit
+	LOD_POLICY_HYSTERESIS
+};
+LodPolicy lodPolicy = LOD_POLICY_HYSTERESIS;
+const char *lodPolicyNames[] = { "off", "error", "hysteresis" };
+// Largest error, in pixels, of the level drawn
+float lodPixelError = 1.0f;
+// Fraction of lodPixelError a coarser level has to stay under with LOD_POLICY_HYSTERESIS
+const float LOD_HYSTERESIS = 0.25f;
+// Pixels per world unit at a distance of one unit, updated by render
+float lodProjectionScale = 1.0f;
+// Models drawn per level of detail in the current frame, GLDraw counts their triangles
+unsigned int lodInstances[MeshSimplifier::MAX_LODS];
+
+// Near plane of the camera, the first depth slice of the light clusters starts there
+const float CAMERA_NEAR_DISTANCE = 1.0f;
+// Far plane of the camera, draws are sorted by their distance over it
+const float CAMERA_VIEW_DISTANCE = 100.0f;
+// Projection times view of the current frame, left clicks are unprojected with it
+glm::mat4 viewProjection = glm::mat4(1.0f);
+// Model picked by the last left click, nullptr if it hit nothing. Its bounding box is drawn around it
+Model *selectedModel = nullptr;
+// Hierarchy of the pickable models, only rebuilt when a model finished loading or a light moved since the last pick
+SceneBvh pickScene;
+vector<Model *> pickModels;
+vector<BvhInstance> pickInstances;
+// Unit cube drawn in lines, scaled to the bounds of the selected model
+unsigned int selectionBoxVAO;
+unsigned int selectionBoxBuffers[2];
 
 glm::vec3 position = glm::vec3( 0, 0, 5);
 // horizontal angle : toward -Z
@@ -136,10 +307,96 @@ void resize(GLFWwindow *window, int width, int height)
 	userInterface->reshape(windowWidth,windowHeight);
 }
 
+/**
+ * World position of a pickable model, the light cubes are drawn at their light
+ * @param{Model *} scene model or light cube
+ * @returns{glm::vec3} translation of its mesh
+ * */
+glm::vec3 getPickPosition(Model *model)
+{
+	for (int i = 0; i < NUM_POINTLIGHT; i++)
+		if (model == lightSources[i])
+			return pointLights[i].position;
+	return model->getPosition();
+}
+
+/**
+ * Rebuilds the pick hierarchy when the loaded models or their positions changed
+ * */
+void updatePickScene()
+{
+	// Every drawn model with its mesh hierarchy, the light cubes after the scene models
+	vector<Model *> models;
+	vector<BvhInstance> instances;
+	for (Model *model : sceneModels) {
+		if (!model->IsReady())
+			continue;
+		models.push_back(model);
+		instances.push_back({ &model->GetMesh()->GetBvh(), model->getPosition() });
+	}
+	for (int i = 0; i < NUM_POINTLIGHT; i++) {
+		if (!lightSources[i]->IsReady())
+			continue;
+		models.push_back(lightSources[i]);
+		instances.push_back({ &lightSources[i]->GetMesh()->GetBvh(), getPickPosition(lightSources[i]) });
+	}
+
+	bool changed = instances.size() != pickInstances.size();
+	for (size_t i = 0; i < instances.size() && !changed; i++)
+		changed = instances[i].bvh != pickInstances[i].bvh || instances[i].position != pickInstances[i].position;
+	if (!changed)
+		return;
+
+	pickModels.swap(models);
+	pickInstances.swap(instances);
+	pickScene.Build(pickInstances);
+}
+
+/**
+ * Selects the model under a window position by casting a ray through the scene hierarchy
+ * @param{double} cursor x, in pixels from the left
+ * @param{double} cursor y, in pixels from the top
+ * */
+void pickModel(double x, double y)
+{
+	updatePickScene();
+
+	// Segment from the near to the far plane under the cursor
+	glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+	float ndcX = (float)(2.0 * x / windowWidth - 1.0);
+	float ndcY = (float)(1.0 - 2.0 * y / windowHeight);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 to = glm::vec3(farPoint) / farPoint.w;
+
+	SceneRayHit hit;
+	if (!pickScene.Raycast(from, to - from, 1.0f, hit)) {
+		selectedModel = nullptr;
+		printf("Picked nothing\n");
+		return;
+	}
+
+	selectedModel = pickModels[hit.instance];
+	bool light = std::find(lightSources, lightSources + NUM_POINTLIGHT, selectedModel) != lightSources + NUM_POINTLIGHT;
+	const char *materialNames[] = { "Blinn-Phong", "Oren-Nayar", "Cook-Torrance" };
+	glm::vec3 modelPosition = pickInstances[hit.instance].position;
+	printf("Picked the %s model at (%.1f, %.1f, %.1f): triangle %u, barycentrics (%.3f, %.3f), %.2f units away\n",
+		light ? "light" : materialNames[selectedModel->getMaterial()],
+		modelPosition.x, modelPosition.y, modelPosition.z, hit.triangle, hit.u, hit.v, hit.distance * glm::length(to - from));
+}
+
 void mouseButton(GLFWwindow* window, int button, int action, int mods)
 {
 	if (TwEventMouseButtonGLFW(button, action))
 		return;
+
+	// The right button turns the camera, the left one picks
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		double x, y;
+		glfwGetCursorPos(window, &x, &y);
+		pickModel(x, y);
+	}
 }
 
 void cursorPos(GLFWwindow* window, double x, double y)
@@ -317,7 +574,7 @@ void UpdateUserInterface() {
 void initGL()
 {
     // Enables the z-buffer test
-    glEnable(GL_DEPTH_TEST);
+    GLState::SetCapability(GL_DEPTH_TEST, true);
     // Sets the ViewPort
     glViewport(0, 0, windowWidth, windowHeight);
     // Sets the clear color
@@ -326,21 +583,33 @@ void initGL()
 }
 
 /**
- * Loads a texture into the GPU
- * @param{const char} path of the texture file
- * @returns{unsigned int} GPU texture index
+ * Fills a GPU texture with a single texel
+ * @param{unsigned int} GPU texture index
+ * @param{const glm::vec3 &} color of the texel
  * */
-unsigned int loadTexture(const char *path)
+void uploadColorTexel(unsigned int id, const glm::vec3 &color)
+{
+	unsigned char texel[4] = { (unsigned char)(color.r * 255.0f), (unsigned char)(color.g * 255.0f), (unsigned char)(color.b * 255.0f), 255 };
+
+	GLState::BindTexture(0, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+/**
+ * Uploads decoded texture data into a GPU texture
+ * @param{unsigned int} GPU texture index
+ * @param{unsigned char *} decoded texture data, nullptr if the file could not be loaded
+ * @param{int} width of the texture
+ * @param{int} height of the texture
+ * @param{int} number of channels of the data
+ * @param{const char} path of the texture file, for the error message
+ * @param{const glm::vec3 &} color of the single texel uploaded when the file could not be loaded
+ * */
+void uploadTexture(unsigned int id, unsigned char *data, int textureWidth, int textureHeight, int numberOfChannels, const char *path,
+    const glm::vec3 &fallback)
 {
-    unsigned int id;
-    // Creates the texture on GPU
-    glGenTextures(1, &id);
-    // Loads the texture
-    int textureWidth, textureHeight, numberOfChannels;
-    // Flips the texture when loads it because in opengl the texture coordinates are flipped
-    stbi_set_flip_vertically_on_load(true);
-    // Loads the texture file data
-    unsigned char *data = stbi_load(path, &textureWidth, &textureHeight, &numberOfChannels, 0);
     if (data)
     {
         // Gets the texture channel format
@@ -359,7 +628,7 @@ unsigned int loadTexture(const char *path)
         }
 
         // Binds the texture
-        glBindTexture(GL_TEXTURE_2D, id);
+        GLState::BindTexture(0, id);
         // Creates the texture
         glTexImage2D(GL_TEXTURE_2D, 0, format, textureWidth, textureHeight, 0, format, GL_UNSIGNED_BYTE, data);
         // Creates the texture mipmaps
@@ -374,13 +643,212 @@ unsigned int loadTexture(const char *path)
     else
     {
         std::cout << "ERROR:: Unable to load texture " << path << std::endl;
-        glDeleteTextures(1, &id);
+        // Models already hold the texture name, it stays valid with a neutral texel
+        uploadColorTexel(id, fallback);
     }
     // We dont need the data texture anymore because is loaded on the GPU
     stbi_image_free(data);
+}
+
+/**
+ * Loads a texture into the GPU
+ * @param{const char} path of the texture file
+ * @param{const glm::vec3 &} color of the texture if the file can not be loaded
+ * @returns{unsigned int} GPU texture index
+ * */
+unsigned int loadTexture(const char *path, const glm::vec3 &fallback)
+{
+    unsigned int id;
+    // Creates the texture on GPU
+    glGenTextures(1, &id);
+    // Loads the texture
+    int textureWidth, textureHeight, numberOfChannels;
+    // Flips the texture when loads it because in opengl the texture coordinates are flipped
+    stbi_set_flip_vertically_on_load(true);
+    // Loads the texture file data
+    unsigned char *data = stbi_load(path, &textureWidth, &textureHeight, &numberOfChannels, 0);
+    uploadTexture(id, data, textureWidth, textureHeight, numberOfChannels, path, fallback);
+
+    return id;
+}
+
+/**
+ * Decoded texture waiting for its GPU upload
+ * */
+struct PendingTexture {
+    std::string path;
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int numberOfChannels = 0;
+};
+
+/**
+ * Decodes a texture on the loader threads, the GPU upload happens later on the GL thread
+ * @param{const char} path of the texture file
+ * @param{const glm::vec3 &} color of the texture if the file can not be loaded
+ * @returns{unsigned int} GPU texture index, empty until the upload ran
+ * */
+unsigned int loadTextureAsync(const char *path, const glm::vec3 &fallback)
+{
+    unsigned int id;
+    // The texture object exists right away so models can reference it
+    glGenTextures(1, &id);
+    // stb_image keeps this flag in a global, it is set here before any worker decodes
+    stbi_set_flip_vertically_on_load(true);
+
+    std::shared_ptr<PendingTexture> texture = std::make_shared<PendingTexture>();
+    texture->path = path;
+
+    AssetLoader::Instance()->Submit(
+        [texture]() {
+            texture->data = stbi_load(texture->path.c_str(), &texture->width, &texture->height, &texture->numberOfChannels, 0);
+            return texture->data != nullptr;
+        },
+        [texture, id, fallback](bool) {
+            uploadTexture(id, texture->data, texture->width, texture->height, texture->numberOfChannels, texture->path.c_str(), fallback);
+        });
 
     return id;
 }
+/**
+ * Creates a texture of a single texel, for models without a texture file
+ * @param{const glm::vec3 &} color of the texel
+ * @returns{unsigned int} GPU texture index
+ * */
+unsigned int createColorTexture(const glm::vec3 &color)
+{
+	unsigned int id;
+	glGenTextures(1, &id);
+	uploadColorTexel(id, color);
+	return id;
+}
+
+/**
+ * Loads a texture, decoded on the loader threads unless the loading is synchronous
+ * @param{const char} path of the texture file
+ * @param{const glm::vec3 &} color of the texture if the file can not be loaded, white leaves diffuse colors as they are
+ * @returns{unsigned int} GPU texture index
+ * */
+unsigned int loadAssetTexture(const char *path, const glm::vec3 &fallback = glm::vec3(1.0f))
+{
+	return syncLoading ? loadTexture(path, fallback) : loadTextureAsync(path, fallback);
+}
+
+/**
+ * Loads the mesh of a model, parsed on the loader threads unless the loading is synchronous.
+ * Asynchronous models are drawn once their mesh is uploaded
+ * @param{Model *} model to load
+ * @param{const string &} path of the OBJ file
+ * @returns{bool} false if a synchronous load failed
+ * */
+bool loadModel(Model *model, const string &path)
+{
+	if (syncLoading)
+		return model->LoadObj(path.c_str());
+
+	model->LoadObjAsync(path.c_str());
+	return true;
+}
+
+/**
+ * Resolves the uniforms of a lighting shader
+ * @param{const Shader *} linked lighting shader
+ * @returns{LightingUniforms} handles, the ones the shader does not use are invalid
+ * */
+LightingUniforms resolveLightingUniforms(const Shader *shader)
+{
+	LightingUniforms uniforms;
+	uniforms.shininess = shader->uniform("shininess");
+	uniforms.roughness = shader->uniform("roughness");
+	uniforms.intensity = shader->uniform("intensity");
+	uniforms.reflectance = shader->uniform("reflectance");
+
+	uniforms.normalMap = shader->uniform("normalMap");
+	uniforms.pointLightData = shader->uniform("pointLightData");
+	uniforms.clusterRanges = shader->uniform("clusterRanges");
+	uniforms.clusterLightIndices = shader->uniform("clusterLightIndices");
+	return uniforms;
+}
+
+/**
+ * Connects the uniform blocks of a lighting shader to the binding points the frame binds its buffers to
+ * @param{Shader *} linked lighting shader
+ * @param{const char *} shader name, for the messages
+ * */
+void bindLightingBlocks(Shader *shader, const char *shaderName)
+{
+	const struct {
+		const char *name;
+		UniformBlockBinding binding;
+		size_t size;
+	} blocks[] = {
+		{ "FrameBlock", UNIFORM_BLOCK_FRAME, sizeof(FrameBlock) },
+		{ "LightBlock", UNIFORM_BLOCK_LIGHTS, sizeof(LightBlock) },
+		{ "ObjectBlock", UNIFORM_BLOCK_OBJECT, sizeof(ObjectBlock) }
+	};
+
+	for (const auto &block : blocks) {
+		int size = shader->bindUniformBlock(block.name, block.binding);
+		// A block bigger than its mirror means the shader and UniformBlocks.h went out of sync
+		if (size > (int)block.size)
+			printf("%s: %s takes %d bytes, UniformBlocks.h only fills %zu\n", shaderName, block.name, size, block.size);
+	}
+}
+
+/**
+ * Compiles the three lighting shaders and the two passes of the deferred path, resolves their uniforms and binds their uniform blocks
+ * */
+void loadLightingShaders()
+{
+	shaderBlinnPhong = new Shader("assets/shaders/lightningBlingPhong.vert", "assets/shaders/lightningBlingPhong.frag");
+	shaderOrenNayar = new Shader("assets/shaders/lightningOrenNayar.vert", "assets/shaders/lightningOrenNayar.frag");
+	shaderCookTorrance = new Shader("assets/shaders/lightningCookTorrance.vert", "assets/shaders/lightningCookTorrance.frag");
+
+	uniformsBlinnPhong = resolveLightingUniforms(shaderBlinnPhong);
+	uniformsOrenNayar = resolveLightingUniforms(shaderOrenNayar);
+	uniformsCookTorrance = resolveLightingUniforms(shaderCookTorrance);
+	bindLightingBlocks(shaderBlinnPhong, "Blinn-Phong");
+	bindLightingBlocks(shaderOrenNayar, "Oren-Nayar");
+	bindLightingBlocks(shaderCookTorrance, "Cook-Torrance");
+
+	// The geometry pass takes the vertex stage of Blinn-Phong, the lighting pass evaluates the three BRDFs
+	shaderGBuffer = new Shader("assets/shaders/lightningBlingPhong.vert", "assets/shaders/gbuffer.frag");
+	shaderDeferredLighting = new Shader("assets/shaders/deferredLighting.vert", "assets/shaders/deferredLighting.frag");
+	uniformsGBuffer = resolveLightingUniforms(shaderGBuffer);
+	uniformsDeferredLighting = resolveLightingUniforms(shaderDeferredLighting);
+	gBufferMaterial = shaderGBuffer->uniform("material");
+	deferredInverseViewProjection = shaderDeferredLighting->uniform("inverseViewProjection");
+	bindLightingBlocks(shaderGBuffer, "G-buffer");
+	bindLightingBlocks(shaderDeferredLighting, "Deferred lighting");
+
+	// Normal maps sit on texture unit 1, next to the diffuse texture, the light clusters on the next three
+	const struct {
+		Shader *shader;
+		LightingUniforms *uniforms;
+	} shaders[] = { { shaderBlinnPhong, &uniformsBlinnPhong }, { shaderOrenNayar, &uniformsOrenNayar }, { shaderCookTorrance, &uniformsCookTorrance },
+		{ shaderGBuffer, &uniformsGBuffer }, { shaderDeferredLighting, &uniformsDeferredLighting } };
+	for (const auto &lighting : shaders) {
+		lighting.shader->use();
+		lighting.uniforms->normalMap.set(1);
+		lighting.uniforms->pointLightData.set((int)LIGHT_CLUSTER_TEXTURE_UNIT);
+		lighting.uniforms->clusterRanges.set((int)LIGHT_CLUSTER_TEXTURE_UNIT + 1);
+		lighting.uniforms->clusterLightIndices.set((int)LIGHT_CLUSTER_TEXTURE_UNIT + 2);
+	}
+
+	// Both passes store and read the material parameters over the same range
+	shaderGBuffer->use();
+	shaderGBuffer->uniform("parameterRange").set(GBuffer::MATERIAL_PARAMETER_RANGE);
+	shaderDeferredLighting->use();
+	shaderDeferredLighting->uniform("parameterRange").set(GBuffer::MATERIAL_PARAMETER_RANGE);
+	shaderDeferredLighting->uniform("albedoMaterial").set(0);
+	shaderDeferredLighting->uniform("normalParameters").set(1);
+	shaderDeferredLighting->uniform("depth").set((int)GBUFFER_DEPTH_TEXTURE_UNIT);
+
+	printf("Lighting shaders: %zu, %zu and %zu active uniforms\n", shaderBlinnPhong->getUniforms().size(),
+		shaderOrenNayar->getUniforms().size(), shaderCookTorrance->getUniforms().size());
+}
+
 /**
  * Initialize everything
  * @returns{bool} true if everything goes ok
@@ -393,19 +861,57 @@ bool init()
 
     // Initialize the opengl context
     initGL();
+	sceneUniforms = new UniformBuffer();
+	instanceBatcher = new InstanceBatcher();
+	occlusionCuller = new OcclusionCuller();
+	lightClusterer = new LightClusterer();
+	lightClusterer->SetClustered(clusteredLighting);
+	gBuffer = new GBuffer();
+	glGenQueries(SCENE_TIMER_QUERIES, sceneTimerQueries);
 
     // Loads the shader
 	shaderLights = new Shader("assets/shaders/basic.vert", "assets/shaders/basic.frag");
-	shaderBlinnPhong = new Shader("assets/shaders/lightningBlingPhong.vert", "assets/shaders/lightningBlingPhong.frag");
-	shaderOrenNayar = new Shader("assets/shaders/lightningOrenNayar.vert", "assets/shaders/lightningOrenNayar.frag");
-	shaderCookTorrance = new Shader("assets/shaders/lightningCookTorrance.vert", "assets/shaders/lightningCookTorrance.frag");
+	lightsMVP = shaderLights->uniform("MVP");
+	lightsColorIn = shaderLights->uniform("colorIn");
+	loadLightingShaders();
+	shaderOcclusionDebug = new Shader("assets/shaders/occlusionDebug.vert", "assets/shaders/occlusionDebug.frag");
+	shaderOcclusionDebug->use();
+	shaderOcclusionDebug->uniform("depthBuffer").set(0);
+
+	// Level 0 of the occlusion pyramid, updated every frame the debug view is on
+	glGenTextures(1, &occlusionDepthTextureID);
+	GLState::BindTexture(0, occlusionDepthTextureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// The fullscreen quads have no vertex buffer, but the core profile needs a vertex array bound to draw
+	glGenVertexArrays(1, &fullscreenVAO);
+
+	// Corners of the unit cube and its twelve edges, scaled to the bounds of the selected model
+	const float boxCorners[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1 };
+	const unsigned short boxEdges[] = { 0, 1, 2, 3, 4, 5, 6, 7, 0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7 };
+	glGenVertexArrays(1, &selectionBoxVAO);
+	glGenBuffers(2, selectionBoxBuffers);
+	GLState::BindVertexArray(selectionBoxVAO);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, selectionBoxBuffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(boxCorners), boxCorners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, selectionBoxBuffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boxEdges), boxEdges, GL_STATIC_DRAW);
+	GLState::BindVertexArray(0);
 
 	#pragma region loadTextures
 
 	// Loads the texture into the GPU
-	houseTextureID = loadTexture("assets/textures/cottage_diffuse.png");
+	houseTextureID = loadAssetTexture("assets/textures/cottage_diffuse.png");
 
-	planeTextureID = loadTexture("assets/textures/plane_diffuse.jpg");
+	// The plane is a brick floor, its normal map works in the tangent space of the mesh
+	planeTextureID = loadAssetTexture("assets/textures/bricks2.jpg");
+	// A missing normal map falls back to the flat tangent space normal
+	planeNormalMapID = loadAssetTexture("assets/textures/bricks2_normal.jpg", glm::vec3(0.5f, 0.5f, 1.0f));
 
 	#pragma endregion
 
@@ -416,13 +922,14 @@ bool init()
 	string pathCube = "./assets/models/cube.obj";
 	string pathHouse = "./assets/models/cottage/cottage.obj";
 	string pathPlane = "./assets/models/plane.obj";
+	string pathTree = "./assets/models/lowPolyTree/lowPolyTree.obj";
 
 
 	Model *model1 = new Model();
-	if (model1->LoadObj(pathHouse.c_str())) {
-		model1->BuildGeometry();
-
-		modelsBlinnPhong.push_back(model1);
+	if (compactVertices)
+		model1->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+	if (loadModel(model1, pathHouse)) {
+		sceneModels.push_back(model1);
 	}
 
 	model1->setPosition(modelPosition1);
@@ -430,10 +937,10 @@ bool init()
 	model1->setTextureID(houseTextureID);
 
 	Model *model2 = new Model();
-	if (model2->LoadObj(pathHouse.c_str())) {
-		model2->BuildGeometry();
-
-		modelsOrenNayar.push_back(model2);
+	if (compactVertices)
+		model2->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+	if (loadModel(model2, pathHouse)) {
+		sceneModels.push_back(model2);
 	}
 
 	model2->setPosition(modelPosition2);
@@ -441,35 +948,85 @@ bool init()
 	model2->setTextureID(houseTextureID);
 
 	Model *model3 = new Model();
-	if (model3->LoadObj(pathHouse.c_str())) {
-		model3->BuildGeometry();
-
-		modelsCookTorrance.push_back(model3);
+	if (compactVertices)
+		model3->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+	if (loadModel(model3, pathHouse)) {
+		sceneModels.push_back(model3);
 	}
 
 	model3->setPosition(modelPosition3);
 	model3->setMaterial(cookTorrance);
 	model3->setTextureID(houseTextureID);
 
-	Model *model4 = new Model();
-	if (model4->LoadObj(pathPlane.c_str())) {
-		model4->BuildGeometry();
+	// The cottages are large and closed, they are the occluders
+	occluderModels = { model1, model2, model3 };
 
-		modelsBlinnPhong.push_back(model4);
+	Model *model4 = new Model();
+	if (compactVertices)
+		model4->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+	if (loadModel(model4, pathPlane)) {
+		sceneModels.push_back(model4);
 	}
 
 	model4->setPosition(planePosition);
 	model4->setMaterial(blinnPhong);
 	model4->setTextureID(planeTextureID);
+	model4->setNormalMapID(planeNormalMapID);
+
+	// Stress scene: a forest behind the cottages, every tree shares the same mesh and material
+	if (numTrees > 0) {
+		treeTextureID = createColorTexture(glm::vec3(0.35f, 0.55f, 0.25f));
+		int gridSize = (int)ceil(sqrt((double)numTrees));
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+		for (int i = 0; i < numTrees; i++) {
+
+			Model *tree = new Model();
+			if (compactVertices)
+				tree->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+			if (!loadModel(tree, pathTree)) {
+				delete tree;
+				break;
+			}
+			sceneModels.push_back(tree);
+
+			tree->setPosition(glm::vec3((i % gridSize - gridSize / 2) * 3.0f + jitter(random), 0, -45.0f - (i / gridSize) * 3.0f + jitter(random)));
+			tree->setMaterial(blinnPhong);
+			tree->setTextureID(treeTextureID);
+		}
+		printf("Stress scene: %d trees\n", numTrees);
+	}
+
+	// Stress scene: small colored point lights over the whole scene, a few units of range each
+	if (numBenchmarkLights > 0) {
+		std::mt19937 random(2);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < numBenchmarkLights; i++) {
+			ClusterLight light;
+			light.position = glm::vec3(-40.0f + 80.0f * unit(random), 0.5f + 5.5f * unit(random), -50.0f + 100.0f * unit(random));
+			glm::vec3 color = glm::vec3(unit(random), unit(random), unit(random));
+			color /= std::max(std::max(color.r, color.g), std::max(color.b, 0.01f));
+			light.ambient = glm::vec3(0.0f);
+			light.diffuse = color;
+			light.specular = color * 0.5f;
+			light.constant = 1.0f;
+			light.linear = 0.7f;
+			light.quadratic = 1.8f;
+			light.range = LightClusterer::ComputeRange(light.constant, light.linear, light.quadratic, 1.0f);
+			benchmarkLights.push_back(light);
+		}
+		printf("Stress scene: %d point lights, %.1f units of range each\n", numBenchmarkLights, benchmarkLights[0].range);
+	}
 
 	for (int i = 0; i < 2; i++) {
 
 		lightSources[i] = new Light();
-		if (lightSources[i]->LoadObj(pathCube.c_str())) {
-			lightSources[i]->BuildGeometry();
-		}
+		loadModel(lightSources[i], pathCube);
 	}
 
+	MeshManager::Instance()->PrintStats();
+	MeshManager::Instance()->PrintMemoryStats();
+
 	userInterface->setPointLight1Translation(glm::vec3(-21, 5, -30));
 	userInterface->setPointLight2Translation(glm::vec3(-21, 5, -2));
 
@@ -497,12 +1054,69 @@ void processKeyboardInput(GLFWwindow *window)
         delete shaderBlinnPhong;
 		delete shaderOrenNayar;
 		delete shaderCookTorrance;
+		delete shaderGBuffer;
+		delete shaderDeferredLighting;
 
-		shaderBlinnPhong = new Shader("assets/shaders/lightningBlingPhong.vert", "assets/shaders/lightningBlingPhong.frag");
-		shaderOrenNayar = new Shader("assets/shaders/lightningOrenNayar.vert", "assets/shaders/lightningOrenNayar.frag");
-		shaderCookTorrance = new Shader("assets/shaders/lightningCookTorrance.vert", "assets/shaders/lightningCookTorrance.frag");
+		loadLightingShaders();
     }
 
+	// Checks if the u key was just pressed, the meshes are uploaded again from what their residency kept
+	static bool uploadKeyDown = false;
+	bool uploadKeyPressed = glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS;
+	if (uploadKeyPressed && !uploadKeyDown) {
+		unsigned int numFailed = MeshManager::Instance()->ReuploadAll();
+		if (numFailed > 0)
+			printf("%u meshes could not be uploaded again\n", numFailed);
+		MeshManager::Instance()->PrintMemoryStats();
+	}
+	uploadKeyDown = uploadKeyPressed;
+
+	// Checks if the i key was just pressed, switches between instanced batches and one draw per model
+	static bool instancingKeyDown = false;
+	bool instancingKeyPressed = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+	if (instancingKeyPressed && !instancingKeyDown) {
+		instancing = !instancing;
+		printf("Instancing %s\n", instancing ? "on" : "off");
+	}
+	instancingKeyDown = instancingKeyPressed;
+
+	// Checks if the o key was just pressed, switches the occlusion culling
+	static bool occlusionKeyDown = false;
+	bool occlusionKeyPressed = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+	if (occlusionKeyPressed && !occlusionKeyDown) {
+		occlusionCulling = !occlusionCulling;
+		printf("Occlusion culling %s\n", occlusionCulling ? "on" : "off");
+	}
+	occlusionKeyDown = occlusionKeyPressed;
+
+	// Checks if the v key was just pressed, shows or hides the occlusion depth buffer
+	static bool occlusionDebugKeyDown = false;
+	bool occlusionDebugKeyPressed = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+	if (occlusionDebugKeyPressed && !occlusionDebugKeyDown)
+		occlusionDebug = !occlusionDebug;
+	occlusionDebugKeyDown = occlusionDebugKeyPressed;
+
+	// Checks if the l key was just pressed, switches between the light clusters and a single list of every light in view
+	static bool clusterKeyDown = false;
+	bool clusterKeyPressed = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+	if (clusterKeyPressed && !clusterKeyDown) {
+		clusteredLighting = !clusteredLighting;
+		lightClusterer->SetClustered(clusteredLighting);
+		printf("Clustered lighting %s\n", clusteredLighting ? "on" : "off");
+	}
+	clusterKeyDown = clusterKeyPressed;
+
+	// Checks if the g key was just pressed, switches between forward and deferred shading
+	static bool deferredKeyDown = false;
+	bool deferredKeyPressed = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+	if (deferredKeyPressed && !deferredKeyDown) {
+		deferredShading = !deferredShading;
+		sceneGpuMilliseconds = 0.0;
+		sceneGpuFrames = 0;
+		printf("Shading %s\n", deferredShading ? "deferred" : "forward");
+	}
+	deferredKeyDown = deferredKeyPressed;
+
 	// Check is the right click of the mouse is pressed
 	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS){
 		rightButtonPressed = true;
@@ -566,90 +1180,416 @@ void processKeyboardInput(GLFWwindow *window)
 }
 
 
-void RenderModelsMaterial(vector<Model *> materialModels, Shader *shaderMaterial, glm::mat4 modelMatrix
-	, glm::mat4 view, glm::mat4 projection, glm::mat3 normalMatrix, MaterialType materialType) {
+/**
+ * Picks the level of detail of a model drawn this frame with the current policy
+ * @param{Model *} model to draw
+ * @returns{unsigned int} level to draw
+ * */
+unsigned int selectModelLod(Model *model)
+{
+	unsigned int lod = 0;
+	if (lodPolicy != LOD_POLICY_OFF)
+		lod = model->SelectLod(position, lodProjectionScale, lodPixelError, lodPolicy == LOD_POLICY_HYSTERESIS ? LOD_HYSTERESIS : 0.0f);
+	lodInstances[lod]++;
+	return lod;
+}
 
-	
+/**
+ * Draws the mesh of a model, clusters outside the frustum or facing away are skipped.
+ * The vertex array of the model has to be bound
+ * @param{Model *} model to draw
+ * @param{const glm::mat4 &} model matrix
+ * @param{unsigned int} level of detail, from selectModelLod
+ * */
+void drawModel(Model *model, const glm::mat4 &modelMatrix, unsigned int lod)
+{
+	static vector<MeshletRange> visibleRanges;
+	static vector<GLsizei> counts;
+	static vector<const void *> offsets;
+
+	size_t indexSize = model->GetIndexType() == GL_UNSIGNED_SHORT ? 2 : 4;
+	GLsizei numVertices = (GLsizei)model->GetMesh()->GetNumVertices();
+	const vector<Meshlet> &meshlets = model->GetMesh()->GetMeshlets();
+	if (lod > 0) {
+		// Coarser levels are small, they are drawn whole from their range of the index buffer
+		const MeshLod &level = model->GetMesh()->GetLods()[lod];
+		GLDraw::DrawElements(GL_TRIANGLES, level.indexCount, model->GetIndexType(), (void *)(level.firstIndex * indexSize), numVertices);
+	}
+	else if (clusterCulling && meshlets.size() > 1) {
+
+		visibleRanges.clear();
+		MeshletBuilder::Cull(meshlets, modelMatrix, viewFrustum, position, coneCulling, visibleRanges, clusterStats);
+
+		counts.resize(visibleRanges.size());
+		offsets.resize(visibleRanges.size());
+		for (size_t r = 0; r < visibleRanges.size(); r++) {
+			counts[r] = visibleRanges[r].indexCount;
+			offsets[r] = (const void *)(visibleRanges[r].firstIndex * indexSize);
+		}
+
+		// Renders the visible clusters in a single call
+		if (!visibleRanges.empty())
+			GLDraw::MultiDrawElements(GL_TRIANGLES, counts.data(), model->GetIndexType(), offsets.data(), (GLsizei)visibleRanges.size(), numVertices);
+	}
+	else {
+		// Renders the triangle gemotry
+		GLDraw::DrawElements(GL_TRIANGLES, model->GetNumIndices(), model->GetIndexType(), (void *)0, numVertices);
+	}
+}
+
+/**
+ * Packs a light color in the std140 layout of LightColor
+ * @param{const LightColor &} color of the light
+ * @returns{LightColorStd140} block member
+ * */
+LightColorStd140 packLightColor(const LightColor &color)
+{
+	return { glm::vec4(color.ambient, 0.0f), glm::vec4(color.diffuse, 0.0f), glm::vec4(color.specular, 0.0f) };
+}
+
+/**
+ * Converts a point light of the user interface, its range follows from its attenuation and brightest color
+ * @param{const PointLightProperties &} light
+ * @returns{ClusterLight} light for LightClusterer
+ * */
+ClusterLight packClusterLight(const PointLightProperties &light)
+{
+	ClusterLight packed;
+	packed.position = light.position;
+	packed.ambient = light.color.ambient;
+	packed.diffuse = light.color.diffuse;
+	packed.specular = light.color.specular;
+	packed.constant = light.attenuation.constant;
+	packed.linear = light.attenuation.linear;
+	packed.quadratic = light.attenuation.quadratic;
+	glm::vec3 brightest = glm::max(light.color.ambient, glm::max(light.color.diffuse, light.color.specular));
+	packed.range = LightClusterer::ComputeRange(packed.constant, packed.linear, packed.quadratic,
+		std::max(brightest.r, std::max(brightest.g, brightest.b)));
+	return packed;
+}
+
+/**
+ * Assigns the point lights of the frame to the clusters of the view frustum and uploads the lists
+ * @param{const glm::mat4 &} view matrix of the frame
+ * */
+void clusterLights(const glm::mat4 &view)
+{
+	frameLights.clear();
+	if (isActivePointLight1)
+		frameLights.push_back(packClusterLight(pointLights[0]));
+	if (isActivePointLight2)
+		frameLights.push_back(packClusterLight(pointLights[1]));
+	frameLights.insert(frameLights.end(), benchmarkLights.begin(), benchmarkLights.end());
+
+	lightClusterer->SetProjection(glm::radians(45.0f), windowWidth, windowHeight, CAMERA_NEAR_DISTANCE, CAMERA_VIEW_DISTANCE);
+	lightClusterer->Build(view, frameLights);
+	lightClusterer->Upload();
+}
+
+/**
+ * Packs the directional and spot lights and the cluster grid of the point lights, the spot light follows the camera
+ * @returns{LightBlock} block read by every lighting shader
+ * */
+LightBlock packLightBlock()
+{
+	LightBlock block;
+	block.dirLight.direction = glm::vec4(directionalLight.direction, 0.0f);
+	block.dirLight.color = packLightColor(directionalLight.color);
+
+	block.spotLight.position = glm::vec4(position, 1.0f);
+	block.spotLight.direction = glm::vec4(direction, 0.0f);
+	block.spotLight.color = packLightColor(spotLight.color);
+	block.spotLight.cutOff = spotLight.cutOff;
+	block.spotLight.outerCutOff = spotLight.outerCutOff;
+	block.spotLight.padding[0] = block.spotLight.padding[1] = 0.0f;
+	block.spotLight.attenuation = { spotLight.attenuation.constant, spotLight.attenuation.linear, spotLight.attenuation.quadratic, 0.0f };
+
+	block.isActiveDirLight = isActiveDirLight;
+	block.isActiveSpotLight = isActiveSpotLight;
+	block.padding[0] = block.padding[1] = 0;
+	block.clusterCount = lightClusterer->GetClusterCount();
+	block.clusterScale = lightClusterer->GetClusterScale();
+	return block;
+}
 
-	shaderMaterial->use();
+/**
+ * Packs the transform and the vertex decoding of a model
+ * @param{Model *} model drawn
+ * @param{const glm::mat4 &} model matrix
+ * @returns{ObjectBlock} block read by the draw of the model
+ * */
+ObjectBlock packObjectBlock(Model *model, const glm::mat4 &modelMatrix)
+{
+	ObjectBlock block;
+	block.model = modelMatrix;
+	block.vertexQuantized = model->GetVertexFormat() == VERTEX_FORMAT_COMPACT;
+	block.normalMapping = normalMaps && model->getNormalMapID() != 0;
+	block.instanced = 0;
+	block.padding = 0;
+	block.boundsMin = glm::vec4(model->GetBoundsMin(), 0.0f);
+	block.boundsExtent = glm::vec4(model->GetBoundsExtent(), 0.0f);
+	return block;
+}
 
-	shaderMaterial->setMat4("view", view);
-	shaderMaterial->setMat4("proj", projection);
+/**
+ * Tests the bounding sphere of every loaded model against the view frustum, the visible ones make the draw list
+ * */
+void buildDrawLists()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-	//dirLight
-	shaderMaterial->setVec3("dirLight.direction", directionalLight.direction);
-	shaderMaterial->setVec3("dirLight.color.ambient", directionalLight.color.ambient);
-	shaderMaterial->setVec3("dirLight.color.diffuse", directionalLight.color.diffuse);
-	shaderMaterial->setVec3("dirLight.color.specular", directionalLight.color.specular);
-	shaderMaterial->setBool("isActiveDirLight", isActiveDirLight);
+	modelCuller.Clear();
+	cullCandidates.clear();
+	for (Model *model : sceneModels) {
 
-	//spotLight
+		// Still loading, it is not drawn
+		if (!model->IsReady())
+			continue;
 
-	shaderMaterial->setVec3("spotLight.position", position);
-	shaderMaterial->setVec3("spotLight.direction", direction);
-	shaderMaterial->setVec3("spotLight.color.ambient", spotLight.color.ambient);
-	shaderMaterial->setVec3("spotLight.color.diffuse", spotLight.color.diffuse);
-	shaderMaterial->setVec3("spotLight.color.specular", spotLight.color.specular);
-	shaderMaterial->setFloat("spotLight.cutOff", spotLight.cutOff);
-	shaderMaterial->setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-	shaderMaterial->setFloat("spotLight.attenuation.constant", spotLight.attenuation.constant);
-	shaderMaterial->setFloat("spotLight.attenuation.linear", spotLight.attenuation.linear);
-	shaderMaterial->setFloat("spotLight.attenuation.quadratic", spotLight.attenuation.quadratic);
-	shaderMaterial->setBool("isActiveSpotLight", isActiveSpotLight);
+		cullCandidates.push_back(model);
+		modelCuller.Add(model->GetBoundingSphere());
+	}
 
+	size_t numVisible = modelCuller.Cull(viewFrustum, visibleModels);
 
-	//pointLights
-	for (int i = 0; i < 2; i++) {
+	drawModels.clear();
+	for (size_t i = 0; i < numVisible; i++)
+		drawModels.push_back(cullCandidates[visibleModels[i]]);
 
-		shaderMaterial->setVec3("pointLights[" + to_string(i) + "]" + ".position", pointLights[i].position);
-		shaderMaterial->setVec3("pointLights[" + to_string(i) + "]" + ".color.ambient", pointLights[i].color.ambient);
-		shaderMaterial->setVec3("pointLights[" + to_string(i) + "]" + ".color.diffuse", pointLights[i].color.diffuse);
-		shaderMaterial->setVec3("pointLights[" + to_string(i) + "]" + ".color.specular", pointLights[i].color.specular);
-		shaderMaterial->setFloat("pointLights[" + to_string(i) + "]" + ".attenuation.constant", pointLights[i].attenuation.constant);
-		shaderMaterial->setFloat("pointLights[" + to_string(i) + "]" + ".attenuation.linear", pointLights[i].attenuation.linear);
-		shaderMaterial->setFloat("pointLights[" + to_string(i) + "]" + ".attenuation.quadratic", pointLights[i].attenuation.quadratic);
+	modelsCulled = cullCandidates.size() - numVisible;
+	cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Rasterizes the occluders into the software depth buffer and removes the models of the draw list they hide
+ * */
+void cullOccludedModels()
+{
+	occlusionCuller->Begin(viewProjection);
+	for (Model *model : occluderModels) {
+		if (!model->IsReady())
+			continue;
+		// Without a hierarchy, --no-bvh, the mesh keeps no triangles on the CPU and occludes nothing
+		occlusionCuller->AddOccluder(model->GetMesh()->GetBvh(), glm::translate(glm::mat4(1.0f), model->getPosition()));
 	}
+	occlusionCuller->Rasterize();
+
+	drawModels.erase(std::remove_if(drawModels.begin(), drawModels.end(), [](Model *model) {
+		// An occluder is never hidden by its own triangles, it is not worth testing
+		if (std::find(occluderModels.begin(), occluderModels.end(), model) != occluderModels.end())
+			return false;
+		return !occlusionCuller->IsVisible(model->GetWorldBoundsMin(), model->GetWorldBoundsMax());
+	}), drawModels.end());
+}
+
+/**
+ * Draws the software depth buffer of the occlusion culling in the lower left corner of the window
+ * */
+void drawOcclusionDebug()
+{
+	GLState::BindTexture(0, occlusionDepthTextureID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT, GL_RED, GL_FLOAT,
+		occlusionCuller->GetDepth(0).data());
+
+	glViewport(0, 0, windowWidth / 3, windowHeight / 3);
+	GLState::SetCapability(GL_DEPTH_TEST, false);
+	shaderOcclusionDebug->use();
+	GLState::BindVertexArray(fullscreenVAO);
+	GLDraw::DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	GLState::SetCapability(GL_DEPTH_TEST, true);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+/**
+ * Draws the bounding box of the selected model in lines, with the program of the light cubes
+ * */
+void drawSelectionBox()
+{
+	Mesh *mesh = selectedModel->GetMesh();
+	glm::mat4 box = glm::translate(glm::mat4(1.0f), getPickPosition(selectedModel) + mesh->GetBoundsMin());
+	box = glm::scale(box, mesh->GetBoundsExtent());
+
+	shaderLights->use();
+	lightsMVP.set(viewProjection * box);
+	lightsColorIn.set(glm::vec3(1, 1, 0));
+	GLState::BindVertexArray(selectionBoxVAO);
+	GLDraw::DrawElements(GL_LINES, 24, GL_UNSIGNED_SHORT, (void *)0, 8);
+}
 
-	shaderMaterial->setBool("isActivePointLight1", isActivePointLight1);
-	shaderMaterial->setBool("isActivePointLight2", isActivePointLight2);
+/**
+ * Sort key of a draw: the program of its material, its normal map, diffuse texture, vertex array and distance
+ * @param{Model *} model drawn, the first one for a batch
+ * @returns{uint64_t} key for renderQueue
+ * */
+uint64_t makeSortKey(Model *model)
+{
+	float distance = glm::length(model->getPosition() - position);
+	unsigned int normalMapID = normalMaps ? model->getNormalMapID() : 0;
+	return RenderQueue::MakeKey(model->getMaterial(), normalMapID, model->getTextureID(), model->GetVAO(), distance / CAMERA_VIEW_DISTANCE);
+}
 
+/**
+ * Adds the visible models to the instance batches
+ * */
+void batchModels()
+{
+	for (Model *model : drawModels)
+		instanceBatcher->Add(model, glm::translate(glm::mat4(1.0f), model->getPosition()), selectModelLod(model));
+}
+
+/**
+ * Stages the ObjectBlock of every batch and queues the batch, a batch of one model keeps its own transform
+ * */
+void submitBatches()
+{
+	const vector<InstanceBatch> &batches = instanceBatcher->GetBatches();
+	for (const InstanceBatch &batch : batches) {
+		bool single = batch.numInstances == 1;
+		ObjectBlock block = packObjectBlock(batch.model, single ? instanceBatcher->GetMatrix(batch.firstInstance) : glm::mat4(1.0f));
+		block.instanced = !single;
+		size_t offset = sceneUniforms->Push(&block, sizeof(block));
+		// A lone model keeps the cluster culling of the regular path
+		renderQueue.Submit(makeSortKey(batch.model), { batch.model, batch.lod, offset, single ? nullptr : &batch });
+	}
+}
 
+/**
+ * Stages the ObjectBlock of every visible model and queues its draw
+ * */
+void submitModels()
+{
+	for (Model *model : drawModels) {
+		ObjectBlock block = packObjectBlock(model, glm::translate(glm::mat4(1.0f), model->getPosition()));
+		size_t offset = sceneUniforms->Push(&block, sizeof(block));
+		renderQueue.Submit(makeSortKey(model), { model, selectModelLod(model), offset, nullptr });
+	}
+}
 
-	if (materialType == blinnPhong) {
+/**
+ * Uses the program of a material and sets its parameters
+ * @param{MaterialType} material drawn next
+ * */
+void useMaterialProgram(MaterialType materialType)
+{
+	if (deferredShading) {
+		// One program for every material, the G-buffer keeps the material and its parameters for the lighting pass
+		shaderGBuffer->use();
+		gBufferMaterial.set((int)materialType);
+		uniformsGBuffer.roughness.set(materialType == blinnPhong ? shininess : roughness);
+		uniformsGBuffer.reflectance.set(reflectance);
+	}
+	else if (materialType == blinnPhong) {
 		//BLINN PHONG PARAMETERS
-		shaderMaterial->setFloat("shininess", shininess);
+		shaderBlinnPhong->use();
+		uniformsBlinnPhong.shininess.set(shininess);
 	}else if (materialType == orenNayar) {
 		//OREN NAYAR PARAMETERS
-		shaderMaterial->setFloat("roughness", roughness);
-		shaderMaterial->setFloat("intensity", intensity);
+		shaderOrenNayar->use();
+		uniformsOrenNayar.roughness.set(roughness);
+		uniformsOrenNayar.intensity.set(intensity);
 	}
 	else if (materialType == cookTorrance) {
 		//COOK TORRANCE PARAMETERS
-		shaderMaterial->setFloat("roughness", roughness);
-		shaderMaterial->setFloat("intensity", intensity);
-		shaderMaterial->setFloat("reflectance", reflectance);
+		shaderCookTorrance->use();
+		uniformsCookTorrance.roughness.set(roughness);
+		uniformsCookTorrance.intensity.set(intensity);
+		uniformsCookTorrance.reflectance.set(reflectance);
 	}
-	
-	//GENERAL PARAMETERS
-	shaderMaterial->setVec3("viewPos", position);
+}
 
-	//DRAW THE MODELS
-	for (int i = 0; i < materialModels.size(); i++) {
+/**
+ * Draws the sorted queue, the program, textures and vertex array are only bound when they differ from the last draw.
+ * GLState skips the binds that match what the last frame left, the counters here are the changes the queue asks for
+ * */
+void executeRenderQueue()
+{
+	// Nothing is known about the state left by the last frame and the user interface
+	int currentMaterial = -1;
+	unsigned int currentTexture = ~0u;
+	unsigned int currentNormalMap = ~0u;
+	unsigned int currentVAO = ~0u;
 
-		glBindTexture(GL_TEXTURE_2D, materialModels[i]->getTextureID() );
+	for (size_t i = 0; i < renderQueue.GetNumItems(); i++) {
 
-		modelMatrix = glm::mat4(1.0f);
-		glm::vec3 modelPosition = materialModels[i]->getPosition();
-		modelMatrix = glm::translate(modelMatrix, modelPosition);
+		const RenderItem &item = renderQueue.GetItem(i);
+		Model *model = item.model;
 
-		shaderMaterial->setMat4("model", modelMatrix);
+		if (model->getMaterial() != currentMaterial) {
+			currentMaterial = model->getMaterial();
+			useMaterialProgram(model->getMaterial());
+			programBinds++;
+		}
+		if (model->getTextureID() != currentTexture) {
+			currentTexture = model->getTextureID();
+			GLState::BindTexture(0, currentTexture);
+			textureBinds++;
+		}
+		// Normal maps sit on texture unit 1, next to the diffuse texture
+		unsigned int normalMapID = normalMaps ? model->getNormalMapID() : 0;
+		if (normalMapID != 0 && normalMapID != currentNormalMap) {
+			currentNormalMap = normalMapID;
+			GLState::BindTexture(1, normalMapID);
+			textureBinds++;
+		}
+		if (model->GetVAO() != currentVAO) {
+			currentVAO = model->GetVAO();
+			GLState::BindVertexArray(currentVAO);
+			vaoBinds++;
+		}
 
-		// Binds the vertex array to be drawn
-		glBindVertexArray(materialModels[i]->GetVAO());
-		// Renders the triangle gemotry
-		glDrawArrays(GL_TRIANGLES, 0, materialModels[i]->GetNumTriangles() * 3);
-		glBindVertexArray(0);
+		// Transform and vertex decoding were uploaded with the rest of the frame
+		sceneUniforms->Bind(UNIFORM_BLOCK_OBJECT, item.objectBlock, sizeof(ObjectBlock));
+
+		if (item.batch != nullptr)
+			instanceBatcher->Draw(*item.batch);
+		else
+			drawModel(model, glm::translate(glm::mat4(1.0f), model->getPosition()), item.lod);
+	}
+}
+
+/**
+ * Deferred path: the queue writes the G-buffer, one fullscreen pass shades every pixel the scene covers with the BRDF of
+ * its material and the lights of its cluster, and the depth goes to the window so the scene still hides the light cubes
+ * */
+void renderDeferred()
+{
+	gBuffer->BeginGeometry();
+	executeRenderQueue();
+	gBuffer->End();
+
+	// Pixels left at the cleared depth are discarded by the shader, the depth test has nothing to add
+	GLState::SetCapability(GL_DEPTH_TEST, false);
+	shaderDeferredLighting->use();
+	programBinds++;
+	uniformsDeferredLighting.intensity.set(intensity);
+	deferredInverseViewProjection.set(glm::inverse(viewProjection));
+	gBuffer->BindTextures(0, 1, GBUFFER_DEPTH_TEXTURE_UNIT);
+	GLState::BindVertexArray(fullscreenVAO);
+	GLDraw::DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	GLState::SetCapability(GL_DEPTH_TEST, true);
+
+	gBuffer->BlitDepth();
+}
+
+/**
+ * Starts the GPU timer of the scene passes, the query of the slot was issued SCENE_TIMER_QUERIES frames ago and is read first
+ * */
+void beginSceneTimer()
+{
+	GLuint query = sceneTimerQueries[sceneTimerFrames % SCENE_TIMER_QUERIES];
+	if (sceneTimerFrames >= SCENE_TIMER_QUERIES) {
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		sceneGpuMilliseconds += nanoseconds / 1e6;
+		sceneGpuFrames++;
 	}
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void endSceneTimer()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	sceneTimerFrames++;
 }
 
 /**
@@ -661,7 +1601,7 @@ void render()
     // Clears the color and depth buffers from the frame buffer
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)windowWidth / (float)windowHeight, 1.0f, 100.0f);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)windowWidth / (float)windowHeight, CAMERA_NEAR_DISTANCE, CAMERA_VIEW_DISTANCE);
 
 	glm::mat4 view = glm::lookAt(
 		position, // Camera is at (4,3,3), in world space
@@ -672,35 +1612,92 @@ void render()
 	//model matrix: an identity matrix (model will be at the origin)
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 
-	glm::mat3 normalMatrix = glm::mat3(1.0f);
-
-	RenderModelsMaterial(modelsBlinnPhong, shaderBlinnPhong, modelMatrix, view, projection, normalMatrix, blinnPhong);
-
-	RenderModelsMaterial(modelsOrenNayar, shaderOrenNayar, modelMatrix, view, projection, normalMatrix, orenNayar);
-
-	RenderModelsMaterial(modelsCookTorrance, shaderCookTorrance, modelMatrix, view, projection, normalMatrix, cookTorrance);
+	viewProjection = projection * view;
+	viewFrustum = Frustum::FromMatrix(viewProjection);
+	clusterStats = MeshletCullStats();
+	lodProjectionScale = windowHeight / (2.0f * tanf(glm::radians(45.0f) * 0.5f));
+	memset(lodInstances, 0, sizeof(lodInstances));
+	GLDraw::ResetStats();
+	programBinds = textureBinds = vaoBinds = 0;
+	GLState::ResetCounters();
+	buildDrawLists();
+	if (occlusionCulling)
+		cullOccludedModels();
+	Shader::resetLookupCount();
+	clusterLights(view);
+
+	// Camera, lights and every model go to the uniform buffer in one copy, whatever the number of shaders reading them
+	sceneUniforms->BeginFrame();
+	FrameBlock frameBlock = { view, projection, glm::vec4(position, 1.0f) };
+	size_t frameOffset = sceneUniforms->Push(&frameBlock, sizeof(frameBlock));
+	LightBlock lightBlock = packLightBlock();
+	size_t lightOffset = sceneUniforms->Push(&lightBlock, sizeof(lightBlock));
+	renderQueue.Clear();
+	if (instancing) {
+		instanceBatcher->Begin();
+		batchModels();
+		instanceBatcher->Upload();
+		submitBatches();
+	}
+	else
+		submitModels();
+	renderQueue.Sort();
+	sceneUniforms->Upload();
+	sceneUniforms->Bind(UNIFORM_BLOCK_FRAME, frameOffset, sizeof(FrameBlock));
+	sceneUniforms->Bind(UNIFORM_BLOCK_LIGHTS, lightOffset, sizeof(LightBlock));
+	uniformBytes = sceneUniforms->GetUploadedBytes();
+	lightClusterer->Bind(LIGHT_CLUSTER_TEXTURE_UNIT);
+
+	beginSceneTimer();
+	// A G-buffer that cannot be created leaves the frames to the forward path
+	if (deferredShading && !gBuffer->Resize(windowWidth, windowHeight)) {
+		deferredShading = false;
+		printf("Shading forward, the G-buffer could not be created\n");
+	}
+	if (deferredShading)
+		renderDeferred();
+	else
+		executeRenderQueue();
+	endSceneTimer();
 
 	
 	//DRAW THE LIGHTNINGS
 
 	shaderLights->use();
+	programBinds++;
 
 
 	for (int i = 0; i < 2; i++) {
 
+		if (!lightSources[i]->IsReady())
+			continue;
+
 		modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, pointLights[i].position);
 		glm::mat4 mvp = projection * view * modelMatrix; //Remember, matrix multimplication is the other way around
 
-		shaderLights->setMat4("MVP", mvp);
-		shaderLights->setVec3("colorIn", glm::vec3(0, 0, 1));
+		lightsMVP.set(mvp);
+		lightsColorIn.set(glm::vec3(0, 0, 1));
 
-		glBindVertexArray(lightSources[i]->GetVAO());
-		glDrawArrays(GL_TRIANGLES, 0, lightSources[i]->GetNumTriangles() * 3);
-		glBindVertexArray(0);
+		GLState::BindVertexArray(lightSources[i]->GetVAO());
+		vaoBinds++;
+		drawModel(lightSources[i], modelMatrix, selectModelLod(lightSources[i]));
 	}
 
+	if (selectedModel != nullptr && selectedModel->IsReady())
+		drawSelectionBox();
+
+	// The slice of this frame is reused once the GPU is done with these draws
+	sceneUniforms->EndFrame();
+	uniformLookups = Shader::getLookupCount();
+
+	if (occlusionCulling && occlusionDebug)
+		drawOcclusionDebug();
+
+	// The user interface binds its own objects, it must not change the vertex array of a mesh, nor trust what GLState knows
+	GLState::BindVertexArray(0);
 	TwDraw();
+	GLState::Invalidate();
 
 	// Swap the buffer
 	glfwSwapBuffers(window);
@@ -711,16 +1708,99 @@ void render()
  * */
 void update()
 {
+    bool firstFrame = true;
+    double lastReport = glfwGetTime();
+    unsigned int reportFrames = 0;
+    bool assetsPending = AssetLoader::Instance()->GetNumPending() > 0;
+
     // Loop until something tells the window, that it has to be closed
     while (!glfwWindowShouldClose(window))
     {
         // Checks for keyboard inputs
         processKeyboardInput(window);
 
+        // Uploads the assets the loader threads finished, models show up as their meshes arrive
+        AssetLoader::Instance()->ProcessUploads(uploadBudget);
 
         // Renders everything
         render();
 
+        // Culling and level of detail counters of the last frame, once per second
+        reportFrames++;
+        if (glfwGetTime() - lastReport >= 1.0) {
+            double frameTime = (glfwGetTime() - lastReport) * 1000.0 / reportFrames;
+            lastReport = glfwGetTime();
+            reportFrames = 0;
+            if (clusterCulling) {
+                double tested = clusterStats.numMeshlets > 0 ? (double)clusterStats.numMeshlets : 1.0;
+                printf("Clusters: %zu tested, %.1f%% rejected (%.1f%% frustum, %.1f%% backface), %zu draw ranges\n",
+                    clusterStats.numMeshlets, clusterStats.GetRejectedFraction() * 100.0,
+                    clusterStats.frustumCulled * 100.0 / tested, clusterStats.coneCulled * 100.0 / tested, clusterStats.numDraws);
+            }
+            const DrawStats &draws = GLDraw::GetStats();
+            printf("Draws: %u calls, %zu ranges, %zu instances, %zu vertices, %zu triangles", draws.draws, draws.ranges,
+                draws.instances, draws.vertices, draws.triangles);
+            if (draws.invalidDraws > 0)
+                printf(", %u skipped by the validation", draws.invalidDraws);
+            printf("\n");
+            printf("LOD %s: models per level", lodPolicyNames[lodPolicy]);
+            for (unsigned int l = 0; l < MeshSimplifier::MAX_LODS; l++)
+                printf("%s %u", l > 0 ? " /" : "", lodInstances[l]);
+            printf(", %.2f ms per frame, %u uniform lookups, %zu uniform buffer bytes (%u waits)\n", frameTime, uniformLookups,
+                uniformBytes, sceneUniforms->GetNumWaits());
+            printf("Frustum culling (%s): %zu models drawn, %zu culled in %.3f ms\n", FrustumCuller::GetSimdName(),
+                cullCandidates.size() - modelsCulled, modelsCulled, cullMilliseconds);
+            if (occlusionCulling) {
+                const OcclusionStats &occlusion = occlusionCuller->GetStats();
+                printf("Occlusion culling (%s): %zu of %zu occluder triangles rasterized in %.3f ms (pyramid %.3f ms), %zu of %zu models hidden\n",
+                    OcclusionCuller::GetSimdName(), occlusion.numRasterized, occlusion.numTriangles, occlusion.rasterMilliseconds,
+                    occlusion.pyramidMilliseconds, occlusion.numOccluded, occlusion.numTested);
+            }
+            const LightClusterStats &lightStats = lightClusterer->GetStats();
+            printf("Light clusters (%s): %zu of %zu point lights in view, %zu indices in %zu clusters (%.1f average, %u max) built in %.3f ms",
+                clusteredLighting ? "on" : "off", lightStats.numVisible, lightStats.numLights, lightStats.numIndices, lightStats.numOccupied,
+                lightStats.numOccupied > 0 ? (double)lightStats.numIndices / lightStats.numOccupied : 0.0, lightStats.maxPerCluster,
+                lightStats.buildMilliseconds);
+            if (lightStats.numDropped > 0)
+                printf(", %zu dropped from full clusters", lightStats.numDropped);
+            printf("\n");
+            printf("Shading %s: %.2f ms per frame, %.3f ms GPU in the scene passes", deferredShading ? "deferred" : "forward", frameTime,
+                sceneGpuFrames > 0 ? sceneGpuMilliseconds / sceneGpuFrames : 0.0);
+            if (deferredShading)
+                printf(", %.1f MB of G-buffer", gBuffer->GetMemoryBytes() / (1024.0 * 1024.0));
+            printf("\n");
+            sceneGpuMilliseconds = 0.0;
+            sceneGpuFrames = 0;
+            printf("Render queue: %zu draws sorted in %.3f ms, %u program, %u texture and %u vertex array binds\n",
+                renderQueue.GetNumItems(), renderQueue.GetSortMilliseconds(), programBinds, textureBinds, vaoBinds);
+#if defined(GL_STATE_COUNTERS)
+            const GLStateCounters &glCalls = GLState::GetCounters();
+            const char *glCallNames[GL_STATE_CALL_COUNT] = { "program", "vertex array", "texture", "buffer", "uniform", "capability" };
+            printf("GL state calls issued/skipped:");
+            for (int call = 0; call < GL_STATE_CALL_COUNT; call++)
+                printf("%s %s %u/%u", call > 0 ? "," : "", glCallNames[call], glCalls.issued[call], glCalls.skipped[call]);
+            printf("\n");
+#endif
+            if (instancing)
+                printf("Instancing: %u draw calls, %zu models in %zu batches\n", draws.draws,
+                    instanceBatcher->GetNumInstances(), instanceBatcher->GetBatches().size());
+            else
+                printf("Instancing off: %u draw calls\n", draws.draws);
+        }
+
+        if (firstFrame) {
+            firstFrame = false;
+            printf("Startup: first frame after %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count());
+        }
+        if (assetsPending && AssetLoader::Instance()->GetNumPending() == 0) {
+            assetsPending = false;
+            printf("Startup: every asset ready after %.1f ms, %.1f ms of it spent in GPU uploads\n",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count(),
+                AssetLoader::Instance()->GetUploadSeconds() * 1000.0);
+            MeshManager::Instance()->PrintStats();
+            MeshManager::Instance()->PrintMemoryStats();
+        }
+
 		//Get the data from the user interface
 		UpdateUserInterface();
 		
@@ -728,6 +1808,437 @@ void update()
         glfwPollEvents();
     }
 }
+/**
+ * Builds OBJ text large enough to be split in several chunks per thread. Faces only use negative indices,
+ * some of them reach a few hundred vertices back so they cross the chunk boundaries
+ * @param{unsigned int} Number of threads of the parallel parse
+ * @returns{std::string} OBJ text
+ * */
+std::string createRelativeIndexObj(unsigned int numThreads)
+{
+	// Four times the 64 KB minimum chunk of ObjLoader for every thread
+	const size_t size = (size_t)numThreads * 4 * 64 * 1024;
+	const int reach = 300;
+
+	std::string text;
+	text.reserve(size + 256);
+	char line[128];
+	for (int quad = 0; text.size() < size; quad++) {
+		for (int corner = 0; corner < 4; corner++) {
+			float x = (float)quad + (corner & 1), z = (float)(corner >> 1);
+			snprintf(line, sizeof(line), "v %g %g %g\nvt %g %g\nvn 0 1 0\n", x, (float)(quad % 7) * 0.25f, z, x * 0.125f, z);
+			text += line;
+		}
+		text += "f -4/-4/-4 -3/-3/-3 -1/-1/-1 -2/-2/-2\n";
+		if (quad * 4 >= reach && quad % 16 == 0) {
+			snprintf(line, sizeof(line), "f -1//-1 -%d//-%d -%d//-%d\n", reach / 2, reach / 2, reach, reach);
+			text += line;
+		}
+	}
+	return text;
+}
+/**
+ * Checks that the multithreaded OBJ parser returns the same data as the serial one
+ * @returns{bool} true if every model and the synthetic relative index file match
+ * */
+bool verifyObjLoader()
+{
+	unsigned int numThreads = Mesh::GetLoaderThreads();
+	if (numThreads <= 1)
+		numThreads = std::max(2u, std::thread::hardware_concurrency());
+
+	bool allMatch = true;
+	for (const char *path : bundledModels)
+		allMatch = ObjLoader::CompareSerialParallel(path, numThreads) && allMatch;
+
+	std::string relative = createRelativeIndexObj(numThreads);
+	allMatch = ObjLoader::CompareSerialParallel("relative indices", relative.data(), relative.data() + relative.size(), numThreads) && allMatch;
+
+	return allMatch;
+}
+/**
+ * Casts random rays at a set of triangle hierarchies, on one thread and then on every hardware thread
+ * @param{const std::function<bool(const glm::vec3 &, const glm::vec3 &)> &} Ray query, returns true on a hit
+ * @param{const glm::vec3 &} Lowest corner of the target bounds
+ * @param{const glm::vec3 &} Highest corner of the target bounds
+ * @param{int} number of rays
+ * @param{const char *} Name shown in the report
+ * */
+void benchmarkRays(const std::function<bool(const glm::vec3 &, const glm::vec3 &)> &query, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, int numRays, const char *name)
+{
+	// Rays start on a sphere around the bounds and aim at random points inside them
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::max(glm::length(boundsMax - boundsMin), 1e-3f);
+	std::mt19937 generator(12345);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	vector<glm::vec3> origins(numRays), directions(numRays);
+	for (int r = 0; r < numRays; r++) {
+		float z = unit(generator) * 2.0f - 1.0f;
+		float angle = unit(generator) * 6.2831853f;
+		float ring = sqrtf(1.0f - z * z);
+		origins[r] = center + glm::vec3(ring * cosf(angle), z, ring * sinf(angle)) * radius;
+		glm::vec3 target = boundsMin + (boundsMax - boundsMin) * glm::vec3(unit(generator), unit(generator), unit(generator));
+		directions[r] = glm::normalize(target - origins[r]);
+	}
+
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	ThreadPool pool(numThreads);
+	for (unsigned int threads : { 1u, numThreads }) {
+		std::vector<unsigned int> hits(threads, 0);
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int t = 0; t < threads; t++) {
+			auto job = [&, t]() {
+				unsigned int chunkHits = 0;
+				for (int r = (int)((size_t)numRays * t / threads); r < (int)((size_t)numRays * (t + 1) / threads); r++)
+					chunkHits += query(origins[r], directions[r]) ? 1 : 0;
+				hits[t] = chunkHits;
+			};
+			if (threads == 1)
+				job();
+			else
+				pool.Submit(job);
+		}
+		pool.Wait();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		unsigned int numHits = 0;
+		for (unsigned int h : hits)
+			numHits += h;
+		printf("%s: %d rays on %u thread(s), %.1f%% hit, %.2f Mrays/s\n", name, numRays, threads,
+			numHits * 100.0 / numRays, seconds > 0.0 ? numRays / seconds / 1e6 : 0.0);
+		if (numThreads == 1)
+			break;
+	}
+}
+/**
+ * Builds the triangle hierarchy of every bundled model and of a grid of cottages, then casts rays at them
+ * @param{int} number of rays per test
+ * @returns{bool} true if every model could be loaded
+ * */
+bool benchmarkBvh(int numRays)
+{
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	// The hierarchies read their triangles from the meshes, which must outlive them
+	vector<std::unique_ptr<MeshData>> meshes;
+	vector<std::unique_ptr<MeshBvh>> meshBvhs;
+
+	for (const char *path : bundledModels) {
+		ObjData data;
+		if (!ObjLoader::Load(path, data, nullptr, numThreads)) {
+			printf("Could not load %s\n", path);
+			return false;
+		}
+		meshes.emplace_back(new MeshData());
+		MeshData &mesh = *meshes.back();
+		MeshBuilder::BuildIndexed(data, mesh);
+
+		// The same mesh built serially and on every hardware thread
+		std::unique_ptr<MeshBvh> bvh(new MeshBvh());
+		for (unsigned int threads : { 1u, numThreads }) {
+			BvhBuildStats stats;
+			bvh->Build(mesh.indices, mesh.positions, threads, &stats);
+			MeshBvh::PrintStats(path, stats);
+			if (numThreads == 1)
+				break;
+		}
+		BvhGeometry geometry;
+		geometry.positions = mesh.positions.data();
+		geometry.indices = mesh.indices.data();
+		geometry.indexSize = sizeof(unsigned int);
+		bvh->SetGeometry(geometry);
+
+		const MeshBvh &meshBvh = *bvh;
+		benchmarkRays([&meshBvh](const glm::vec3 &origin, const glm::vec3 &direction) {
+			MeshRayHit hit;
+			return meshBvh.Raycast(origin, direction, FLT_MAX, hit);
+		}, meshBvh.GetBoundsMin(), meshBvh.GetBoundsMax(), numRays, path);
+		meshBvhs.push_back(std::move(bvh));
+	}
+
+	// Top level hierarchy over a 32 x 32 grid of cottages
+	const MeshBvh &cottage = *meshBvhs[1];
+	glm::vec3 spacing = (cottage.GetBoundsMax() - cottage.GetBoundsMin()) * 1.5f;
+	vector<BvhInstance> instances;
+	for (int z = 0; z < 32; z++)
+		for (int x = 0; x < 32; x++)
+			instances.push_back({ &cottage, glm::vec3(x * spacing.x, 0.0f, z * spacing.z) });
+
+	SceneBvh scene;
+	auto start = std::chrono::steady_clock::now();
+	scene.Build(instances);
+	printf("Scene hierarchy of %zu cottages built in %.2f ms\n", scene.GetNumInstances(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+	glm::vec3 sceneMax = instances.back().position + cottage.GetBoundsMax();
+	benchmarkRays([&scene](const glm::vec3 &origin, const glm::vec3 &direction) {
+		SceneRayHit hit;
+		return scene.Raycast(origin, direction, FLT_MAX, hit);
+	}, cottage.GetBoundsMin(), sceneMax, numRays, "cottage grid");
+
+	return true;
+}
+/**
+ * Generates the tangents of a large synthetic mesh, on one thread and then on every hardware thread
+ * @param{int} number of triangles of the mesh
+ * */
+void benchmarkTangents(int numTriangles)
+{
+	// Wavy grid with a sheared uv mapping, so no two triangles share a tangent
+	int side = std::max(1, (int)sqrt(numTriangles / 2.0));
+	MeshData mesh;
+	mesh.hasUvs = true;
+	mesh.positions.reserve((size_t)(side + 1) * (side + 1));
+	mesh.normals.reserve((size_t)(side + 1) * (side + 1));
+	mesh.uvs.reserve((size_t)(side + 1) * (side + 1));
+	for (int z = 0; z <= side; z++) {
+		for (int x = 0; x <= side; x++) {
+			float height = sinf(x * 0.1f) * cosf(z * 0.07f);
+			mesh.positions.push_back(glm::vec3(x, height, z));
+			mesh.normals.push_back(glm::normalize(glm::vec3(-0.1f * cosf(x * 0.1f) * cosf(z * 0.07f), 1.0f, 0.07f * sinf(x * 0.1f) * sinf(z * 0.07f))));
+			mesh.uvs.push_back(glm::vec2(x * 0.01f + z * 0.002f, z * 0.01f));
+		}
+	}
+	mesh.indices.reserve((size_t)side * side * 6);
+	for (int z = 0; z < side; z++) {
+		for (int x = 0; x < side; x++) {
+			unsigned int corner = z * (side + 1) + x;
+			unsigned int quad[6] = { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads : { 1u, numThreads }) {
+		TangentStats stats;
+		TangentGenerator::Generate(mesh, mesh.indices.size(), threads, &stats);
+		TangentGenerator::PrintStats("synthetic grid", stats);
+		printf("synthetic grid: %.1f million triangles per second\n", stats.seconds > 0.0 ? stats.numTriangles / stats.seconds / 1e6 : 0.0);
+		if (numThreads == 1)
+			break;
+	}
+}
+/**
+ * Culls random bounding spheres against the frustum of the demo camera with the SIMD and the scalar tests
+ * @param{int} number of spheres
+ * @returns{bool} true if both tests keep the same spheres
+ * */
+bool benchmarkCulling(int numSpheres)
+{
+	const int SIMD_RUNS = 100;
+	const int SCALAR_RUNS = 10;
+
+	// Models spread over a cube around the camera, a few units wide each
+	FrustumCuller culler;
+	culler.Reserve(numSpheres);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+	for (int i = 0; i < numSpheres; i++)
+		culler.Add(glm::vec4(coordinate(random), coordinate(random), coordinate(random), radius(random)));
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)windowWidth / (float)windowHeight, 1.0f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 5), glm::vec3(0, 0, 4), glm::vec3(0, 1, 0));
+	Frustum frustum = Frustum::FromMatrix(projection * view);
+
+	vector<uint32_t> visible, reference;
+	size_t numVisible = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int run = 0; run < SIMD_RUNS; run++)
+		numVisible = culler.Cull(frustum, visible);
+	double simdMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / SIMD_RUNS;
+
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < SCALAR_RUNS; run++)
+		culler.CullScalar(frustum, reference);
+	double scalarMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / SCALAR_RUNS;
+
+	printf("Frustum culling of %d spheres: %zu visible, %.3f ms with %s (%.1f million per second), %.3f ms scalar\n",
+		numSpheres, numVisible, simdMilliseconds, FrustumCuller::GetSimdName(),
+		simdMilliseconds > 0.0 ? numSpheres / simdMilliseconds / 1000.0 : 0.0, scalarMilliseconds);
+
+	if (numVisible != reference.size() || !std::equal(reference.begin(), reference.end(), visible.begin())) {
+		printf("Frustum culling: the %s and scalar tests disagree\n", FrustumCuller::GetSimdName());
+		return false;
+	}
+	return true;
+}
+/**
+ * Assigns random point lights to the clusters of the demo camera with one thread and with every hardware thread
+ * @param{int} number of lights
+ * @returns{bool} true if both builds give the same lists
+ * */
+bool benchmarkLightClusters(int numLights)
+{
+	const int RUNS = 50;
+
+	// Lights of a few units of range, spread over the view distance in front of the camera
+	vector<ClusterLight> lights(numLights);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (ClusterLight &light : lights) {
+		light.position = glm::vec3(-50.0f + 100.0f * unit(random), -10.0f + 20.0f * unit(random), -CAMERA_VIEW_DISTANCE * unit(random));
+		light.ambient = glm::vec3(0.0f);
+		light.diffuse = light.specular = glm::vec3(1.0f);
+		light.constant = 1.0f;
+		light.linear = 0.7f;
+		light.quadratic = 1.8f;
+		light.range = LightClusterer::ComputeRange(light.constant, light.linear, light.quadratic, 1.0f);
+	}
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 5), glm::vec3(0, 0, 4), glm::vec3(0, 1, 0));
+
+	LightClusterer serial(1), parallel;
+	double milliseconds[2];
+	LightClusterer *clusterers[2] = { &serial, &parallel };
+	for (int c = 0; c < 2; c++) {
+		clusterers[c]->SetProjection(glm::radians(45.0f), windowWidth, windowHeight, CAMERA_NEAR_DISTANCE, CAMERA_VIEW_DISTANCE);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int run = 0; run < RUNS; run++)
+			clusterers[c]->Build(view, lights);
+		milliseconds[c] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+	}
+
+	const LightClusterStats &stats = parallel.GetStats();
+	printf("Light clusters of %d point lights: %zu in view, %zu indices in %zu of %u clusters (%u max), %.3f ms on %u threads, %.3f ms on one\n",
+		numLights, stats.numVisible, stats.numIndices, stats.numOccupied,
+		LightClusterer::CLUSTERS_X * LightClusterer::CLUSTERS_Y * LightClusterer::CLUSTERS_Z, stats.maxPerCluster,
+		milliseconds[1], std::thread::hardware_concurrency(), milliseconds[0]);
+
+	if (serial.GetClusterRanges() != parallel.GetClusterRanges() || serial.GetLightIndices() != parallel.GetLightIndices()) {
+		printf("Light clusters: the serial and parallel builds disagree\n");
+		return false;
+	}
+	return true;
+}
+/**
+ * Residency policy named on the command line
+ * @param{const char *} keep, drop or compressed
+ * @returns{MeshResidency} the policy, the default one if the name is unknown
+ * */
+MeshResidency parseResidency(const char *name)
+{
+	for (int policy = MESH_RESIDENCY_KEEP; policy <= MESH_RESIDENCY_COMPRESSED; policy++)
+		if (strcmp(name, Mesh::GetResidencyName((MeshResidency)policy)) == 0)
+			return (MeshResidency)policy;
+	printf("Unknown residency %s, using %s\n", name, Mesh::GetResidencyName(Mesh::GetDefaultResidency()));
+	return Mesh::GetDefaultResidency();
+}
+/**
+ * Draws the cottage many times with the interleaved and the split vertex layouts and prints the GPU time of each
+ * @param{int} number of cottages drawn per frame
+ * */
+void benchmarkVertexLayouts(int numDraws)
+{
+	const int NUM_FRAMES = 60;
+	const VertexLayout layouts[] = { VERTEX_LAYOUT_INTERLEAVED, VERTEX_LAYOUT_SPLIT };
+	const char *layoutNames[] = { "interleaved", "split" };
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)windowWidth / (float)windowHeight, 1.0f, 2000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 400, 800), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	int gridSize = (int)ceil(sqrt((double)numDraws));
+
+	// A tiny viewport keeps the fragment work low so the vertex fetch dominates the frame
+	glViewport(0, 0, 64, 64);
+
+	GLuint query;
+	glGenQueries(1, &query);
+	vector<size_t> objectOffsets;
+
+	for (int l = 0; l < 2; l++) {
+
+		// A private mesh, the shared one keeps the layout chosen for the scene
+		Mesh mesh;
+		mesh.SetVertexLayout(layouts[l]);
+		if (!mesh.LoadObj("./assets/models/cottage/cottage.obj"))
+			break;
+		mesh.BuildGeometry();
+
+		shaderBlinnPhong->use();
+		GLState::BindTexture(0, houseTextureID);
+		GLState::BindVertexArray(mesh.GetVAO());
+
+		GLuint64 totalNanoseconds = 0;
+		for (int frame = 0; frame < NUM_FRAMES; frame++) {
+
+			// Every transform of the frame is uploaded before the timed draws
+			sceneUniforms->BeginFrame();
+			FrameBlock frameBlock = { view, projection, glm::vec4(0, 400, 800, 1) };
+			size_t frameOffset = sceneUniforms->Push(&frameBlock, sizeof(frameBlock));
+			LightBlock lightBlock = packLightBlock();
+			size_t lightOffset = sceneUniforms->Push(&lightBlock, sizeof(lightBlock));
+			objectOffsets.resize(numDraws);
+			for (int d = 0; d < numDraws; d++) {
+				glm::vec3 offset((d % gridSize - gridSize / 2) * 40.0f, 0, (d / gridSize - gridSize / 2) * 40.0f);
+				ObjectBlock objectBlock = { glm::translate(glm::mat4(1.0f), offset), 0, 0, 0, 0, glm::vec4(0.0f), glm::vec4(1.0f) };
+				objectOffsets[d] = sceneUniforms->Push(&objectBlock, sizeof(objectBlock));
+			}
+			sceneUniforms->Upload();
+			sceneUniforms->Bind(UNIFORM_BLOCK_FRAME, frameOffset, sizeof(FrameBlock));
+			sceneUniforms->Bind(UNIFORM_BLOCK_LIGHTS, lightOffset, sizeof(LightBlock));
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+
+			for (int d = 0; d < numDraws; d++) {
+				sceneUniforms->Bind(UNIFORM_BLOCK_OBJECT, objectOffsets[d], sizeof(ObjectBlock));
+				GLDraw::DrawElements(GL_TRIANGLES, mesh.GetNumIndices(), mesh.GetIndexType(), (void *)0, (GLsizei)mesh.GetNumVertices());
+			}
+
+			glEndQuery(GL_TIME_ELAPSED);
+			sceneUniforms->EndFrame();
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+			totalNanoseconds += nanoseconds;
+		}
+
+		GLState::BindVertexArray(0);
+
+		double milliseconds = totalNanoseconds / 1e6 / NUM_FRAMES;
+		double megabytes = (double)numDraws * mesh.GetNumVertices() * mesh.GetVertexStride() / (1024.0 * 1024.0);
+		printf("%s layout: %u byte vertices, %d draws of %d triangles, %.3f ms GPU per frame, %.1f MB of vertices fetched per frame (%.2f GB/s)\n",
+			layoutNames[l], mesh.GetVertexStride(), numDraws, mesh.GetNumTriangles(), milliseconds, megabytes,
+			milliseconds > 0.0 ? megabytes / 1024.0 / (milliseconds / 1000.0) : 0.0);
+	}
+
+	glDeleteQueries(1, &query);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+/**
+ * Renders the scene with forward and then with deferred shading and prints the frame and GPU times of each
+ * @param{int} number of frames measured per shading path
+ * */
+void benchmarkShading(int numFrames)
+{
+	// The frames are not held to the refresh rate of the display
+	glfwSwapInterval(0);
+
+	double frameTimes[2];
+	double gpuTimes[2];
+	for (int path = 0; path < 2; path++) {
+
+		deferredShading = path == 1;
+		// The timer results arrive SCENE_TIMER_QUERIES frames late, these frames flush the ones of the other path
+		for (unsigned int frame = 0; frame < SCENE_TIMER_QUERIES; frame++)
+			render();
+		sceneGpuMilliseconds = 0.0;
+		sceneGpuFrames = 0;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < numFrames; frame++) {
+			render();
+			glfwPollEvents();
+		}
+		glFinish();
+		frameTimes[path] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / numFrames;
+		gpuTimes[path] = sceneGpuFrames > 0 ? sceneGpuMilliseconds / sceneGpuFrames : 0.0;
+
+		printf("%s shading: %d frames of %ux%u pixels, %.3f ms per frame, %.3f ms GPU in the scene passes\n", path == 1 ? "Deferred" : "Forward",
+			numFrames, windowWidth, windowHeight, frameTimes[path], gpuTimes[path]);
+	}
+
+	printf("Deferred against forward: %.2fx the frame time, %.2fx the GPU time, %zu point lights, %.1f MB of G-buffer\n",
+		frameTimes[0] > 0.0 ? frameTimes[1] / frameTimes[0] : 0.0, gpuTimes[0] > 0.0 ? gpuTimes[1] / gpuTimes[0] : 0.0,
+		frameLights.size(), gBuffer->GetMemoryBytes() / (1024.0 * 1024.0));
+}
 /**
  * App starting point
  * @param{int} number of arguments
@@ -736,6 +2247,133 @@ void update()
  * */
 int main(int argc, char const *argv[])
 {
+	/*Command line options*/
+	startupTime = std::chrono::steady_clock::now();
+
+	bool verifyLoader = false;
+	int bvhBenchmarkRays = 0;
+	int tangentBenchmarkTriangles = 0;
+	int layoutBenchmarkDraws = 0;
+	int cullingBenchmarkSpheres = 0;
+	int lightClusterBenchmarkLights = 0;
+	int shadingBenchmarkFrames = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--loader-threads") == 0 && i + 1 < argc) {
+			Mesh::SetLoaderThreads(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--verify-loader") == 0) {
+			verifyLoader = true;
+		}
+		else if (strcmp(argv[i], "--no-mesh-cache") == 0) {
+			Mesh::SetUseMeshCache(false);
+		}
+		else if (strcmp(argv[i], "--no-bvh") == 0) {
+			Mesh::SetBuildBvhs(false);
+		}
+		else if (strcmp(argv[i], "--no-normal-maps") == 0) {
+			normalMaps = false;
+		}
+		else if (strcmp(argv[i], "--benchmark-tangents") == 0) {
+			tangentBenchmarkTriangles = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 4000000;
+		}
+		else if (strcmp(argv[i], "--benchmark-bvh") == 0) {
+			bvhBenchmarkRays = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000000;
+		}
+		else if (strcmp(argv[i], "--no-mesh-optimize") == 0) {
+			Mesh::SetOptimizeMeshes(false);
+		}
+		else if (strcmp(argv[i], "--compact-vertices") == 0) {
+			compactVertices = true;
+		}
+		else if (strcmp(argv[i], "--sync-loading") == 0) {
+			syncLoading = true;
+		}
+		else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc) {
+			uploadBudget = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--asset-threads") == 0 && i + 1 < argc) {
+			AssetLoader::Instance()->Start(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--no-cluster-culling") == 0) {
+			clusterCulling = false;
+		}
+		else if (strcmp(argv[i], "--no-cone-culling") == 0) {
+			coneCulling = false;
+		}
+		else if (strcmp(argv[i], "--lod-policy") == 0 && i + 1 < argc) {
+			const char *name = argv[++i];
+			for (int policy = LOD_POLICY_OFF; policy <= LOD_POLICY_HYSTERESIS; policy++)
+				if (strcmp(name, lodPolicyNames[policy]) == 0)
+					lodPolicy = (LodPolicy)policy;
+		}
+		else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc) {
+			lodPixelError = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--split-vertices") == 0) {
+			Mesh::SetDefaultVertexLayout(VERTEX_LAYOUT_SPLIT);
+		}
+		else if (strcmp(argv[i], "--vertex-stride") == 0 && i + 1 < argc) {
+			Mesh::SetInterleavedStride(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--residency") == 0 && i + 1 < argc) {
+			Mesh::SetDefaultResidency(parseResidency(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--residency-asset") == 0 && i + 2 < argc) {
+			const char *path = argv[++i];
+			MeshManager::Instance()->SetResidency(path, parseResidency(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--benchmark-culling") == 0) {
+			cullingBenchmarkSpheres = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000000;
+		}
+		else if (strcmp(argv[i], "--no-instancing") == 0) {
+			instancing = false;
+		}
+		else if (strcmp(argv[i], "--no-occlusion-culling") == 0) {
+			occlusionCulling = false;
+		}
+		else if (strcmp(argv[i], "--occlusion-debug") == 0) {
+			occlusionDebug = true;
+		}
+		else if (strcmp(argv[i], "--trees") == 0) {
+			numTrees = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 10000;
+		}
+		else if (strcmp(argv[i], "--point-lights") == 0) {
+			numBenchmarkLights = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000;
+		}
+		else if (strcmp(argv[i], "--no-light-clusters") == 0) {
+			clusteredLighting = false;
+		}
+		else if (strcmp(argv[i], "--deferred") == 0) {
+			deferredShading = true;
+		}
+		else if (strcmp(argv[i], "--benchmark-shading") == 0) {
+			shadingBenchmarkFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 300;
+		}
+		else if (strcmp(argv[i], "--benchmark-light-clusters") == 0) {
+			lightClusterBenchmarkLights = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000;
+		}
+		else if (strcmp(argv[i], "--benchmark-layouts") == 0) {
+			layoutBenchmarkDraws = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000;
+		}
+	}
+
+	if (verifyLoader)
+		return verifyObjLoader() ? 0 : 1;
+
+	if (bvhBenchmarkRays > 0)
+		return benchmarkBvh(bvhBenchmarkRays) ? 0 : 1;
+
+	if (tangentBenchmarkTriangles > 0) {
+		benchmarkTangents(tangentBenchmarkTriangles);
+		return 0;
+	}
+
+	if (cullingBenchmarkSpheres > 0)
+		return benchmarkCulling(cullingBenchmarkSpheres) ? 0 : 1;
+
+	if (lightClusterBenchmarkLights > 0)
+		return benchmarkLightClusters(lightClusterBenchmarkLights) ? 0 : 1;
+
 	/*Initialize variables*/
 
 	//directional light
@@ -774,74 +2412,50 @@ int main(int argc, char const *argv[])
         return -1;
     }
 
-    std::cout << "=====================================================" << std::endl
-              << "        Press Escape to close the program            " << std::endl
-              << "=====================================================" << std::endl;
-
-    // Starts the app main loop
-    update();
-
-    // Deletes the texture from the gpu
-    glDeleteTextures(1, &houseTextureID);
-	glDeleteTextures(1, &planeTextureID);
-
-	for (auto x : modelsBlinnPhong) {
-
-		// Index (GPU) of the geometry buffer
-		unsigned int VBO = x->GetVBO();
-		// Index (GPU) vertex array object
-		unsigned int VAO = x->GetVAO();
-
-		GLuint normalBuffer = x->GetNormalBuffer();
-		GLuint uvBuffer = x->GetUvBuffer();
-
-		// Deletes the vertex array from the GPU
-		glDeleteVertexArrays(1, &VAO );
-		// Deletes the vertex object from the GPU
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &normalBuffer);
-		glDeleteBuffers(1, &uvBuffer);
+    printf("Startup: init returned after %.1f ms (%s loading)\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count(),
+        syncLoading ? "synchronous" : "asynchronous");
 
+	// The benchmark replaces the interactive session
+	if (layoutBenchmarkDraws > 0) {
+		AssetLoader::Instance()->Finish();
+		benchmarkVertexLayouts(layoutBenchmarkDraws);
 	}
-
-	for (auto x : modelsOrenNayar) {
-
-		// Index (GPU) of the geometry buffer
-		unsigned int VBO = x->GetVBO();
-		// Index (GPU) vertex array object
-		unsigned int VAO = x->GetVAO();
-
-		GLuint normalBuffer = x->GetNormalBuffer();
-		GLuint uvBuffer = x->GetUvBuffer();
-
-		// Deletes the vertex array from the GPU
-		glDeleteVertexArrays(1, &VAO);
-		// Deletes the vertex object from the GPU
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &normalBuffer);
-		glDeleteBuffers(1, &uvBuffer);
-
+	else if (shadingBenchmarkFrames > 0) {
+		AssetLoader::Instance()->Finish();
+		benchmarkShading(shadingBenchmarkFrames);
 	}
+	else {
+		std::cout << "=====================================================" << std::endl
+			<< "        Press Escape to close the program            " << std::endl
+			<< "=====================================================" << std::endl;
 
+		// Starts the app main loop
+		update();
+	}
 
-	for (auto x : modelsCookTorrance) {
-
-		// Index (GPU) of the geometry buffer
-		unsigned int VBO = x->GetVBO();
-		// Index (GPU) vertex array object
-		unsigned int VAO = x->GetVAO();
-
-		GLuint normalBuffer = x->GetNormalBuffer();
-		GLuint uvBuffer = x->GetUvBuffer();
-
-		// Deletes the vertex array from the GPU
-		glDeleteVertexArrays(1, &VAO);
-		// Deletes the vertex object from the GPU
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &normalBuffer);
-		glDeleteBuffers(1, &uvBuffer);
+	// Loads still in flight hold references to their meshes, and their uploads bind the textures deleted below
+	AssetLoader::Instance()->Finish();
 
-	}
+    // Deletes the texture from the gpu
+    GLState::DeleteTexture(houseTextureID);
+	GLState::DeleteTexture(planeTextureID);
+	GLState::DeleteTexture(planeNormalMapID);
+	if (treeTextureID != 0)
+		GLState::DeleteTexture(treeTextureID);
+	GLState::DeleteTexture(occlusionDepthTextureID);
+	GLState::DeleteVertexArray(fullscreenVAO);
+	GLState::DeleteVertexArray(selectionBoxVAO);
+	GLState::DeleteBuffer(selectionBoxBuffers[0]);
+	GLState::DeleteBuffer(selectionBoxBuffers[1]);
+
+	// Models release their meshes, the last release deletes the GPU buffers
+	for (auto x : sceneModels)
+		delete x;
+	for (int i = 0; i < 2; i++)
+		delete lightSources[i];
+
+	if (MeshManager::Instance()->GetNumMeshes() != 0)
+		std::cout << "Some meshes are still referenced at exit" << std::endl;
 
 
     // Destroy the shader
@@ -850,6 +2464,15 @@ int main(int argc, char const *argv[])
 	delete shaderCookTorrance;
 	// Destroy the shader lights
 	delete shaderLights;
+	delete sceneUniforms;
+	delete instanceBatcher;
+	delete shaderOcclusionDebug;
+	delete occlusionCuller;
+	delete lightClusterer;
+	delete shaderGBuffer;
+	delete shaderDeferredLighting;
+	delete gBuffer;
+	glDeleteQueries(SCENE_TIMER_QUERIES, sceneTimerQueries);
 
     // Stops the glfw program
     glfwTerminate();